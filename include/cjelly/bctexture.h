@@ -0,0 +1,169 @@
+/**
+ * @file bctexture.h
+ * @brief Block-compressed (BC1, BC3, and BC7) textures encoded from decoded
+ * images.
+ *
+ * @details
+ * A block-compressed texture stores each 4x4 block of texels in 8 bytes (BC1)
+ * or 16 bytes (BC3 and BC7), instead of the 64 bytes of RGBA8.  The GPU
+ * samples the blocks directly, so the texture takes 4 to 8 times less device
+ * memory, staging space, and upload bandwidth.
+ *
+ * Block-compressed formats cannot be blitted, so the whole mip chain is built
+ * on the host, with a box filter, and every level is encoded.  The encoders
+ * favour speed over the last fraction of quality, since they run the first
+ * time a texture is loaded:
+ *
+ * - BC1 (opaque images) fits the endpoints of each block to the principal
+ *   axis of its colors, and uses the four-color mode only.
+ * - BC3 (images with alpha) encodes the color like BC1 and the alpha with the
+ *   eight-value mode of its alpha block.
+ * - BC7 (images with alpha) uses mode 6 only: one RGBA line per block with
+ *   7-bit endpoints, a shared bit per endpoint, and 16 interpolation steps.
+ *
+ * Encoding is slow compared to loading, which is what the BC texture cache
+ * (see bctexturecache.h) is for.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_BCTEXTURE_H
+#define CJELLY_BCTEXTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include <cjelly/format/image.h>
+#include <cjelly/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+/**
+ * @brief Largest number of mip levels of a texture.
+ *
+ * This is enough for a full chain of any image whose dimensions fit in an
+ * int.
+ */
+#define CJELLY_BC_TEXTURE_MAX_LEVELS 32
+
+
+/**
+ * @brief Enumeration of error codes for the BC texture encoder.
+ */
+typedef enum {
+  CJELLY_BC_TEXTURE_SUCCESS = 0,       /**< No error */
+  CJELLY_BC_TEXTURE_ERR_OUT_OF_MEMORY, /**< Memory allocation failure */
+  CJELLY_BC_TEXTURE_ERR_IMAGE,         /**< The image is empty, or not 8-bit RGB or RGBA */
+  CJELLY_BC_TEXTURE_ERR_FORMAT,        /**< The format is not one that can be encoded */
+} CJellyBcTextureError;
+
+
+/**
+ * @brief Structure representing a block-compressed texture with its mip
+ * chain.
+ *
+ * The levels are stored one after the other in `data`, each as rows of
+ * blocks, which is the layout that cjelly_uploader_upload_image_levels()
+ * expects.
+ */
+typedef struct CJellyBcTexture {
+  VkFormat format;                                         /**< VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK, or VK_FORMAT_BC7_UNORM_BLOCK */
+  uint32_t width;                                          /**< Width of the first level in pixels */
+  uint32_t height;                                         /**< Height of the first level in pixels */
+  uint32_t mipLevels;                                      /**< Number of levels */
+  VkDeviceSize levelOffsets[CJELLY_BC_TEXTURE_MAX_LEVELS]; /**< Offset of each level within `data` */
+  VkDeviceSize levelSizes[CJELLY_BC_TEXTURE_MAX_LEVELS];   /**< Size of each level in bytes */
+  unsigned char * data;                                    /**< The blocks of every level */
+  VkDeviceSize size;                                       /**< Size of `data` in bytes */
+} CJellyBcTexture;
+
+
+/**
+ * @brief Picks the block-compressed formats that a device can sample.
+ *
+ * A format qualifies if its optimal tiling supports
+ * VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT and
+ * VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT.  Opaque images use BC1.
+ * Images with alpha use BC7, or BC3 if the device cannot sample BC7.
+ *
+ * @param physicalDevice The physical device.
+ * @param outOpaqueFormat Receives the format for opaque images.
+ * @param outAlphaFormat Receives the format for images with alpha.
+ * @return true if the device can sample all of the chosen formats, or false
+ *   if images should be uploaded uncompressed.
+ */
+bool cjelly_bc_texture_choose_formats(VkPhysicalDevice physicalDevice, VkFormat * outOpaqueFormat, VkFormat * outAlphaFormat);
+
+
+/**
+ * @brief Returns whether an image has any texel that is not fully opaque.
+ *
+ * @param image The image.
+ * @return true if the image has an alpha channel that is used.
+ */
+bool cjelly_bc_texture_image_has_alpha(const CJellyFormatImageRaw * image);
+
+
+/**
+ * @brief Returns the size in bytes of one block of a format.
+ *
+ * @param format The format.
+ * @return 8 for BC1, 16 for BC3 and BC7, or 0 for any other format.
+ */
+uint32_t cjelly_bc_texture_block_size(VkFormat format);
+
+
+/**
+ * @brief Lays out the full mip chain of a texture.
+ *
+ * Fills in `mipLevels`, `levelOffsets`, `levelSizes`, and `size` from the
+ * texture's format and dimensions.
+ *
+ * @param texture The texture, whose format and dimensions are set.
+ * @return false if the format is not block-compressed, or a dimension is 0.
+ */
+bool cjelly_bc_texture_layout(CJellyBcTexture * texture);
+
+
+/**
+ * @brief Encodes an image, and a full mip chain built from it.
+ *
+ * @param image The image, with 8-bit RGB or RGBA texels.
+ * @param format VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK, or
+ *   VK_FORMAT_BC7_UNORM_BLOCK.  BC1 discards the alpha channel.
+ * @param outTexture Output pointer that will point to the allocated texture
+ *   on success.
+ * @return CJellyBcTextureError Error code indicating success or the type of failure.
+ */
+CJellyBcTextureError cjelly_bc_texture_encode(const CJellyFormatImageRaw * image, VkFormat format, CJellyBcTexture * * outTexture);
+
+
+/**
+ * @brief Frees a texture allocated by cjelly_bc_texture_encode().
+ *
+ * @param texture The texture to free.  May be NULL.
+ */
+void cjelly_bc_texture_free(CJellyBcTexture * texture);
+
+
+/**
+ * @brief Converts a BC texture error code to a human-readable error message.
+ *
+ * @param err The CJellyBcTextureError code.
+ * @return A constant string describing the error.
+ */
+const char * cjelly_bc_texture_strerror(CJellyBcTextureError err);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_BCTEXTURE_H
@@ -0,0 +1,152 @@
+/**
+ * @file bctexturecache.h
+ * @brief Binary cache of block-compressed textures.
+ *
+ * @details
+ * Encoding an image to BC1, BC3, or BC7 takes far longer than decoding it, so
+ * the encoded mip chain is kept in a cache file, and later runs read the
+ * blocks straight from it: opening a cache maps the file into memory, and the
+ * levels are copied from the mapped pages into a staging buffer.
+ *
+ * Like the mesh cache, the file starts with a versioned header that records
+ * the format and dimensions of the texture, a checksum of the blocks, and a
+ * stamp (size, modification time, and content hash) of the source image.  A
+ * cache whose stamp no longer matches its source is stale, and
+ * cjelly_bc_texture_cache_load_image() transparently re-encodes it.  A cache
+ * can also be written ahead of time with cjelly_bc_texture_cache_write(), so
+ * that even the first run does not have to encode.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_BCTEXTURECACHE_H
+#define CJELLY_BCTEXTURECACHE_H
+
+#include <cjelly/macros.h>
+#include <cjelly/bctexture.h>
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * @brief Enumeration of error codes for the BC texture cache.
+ */
+typedef enum {
+  CJELLY_BC_TEXTURE_CACHE_SUCCESS = 0,          /**< No error */
+  CJELLY_BC_TEXTURE_CACHE_ERR_OUT_OF_MEMORY,    /**< Memory allocation failure */
+  CJELLY_BC_TEXTURE_CACHE_ERR_FILE_NOT_FOUND,   /**< The file does not exist or cannot be opened */
+  CJELLY_BC_TEXTURE_CACHE_ERR_IO,               /**< The file could not be read, written, or mapped */
+  CJELLY_BC_TEXTURE_CACHE_ERR_INVALID,          /**< The file is not a compatible, intact texture cache */
+  CJELLY_BC_TEXTURE_CACHE_ERR_STALE,            /**< The source image has changed since the cache was written */
+  CJELLY_BC_TEXTURE_CACHE_ERR_SOURCE,           /**< The source image could not be loaded or encoded */
+} CJellyBcTextureCacheError;
+
+/**
+ * @brief An opened BC texture cache.
+ *
+ * Usually the texture's data points directly into a read-only mapping of the
+ * cache file, and must not be modified.
+ */
+typedef struct CJellyBcTextureCache CJellyBcTextureCache;
+
+/**
+ * @brief Builds the file name of the cache of a source image.
+ *
+ * The name is derived from a hash of the source path, so that every image
+ * gets its own cache file in a shared directory (see
+ * cjelly_cache_file_path()).
+ *
+ * @param source_path The path of the source image.
+ * @param buffer Receives the file name.
+ * @param size The size of `buffer`.
+ * @return true if the name fits in `buffer`.
+ */
+bool cjelly_bc_texture_cache_name(const char * source_path, char * buffer, size_t size);
+
+/**
+ * @brief Writes a texture to a cache file.
+ *
+ * The file is written under a temporary name and then renamed, so that a
+ * reader never sees a partially written cache.
+ *
+ * @param texture The texture to store.
+ * @param source_path The image file that the texture was encoded from, whose
+ *   stamp is recorded in the cache.  May be NULL, in which case the cache is
+ *   never considered stale.
+ * @param cache_path Path of the cache file to write.
+ * @return CJellyBcTextureCacheError Error code indicating success or the type of failure.
+ */
+CJellyBcTextureCacheError cjelly_bc_texture_cache_write(const CJellyBcTexture * texture, const char * source_path, const char * cache_path);
+
+/**
+ * @brief Opens a cache file by mapping it into memory.
+ *
+ * The header and the checksum of the blocks are verified.  If `source_path`
+ * is given, the source's size and modification time are compared with the
+ * stamp in the cache; if either differs, the source is hashed, and the cache
+ * is only stale if the content itself has changed.
+ *
+ * @param cache_path Path of the cache file.
+ * @param source_path The image file to check the cache against, or NULL to
+ *   skip the check.
+ * @param outCache Output pointer that will point to the opened cache on success.
+ * @return CJellyBcTextureCacheError Error code indicating success or the type of failure.
+ */
+CJellyBcTextureCacheError cjelly_bc_texture_cache_open(const char * cache_path, const char * source_path, CJellyBcTextureCache * * outCache);
+
+/**
+ * @brief Loads an image as a block-compressed texture, going through a cache
+ * file.
+ *
+ * If the cache is missing, invalid, or stale, or holds a format other than
+ * the one the image calls for, the image is loaded, encoded with
+ * cjelly_bc_texture_encode(), and written back to the cache.  If the cache
+ * cannot be written (for example, because its directory is read-only), the
+ * freshly encoded texture is still returned, just without the benefit of
+ * caching.
+ *
+ * @param image_path Path of the image file.
+ * @param cache_path Path of the cache file.
+ * @param opaqueFormat The format of images without alpha, as chosen by
+ *   cjelly_bc_texture_choose_formats().
+ * @param alphaFormat The format of images with alpha, as chosen by
+ *   cjelly_bc_texture_choose_formats().
+ * @param outCache Output pointer that will point to the opened cache on success.
+ * @return CJellyBcTextureCacheError Error code indicating success or the type of failure.
+ */
+CJellyBcTextureCacheError cjelly_bc_texture_cache_load_image(const char * image_path, const char * cache_path, VkFormat opaqueFormat, VkFormat alphaFormat, CJellyBcTextureCache * * outCache);
+
+/**
+ * @brief Returns the texture held by an opened cache.
+ *
+ * @param cache The cache.
+ * @return The texture, which remains valid until the cache is closed.
+ */
+const CJellyBcTexture * cjelly_bc_texture_cache_texture(const CJellyBcTextureCache * cache);
+
+/**
+ * @brief Closes a cache, unmapping its file.
+ *
+ * @param cache The cache to close.  May be NULL.
+ */
+void cjelly_bc_texture_cache_close(CJellyBcTextureCache * cache);
+
+/**
+ * @brief Converts a BC texture cache error code to a human-readable error
+ * message.
+ *
+ * @param err The CJellyBcTextureCacheError code.
+ * @return A constant string describing the error.
+ */
+const char * cjelly_bc_texture_cache_strerror(CJellyBcTextureCacheError err);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_BCTEXTURECACHE_H
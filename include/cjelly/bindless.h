@@ -0,0 +1,154 @@
+/**
+ * @file bindless.h
+ * @brief Bindless table of textures, shared by every draw.
+ *
+ * @details
+ * The table is a single descriptor set with one large array of combined image
+ * samplers (`sampler2D textures[]` in GLSL).  A texture is added to the table
+ * once, and is then referred to by its index, which shaders receive through a
+ * push constant or a vertex attribute.  The set is bound once per command
+ * buffer, so drawing with another texture needs no descriptor work at all.
+ *
+ * The binding is partially bound, so slots that hold no texture are allowed as
+ * long as shaders do not read them, and it is updated after bind, so textures
+ * can be added while command buffers that use the table are recorded or
+ * pending.  This requires the descriptor indexing features of Vulkan 1.2 (or
+ * of VK_EXT_descriptor_indexing): runtimeDescriptorArray,
+ * descriptorBindingPartiallyBound,
+ * descriptorBindingSampledImageUpdateAfterBind,
+ * descriptorBindingUpdateUnusedWhilePending, and
+ * shaderSampledImageArrayNonUniformIndexing.
+ *
+ * Freed slots are reused before unused ones.  All of the functions may be
+ * called from any thread.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_BINDLESS_H
+#define CJELLY_BINDLESS_H
+
+#include <cjelly/pipelineregistry.h>
+#include <cjelly/types.h>
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+/**
+ * @brief Opaque structure representing a bindless texture table.
+ */
+typedef struct CJellyBindlessTable CJellyBindlessTable;
+
+
+/**
+ * @brief Enumeration of error codes for the bindless table.
+ */
+typedef enum {
+  CJELLY_BINDLESS_SUCCESS = 0, /**< No error */
+  CJELLY_BINDLESS_ERR_FULL,    /**< Every slot of the table is in use */
+} CJellyBindlessError;
+
+
+/**
+ * @brief Describes the descriptor set layout of a bindless table.
+ *
+ * The layout has one binding, 0, with `capacity` combined image samplers.
+ * Pipelines that use the table put this layout in their pipeline layout, and
+ * the table is created with the layout that the registry returns for it.
+ *
+ * @param capacity The number of slots.
+ * @param stageFlags The shader stages that read the table.
+ * @param desc The description to fill.
+ */
+void cjelly_bindless_table_describe(uint32_t capacity, VkShaderStageFlags stageFlags, CJellyDescriptorSetLayoutDesc * desc);
+
+
+/**
+ * @brief Creates a bindless table.
+ *
+ * @param device The logical device.
+ * @param layout The layout described by cjelly_bindless_table_describe().
+ * @param capacity The number of slots, as passed to
+ *   cjelly_bindless_table_describe().
+ * @return A pointer to the new table, or NULL on failure.
+ */
+CJellyBindlessTable * cjelly_bindless_table_create(VkDevice device, VkDescriptorSetLayout layout, uint32_t capacity);
+
+
+/**
+ * @brief Destroys a table.  The GPU must no longer be using it.
+ *
+ * @param table The table to destroy.  May be NULL.
+ */
+void cjelly_bindless_table_destroy(CJellyBindlessTable * table);
+
+
+/**
+ * @brief Adds a texture to a free slot of the table.
+ *
+ * @param table The table.
+ * @param imageView The view of the texture, which is read in
+ *   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+ * @param sampler The sampler of the texture.
+ * @param outIndex Receives the index of the slot.
+ * @return CJellyBindlessError Error code indicating success or the type of failure.
+ */
+CJellyBindlessError cjelly_bindless_table_add(CJellyBindlessTable * table, VkImageView imageView, VkSampler sampler, uint32_t * outIndex);
+
+
+/**
+ * @brief Replaces the texture in a slot that is in use.
+ *
+ * No submitted command buffer that reads the slot may still be pending.
+ *
+ * @param table The table.
+ * @param index The slot.
+ * @param imageView The view of the new texture.
+ * @param sampler The sampler of the new texture.
+ */
+void cjelly_bindless_table_update(CJellyBindlessTable * table, uint32_t index, VkImageView imageView, VkSampler sampler);
+
+
+/**
+ * @brief Frees a slot, so that it can be given to another texture.
+ *
+ * The descriptor is left as it is, so the slot must not be read again.  No
+ * submitted command buffer that reads it may still be pending, since the next
+ * texture that is added may overwrite it.
+ *
+ * @param table The table.
+ * @param index The slot to free.
+ */
+void cjelly_bindless_table_remove(CJellyBindlessTable * table, uint32_t index);
+
+
+/**
+ * @brief Returns the descriptor set of a table.
+ *
+ * @param table The table.
+ * @return The descriptor set, which is owned by the table.
+ */
+VkDescriptorSet cjelly_bindless_table_set(const CJellyBindlessTable * table);
+
+
+/**
+ * @brief Returns a human-readable description of an error code.
+ *
+ * @param err The error code.
+ * @return A static string.
+ */
+const char * cjelly_bindless_strerror(CJellyBindlessError err);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_BINDLESS_H
@@ -0,0 +1,192 @@
+/**
+ * @file cachefile.h
+ * @brief File and hashing helpers shared by CJelly's caches.
+ *
+ * @details
+ * The mesh, BC texture, and pipeline caches all store their data in files
+ * that are replaced atomically, verified with a 64-bit FNV-1a checksum, and
+ * (for the mesh and texture caches) mapped into memory and stamped with the
+ * state of the source file they were built from.  The in-memory caches use
+ * the same hash to key their entries.  This module holds that shared
+ * machinery, so that every cache reads, writes, and hashes files the same
+ * way.
+ *
+ * These helpers are internal to the library.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_CACHEFILE_H
+#define CJELLY_CACHEFILE_H
+
+#include <cjelly/macros.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * @brief Seed and multiplier of the 64-bit FNV-1a hash.
+ */
+#define CJELLY_HASH_SEED 0xCBF29CE484222325ull
+#define CJELLY_HASH_PRIME 0x100000001B3ull
+
+/**
+ * @brief Enumeration of error codes for the cache file helpers.
+ *
+ * The codes match the first codes of every cache's own error enumeration.
+ */
+typedef enum {
+  CJELLY_CACHE_FILE_SUCCESS = 0,          /**< No error */
+  CJELLY_CACHE_FILE_ERR_OUT_OF_MEMORY,    /**< Memory allocation failure */
+  CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND,   /**< The file does not exist or cannot be opened */
+  CJELLY_CACHE_FILE_ERR_IO,               /**< The file could not be read, written, or mapped */
+  CJELLY_CACHE_FILE_ERR_INVALID,          /**< A path does not fit in its buffer */
+} CJellyCacheFileError;
+
+/**
+ * @brief A read-only view of an entire file in memory.
+ */
+typedef struct {
+  const unsigned char * data; /**< First byte of the file (NULL if the file is empty) */
+  size_t size;                /**< Size of the file in bytes */
+#ifdef _WIN32
+  void * file;                /**< HANDLE of the opened file */
+  void * mapping;             /**< HANDLE of the file mapping object */
+#endif
+} CJellyCacheFileView;
+
+/**
+ * @brief The state of a source file when a cache was built from it.
+ */
+typedef struct {
+  uint64_t size;  /**< Size of the file in bytes */
+  int64_t mtime;  /**< Modification time, in the platform's native resolution */
+  uint64_t hash;  /**< Hash of the file's contents */
+} CJellyCacheFileStamp;
+
+/**
+ * @brief A cache file that is being written under a temporary name.
+ */
+typedef struct {
+  FILE * file;        /**< The temporary file */
+  const char * path;  /**< The path that the file replaces once it is complete */
+  char * tempPath;    /**< The temporary path */
+} CJellyCacheFileWriter;
+
+/**
+ * @brief Hashes a block of memory with FNV-1a, continuing from `hash`.
+ *
+ * The data is consumed one 64-bit word at a time, rather than one byte at a
+ * time, because the caches must be fast to verify.
+ *
+ * @param data The data to hash.
+ * @param size The size of `data` in bytes.
+ * @param hash CJELLY_HASH_SEED, or the hash of the preceding data.
+ * @return The hash.
+ */
+uint64_t cjelly_hash_bytes(const void * data, size_t size, uint64_t hash);
+
+/**
+ * @brief Builds the path of a file in the per-user cache directory.
+ *
+ * The directory is `$XDG_CACHE_HOME/cjelly` (or `$HOME/.cache/cjelly`) on
+ * Linux, and `%LOCALAPPDATA%\cjelly` on Windows.  It is created, along with
+ * any missing parent, if it does not exist yet.
+ *
+ * @param name The file name.
+ * @param buffer Receives the path.
+ * @param size The size of `buffer`, in bytes.
+ * @return CJellyCacheFileError Error code indicating success or the type of
+ *   failure.  CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND means that there is no
+ *   per-user cache directory at all.
+ */
+CJellyCacheFileError cjelly_cache_file_path(const char * name, char * buffer, size_t size);
+
+/**
+ * @brief Maps a file into memory for reading.
+ *
+ * @param path Path to the file.
+ * @param view The view to initialize.
+ * @return CJellyCacheFileError Error code indicating success or the type of failure.
+ */
+CJellyCacheFileError cjelly_cache_file_map(const char * path, CJellyCacheFileView * view);
+
+/**
+ * @brief Releases a view created by cjelly_cache_file_map().
+ *
+ * @param view The view to release.
+ */
+void cjelly_cache_file_unmap(CJellyCacheFileView * view);
+
+/**
+ * @brief Records the size, modification time, and content hash of a file.
+ *
+ * The size and modification time are read before the contents are hashed, so
+ * that a file that changes while it is hashed leaves a stamp that no longer
+ * matches it.
+ *
+ * @param path Path to the file.
+ * @param stamp Receives the stamp.
+ * @return CJellyCacheFileError Error code indicating success or the type of failure.
+ */
+CJellyCacheFileError cjelly_cache_file_stamp(const char * path, CJellyCacheFileStamp * stamp);
+
+/**
+ * @brief Checks whether a file has changed since it was stamped.
+ *
+ * If the size differs, the file has changed.  If only the modification time
+ * differs, the contents are hashed, since a touched file (e.g., after a fresh
+ * checkout) usually still holds the same data.
+ *
+ * @param stamp The stamp taken by cjelly_cache_file_stamp().
+ * @param path Path to the file.
+ * @return true if the file has changed.  A file that cannot be found is not
+ *   considered changed, so that a cache can be shipped without its source.
+ */
+bool cjelly_cache_file_stamp_changed(const CJellyCacheFileStamp * stamp, const char * path);
+
+/**
+ * @brief Starts writing a file under a temporary name.
+ *
+ * @param path The path of the file to replace.  It must remain valid until
+ *   the writer is committed.
+ * @param writer The writer to initialize.
+ * @return CJellyCacheFileError Error code indicating success or the type of failure.
+ */
+CJellyCacheFileError cjelly_cache_file_begin(const char * path, CJellyCacheFileWriter * writer);
+
+/**
+ * @brief Writes `count` zero bytes.
+ *
+ * @param writer The writer.
+ * @param count The number of bytes.
+ * @return true if the bytes were written.
+ */
+bool cjelly_cache_file_pad(CJellyCacheFileWriter * writer, uint64_t count);
+
+/**
+ * @brief Finishes a file started by cjelly_cache_file_begin().
+ *
+ * The temporary file is closed and, if it was written completely, renamed
+ * over the destination, so that a reader never sees a partially written
+ * file.  Otherwise it is removed.
+ *
+ * @param writer The writer.
+ * @param written Whether every write to the file succeeded.
+ * @return CJellyCacheFileError Error code indicating success or the type of failure.
+ */
+CJellyCacheFileError cjelly_cache_file_commit(CJellyCacheFileWriter * writer, bool written);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_CACHEFILE_H
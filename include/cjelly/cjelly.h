@@ -45,7 +45,17 @@
 #include <stddef.h> // For size_t and offsetof
 #include <vulkan/vulkan.h>
 
+#include <cjelly/bindless.h>
+#include <cjelly/gpuallocator.h>
 #include <cjelly/macros.h>
+#include <cjelly/pipelinecache.h>
+#include <cjelly/pipelineregistry.h>
+#include <cjelly/recorder.h>
+#include <cjelly/scheduler.h>
+#include <cjelly/shadercache.h>
+#include <cjelly/texturecache.h>
+#include <cjelly/threadpool.h>
+#include <cjelly/upload.h>
 
 
 #ifdef __cplusplus
@@ -121,9 +131,49 @@ extern VkQueue graphicsQueue;
  * @brief Present queue.
  *
  * This queue is used to handle presentation of rendered images to the display.
+ * It is the graphics queue itself, unless the graphics family cannot present.
  */
 extern VkQueue presentQueue;
 
+/**
+ * @brief Transfer queue.
+ *
+ * This queue executes uploads.  It comes from a transfer-only queue family if
+ * the device has one, and otherwise is a second queue of the graphics family,
+ * or the graphics queue itself.
+ */
+extern VkQueue transferQueue;
+
+/**
+ * @brief Compute queue.
+ *
+ * This queue executes compute work asynchronously to rendering.  It comes from
+ * a compute family without graphics if the device has one, and otherwise is a
+ * spare queue of the graphics family.  If the device has no queue to spare, it
+ * is the same queue as one of the others, and must be synchronized with it.
+ */
+extern VkQueue computeQueue;
+
+/**
+ * @brief Queue family index of the graphics queue.
+ */
+extern uint32_t graphicsQueueFamilyIndex;
+
+/**
+ * @brief Queue family index of the present queue.
+ */
+extern uint32_t presentQueueFamilyIndex;
+
+/**
+ * @brief Queue family index of the transfer queue.
+ */
+extern uint32_t transferQueueFamilyIndex;
+
+/**
+ * @brief Queue family index of the compute queue.
+ */
+extern uint32_t computeQueueFamilyIndex;
+
 /**
  * @brief Vulkan render pass.
  *
@@ -168,7 +218,124 @@ extern VkBuffer vertexBuffer;
  *
  * This memory is allocated and bound to the vertex buffer to store vertex data.
  */
-extern VkDeviceMemory vertexBufferMemory;
+extern CJellyGpuAllocation * vertexBufferMemory;
+
+/**
+ * @brief Image view of the texture loaded by initVulkanGlobal().
+ */
+extern VkImageView textureImageView;
+
+/**
+ * @brief Sampler of the texture loaded by initVulkanGlobal().
+ */
+extern VkSampler textureSampler;
+
+/**
+ * @brief GPU memory allocator.
+ *
+ * All buffers and images draw their device memory from this allocator, which
+ * packs many resources into each VkDeviceMemory block.  It is created by
+ * initVulkanGlobal() and destroyed by cleanupVulkanGlobal().
+ */
+extern CJellyGpuAllocator * gpuAllocator;
+
+/**
+ * @brief Upload queue.
+ *
+ * Buffer and image contents are copied to the GPU through this uploader, which
+ * batches the copies and executes them on the transfer queue.  The
+ * application calls cjelly_uploader_poll() once per frame, and must not draw
+ * a resource before its upload is ready.
+ */
+extern CJellyUploader * uploader;
+
+/**
+ * @brief Worker threads shared by the renderer.
+ *
+ * Windows that re-record their commands every frame split the recording
+ * across these threads.
+ */
+extern CJellyThreadPool * threadPool;
+
+/**
+ * @brief Pipeline cache used to create every pipeline.
+ *
+ * initVulkanGlobal() loads it from the per-user cache directory, and
+ * cleanupVulkanGlobal() saves it back, so that pipelines compiled by one run
+ * are reused by the next.
+ */
+extern VkPipelineCache pipelineCache;
+
+/**
+ * @brief The result of loading pipelineCache.
+ *
+ * CJELLY_PIPELINE_CACHE_SUCCESS if the cache was filled from disk (a warm
+ * start), or otherwise the reason that it started out empty.
+ */
+extern CJellyPipelineCacheError pipelineCacheStatus;
+
+/**
+ * @brief Time taken by initVulkanGlobal() to create the global pipelines, in
+ * nanoseconds.
+ */
+extern uint64_t pipelineCreationTime;
+
+/**
+ * @brief Registry that owns every pipeline, pipeline layout, and descriptor
+ * set layout.
+ *
+ * Pipelines are shared by description, and are compiled through
+ * pipelineCache, either on first use or on a background compile thread.
+ */
+extern CJellyPipelineRegistry * pipelineRegistry;
+
+/**
+ * @brief Bindless table that holds every texture.
+ *
+ * Pipelines that sample textures use the table as their descriptor set 0, and
+ * select a texture by its slot, so no descriptor sets are allocated or bound
+ * per draw.
+ */
+extern CJellyBindlessTable * bindlessTextures;
+
+/**
+ * @brief Slot of the texture loaded by initVulkanGlobal() in bindlessTextures.
+ */
+extern uint32_t textureTableIndex;
+
+/**
+ * @brief Cache of textures loaded from image files, by path.
+ *
+ * Its textures live in bindlessTextures, and are evicted and streamed back in
+ * as needed to stay within textureCacheBudget.  runWindowLoop() advances it
+ * once per iteration.
+ */
+extern CJellyTextureCache * textureCache;
+
+/**
+ * @brief The most device memory that textureCache may use.
+ *
+ * Set it before initVulkanGlobal().  Zero (the default) limits the cache only
+ * by the memory that the device heap has left, as reported by
+ * VK_EXT_memory_budget when the device supports it.
+ */
+extern VkDeviceSize textureCacheBudget;
+
+/**
+ * @brief Cache of every shader module, keyed by its SPIR-V code.
+ */
+extern CJellyShaderCache * shaderCache;
+
+/**
+ * @brief Directory of .spv files to load the built-in shaders from.
+ *
+ * If set before initVulkanGlobal(), the shaders are loaded from this directory
+ * instead of the copies embedded in the program, and runWindowLoop() reloads
+ * them when the files change, rebuilding only the pipelines that use them.
+ * A shader that cannot be loaded falls back to the embedded copy.  NULL (the
+ * default) uses the embedded shaders only.
+ */
+extern const char * shaderDirectory;
 
 /**
  * @brief Global flag indicating whether the application should close.
@@ -197,8 +364,38 @@ extern VkDebugUtilsMessengerEXT debugMessenger;
 extern const int WIDTH;
 extern const int HEIGHT;
 
+/**
+ * @brief The number of frames that a window may have in flight when its
+ * framesInFlight field is left at zero.
+ */
+#define CJELLY_DEFAULT_FRAMES_IN_FLIGHT 2
+
+/**
+ * @brief Synchronization objects for one frame in flight.
+ *
+ * A window cycles through an array of these, so that the CPU can prepare the
+ * next frame while the GPU is still rendering the previous ones.
+ */
+typedef struct CJellyFrameSync {
+  VkSemaphore imageAvailableSemaphore; /**< Signaled when the acquired image
+                                          may be rendered to */
+  VkSemaphore renderFinishedSemaphore; /**< Signaled when rendering has
+                                          finished, waited on by present */
+  VkFence inFlightFence; /**< Signaled when the frame's submission completes */
+  uint64_t serial; /**< Serial of the frame last recorded in this slot while
+                      it may still execute, or 0 */
+  bool submitted;  /**< Whether the frame with `serial` has been submitted */
+  struct CJellyFrameSync * nextOutstanding; /**< Next frame whose serial may
+                                               still execute */
+} CJellyFrameSync;
+
 typedef struct CJellyWindow CJellyWindow;
 
+/**
+ * @brief Opaque structure representing a window's present thread.
+ */
+typedef struct CJellyPresentThread CJellyPresentThread;
+
 /**
  * @brief Callback type for per-window rendering.
  *
@@ -209,6 +406,17 @@ typedef struct CJellyWindow CJellyWindow;
  */
 typedef void (*CJellyRenderCallback)(CJellyWindow * win);
 
+/**
+ * @brief Callback type for functions that allocate and record a window's
+ * pre-recorded command buffers.
+ *
+ * The window keeps the function that created its command buffers, so that
+ * they can be recorded again for a new swap chain.
+ *
+ * @param win Pointer to the CJellyWindow whose command buffers are recorded.
+ */
+typedef void (*CJellyCommandBufferCallback)(CJellyWindow * win);
+
 /**
  * @brief Specifies the update mode for a CJelly window.
  *
@@ -226,6 +434,29 @@ typedef enum {
                                      needing an update. */
 } CJellyUpdateMode;
 
+/**
+ * @brief Specifies how a window's swap chain presents images.
+ *
+ * A requested mode that the surface does not support falls back to a similar
+ * supported mode, and ultimately to FIFO, which every surface supports.
+ */
+typedef enum {
+  CJELLY_PRESENT_MODE_DEFAULT = 0, /**< Chosen from the window's update mode:
+                                      FIFO for VSync windows, and MAILBOX for
+                                      fixed and event-driven windows. */
+  CJELLY_PRESENT_MODE_FIFO,        /**< Wait for vertical blank, queueing
+                                      frames.  Never tears. */
+  CJELLY_PRESENT_MODE_FIFO_RELAXED, /**< Like FIFO, but a late frame is shown
+                                       immediately, and may tear.  Falls back
+                                       to FIFO. */
+  CJELLY_PRESENT_MODE_MAILBOX,     /**< Show the newest frame at vertical blank,
+                                      replacing queued frames.  Never tears.
+                                      Falls back to FIFO. */
+  CJELLY_PRESENT_MODE_IMMEDIATE    /**< Show frames as soon as they are ready,
+                                      and may tear.  Falls back to MAILBOX, then
+                                      FIFO. */
+} CJellyPresentMode;
+
 /**
  * @brief Represents a window and its associated Vulkan resources in the CJelly
  * framework.
@@ -269,16 +500,49 @@ typedef enum {
  *  An array of command buffers allocated for recording rendering commands for
  * this window.
  *
- * @var CJellyWindow::imageAvailableSemaphore
- *  A semaphore used to signal that a swapchain image is available for
- * rendering.
+ * @var CJellyWindow::recordCommandBuffers
+ *  The function that created commandBuffers, called again to re-record them
+ * when the swap chain is recreated, or when the pipeline that they use is
+ * replaced.
+ *
+ * @var CJellyWindow::heldPipeline
+ *  The registry entry of the pipeline that commandBuffers use, or NULL.
+ *
+ * @var CJellyWindow::heldPipelineHandle
+ *  The version of heldPipeline that commandBuffers were recorded with, which
+ * is held in the registry until they are freed.
+ *
+ * @var CJellyWindow::framebufferResized
+ *  A flag that indicates that the window's size has changed, and that its
+ * swap chain must be recreated before the next frame.
+ *
+ * @var CJellyWindow::framesInFlight
+ *  The maximum number of frames that may be queued on the GPU at once.  Zero
+ * selects CJELLY_DEFAULT_FRAMES_IN_FLIGHT.
+ *
+ * @var CJellyWindow::frames
+ *  An array of framesInFlight sets of synchronization objects, one for each
+ * frame in flight.
  *
- * @var CJellyWindow::renderFinishedSemaphore
- *  A semaphore used to signal that rendering has completed.
+ * @var CJellyWindow::currentFrame
+ *  The index into frames of the next frame to be rendered.
  *
- * @var CJellyWindow::inFlightFence
- *  A fence used to synchronize command buffer submission and rendering
- * completion.
+ * @var CJellyWindow::imagesInFlight
+ *  An array holding, for each swapchain image, the fence of the frame that
+ * last rendered to it, or VK_NULL_HANDLE.
+ *
+ * @var CJellyWindow::recorder
+ *  Records the window's commands every frame, or NULL if the window draws
+ * with the pre-recorded commandBuffers.
+ *
+ * @var CJellyWindow::recordJob
+ *  The function that records each job of the window's render pass.
+ *
+ * @var CJellyWindow::recordUser
+ *  User data passed to recordJob.
+ *
+ * @var CJellyWindow::recordJobCount
+ *  The number of jobs that the render pass is split into.
  *
  * @var CJellyWindow::swapChainExtent
  *  The dimensions (width and height) of the swapchain images.
@@ -301,8 +565,34 @@ typedef enum {
  * updates.
  *
  * @var CJellyWindow::nextFrameTime
- *  The timestamp (in milliseconds) when the next frame should be rendered (for
- * fixed update mode).
+ *  The timestamp (in nanoseconds, as returned by getCurrentTimeInNanoseconds())
+ * when the next frame should be rendered (for fixed update mode).
+ *
+ * @var CJellyWindow::frameTimeRemainder
+ *  The fraction of a nanosecond, in units of 1/fixedFramerate, that
+ * nextFrameTime is behind the exact frame time.  Carrying it over keeps fixed
+ * frame rates from drifting.
+ *
+ * @var CJellyWindow::frameDeferred
+ *  A flag set by drawFrameForWindow() when the frame could not be started
+ * without blocking, because the GPU or the presentation engine still holds the
+ * resources it needs.  The frame should be retried shortly.
+ *
+ * @var CJellyWindow::framesPresented
+ *   The number of frames presented to the window so far.  It is updated on
+ * the thread that runs the window loop, once a frame's present has succeeded.
+ *
+ * @var CJellyWindow::presentMode
+ *   The requested present mode.  A change takes effect when the swap chain is
+ * next created, e.g. after setting framebufferResized.
+ *
+ * @var CJellyWindow::swapChainPresentMode
+ *   The present mode that the swap chain was actually created with.
+ *
+ * @var CJellyWindow::presentThread
+ *   The thread that acquires images, records commands, and submits and
+ * presents the frames of the window, or NULL if frames are drawn on the
+ * thread that calls drawFrameForWindow().
  *
  * @var CJellyWindow::renderCallback
  *   Function pointer for the custom rendering callback for this window.
@@ -315,6 +605,10 @@ typedef struct CJellyWindow {
 #endif
   VkSurfaceKHR surface;     /**< Vulkan surface associated with the window */
   VkSwapchainKHR swapChain; /**< Vulkan swapchain for image presentation */
+  VkSwapchainKHR retiredSwapChain; /**< Swapchain replaced by `swapChain`,
+                                      whose presents may still be pending */
+  uint64_t retiredSwapChainSerial; /**< Serial of the first frame recorded
+                                      for `swapChain`, or 0 */
   uint32_t swapChainImageCount; /**< Number of images in the swapchain */
   VkImage * swapChainImages; /**< Array of Vulkan images from the swapchain */
   VkImageView * swapChainImageViews; /**< Array of image views corresponding to
@@ -323,11 +617,22 @@ typedef struct CJellyWindow {
       swapChainFramebuffers; /**< Array of framebuffers for rendering */
   VkCommandBuffer *
       commandBuffers; /**< Array of command buffers allocated for the window */
-  VkSemaphore
-      imageAvailableSemaphore; /**< Semaphore signaling image availability */
-  VkSemaphore renderFinishedSemaphore; /**< Semaphore signaling that rendering
-                                          is finished */
-  VkFence inFlightFence; /**< Fence used for synchronizing frame submissions */
+  CJellyCommandBufferCallback
+      recordCommandBuffers; /**< Function that created commandBuffers */
+  CJellyPipeline * heldPipeline; /**< Pipeline used by commandBuffers */
+  VkPipeline heldPipelineHandle; /**< Version of heldPipeline that
+                                    commandBuffers were recorded with */
+  int framebufferResized; /**< Flag indicating the swap chain is out of date */
+  uint32_t framesInFlight; /**< Maximum number of frames queued on the GPU */
+  CJellyFrameSync * frames; /**< Synchronization objects for each frame in
+                               flight */
+  uint32_t currentFrame;    /**< Index of the next frame in `frames` */
+  VkFence * imagesInFlight; /**< Fence of the frame using each swapchain
+                               image */
+  CJellyCommandRecorder * recorder; /**< Per-frame recorder, or NULL */
+  CJellyRecordJob recordJob; /**< Records one job of the render pass */
+  void * recordUser;         /**< User data passed to recordJob */
+  uint32_t recordJobCount;   /**< Number of jobs per frame */
   VkExtent2D swapChainExtent;  /**< Dimensions of the swapchain images */
   int width;                   /**< Window width in pixels */
   int height;                  /**< Window height in pixels */
@@ -337,8 +642,18 @@ typedef struct CJellyWindow {
       fixedFramerate; /**< Target frame rate (FPS) when in fixed update mode */
   int needsRedraw; /**< Flag indicating a redraw is needed in event-driven mode
                     */
-  uint64_t nextFrameTime; /**< Timestamp (in milliseconds) when the next frame
+  uint64_t nextFrameTime; /**< Timestamp (in nanoseconds) when the next frame
                              should be rendered (for fixed mode) */
+  uint32_t frameTimeRemainder; /**< Sub-nanosecond remainder of nextFrameTime,
+                                  in units of 1/fixedFramerate */
+  int frameDeferred; /**< Flag indicating the last frame could not be started
+                        without blocking */
+  uint64_t framesPresented; /**< Number of frames presented so far */
+  CJellyPresentMode presentMode; /**< Requested present mode */
+  VkPresentModeKHR
+      swapChainPresentMode; /**< Present mode in use by the swap chain */
+  CJellyPresentThread *
+      presentThread; /**< Thread that prepares frames, or NULL */
   CJellyRenderCallback
       renderCallback; /**< Custom render function for this window */
 } CJellyWindow;
@@ -468,16 +783,70 @@ void createPlatformWindow(
  * @brief Processes OS-specific window events.
  *
  * This function processes pending events for the underlying window system.
+ * Windows that were resized are flagged with framebufferResized, and windows
+ * that were resized or exposed are flagged with needsRedraw.
  */
 void processWindowEvents(void);
 
+/**
+ * @brief Blocks until a window event arrives, or until a timeout expires.
+ *
+ * On Linux, this waits on the X11 connection's file descriptor, and on
+ * Windows, on the thread's message queue.  Events that are already queued
+ * return immediately.
+ *
+ * @param timeout The maximum time to wait, in milliseconds, or -1 to wait
+ * indefinitely.
+ */
+void waitForWindowEvents(int timeout);
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ *
+ * @return The time since an unspecified starting point, in nanoseconds.
+ */
+uint64_t getCurrentTimeInNanoseconds(void);
+
+/**
+ * @brief Returns a monotonic timestamp in milliseconds.
+ *
+ * @return The time since an unspecified starting point, in milliseconds.
+ */
+uint64_t getCurrentTimeInMilliseconds(void);
+
+
+/* === RUN LOOP === */
+
+/**
+ * @brief Processes events and renders windows until shouldClose is set.
+ *
+ * Each window is rendered according to its update mode: VSync windows as
+ * often as their swap chain hands out images, fixed-rate windows when their
+ * nextFrameTime has passed, and event-driven windows when needsRedraw is set.
+ * The deadline of every window is kept in a CJellyFrameScheduler, and the
+ * loop sleeps in waitForWindowEvents() until the earliest one, so that a set
+ * of idle windows uses no CPU time.  Frames never block on the GPU or on
+ * presentation: a window whose frame was deferred is retried a moment later,
+ * while the other windows keep their own schedule.  The global uploader is
+ * polled on every iteration, and frames prepared by present threads are
+ * submitted as soon as they arrive.
+ *
+ * Before returning, the loop waits for frames that present threads are still
+ * preparing, cancelling those that are waiting for an image, so that no
+ * window is left with a frame in progress.
+ *
+ * @param windows The windows to render.
+ * @param windowCount The number of windows.
+ */
+void runWindowLoop(CJellyWindow * const * windows, int windowCount);
+
 /* === PER-WINDOW VULKAN OBJECTS === */
 
 /**
  * @brief Creates a Vulkan surface for the specified window.
  *
  * This function creates a platform-specific Vulkan surface using the window's
- * handle.
+ * handle, and checks that the present queue can present to it.
  *
  * @param win Pointer to the CJellyWindow structure.
  */
@@ -487,12 +856,29 @@ void createSurfaceForWindow(CJellyWindow * win);
  * @brief Creates the swap chain for the specified window.
  *
  * This function queries the surface capabilities and creates a swap chain for
- * the window.
+ * the window.  The present mode is chosen from the window's presentMode among
+ * the modes that the surface supports, and the number of images is chosen to
+ * suit the present mode.  If the window already has a swap chain, it is passed to the
+ * new one as the old swap chain, and remains for the caller to destroy.
  *
  * @param win Pointer to the CJellyWindow structure.
  */
 void createSwapChainForWindow(CJellyWindow * win);
 
+/**
+ * @brief Recreates the swap chain of a window, after a resize or when the
+ * old one is out of date.
+ *
+ * Only the window's own frames in flight are waited for, so other windows
+ * keep rendering.  The image views and framebuffers are rebuilt, and
+ * pre-recorded command buffers are recorded again.
+ *
+ * @param win Pointer to the CJellyWindow structure.
+ * @return 1 if the swap chain was recreated, or 0 if the window currently has
+ * no area to render to (e.g., it is minimized).
+ */
+int recreateSwapChainForWindow(CJellyWindow * win);
+
 /**
  * @brief Creates image views for the swap chain images of the specified window.
  *
@@ -526,18 +912,70 @@ void createCommandBuffersForWindow(CJellyWindow * win);
 /**
  * @brief Creates synchronization objects for the specified window.
  *
- * This function creates semaphores and a fence to synchronize rendering
- * operations.
+ * This function creates a pair of semaphores and a fence for each frame that
+ * may be in flight, as configured by the window's framesInFlight field.  It
+ * must be called after the swap chain images have been retrieved.
  *
  * @param win Pointer to the CJellyWindow structure.
  */
 void createSyncObjectsForWindow(CJellyWindow * win);
 
+/**
+ * @brief Creates the recorder that re-records a window's commands every
+ * frame.
+ *
+ * The window's recordJob, recordUser, and recordJobCount fields must be set
+ * first.  If recordJobCount is zero, it is set to the number of threads in
+ * threadPool.
+ *
+ * @param win Pointer to the CJellyWindow structure.
+ */
+void createCommandRecorderForWindow(CJellyWindow * win);
+
+/**
+ * @brief Gives a window a thread of its own that draws its frames.
+ *
+ * The present thread waits for the frame's fence, blocks in
+ * vkAcquireNextImageKHR until an image is available, and records the frame's
+ * commands.  A window whose presentation engine is slow, e.g. a FIFO swap
+ * chain on a display with a low refresh rate, then only blocks its own
+ * thread.
+ *
+ * The present thread also submits and presents the frame.  Vulkan requires
+ * that access to a queue is externally synchronized, and the queues are
+ * shared by every window and by the uploader, so each queue is only used with
+ * its own mutex held, for no longer than the call itself.
+ * drawFrameForWindow() only asks the present thread for a frame, and defers
+ * the frame if the previous one is still being drawn.  runWindowLoop()
+ * collects the outcome of each frame, e.g. that the swap chain has to be
+ * recreated, which it then does while the thread is idle.
+ *
+ * The function must be called after createSyncObjectsForWindow() and, if the
+ * window has one, createCommandRecorderForWindow().  The window's recordJob
+ * is then called from the present thread.  The thread is stopped by
+ * cleanupWindow().
+ *
+ * On X11, vkAcquireNextImageKHR and vkQueuePresentKHR talk to the display
+ * from the present thread while runWindowLoop() reads its events, so
+ * XInitThreads() must have been called before the display was opened.
+ *
+ * @param win Pointer to the CJellyWindow structure.
+ */
+void createPresentThreadForWindow(CJellyWindow * win);
+
 /**
  * @brief Renders a frame for the specified window.
  *
  * This function submits the recorded command buffer for rendering and presents
- * the image.
+ * the image.  If the window has a recorder, the command buffer is recorded
+ * first, in parallel, by the window's recordJob.
+ *
+ * The function does not block on a frame slot that is still in flight, or on
+ * a swapchain image that is not yet available.  It sets the window's
+ * frameDeferred flag and returns instead, and the frame should be retried.
+ *
+ * If the window has a present thread, the frame is prepared by that thread,
+ * and submitted later by runWindowLoop().
  *
  * @param win Pointer to the CJellyWindow structure.
  */
@@ -546,8 +984,9 @@ void drawFrameForWindow(CJellyWindow * win);
 /**
  * @brief Cleans up and destroys per-window Vulkan and OS resources.
  *
- * This function destroys swap chain, image views, framebuffers, command
- * buffers, and other resources associated with the window.
+ * This function stops the window's present thread, if it has one, and
+ * destroys swap chain, image views, framebuffers, command buffers, and other
+ * resources associated with the window.
  *
  * @param win Pointer to the CJellyWindow structure.
  */
@@ -582,19 +1021,112 @@ void destroyDebugMessenger(void);
  * @brief Selects a suitable physical device (GPU) for Vulkan.
  *
  * This function enumerates available physical devices and selects one that
- * supports Vulkan.
+ * supports Vulkan, swap chains, and has queue families that can render and
+ * present to windows.
  */
 void pickPhysicalDevice(void);
 
 /**
- * @brief Creates a logical device and retrieves the graphics and present
- * queues.
- *
- * This function creates a logical device for the selected physical device and
- * obtains handles to the graphics and present queues.
+ * @brief Creates a logical device and retrieves its queues.
+ *
+ * This function enumerates the queue families of the selected physical device,
+ * and chooses a family for each of graphics, presentation, async compute, and
+ * uploads, preferring dedicated compute and transfer families.  Within a
+ * family, each role gets a queue of its own while the family has one to spare.
+ * The logical device is created with those queues, and their handles and
+ * family indices are stored in the globals.
+ *
+ * Since the device is created before any surface, presentation support is
+ * queried from the window system.  createSurfaceForWindow() checks that each
+ * surface is supported by presentQueueFamilyIndex.
  */
 void createLogicalDevice(void);
 
+/**
+ * @brief Records the release half of a queue family ownership transfer of a
+ * buffer.
+ *
+ * Resources created with VK_SHARING_MODE_EXCLUSIVE belong to one queue family
+ * at a time.  To use a buffer on a queue of another family without losing its
+ * contents, the source queue records a release, and the destination queue
+ * records a matching acquire with acquireBufferOwnership(), in a submission
+ * that waits (e.g., on a semaphore) for the release.  If both families are the
+ * same, no transfer is needed, and nothing is recorded.
+ *
+ * @param commandBuffer A command buffer to be submitted to the source family.
+ * @param buffer The buffer.
+ * @param srcQueueFamilyIndex The family that owns the buffer.
+ * @param dstQueueFamilyIndex The family that will own the buffer.
+ * @param srcStageMask The stages that last used the buffer on the source
+ *   family.
+ * @param srcAccessMask The accesses that must be made available.
+ */
+void releaseBufferOwnership(VkCommandBuffer commandBuffer, VkBuffer buffer,
+    uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask);
+
+/**
+ * @brief Records the acquire half of a queue family ownership transfer of a
+ * buffer.
+ *
+ * @param commandBuffer A command buffer to be submitted to the destination
+ *   family.
+ * @param buffer The buffer.
+ * @param srcQueueFamilyIndex The family that released the buffer.
+ * @param dstQueueFamilyIndex The family that acquires the buffer.
+ * @param dstStageMask The stages that will use the buffer.
+ * @param dstAccessMask The accesses that the buffer will be used for.
+ */
+void acquireBufferOwnership(VkCommandBuffer commandBuffer, VkBuffer buffer,
+    uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+
+/**
+ * @brief Records the release half of a queue family ownership transfer of an
+ * image.
+ *
+ * As releaseBufferOwnership().  The layouts must match those passed to
+ * acquireImageOwnership(), and the layout transition happens once, between
+ * the two halves.
+ *
+ * @param commandBuffer A command buffer to be submitted to the source family.
+ * @param image The image.
+ * @param range The subresources to transfer.
+ * @param oldLayout The current layout.
+ * @param newLayout The layout after the transfer.
+ * @param srcQueueFamilyIndex The family that owns the image.
+ * @param dstQueueFamilyIndex The family that will own the image.
+ * @param srcStageMask The stages that last used the image on the source
+ *   family.
+ * @param srcAccessMask The accesses that must be made available.
+ */
+void releaseImageOwnership(VkCommandBuffer commandBuffer, VkImage image,
+    const VkImageSubresourceRange * range, VkImageLayout oldLayout,
+    VkImageLayout newLayout, uint32_t srcQueueFamilyIndex,
+    uint32_t dstQueueFamilyIndex, VkPipelineStageFlags srcStageMask,
+    VkAccessFlags srcAccessMask);
+
+/**
+ * @brief Records the acquire half of a queue family ownership transfer of an
+ * image.
+ *
+ * @param commandBuffer A command buffer to be submitted to the destination
+ *   family.
+ * @param image The image.
+ * @param range The subresources to transfer.
+ * @param oldLayout The layout passed to releaseImageOwnership().
+ * @param newLayout The layout after the transfer.
+ * @param srcQueueFamilyIndex The family that released the image.
+ * @param dstQueueFamilyIndex The family that acquires the image.
+ * @param dstStageMask The stages that will use the image.
+ * @param dstAccessMask The accesses that the image will be used for.
+ */
+void acquireImageOwnership(VkCommandBuffer commandBuffer, VkImage image,
+    const VkImageSubresourceRange * range, VkImageLayout oldLayout,
+    VkImageLayout newLayout, uint32_t srcQueueFamilyIndex,
+    uint32_t dstQueueFamilyIndex, VkPipelineStageFlags dstStageMask,
+    VkAccessFlags dstAccessMask);
+
 /**
  * @brief Creates a vertex buffer and uploads vertex data.
  *
@@ -613,8 +1145,8 @@ void createRenderPass(void);
 /**
  * @brief Creates the graphics pipeline.
  *
- * This function loads shader modules, configures both fixed and dynamic states,
- * and creates the graphics pipeline for rendering.
+ * This function describes the pipeline's shaders and vertex layout, and gets
+ * the pipeline and its layout from pipelineRegistry.
  */
 void createGraphicsPipeline(void);
 
@@ -631,21 +1163,228 @@ void createCommandPool(void);
  *
  * This function creates the Vulkan instance, selects a physical device, creates
  * a logical device, and initializes global resources such as the vertex buffer,
- * render pass, graphics pipeline, and command pool.
+ * render pass, graphics pipeline, and command pool.  The pipelines are created
+ * by pipelineRegistry, through pipelineCache, which is loaded from disk first.
  */
 void initVulkanGlobal(void);
 
 /**
  * @brief Cleans up global Vulkan resources.
  *
- * This function destroys the graphics pipeline, render pass, vertex buffer,
- * command pool, and other global Vulkan objects.
+ * This function destroys the pipeline registry, render pass, vertex buffer,
+ * command pool, and other global Vulkan objects.  The pipeline cache is saved
+ * to disk before it is destroyed.
  */
 void cleanupVulkanGlobal(void);
 
 
+/* === BINDLESS TEXTURES === */
+
+/**
+ * @brief Creates bindlessTextures.
+ *
+ * The table is as large as the device allows, up to 4096 textures.  It is
+ * created by initVulkanGlobal().
+ */
+void createBindlessTextureTable(void);
+
+/**
+ * @brief Adds a texture to bindlessTextures.
+ *
+ * @param imageView The view of the texture, which is read in
+ *   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+ * @param sampler The sampler of the texture.
+ * @return The slot of the texture.
+ */
+uint32_t addBindlessTexture(VkImageView imageView, VkSampler sampler);
+
+
 void createTexturedCommandBuffersForWindow(CJellyWindow * win);
 
+
+/* === INDEXED MESHES === */
+
+/**
+ * @brief GPU buffers for an indexed triangle mesh.
+ *
+ * Both buffers live in device-local memory.  The transform is pushed to the
+ * mesh vertex shader, and fits the mesh's bounding box into clip space.
+ */
+typedef struct CJellyGpuMesh {
+  VkBuffer vertexBuffer;                    /**< Interleaved CJellyMeshVertex data */
+  CJellyGpuAllocation * vertexBufferMemory; /**< Memory bound to the vertex buffer */
+  VkBuffer indexBuffer;                     /**< Triangle list indices */
+  CJellyGpuAllocation * indexBufferMemory;  /**< Memory bound to the index buffer */
+  uint32_t indexCount;                      /**< Number of indices to draw */
+  VkIndexType indexType;                    /**< VK_INDEX_TYPE_UINT16 or VK_INDEX_TYPE_UINT32 */
+  float transform[4];                       /**< Translation (xyz) and uniform scale (w) */
+  CJellyPipeline * pipeline;                /**< The pipeline that draws the mesh */
+} CJellyGpuMesh;
+
+/**
+ * @brief Creates the graphics pipeline used to draw indexed meshes.
+ *
+ * The pipeline consumes CJellyMeshVertex data and takes the mesh transform as
+ * a push constant.  It is created by initVulkanGlobal().  Meshes are drawn
+ * with cjelly_pipeline_registry_try_get(), so that a mesh is skipped, rather
+ * than stalling the frame, while its pipeline is being compiled.
+ */
+void createMeshGraphicsPipeline(void);
+
+/**
+ * @brief Uploads a mesh to device-local vertex and index buffers.
+ *
+ * The copies are queued on the global uploader, and the mesh must not be
+ * drawn until they are ready.
+ *
+ * @param mesh The mesh, as built by cjelly_mesh_build_from_obj().
+ * @param gpuMesh The structure to populate.
+ */
+void createGpuMesh(const CJellyMesh * mesh, CJellyGpuMesh * gpuMesh);
+
+/**
+ * @brief Destroys the buffers of a GPU mesh.
+ *
+ * @param gpuMesh The mesh to destroy.
+ */
+void destroyGpuMesh(CJellyGpuMesh * gpuMesh);
+
+/**
+ * @brief Records one job of a frame that draws a mesh.
+ *
+ * The mesh's triangles are divided evenly between the jobs, and each job
+ * draws its share with a single vkCmdDrawIndexed() call.
+ *
+ * @param user The CJellyGpuMesh to draw.
+ * @param commandBuffer The secondary command buffer to record into.
+ * @param context Describes the job.
+ */
+void recordMeshJob(void * user, VkCommandBuffer commandBuffer,
+    const CJellyRecordContext * context);
+
+/**
+ * @brief Sets up a window to draw a mesh, re-recording its commands on the
+ * worker threads every frame.
+ *
+ * @param win Pointer to the CJellyWindow structure.
+ * @param gpuMesh The mesh to draw.  It must outlive the window.
+ */
+void createMeshRecorderForWindow(CJellyWindow * win, CJellyGpuMesh * gpuMesh);
+
+
+/* === SPRITE BATCHES === */
+
+/**
+ * @brief One textured quad of a sprite batch.
+ *
+ * The transform is a 2x3 affine matrix, stored by columns, that maps the unit
+ * square to clip space: the quad's corners are `translation`,
+ * `translation + axisX`, `translation + axisY`, and
+ * `translation + axisX + axisY`.  Texture coordinates are interpolated from
+ * (u0, v0) at the first corner to (u1, v1) at the last.
+ */
+typedef struct CJellySprite {
+  float transform[6];    /**< x axis, y axis, and translation, in clip space */
+  float uvRect[4];       /**< u0, v0, u1, v1 */
+  uint32_t textureIndex; /**< Slot of the texture in bindlessTextures */
+} CJellySprite;
+
+/**
+ * @brief Opaque structure representing a batch of sprites.
+ *
+ * The sprites are streamed into a host-visible instance buffer every frame,
+ * and drawn with one instanced draw, whatever textures they use.  The quads
+ * themselves are generated by the vertex shader, so no vertex buffer is
+ * needed.
+ */
+typedef struct CJellySpriteBatch CJellySpriteBatch;
+
+/**
+ * @brief Signature of a function that adds a frame's sprites to a batch.
+ *
+ * @param user The user data passed to createSpriteRecorderForWindow().
+ * @param batch The batch, already begun for the frame.
+ * @param context Describes the frame.
+ */
+typedef void (*CJellySpriteBatchFill)(void * user, CJellySpriteBatch * batch,
+    const CJellyRecordContext * context);
+
+/**
+ * @brief Creates the graphics pipeline used to draw sprite batches.
+ *
+ * The pipeline reads CJellySprite data per instance, and blends the sprites
+ * by their alpha.  It is created by initVulkanGlobal().
+ */
+void createSpriteGraphicsPipeline(void);
+
+/**
+ * @brief Creates an empty sprite batch.
+ *
+ * @return The new batch.
+ */
+CJellySpriteBatch * createSpriteBatch(void);
+
+/**
+ * @brief Destroys a sprite batch.  The GPU must no longer be using it.
+ *
+ * @param batch The batch to destroy.
+ */
+void destroySpriteBatch(CJellySpriteBatch * batch);
+
+/**
+ * @brief Empties a batch, so that the sprites of a frame can be added.
+ *
+ * Each frame in flight has an instance buffer of its own, so the sprites of
+ * one frame may be written while the GPU still draws another.
+ *
+ * @param batch The batch.
+ * @param frameIndex The frame-in-flight slot, whose previous submission must
+ *   have finished.
+ */
+void beginSpriteBatch(CJellySpriteBatch * batch, uint32_t frameIndex);
+
+/**
+ * @brief Adds sprites to the frame that was begun last.
+ *
+ * Sprites are drawn in the order in which they are added.
+ *
+ * @param batch The batch.
+ * @param sprites The sprites to add.  They are copied.
+ * @param count The number of sprites.
+ */
+void addSprites(
+    CJellySpriteBatch * batch, const CJellySprite * sprites, uint32_t count);
+
+/**
+ * @brief Records the draws of the frame that was begun last.
+ *
+ * The sprites are skipped while the sprite pipeline is still being compiled.
+ *
+ * @param batch The batch.
+ * @param commandBuffer A command buffer inside the render pass, with the
+ *   viewport and scissor already set.
+ * @param serial The serial of the frame being recorded (see
+ *   CJellyRecordContext::serial).
+ */
+void recordSpriteBatch(
+    CJellySpriteBatch * batch, VkCommandBuffer commandBuffer, uint64_t serial);
+
+/**
+ * @brief Sets up a window to draw a sprite batch, which is refilled every
+ * frame.
+ *
+ * The batch is recorded as a single job, since it takes a single draw however
+ * many sprites it holds.
+ *
+ * @param win Pointer to the CJellyWindow structure.
+ * @param batch The batch to draw.  It must outlive the window, and must not
+ *   be drawn by another window.
+ * @param fill Called to add the sprites of each frame.
+ * @param user User data passed to `fill`.
+ */
+void createSpriteRecorderForWindow(CJellyWindow * win, CJellySpriteBatch * batch,
+    CJellySpriteBatchFill fill, void * user);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -2,6 +2,9 @@
 #define CJELLY_FORMAT_3D_OBJ_H
 
 #include <cjelly/macros.h>
+#include <cjelly/threadpool.h>
+
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -75,6 +78,11 @@ struct CJellyFormat3dObjFaceOverflow {
  * normal indices. The count field indicates the number of vertices that form
  * the face.  The material_index field indicates the index of the material used
  * for this face, or -1 if no material is assigned.
+ *
+ * The model does not store its faces in this form.  This structure is a
+ * compatibility view, produced on demand by cjelly_format_3d_obj_faces().
+ * New code should read the face and corner arrays of CJellyFormat3dObjModel
+ * directly.
  */
 struct CJellyFormat3dObjFace {
   int vertex[4];      /**< Vertex indices (0-based) */
@@ -112,6 +120,11 @@ struct CJellyFormat3dObjMaterialMapping {
  *
  * This structure contains dynamically allocated arrays for vertices, texture coordinates,
  * normals, faces, and groups. It also includes a reference to an external material library if present.
+ *
+ * Faces are stored in compressed sparse row form.  The corners of all faces
+ * are stored back to back in three parallel index streams (corner_vertices,
+ * corner_texcoords, and corner_normals), and face `i` consists of the corners
+ * `face_offsets[i]` up to (but not including) `face_offsets[i + 1]`.
  */
 struct CJellyFormat3dObjModel {
   CJellyFormat3dObjVertex * vertices;    /**< Array of vertices */
@@ -126,9 +139,17 @@ struct CJellyFormat3dObjModel {
   int normal_count;       /**< Number of normals */
   int normal_capacity;    /**< Allocated capacity for normals */
 
-  CJellyFormat3dObjFace * faces;           /**< Array of faces */
+  int * face_offsets;     /**< Index of the first corner of each face (face_count + 1 entries) */
+  int * face_materials;   /**< Material index of each face, or -1 if no material assigned */
   int face_count;         /**< Number of faces */
   int face_capacity;      /**< Allocated capacity for faces */
+  int * corner_vertices;  /**< Vertex index of each corner (0-based) */
+  int * corner_texcoords; /**< Texture coordinate index of each corner (0-based or -1 if missing) */
+  int * corner_normals;   /**< Normal index of each corner (0-based or -1 if missing) */
+  int corner_count;       /**< Number of corners, across all faces */
+  int corner_capacity;    /**< Allocated capacity for corners */
+  CJellyFormat3dObjFace * faces;           /**< Compatibility view of the faces, or NULL if not yet built */
+  CJellyFormat3dObjFaceOverflow * face_overflow; /**< Storage for the overflow corners of the compatibility view */
 
   CJellyFormat3dObjGroup* groups;          /**< Array of groups/objects */
   int group_count;        /**< Number of groups */
@@ -155,6 +176,44 @@ struct CJellyFormat3dObjModel {
 CJellyFormat3dObjError cjelly_format_3d_obj_load(const char* filename,
                                                  CJellyFormat3dObjModel** outModel);
 
+/**
+ * @brief Loads an OBJ file, parsing it on multiple threads.
+ *
+ * The file is split into newline-aligned chunks, which are parsed in parallel
+ * and then merged.  The resulting model is identical to the one produced by
+ * cjelly_format_3d_obj_load().  Small files are parsed on the calling thread.
+ *
+ * Splitting the file costs an extra counting pass and a copy of the faces, so
+ * the parallel path does about 1.2 times the work of the serial one.  How much
+ * faster it is on several cores has not been measured; profile before relying
+ * on it.
+ *
+ * @param filename Path to the OBJ file.
+ * @param pool The thread pool to use.  If NULL, a temporary pool with one
+ *   thread per processor is created for the duration of the call.
+ * @param outModel Output pointer that will point to the allocated CJellyFormat3dObjModel on success.
+ * @return CJellyFormat3dObjError Error code indicating success or the type of failure.
+ */
+CJellyFormat3dObjError cjelly_format_3d_obj_load_parallel(const char * filename,
+                                                          CJellyThreadPool * pool,
+                                                          CJellyFormat3dObjModel * * outModel);
+
+/**
+ * @brief Returns the faces of a model as an array of CJellyFormat3dObjFace.
+ *
+ * This is a compatibility view for code written against the original face
+ * layout.  The array is built on the first call and is owned by the model, so
+ * it must not be freed by the caller.  Overflow corners of all faces share a
+ * single allocation.
+ *
+ * @param model The model.  May be NULL, in which case it has no faces.
+ * @param outFaces Output pointer that will point to the array of
+ *   `model->face_count` faces on success, or to NULL if the model has no
+ *   faces.
+ * @return CJellyFormat3dObjError Error code indicating success or the type of failure.
+ */
+CJellyFormat3dObjError cjelly_format_3d_obj_faces(CJellyFormat3dObjModel * model, const CJellyFormat3dObjFace * * outFaces);
+
 /**
  * @brief Frees the memory allocated for an OBJ model.
  *
@@ -0,0 +1,234 @@
+/**
+ * @file gpuallocator.h
+ * @brief CJelly GPU memory sub-allocator.
+ *
+ * @details
+ * Vulkan limits the number of live device memory objects (often to 4096), and
+ * every vkAllocateMemory() call is expensive.  The allocator therefore
+ * requests device memory in large blocks and places buffers and images inside
+ * them, so that many resources share a single VkDeviceMemory.
+ *
+ * Blocks are grouped into pools, one for every memory type (as chosen by the
+ * caller, e.g. with findMemoryType()) and resource kind.  Buffers and images
+ * never share a block, which keeps linear and optimal-tiling resources apart
+ * without having to honor bufferImageGranularity between neighbors.  Within a
+ * block, free space is managed with a two-level segregated fit (TLSF)
+ * allocator, which finds a suitably sized free range in constant time and
+ * merges adjacent free ranges as soon as they are released.
+ *
+ * Requests too large to share a block receive a dedicated device memory
+ * object.  Blocks of host-visible memory are mapped once, when they are
+ * created, and stay mapped for their whole lifetime.
+ *
+ * All functions are thread-safe.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_GPUALLOCATOR_H
+#define CJELLY_GPUALLOCATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#include <cjelly/types.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+
+/**
+ * @brief Opaque structure representing a GPU memory allocator.
+ */
+typedef struct CJellyGpuAllocator CJellyGpuAllocator;
+
+
+/**
+ * @brief The kind of resource that an allocation is bound to.
+ */
+typedef enum {
+  CJELLY_GPU_RESOURCE_BUFFER = 0, /**< A VkBuffer */
+  CJELLY_GPU_RESOURCE_IMAGE,      /**< A VkImage */
+} CJellyGpuResourceKind;
+
+
+/**
+ * @brief A range of device memory handed out by the allocator.
+ *
+ * The fields are read-only.  The address of the structure stays the same for
+ * the lifetime of the allocation, even if defragmentation moves it.
+ */
+typedef struct CJellyGpuAllocation {
+  VkDeviceMemory memory;    /**< The device memory object containing the range */
+  VkDeviceSize offset;      /**< Offset of the range within `memory` */
+  VkDeviceSize size;        /**< Size of the range in bytes */
+  void * mapped;            /**< Host pointer to the range, or NULL if not host-visible */
+  uint32_t memoryTypeIndex; /**< The memory type of `memory` */
+} CJellyGpuAllocation;
+
+
+/**
+ * @brief Memory usage of one memory heap.
+ */
+typedef struct {
+  VkDeviceSize heapSize;      /**< Size of the heap, as reported by the device */
+  VkDeviceSize budget;        /**< Conservative estimate of how much of the heap the application may use */
+  VkDeviceSize usage;         /**< Bytes of the heap in use by the whole application */
+  VkDeviceSize blockBytes;    /**< Bytes of device memory allocated from the heap */
+  VkDeviceSize usedBytes;     /**< Bytes of that memory handed out to allocations */
+  uint32_t blockCount;        /**< Number of device memory objects allocated from the heap */
+  uint32_t allocationCount;   /**< Number of live allocations in the heap */
+} CJellyGpuHeapStats;
+
+
+/**
+ * @brief Signature of the callback that moves an allocation during
+ * defragmentation.
+ *
+ * The callback must create a new resource bound to `to`, copy the contents of
+ * the old resource into it, wait for the copy to complete, and destroy the old
+ * resource.  It is called while the allocator is locked, and must not call
+ * any allocator function.
+ *
+ * @param user The user data pointer passed to
+ *   cjelly_gpu_allocator_defragment().
+ * @param from The allocation being moved.  This is the same pointer that was
+ *   returned when the allocation was made.
+ * @param to The new location of the allocation.
+ * @return true if the resource was moved, or false to leave it where it is.
+ */
+typedef bool (*CJellyGpuDefragmentMove)(void * user, const CJellyGpuAllocation * from, const CJellyGpuAllocation * to);
+
+
+/**
+ * @brief Creates a GPU memory allocator.
+ *
+ * @param physicalDevice The physical device.
+ * @param device The logical device.
+ * @param blockSize The preferred size of each device memory block, or zero to
+ *   choose a size based on the size of each heap.
+ * @return A pointer to the new allocator, or NULL on failure.
+ */
+CJellyGpuAllocator * cjelly_gpu_allocator_create(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize);
+
+
+/**
+ * @brief Destroys an allocator, freeing all of its device memory.
+ *
+ * Every resource bound to memory from the allocator must already have been
+ * destroyed.
+ *
+ * @param allocator The allocator to destroy.  May be NULL.
+ */
+void cjelly_gpu_allocator_destroy(CJellyGpuAllocator * allocator);
+
+
+/**
+ * @brief Finds a memory type that is allowed by a resource and has the
+ * desired properties.
+ *
+ * @param allocator The allocator.
+ * @param typeBits The memoryTypeBits of the resource's memory requirements.
+ * @param properties The properties that the memory type must have.
+ * @param outMemoryTypeIndex Output pointer that receives the memory type.
+ * @return true if a suitable memory type exists.
+ */
+bool cjelly_gpu_allocator_find_memory_type(const CJellyGpuAllocator * allocator, uint32_t typeBits, VkMemoryPropertyFlags properties, uint32_t * outMemoryTypeIndex);
+
+
+/**
+ * @brief Allocates device memory for a resource.
+ *
+ * @param allocator The allocator.
+ * @param requirements The memory requirements of the resource.
+ * @param memoryTypeIndex The memory type to allocate from.  It must be one of
+ *   the types allowed by `requirements->memoryTypeBits`.
+ * @param kind The kind of resource that the memory will be bound to.
+ * @param outAllocation Output pointer that will point to the allocation on
+ *   success.
+ * @return VK_SUCCESS, or the error returned by vkAllocateMemory().
+ */
+VkResult cjelly_gpu_allocator_alloc(CJellyGpuAllocator * allocator, const VkMemoryRequirements * requirements, uint32_t memoryTypeIndex, CJellyGpuResourceKind kind, CJellyGpuAllocation * * outAllocation);
+
+
+/**
+ * @brief Releases an allocation.
+ *
+ * @param allocator The allocator.
+ * @param allocation The allocation to release.  May be NULL.
+ */
+void cjelly_gpu_allocator_free(CJellyGpuAllocator * allocator, CJellyGpuAllocation * allocation);
+
+
+/**
+ * @brief Returns the number of memory heaps of the device.
+ *
+ * @param allocator The allocator.
+ * @return The number of heaps.
+ */
+uint32_t cjelly_gpu_allocator_heap_count(const CJellyGpuAllocator * allocator);
+
+
+/**
+ * @brief Makes the heap statistics report the budget and usage of
+ * VK_EXT_memory_budget.
+ *
+ * The driver's figures account for other applications and for memory that
+ * did not come from the allocator, and change as the system's memory pressure
+ * does.  The extension must have been enabled on the device.
+ *
+ * @param allocator The allocator.
+ */
+void cjelly_gpu_allocator_use_memory_budget(CJellyGpuAllocator * allocator);
+
+
+/**
+ * @brief Returns the heap that a memory type allocates from.
+ *
+ * @param allocator The allocator.
+ * @param memoryTypeIndex The memory type.
+ * @return The index of the heap.
+ */
+uint32_t cjelly_gpu_allocator_memory_type_heap(const CJellyGpuAllocator * allocator, uint32_t memoryTypeIndex);
+
+
+/**
+ * @brief Returns the memory usage of one heap.
+ *
+ * With cjelly_gpu_allocator_use_memory_budget(), the budget and usage are the
+ * driver's current figures.  Otherwise, the budget is 80% of the heap size,
+ * which leaves room for other applications and for the driver's own
+ * allocations, and the usage is the memory allocated by the allocator.
+ *
+ * @param allocator The allocator.
+ * @param heapIndex The heap, less than cjelly_gpu_allocator_heap_count().
+ * @param outStats Output pointer that receives the statistics.
+ */
+void cjelly_gpu_allocator_get_heap_stats(CJellyGpuAllocator * allocator, uint32_t heapIndex, CJellyGpuHeapStats * outStats);
+
+
+/**
+ * @brief Compacts the allocations of each pool into as few blocks as possible.
+ *
+ * Allocations are moved out of the least used blocks and into fuller ones,
+ * and blocks that become empty are released.  The GPU must not be using any
+ * of the resources that may be moved.
+ *
+ * @param allocator The allocator.
+ * @param move The callback that moves each resource.
+ * @param user User data passed to `move`.
+ * @return The number of allocations that were moved.
+ */
+uint32_t cjelly_gpu_allocator_defragment(CJellyGpuAllocator * allocator, CJellyGpuDefragmentMove move, void * user);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_GPUALLOCATOR_H
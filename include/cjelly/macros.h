@@ -46,6 +46,8 @@ typedef struct CJellyFormat3dObjGroup CJellyFormat3dObjGroup;
 typedef struct CJellyFormat3dObjMaterialMapping
     CJellyFormat3dObjMaterialMapping;
 typedef struct CJellyFormat3dObjModel CJellyFormat3dObjModel;
+typedef struct CJellyMeshVertex CJellyMeshVertex;
+typedef struct CJellyMesh CJellyMesh;
 
 /**
  * A cross-compiler macro for marking a function parameter as unused.
@@ -0,0 +1,133 @@
+/**
+ * @file meshcache.h
+ * @brief Binary cache of GPU-ready meshes.
+ *
+ * @details
+ * Parsing a text OBJ file, building the mesh, and optimizing it takes far
+ * longer than reading the result back.  A mesh cache file stores the final
+ * interleaved vertex buffer and index buffer exactly as they are uploaded to
+ * the GPU, so opening one is a matter of mapping the file into memory: the
+ * buffers are then copied straight from the mapped pages into a staging
+ * buffer, without any parsing.
+ *
+ * The file starts with a versioned header that records the layout of the
+ * data, the offset and size of each section, a checksum of the sections, and
+ * a stamp (size, modification time, and content hash) of the source model.
+ * A cache whose stamp no longer matches its source is stale, and
+ * cjelly_mesh_cache_load_obj() transparently rebuilds it.
+ *
+ * The data is stored in the byte order and vertex layout of the host that
+ * wrote it.  A cache written by a different host, or by a different version
+ * of the library, is rejected as invalid (and therefore rebuilt).
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_MESHCACHE_H
+#define CJELLY_MESHCACHE_H
+
+#include <cjelly/macros.h>
+#include <cjelly/mesh.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * @brief Enumeration of error codes for the mesh cache.
+ */
+typedef enum {
+  CJELLY_MESH_CACHE_SUCCESS = 0,          /**< No error */
+  CJELLY_MESH_CACHE_ERR_OUT_OF_MEMORY,    /**< Memory allocation failure */
+  CJELLY_MESH_CACHE_ERR_FILE_NOT_FOUND,   /**< The file does not exist or cannot be opened */
+  CJELLY_MESH_CACHE_ERR_IO,               /**< The file could not be read, written, or mapped */
+  CJELLY_MESH_CACHE_ERR_INVALID,          /**< The file is not a compatible, intact mesh cache */
+  CJELLY_MESH_CACHE_ERR_STALE,            /**< The source model has changed since the cache was written */
+  CJELLY_MESH_CACHE_ERR_SOURCE,           /**< The source model could not be loaded or built */
+} CJellyMeshCacheError;
+
+/**
+ * @brief An opened mesh cache.
+ *
+ * Usually the mesh's arrays point directly into a read-only mapping of the
+ * cache file, and must not be modified.
+ */
+typedef struct CJellyMeshCache CJellyMeshCache;
+
+/**
+ * @brief Writes a mesh to a cache file.
+ *
+ * The file is written under a temporary name and then renamed, so that a
+ * reader never sees a partially written cache.
+ *
+ * @param mesh The mesh to store.
+ * @param source_path The model file that the mesh was built from, whose
+ *   stamp is recorded in the cache.  May be NULL, in which case the cache is
+ *   never considered stale.
+ * @param cache_path Path of the cache file to write.
+ * @return CJellyMeshCacheError Error code indicating success or the type of failure.
+ */
+CJellyMeshCacheError cjelly_mesh_cache_write(const CJellyMesh * mesh, const char * source_path, const char * cache_path);
+
+/**
+ * @brief Opens a cache file by mapping it into memory.
+ *
+ * The header and the section checksum are verified.  If `source_path` is
+ * given, the source's size and modification time are compared with the stamp
+ * in the cache; if either differs, the source is hashed, and the cache is only
+ * stale if the content itself has changed.
+ *
+ * @param cache_path Path of the cache file.
+ * @param source_path The model file to check the cache against, or NULL to
+ *   skip the check.
+ * @param outCache Output pointer that will point to the opened cache on success.
+ * @return CJellyMeshCacheError Error code indicating success or the type of failure.
+ */
+CJellyMeshCacheError cjelly_mesh_cache_open(const char * cache_path, const char * source_path, CJellyMeshCache * * outCache);
+
+/**
+ * @brief Loads an OBJ model as an optimized mesh, going through a cache file.
+ *
+ * If the cache is missing, invalid, or stale, the model is loaded, built with
+ * cjelly_mesh_build_from_obj(), optimized with cjelly_mesh_optimize(), and
+ * written back to the cache.  If the cache cannot be written (for example,
+ * because its directory is read-only), the freshly built mesh is still
+ * returned, just without the benefit of caching.
+ *
+ * @param obj_path Path of the OBJ file.
+ * @param cache_path Path of the cache file.
+ * @param outCache Output pointer that will point to the opened cache on success.
+ * @return CJellyMeshCacheError Error code indicating success or the type of failure.
+ */
+CJellyMeshCacheError cjelly_mesh_cache_load_obj(const char * obj_path, const char * cache_path, CJellyMeshCache * * outCache);
+
+/**
+ * @brief Returns the mesh held by an opened cache.
+ *
+ * @param cache The cache.
+ * @return The mesh, which remains valid until the cache is closed.
+ */
+const CJellyMesh * cjelly_mesh_cache_mesh(const CJellyMeshCache * cache);
+
+/**
+ * @brief Closes a cache, unmapping its file.
+ *
+ * @param cache The cache to close.  May be NULL.
+ */
+void cjelly_mesh_cache_close(CJellyMeshCache * cache);
+
+/**
+ * @brief Converts a mesh cache error code to a human-readable error message.
+ *
+ * @param err The CJellyMeshCacheError code.
+ * @return A constant string describing the error.
+ */
+const char * cjelly_mesh_cache_strerror(CJellyMeshCacheError err);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_MESHCACHE_H
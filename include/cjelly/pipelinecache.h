@@ -0,0 +1,106 @@
+/**
+ * @file pipelinecache.h
+ * @brief Vulkan pipeline cache persisted to disk.
+ *
+ * @details
+ * Creating a pipeline compiles its shaders for the GPU, which is the slowest
+ * part of starting up.  A VkPipelineCache keeps the compiled results, and its
+ * contents can be saved and handed back to the driver on the next run, so that
+ * only new or changed pipelines are compiled again.
+ *
+ * The driver's data is stored behind a header of our own, which records the
+ * vendor, device, driver version, and pipeline cache UUID of the device that
+ * wrote it, along with the size and a checksum of the data.  Drivers are not
+ * required to cope with data from another device or driver, or with corrupt
+ * data, so a file that does not match the current device exactly is
+ * discarded, and the cache starts out empty instead.  The driver's own header
+ * at the start of the data is checked as well.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_PIPELINECACHE_H
+#define CJELLY_PIPELINECACHE_H
+
+#include <cjelly/macros.h>
+
+#include <stddef.h>
+#include <vulkan/vulkan.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/**
+ * @brief Enumeration of error codes for the pipeline cache.
+ */
+typedef enum {
+  CJELLY_PIPELINE_CACHE_SUCCESS = 0,        /**< No error */
+  CJELLY_PIPELINE_CACHE_ERR_OUT_OF_MEMORY,  /**< Memory allocation failure */
+  CJELLY_PIPELINE_CACHE_ERR_FILE_NOT_FOUND, /**< The file does not exist or cannot be opened */
+  CJELLY_PIPELINE_CACHE_ERR_IO,             /**< The file could not be read or written */
+  CJELLY_PIPELINE_CACHE_ERR_INVALID,        /**< The file is not an intact pipeline cache */
+  CJELLY_PIPELINE_CACHE_ERR_STALE,          /**< The file was written for another device or driver */
+  CJELLY_PIPELINE_CACHE_ERR_VULKAN,         /**< A Vulkan call failed */
+} CJellyPipelineCacheError;
+
+/**
+ * @brief Builds the path of a file in the per-user cache directory.
+ *
+ * The directory is `$XDG_CACHE_HOME/cjelly` (or `$HOME/.cache/cjelly`) on
+ * Linux, and `%LOCALAPPDATA%\cjelly` on Windows.  It is created if it does not
+ * exist yet (see cjelly_cache_file_path()).
+ *
+ * @param name The file name.
+ * @param buffer Receives the path.
+ * @param size The size of `buffer`, in bytes.
+ * @return CJellyPipelineCacheError Error code indicating success or the type of failure.
+ */
+CJellyPipelineCacheError cjelly_pipeline_cache_path(const char * name, char * buffer, size_t size);
+
+/**
+ * @brief Creates a pipeline cache, filled from a file if the file is valid.
+ *
+ * A cache is created even if the file is missing, corrupt, or stale; it is
+ * then empty, and the return value tells why.
+ *
+ * @param physicalDevice The physical device whose properties the file must
+ *   match.
+ * @param device The logical device.
+ * @param path Path of the cache file.  May be NULL, to create an empty cache.
+ * @param outCache Receives the new cache, or VK_NULL_HANDLE if the error is
+ *   CJELLY_PIPELINE_CACHE_ERR_VULKAN.
+ * @return CJELLY_PIPELINE_CACHE_SUCCESS if the cache was filled from the
+ *   file, or the reason that it is empty.
+ */
+CJellyPipelineCacheError cjelly_pipeline_cache_load(VkPhysicalDevice physicalDevice, VkDevice device, const char * path, VkPipelineCache * outCache);
+
+/**
+ * @brief Writes the contents of a pipeline cache to a file.
+ *
+ * The file is written under a temporary name and then renamed, so that a
+ * reader never sees a partially written cache.
+ *
+ * @param physicalDevice The physical device, whose properties are recorded.
+ * @param device The logical device.
+ * @param cache The cache to save.
+ * @param path Path of the cache file.
+ * @return CJellyPipelineCacheError Error code indicating success or the type of failure.
+ */
+CJellyPipelineCacheError cjelly_pipeline_cache_save(VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache cache, const char * path);
+
+/**
+ * @brief Returns a human-readable description of an error code.
+ *
+ * @param err The error code.
+ * @return A static string.
+ */
+const char * cjelly_pipeline_cache_strerror(CJellyPipelineCacheError err);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_PIPELINECACHE_H
@@ -0,0 +1,366 @@
+/**
+ * @file pipelineregistry.h
+ * @brief Registry of graphics pipelines, keyed by the state they are built
+ * from.
+ *
+ * @details
+ * A pipeline is described by a CJellyPipelineDesc: its shader modules, vertex
+ * layout, rasterization and blend state, render pass, and pipeline layout.
+ * Requesting a description returns the registry's entry for it, so that equal
+ * descriptions share one pipeline no matter who asks for them.  Descriptor set
+ * layouts and pipeline layouts are shared in the same way, so a material only
+ * has to say which bindings it uses.
+ *
+ * Requesting a pipeline does not compile it.  The pipeline is created the first
+ * time that it is used, or earlier if cjelly_pipeline_registry_prepare() is
+ * called.  If the registry has compile threads, the pipeline is compiled on one
+ * of them, and cjelly_pipeline_registry_try_get() returns VK_NULL_HANDLE until
+ * it is ready, so that a frame can skip the draw instead of waiting for the
+ * driver.  Without compile threads, the pipeline is compiled on the thread that
+ * first uses it.
+ *
+ * When a shader is reloaded, cjelly_pipeline_registry_replace_shader()
+ * rebuilds only the pipelines that use it.  The old pipelines are handed out
+ * until their replacements are ready.  A replaced pipeline may still be in use
+ * by command buffers on the GPU, so it is destroyed only once every frame that
+ * fetched it has finished, as reported to cjelly_pipeline_registry_next_frame(),
+ * and once every hold on it (see cjelly_pipeline_registry_hold()) has been
+ * released.
+ *
+ * All of the functions may be called from any thread.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_PIPELINEREGISTRY_H
+#define CJELLY_PIPELINEREGISTRY_H
+
+#include <cjelly/types.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+/**
+ * @brief Maximum number of vertex attributes in a pipeline description.
+ */
+#define CJELLY_PIPELINE_MAX_VERTEX_ATTRIBUTES 8
+
+/**
+ * @brief Maximum number of bindings in a descriptor set layout description.
+ */
+#define CJELLY_PIPELINE_MAX_DESCRIPTOR_BINDINGS 8
+
+/**
+ * @brief Maximum number of descriptor sets in a pipeline layout description.
+ */
+#define CJELLY_PIPELINE_MAX_DESCRIPTOR_SETS 4
+
+/**
+ * @brief Maximum number of push constant ranges in a pipeline layout
+ * description.
+ */
+#define CJELLY_PIPELINE_MAX_PUSH_CONSTANT_RANGES 2
+
+
+/**
+ * @brief Opaque structure representing a pipeline registry.
+ */
+typedef struct CJellyPipelineRegistry CJellyPipelineRegistry;
+
+
+/**
+ * @brief Opaque structure representing one pipeline of a registry.
+ *
+ * It stays valid until the registry is destroyed.
+ */
+typedef struct CJellyPipeline CJellyPipeline;
+
+
+/**
+ * @brief How the fragment shader's output is combined with the framebuffer.
+ */
+typedef enum {
+  CJELLY_BLEND_MODE_OPAQUE = 0,          /**< The output replaces the framebuffer */
+  CJELLY_BLEND_MODE_ALPHA,               /**< The output is blended by its alpha */
+  CJELLY_BLEND_MODE_PREMULTIPLIED_ALPHA, /**< As above, with color already multiplied by alpha */
+  CJELLY_BLEND_MODE_ADDITIVE,            /**< The output is added to the framebuffer */
+} CJellyBlendMode;
+
+
+/**
+ * @brief Describes a descriptor set layout.
+ *
+ * Immutable samplers are not supported; `pImmutableSamplers` must be NULL.
+ * The binding flags (for example, those of a bindless texture table) are only
+ * passed to Vulkan if one of them is set.
+ */
+typedef struct CJellyDescriptorSetLayoutDesc {
+  VkDescriptorSetLayoutCreateFlags flags;                               /**< Flags of the layout */
+  uint32_t bindingCount;                                                /**< Number of entries used in `bindings` */
+  VkDescriptorSetLayoutBinding bindings[CJELLY_PIPELINE_MAX_DESCRIPTOR_BINDINGS]; /**< The bindings of the set */
+  VkDescriptorBindingFlags bindingFlags[CJELLY_PIPELINE_MAX_DESCRIPTOR_BINDINGS]; /**< Flags of each binding */
+} CJellyDescriptorSetLayoutDesc;
+
+
+/**
+ * @brief Describes a pipeline layout.
+ */
+typedef struct CJellyPipelineLayoutDesc {
+  uint32_t setCount;                                                    /**< Number of entries used in `sets` */
+  CJellyDescriptorSetLayoutDesc sets[CJELLY_PIPELINE_MAX_DESCRIPTOR_SETS]; /**< Layouts of sets 0, 1, ... */
+  uint32_t pushConstantRangeCount;                                      /**< Number of entries used in `pushConstantRanges` */
+  VkPushConstantRange pushConstantRanges[CJELLY_PIPELINE_MAX_PUSH_CONSTANT_RANGES]; /**< The push constant ranges */
+} CJellyPipelineLayoutDesc;
+
+
+/**
+ * @brief Describes a graphics pipeline.
+ *
+ * The pipeline has a vertex and a fragment stage, both with the entry point
+ * `main`, a single vertex buffer binding, a single color attachment, and
+ * dynamic viewport and scissor.  Initialize the structure with
+ * cjelly_pipeline_desc_init(), then fill in the fields that differ from the
+ * defaults.  Entries beyond the counts are ignored.
+ */
+typedef struct CJellyPipelineDesc {
+  VkShaderModule vertexShader;          /**< The vertex shader */
+  VkShaderModule fragmentShader;        /**< The fragment shader */
+  uint32_t vertexStride;                /**< Stride of binding 0, or 0 if there is no vertex buffer */
+  VkVertexInputRate vertexInputRate;    /**< Input rate of binding 0 */
+  uint32_t attributeCount;              /**< Number of entries used in `attributes` */
+  VkVertexInputAttributeDescription attributes[CJELLY_PIPELINE_MAX_VERTEX_ATTRIBUTES]; /**< Attributes of binding 0 */
+  VkPrimitiveTopology topology;         /**< Primitive topology */
+  VkPolygonMode polygonMode;            /**< Polygon mode */
+  VkCullModeFlags cullMode;             /**< Faces to cull */
+  VkFrontFace frontFace;                /**< Winding of front faces */
+  CJellyBlendMode blendMode;            /**< Blending of the color attachment */
+  VkRenderPass renderPass;              /**< A render pass compatible with the ones drawn into */
+  uint32_t subpass;                     /**< Index of the subpass drawn into */
+  CJellyPipelineLayoutDesc layout;      /**< The pipeline layout */
+} CJellyPipelineDesc;
+
+
+/**
+ * @brief Fills a pipeline description with the defaults.
+ *
+ * The defaults are a triangle list, filled polygons, back faces culled with
+ * clockwise front faces, opaque blending, subpass 0, and no shaders, vertex
+ * input, render pass, descriptor sets, or push constants.
+ *
+ * @param desc The description.
+ */
+void cjelly_pipeline_desc_init(CJellyPipelineDesc * desc);
+
+
+/**
+ * @brief Creates a pipeline registry.
+ *
+ * @param device The logical device.
+ * @param cache The pipeline cache that pipelines are created with.  May be
+ *   VK_NULL_HANDLE.
+ * @param compileThreads The number of threads that compile pipelines in the
+ *   background.  If 0, pipelines are compiled on the thread that first uses
+ *   them.
+ * @return A pointer to the new registry, or NULL on failure.
+ */
+CJellyPipelineRegistry * cjelly_pipeline_registry_create(VkDevice device, VkPipelineCache cache, int compileThreads);
+
+
+/**
+ * @brief Destroys a registry, with all of its pipelines and layouts.
+ *
+ * Background compiles that are still running are waited for.  None of the
+ * pipelines may still be in use by the GPU.
+ *
+ * @param registry The registry to destroy.  May be NULL.
+ */
+void cjelly_pipeline_registry_destroy(CJellyPipelineRegistry * registry);
+
+
+/**
+ * @brief Returns the descriptor set layout with the given bindings, creating
+ * it if no equal layout exists yet.
+ *
+ * @param registry The registry.
+ * @param desc The description of the layout.
+ * @return The layout, which is owned by the registry, or VK_NULL_HANDLE on
+ *   failure.
+ */
+VkDescriptorSetLayout cjelly_pipeline_registry_descriptor_set_layout(CJellyPipelineRegistry * registry, const CJellyDescriptorSetLayoutDesc * desc);
+
+
+/**
+ * @brief Returns the pipeline layout with the given sets and push constants,
+ * creating it if no equal layout exists yet.
+ *
+ * @param registry The registry.
+ * @param desc The description of the layout.
+ * @return The layout, which is owned by the registry, or VK_NULL_HANDLE on
+ *   failure.
+ */
+VkPipelineLayout cjelly_pipeline_registry_layout(CJellyPipelineRegistry * registry, const CJellyPipelineLayoutDesc * desc);
+
+
+/**
+ * @brief Returns the registry's entry for a pipeline description, adding one
+ * if no equal description has been requested yet.
+ *
+ * The pipeline layout is created right away, but the pipeline is not compiled
+ * until it is first used or prepared.
+ *
+ * @param registry The registry.
+ * @param desc The description of the pipeline.
+ * @return The entry, or NULL on failure.
+ */
+CJellyPipeline * cjelly_pipeline_registry_request(CJellyPipelineRegistry * registry, const CJellyPipelineDesc * desc);
+
+
+/**
+ * @brief Starts compiling a pipeline in the background, if it has not been
+ * compiled or started yet.
+ *
+ * Does nothing if the registry has no compile threads.
+ *
+ * @param registry The registry.
+ * @param pipeline The entry of the pipeline.
+ */
+void cjelly_pipeline_registry_prepare(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline);
+
+
+/**
+ * @brief Returns a pipeline if it is ready, without waiting for it.
+ *
+ * If the pipeline has not been compiled yet, it is prepared, and
+ * VK_NULL_HANDLE is returned until the compile has finished.  If the registry
+ * has no compile threads, the pipeline is compiled before returning instead.
+ * While a pipeline is being rebuilt, the previous version is returned.
+ *
+ * @param registry The registry.
+ * @param pipeline The entry of the pipeline.
+ * @param serial The serial of the frame whose commands use the pipeline.  If
+ *   the pipeline is replaced, the returned version is not destroyed until a
+ *   call to cjelly_pipeline_registry_next_frame() reports that this frame has
+ *   finished.
+ * @return The pipeline, or VK_NULL_HANDLE if it is not ready or could not be
+ *   created.
+ */
+VkPipeline cjelly_pipeline_registry_try_get(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline, uint64_t serial);
+
+
+/**
+ * @brief Returns a pipeline, compiling it or waiting for its background
+ * compile if necessary.
+ *
+ * The use is not tied to a frame, so if the pipeline is replaced, the returned
+ * version may be destroyed by the next call to
+ * cjelly_pipeline_registry_next_frame().  Use
+ * cjelly_pipeline_registry_try_get() for commands recorded for a frame, or
+ * cjelly_pipeline_registry_hold() for commands that are kept.
+ *
+ * @param registry The registry.
+ * @param pipeline The entry of the pipeline.
+ * @return The pipeline, or VK_NULL_HANDLE if it could not be created.
+ */
+VkPipeline cjelly_pipeline_registry_get(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline);
+
+
+/**
+ * @brief Returns a pipeline like cjelly_pipeline_registry_get(), and keeps
+ * the returned version alive until it is released.
+ *
+ * This is for command buffers that are recorded once and submitted many
+ * times.  Once the pipeline has been replaced (see
+ * cjelly_pipeline_registry_is_current()), they should be recorded again with
+ * the new version, and the hold on the old one released.
+ *
+ * @param registry The registry.
+ * @param pipeline The entry of the pipeline.
+ * @return The pipeline, or VK_NULL_HANDLE if it could not be created, in which
+ *   case nothing is held.
+ */
+VkPipeline cjelly_pipeline_registry_hold(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline);
+
+
+/**
+ * @brief Releases a hold taken by cjelly_pipeline_registry_hold().
+ *
+ * Nothing that was recorded with the held version may still be executing,
+ * unless it was also fetched with cjelly_pipeline_registry_try_get() for that
+ * frame.
+ *
+ * @param registry The registry.
+ * @param pipeline The entry of the pipeline.
+ * @param handle The version that was held.  May be VK_NULL_HANDLE.
+ */
+void cjelly_pipeline_registry_release(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline, VkPipeline handle);
+
+
+/**
+ * @brief Returns whether a version of a pipeline is still the latest one.
+ *
+ * @param registry The registry.
+ * @param pipeline The entry of the pipeline.
+ * @param handle The version.
+ * @return false if the pipeline has been replaced since `handle` was fetched.
+ */
+bool cjelly_pipeline_registry_is_current(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline, VkPipeline handle);
+
+
+/**
+ * @brief Destroys the replaced pipelines that nothing can use anymore.
+ *
+ * A replaced pipeline is destroyed once it is no longer held, and the last
+ * frame that fetched it has finished.  Call this once per frame.
+ *
+ * @param registry The registry.
+ * @param completedSerial The serial up to which every frame has finished
+ *   executing on the GPU.
+ */
+void cjelly_pipeline_registry_next_frame(CJellyPipelineRegistry * registry, uint64_t completedSerial);
+
+
+/**
+ * @brief Rebuilds every pipeline that uses a shader module with another
+ * module instead.
+ *
+ * The pipelines keep their entries, so callers that hold them see the new
+ * pipelines once they are compiled.  The replaced pipelines are destroyed by
+ * cjelly_pipeline_registry_next_frame(), once no command buffer that was
+ * recorded with them can still be executed.
+ *
+ * The registry does not use `oldModule` once this returns, so it may be
+ * destroyed.
+ *
+ * @param registry The registry.
+ * @param oldModule The module to replace.
+ * @param newModule The module that replaces it.
+ * @return The number of pipelines that are rebuilt.
+ */
+size_t cjelly_pipeline_registry_replace_shader(CJellyPipelineRegistry * registry, VkShaderModule oldModule, VkShaderModule newModule);
+
+
+/**
+ * @brief Returns the layout of a pipeline.
+ *
+ * The layout is available as soon as the pipeline has been requested.
+ *
+ * @param pipeline The entry of the pipeline.
+ * @return The layout, which is owned by the registry.
+ */
+VkPipelineLayout cjelly_pipeline_layout(const CJellyPipeline * pipeline);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_PIPELINEREGISTRY_H
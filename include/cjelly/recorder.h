@@ -0,0 +1,128 @@
+/**
+ * @file recorder.h
+ * @brief CJelly parallel command buffer recorder.
+ *
+ * @details
+ * The recorder rebuilds a frame's commands from scratch every frame, so that
+ * the content of a window can change without recreating anything.  The draw
+ * work of a render pass is split into jobs.  Each job records into its own
+ * secondary command buffer on a worker thread of a CJellyThreadPool, and the
+ * recorder then executes the secondary buffers, in job order, from a single
+ * primary command buffer.
+ *
+ * Vulkan requires that a command pool is only used by one thread at a time.
+ * Every job slot of every frame therefore has a command pool of its own, and
+ * pools are reset as a whole, instead of freeing their command buffers one by
+ * one.  A frame's pools are only reset when the frame is recorded again, so
+ * the caller must have waited for the previous submission of that frame
+ * (e.g., on its in-flight fence) before recording it.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_RECORDER_H
+#define CJELLY_RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#include <cjelly/threadpool.h>
+#include <cjelly/types.h>
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+
+/**
+ * @brief Opaque structure representing a parallel command buffer recorder.
+ */
+typedef struct CJellyCommandRecorder CJellyCommandRecorder;
+
+
+/**
+ * @brief Describes the job being recorded.
+ */
+typedef struct CJellyRecordContext {
+  uint32_t frameIndex; /**< The frame being recorded */
+  uint64_t serial;     /**< Serial of the frame, which identifies this
+                            recording of it (see the `serial` parameter of
+                            cjelly_command_recorder_record()) */
+  uint32_t jobIndex;   /**< Index of this job, less than `jobCount` */
+  uint32_t jobCount;   /**< Number of jobs recorded for the render pass */
+  VkExtent2D extent;   /**< Extent of the render area */
+} CJellyRecordContext;
+
+
+/**
+ * @brief Signature of a function that records one job of a render pass.
+ *
+ * The command buffer is a secondary command buffer that continues the render
+ * pass.  Dynamic state and bound objects are not inherited from the primary
+ * command buffer, so every job must set its own viewport, scissor, pipeline,
+ * and buffers.  Jobs of the same frame run concurrently.
+ *
+ * @param user The user data pointer passed to
+ *   cjelly_command_recorder_record().
+ * @param commandBuffer The command buffer to record into.
+ * @param context Describes the job.
+ */
+typedef void (*CJellyRecordJob)(void * user, VkCommandBuffer commandBuffer, const CJellyRecordContext * context);
+
+
+/**
+ * @brief Creates a command buffer recorder.
+ *
+ * @param device The logical device.
+ * @param queueFamilyIndex The queue family that the command buffers will be
+ *   submitted to.
+ * @param frameCount The number of frames that may be in flight at once.
+ * @param pool The thread pool that records the jobs.  If NULL, jobs are
+ *   recorded on the calling thread.
+ * @return A pointer to the new recorder, or NULL on failure.
+ */
+CJellyCommandRecorder * cjelly_command_recorder_create(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, CJellyThreadPool * pool);
+
+
+/**
+ * @brief Destroys a recorder and all of its command pools.
+ *
+ * None of its command buffers may still be pending execution.
+ *
+ * @param recorder The recorder to destroy.  May be NULL.
+ */
+void cjelly_command_recorder_destroy(CJellyCommandRecorder * recorder);
+
+
+/**
+ * @brief Records the primary command buffer of a frame.
+ *
+ * The render pass is begun, the jobs are recorded in parallel and executed in
+ * order, and the render pass is ended.  The function returns once the primary
+ * command buffer is complete and ready to be submitted.
+ *
+ * @param recorder The recorder.
+ * @param frameIndex The frame to record, less than the frame count.  Its
+ *   previous submission must have finished executing.
+ * @param serial A number that the caller assigns to this recording of the
+ *   frame, and passed on to the jobs, so that they can tag the resources
+ *   they use with the submission that uses them.
+ * @param renderPassInfo Describes the render pass to record.
+ * @param jobCount The number of jobs to split the render pass into.
+ * @param job The function that records each job.
+ * @param user User data passed to `job`.
+ * @param outCommandBuffer Output pointer that receives the primary command
+ *   buffer.
+ * @return VK_SUCCESS, or the first error encountered while recording.
+ */
+VkResult cjelly_command_recorder_record(CJellyCommandRecorder * recorder, uint32_t frameIndex, uint64_t serial, const VkRenderPassBeginInfo * renderPassInfo, uint32_t jobCount, CJellyRecordJob job, void * user, VkCommandBuffer * outCommandBuffer);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_RECORDER_H
@@ -0,0 +1,142 @@
+/**
+ * @file scheduler.h
+ * @brief CJelly frame deadline scheduler.
+ *
+ * @details
+ * The scheduler keeps a deadline for each of a set of items (typically
+ * windows), and hands them back in deadline order.  Deadlines are kept in a
+ * binary min-heap, so finding the earliest deadline takes constant time, and
+ * scheduling, rescheduling, or popping an item takes logarithmic time in the
+ * number of items.  Items without a deadline are not in the heap at all, so an
+ * idle event-driven window costs nothing.
+ *
+ * Items are referred to by the id returned when they are added.  Ids are
+ * reused after an item is removed.
+ *
+ * The scheduler is not thread-safe.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_SCHEDULER_H
+#define CJELLY_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#include <cjelly/types.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * @brief Returned by cjelly_frame_scheduler_add() on failure.
+ */
+#define CJELLY_FRAME_SCHEDULER_INVALID_ID UINT32_MAX
+
+
+/**
+ * @brief Opaque structure representing a frame scheduler.
+ */
+typedef struct CJellyFrameScheduler CJellyFrameScheduler;
+
+
+/**
+ * @brief Creates an empty scheduler.
+ *
+ * @return A pointer to the new scheduler, or NULL on failure.
+ */
+CJellyFrameScheduler * cjelly_frame_scheduler_create(void);
+
+
+/**
+ * @brief Destroys a scheduler.
+ *
+ * @param scheduler The scheduler to destroy.  May be NULL.
+ */
+void cjelly_frame_scheduler_destroy(CJellyFrameScheduler * scheduler);
+
+
+/**
+ * @brief Adds an item, without a deadline.
+ *
+ * @param scheduler The scheduler.
+ * @param item The item, returned by cjelly_frame_scheduler_pop().
+ * @return The id of the item, or CJELLY_FRAME_SCHEDULER_INVALID_ID on failure.
+ */
+uint32_t cjelly_frame_scheduler_add(CJellyFrameScheduler * scheduler, void * item);
+
+
+/**
+ * @brief Removes an item, and its deadline if it has one.
+ *
+ * @param scheduler The scheduler.
+ * @param id The id of the item.
+ */
+void cjelly_frame_scheduler_remove(CJellyFrameScheduler * scheduler, uint32_t id);
+
+
+/**
+ * @brief Sets or replaces the deadline of an item.
+ *
+ * @param scheduler The scheduler.
+ * @param id The id of the item.
+ * @param deadline The deadline, in nanoseconds on the caller's clock.
+ */
+void cjelly_frame_scheduler_set_deadline(CJellyFrameScheduler * scheduler, uint32_t id, uint64_t deadline);
+
+
+/**
+ * @brief Sets the deadline of an item, unless it already has an earlier one.
+ *
+ * @param scheduler The scheduler.
+ * @param id The id of the item.
+ * @param deadline The deadline, in nanoseconds on the caller's clock.
+ */
+void cjelly_frame_scheduler_set_deadline_min(CJellyFrameScheduler * scheduler, uint32_t id, uint64_t deadline);
+
+
+/**
+ * @brief Removes the deadline of an item, keeping the item.
+ *
+ * @param scheduler The scheduler.
+ * @param id The id of the item.
+ */
+void cjelly_frame_scheduler_clear_deadline(CJellyFrameScheduler * scheduler, uint32_t id);
+
+
+/**
+ * @brief Returns the earliest deadline.
+ *
+ * @param scheduler The scheduler.
+ * @param outDeadline Output pointer that receives the deadline.
+ * @return true if any item has a deadline.
+ */
+bool cjelly_frame_scheduler_next_deadline(const CJellyFrameScheduler * scheduler, uint64_t * outDeadline);
+
+
+/**
+ * @brief Removes and returns the item with the earliest deadline, if that
+ * deadline is not later than `now`.
+ *
+ * The item keeps its id, but no longer has a deadline.
+ *
+ * @param scheduler The scheduler.
+ * @param now The current time, in nanoseconds.
+ * @param outId Output pointer that receives the id of the item.  May be NULL.
+ * @return The item, or NULL if no deadline has passed.
+ */
+void * cjelly_frame_scheduler_pop(CJellyFrameScheduler * scheduler, uint64_t now, uint32_t * outId);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_SCHEDULER_H
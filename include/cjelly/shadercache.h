@@ -0,0 +1,177 @@
+/**
+ * @file shadercache.h
+ * @brief Cache of shader modules, keyed by their SPIR-V contents, with hot
+ * reloading of shader files.
+ *
+ * @details
+ * Shaders may be embedded in the program (the arrays generated by `xxd -i`)
+ * or loaded from `.spv` files at run time.  Either way, a module is created
+ * once per distinct SPIR-V binary, and loading the same code again returns the
+ * same module.
+ *
+ * Files that were loaded from disk are watched (with inotify on Linux, and by
+ * modification time elsewhere).  cjelly_shader_cache_poll() reloads the files
+ * that have changed, and reports every module that was replaced, so that the
+ * pipelines that use it can be rebuilt without restarting or relinking the
+ * program.
+ *
+ * Modules are reference counted.  Every load adds a reference, which is given
+ * back with cjelly_shader_cache_release() once nothing needs the module any
+ * more (Vulkan does not need a module after the pipelines that use it have
+ * been compiled).  A watched file holds a reference of its own to the module
+ * it currently contains, so a module that is replaced by a reload is
+ * destroyed, and its code freed, once its users have released it.
+ *
+ * The cache is not thread-safe; use it from one thread at a time.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_SHADERCACHE_H
+#define CJELLY_SHADERCACHE_H
+
+#include <cjelly/types.h>
+
+#include <stddef.h>
+#include <vulkan/vulkan.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+/**
+ * @brief Opaque structure representing a shader module cache.
+ */
+typedef struct CJellyShaderCache CJellyShaderCache;
+
+
+/**
+ * @brief Enumeration of error codes for the shader cache.
+ */
+typedef enum {
+  CJELLY_SHADER_CACHE_SUCCESS = 0,        /**< No error */
+  CJELLY_SHADER_CACHE_ERR_OUT_OF_MEMORY,  /**< Memory allocation failure */
+  CJELLY_SHADER_CACHE_ERR_FILE_NOT_FOUND, /**< The file does not exist or cannot be opened */
+  CJELLY_SHADER_CACHE_ERR_IO,             /**< The file could not be read */
+  CJELLY_SHADER_CACHE_ERR_INVALID,        /**< The code is not SPIR-V */
+  CJELLY_SHADER_CACHE_ERR_VULKAN,         /**< vkCreateShaderModule() failed */
+} CJellyShaderCacheError;
+
+
+/**
+ * @brief Signature of a function that is told about a reloaded shader file.
+ *
+ * @param user The user data pointer passed to cjelly_shader_cache_poll().
+ * @param path The path of the file, as it was passed to
+ *   cjelly_shader_cache_load_file().
+ * @param oldModule The module that the file used to contain.  It is released
+ *   by the file after the callback returns, so the callback may still retain
+ *   or release it.
+ * @param newModule The module that it contains now.  A user that switches to
+ *   it should retain it, and release `oldModule` once nothing uses that.
+ */
+typedef void (*CJellyShaderReloadCallback)(void * user, const char * path, VkShaderModule oldModule, VkShaderModule newModule);
+
+
+/**
+ * @brief Creates a shader module cache.
+ *
+ * @param device The logical device.
+ * @return A pointer to the new cache, or NULL on failure.
+ */
+CJellyShaderCache * cjelly_shader_cache_create(VkDevice device);
+
+
+/**
+ * @brief Destroys a cache and every module that it created.
+ *
+ * @param cache The cache to destroy.  May be NULL.
+ */
+void cjelly_shader_cache_destroy(CJellyShaderCache * cache);
+
+
+/**
+ * @brief Returns the module for a SPIR-V binary in memory, creating it if the
+ * cache does not contain the same code yet.
+ *
+ * @param cache The cache.
+ * @param code The SPIR-V code.  It is copied, so it need not outlive the call.
+ * @param size The size of the code in bytes, a multiple of 4.
+ * @param outModule Receives the module, which is owned by the cache.  The
+ *   caller holds a reference to it, which it must release with
+ *   cjelly_shader_cache_release().
+ * @return CJellyShaderCacheError Error code indicating success or the type of failure.
+ */
+CJellyShaderCacheError cjelly_shader_cache_load_memory(CJellyShaderCache * cache, const void * code, size_t size, VkShaderModule * outModule);
+
+
+/**
+ * @brief Returns the module for a `.spv` file, and watches the file for
+ * changes.
+ *
+ * @param cache The cache.
+ * @param path The path of the file.
+ * @param outModule Receives the module, which is owned by the cache.  The
+ *   caller holds a reference to it, which it must release with
+ *   cjelly_shader_cache_release().
+ * @return CJellyShaderCacheError Error code indicating success or the type of failure.
+ */
+CJellyShaderCacheError cjelly_shader_cache_load_file(CJellyShaderCache * cache, const char * path, VkShaderModule * outModule);
+
+
+/**
+ * @brief Adds a reference to a module created by the cache.
+ *
+ * @param cache The cache.
+ * @param module The module.
+ */
+void cjelly_shader_cache_retain(CJellyShaderCache * cache, VkShaderModule module);
+
+
+/**
+ * @brief Releases a reference to a module, and destroys the module once no
+ * reference is left.
+ *
+ * The module may be destroyed as soon as the pipelines that use it have been
+ * created, but not while a pipeline that uses it is still being compiled.
+ *
+ * @param cache The cache.
+ * @param module The module.
+ */
+void cjelly_shader_cache_release(CJellyShaderCache * cache, VkShaderModule module);
+
+
+/**
+ * @brief Reloads the watched files that have changed, without blocking.
+ *
+ * `callback` is called for each file whose code is now different.  A file
+ * that cannot be read, or that is not valid SPIR-V (for example, because the
+ * compiler is still writing it), keeps its current module until it changes
+ * again.
+ *
+ * @param cache The cache.
+ * @param callback Called for each reloaded file.  It must not load files into
+ *   the cache.  May be NULL.
+ * @param user User data passed to `callback`.
+ * @return The number of files that were reloaded.
+ */
+size_t cjelly_shader_cache_poll(CJellyShaderCache * cache, CJellyShaderReloadCallback callback, void * user);
+
+
+/**
+ * @brief Returns a human-readable description of an error code.
+ *
+ * @param err The error code.
+ * @return A static string.
+ */
+const char * cjelly_shader_cache_strerror(CJellyShaderCacheError err);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_SHADERCACHE_H
@@ -0,0 +1,219 @@
+/**
+ * @file texturecache.h
+ * @brief Cache of image file textures, kept resident within a memory budget.
+ *
+ * @details
+ * Textures are acquired by the path of their image file, and are reference
+ * counted.  A file is only loaded once, however many times its path is
+ * acquired, and files with the same content share one texture.  Each texture
+ * that is resident on the GPU has a full mip chain and a slot in a bindless
+ * table, through which shaders read it.
+ *
+ * If the device can sample a block-compressed format, images are loaded
+ * through the BC texture cache (see bctexturecache.h): they are encoded once,
+ * with their mip chain, to a file in the per-user cache directory, and are
+ * uploaded compressed from then on, including when an evicted texture is
+ * streamed back in.  Otherwise, and for any image that cannot be compressed,
+ * the RGBA pixels are uploaded and their mip chain is blitted on the GPU.
+ *
+ * The cache keeps the memory of its resident textures within a budget.  When
+ * a texture would not fit, the textures that have gone unused the longest are
+ * evicted: their images are destroyed and their slots freed, but the textures
+ * themselves stay valid.  Using an evicted texture again streams it back in,
+ * by reloading its file and uploading it through the upload queue.  Released
+ * textures stay cached, in case they are acquired again, until they are
+ * evicted.
+ *
+ * The budget is the smaller of the configured limit and what the device
+ * memory heap has left for the cache, as reported by
+ * cjelly_gpu_allocator_get_heap_stats() (and so by VK_EXT_memory_budget,
+ * when the allocator uses it).
+ *
+ * A texture is never evicted while a frame that used it may still be on the
+ * GPU.  Every use is tagged with the serial of the frame that records it, and
+ * the caller reports, through cjelly_texture_cache_next_frame(), the serial up
+ * to which every frame has finished executing (as observed on the frames'
+ * fences).
+ *
+ * All of the functions may be called from any thread.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_TEXTURECACHE_H
+#define CJELLY_TEXTURECACHE_H
+
+#include <cjelly/bindless.h>
+#include <cjelly/gpuallocator.h>
+#include <cjelly/types.h>
+#include <cjelly/upload.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+/**
+ * @brief Opaque structure representing a texture cache.
+ */
+typedef struct CJellyTextureCache CJellyTextureCache;
+
+
+/**
+ * @brief Opaque structure representing a texture of the cache.
+ */
+typedef struct CJellyTexture CJellyTexture;
+
+
+/**
+ * @brief Enumeration of error codes for the texture cache.
+ */
+typedef enum {
+  CJELLY_TEXTURE_CACHE_SUCCESS = 0,       /**< No error */
+  CJELLY_TEXTURE_CACHE_ERR_OUT_OF_MEMORY, /**< Memory allocation failure */
+  CJELLY_TEXTURE_CACHE_ERR_LOAD,          /**< The image file could not be loaded */
+  CJELLY_TEXTURE_CACHE_ERR_FORMAT,        /**< The image is not 8-bit RGB or RGBA */
+  CJELLY_TEXTURE_CACHE_ERR_VULKAN,        /**< The image could not be created or uploaded */
+  CJELLY_TEXTURE_CACHE_ERR_TABLE_FULL,    /**< The bindless table has no free slot */
+} CJellyTextureCacheError;
+
+
+/**
+ * @brief Statistics of a texture cache.
+ */
+typedef struct {
+  size_t textureCount;        /**< Number of textures, resident or not */
+  size_t residentCount;       /**< Number of resident textures */
+  VkDeviceSize residentBytes; /**< Device memory of the resident textures */
+  VkDeviceSize budget;        /**< The budget that currently applies */
+  uint64_t evictions;         /**< Number of textures evicted so far */
+  uint64_t restreams;         /**< Number of evicted textures streamed back in */
+} CJellyTextureCacheStats;
+
+
+/**
+ * @brief Creates a texture cache.
+ *
+ * @param physicalDevice The physical device.
+ * @param device The logical device.
+ * @param allocator The allocator of the images' memory.
+ * @param uploader The upload queue that the images are streamed through.
+ * @param table The bindless table that the textures are added to.
+ * @param sampler The sampler of every texture.
+ * @param budget The most device memory that resident textures may use, or 0
+ *   to be limited only by the heap.
+ * @return A pointer to the new cache, or NULL on failure.
+ */
+CJellyTextureCache * cjelly_texture_cache_create(VkPhysicalDevice physicalDevice, VkDevice device, CJellyGpuAllocator * allocator, CJellyUploader * uploader, CJellyBindlessTable * table, VkSampler sampler, VkDeviceSize budget);
+
+
+/**
+ * @brief Destroys a cache, and every texture in it.
+ *
+ * The GPU must no longer be using any of the textures.
+ *
+ * @param cache The cache to destroy.  May be NULL.
+ */
+void cjelly_texture_cache_destroy(CJellyTextureCache * cache);
+
+
+/**
+ * @brief Acquires the texture of an image file, loading it if necessary.
+ *
+ * @param cache The cache.
+ * @param path The path of a BMP file.  The file must not change while the
+ *   cache knows it, since an evicted texture is reloaded from it.
+ * @param outTexture Receives the texture, which must be released with
+ *   cjelly_texture_cache_release().
+ * @return CJellyTextureCacheError Error code indicating success or the type of failure.
+ */
+CJellyTextureCacheError cjelly_texture_cache_acquire(CJellyTextureCache * cache, const char * path, CJellyTexture * * outTexture);
+
+
+/**
+ * @brief Releases a texture acquired with cjelly_texture_cache_acquire().
+ *
+ * @param cache The cache.
+ * @param texture The texture.  May be NULL.
+ */
+void cjelly_texture_cache_release(CJellyTextureCache * cache, CJellyTexture * texture);
+
+
+/**
+ * @brief Marks a texture as used by the frame being recorded, and returns
+ * its slot in the bindless table.
+ *
+ * If the texture has been evicted, it is queued to be streamed back in by the
+ * next call to cjelly_texture_cache_next_frame(), and the frame should draw
+ * something else in its place.
+ *
+ * @param cache The cache.
+ * @param texture The texture.
+ * @param serial The serial of the frame being recorded.  The texture is not
+ *   evicted until a call to cjelly_texture_cache_next_frame() reports that
+ *   this frame has finished.
+ * @param outIndex Receives the slot of the texture, if it is ready.
+ * @return true if the texture is resident and uploaded.
+ */
+bool cjelly_texture_cache_use(CJellyTextureCache * cache, CJellyTexture * texture, uint64_t serial, uint32_t * outIndex);
+
+
+/**
+ * @brief Advances the cache by one frame.
+ *
+ * Evicted textures that have been used since the last call are streamed back
+ * in, textures are evicted until the cache is within its budget, and the
+ * uploads are flushed.  Call this once per frame, from the thread that
+ * submits rendering work.
+ *
+ * @param cache The cache.
+ * @param completedSerial The serial up to which every frame has finished
+ *   executing on the GPU.  Only textures whose last use is no later than
+ *   this may be evicted.
+ */
+void cjelly_texture_cache_next_frame(CJellyTextureCache * cache, uint64_t completedSerial);
+
+
+/**
+ * @brief Changes the configured budget.
+ *
+ * The cache shrinks to a smaller budget on the next call to
+ * cjelly_texture_cache_next_frame().
+ *
+ * @param cache The cache.
+ * @param budget The most device memory that resident textures may use, or 0
+ *   to be limited only by the heap.
+ */
+void cjelly_texture_cache_set_budget(CJellyTextureCache * cache, VkDeviceSize budget);
+
+
+/**
+ * @brief Returns the statistics of a cache.
+ *
+ * @param cache The cache.
+ * @param outStats Output pointer that receives the statistics.
+ */
+void cjelly_texture_cache_get_stats(CJellyTextureCache * cache, CJellyTextureCacheStats * outStats);
+
+
+/**
+ * @brief Returns a human-readable description of an error code.
+ *
+ * @param err The error code.
+ * @return A static string.
+ */
+const char * cjelly_texture_cache_strerror(CJellyTextureCacheError err);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_TEXTURECACHE_H
@@ -0,0 +1,107 @@
+/**
+ * @file threadpool.h
+ * @brief CJelly worker thread pool.
+ *
+ * @details
+ * A small, fixed-size pool of worker threads that execute submitted tasks in
+ * FIFO order.  The pool is shared by the parts of the library that split work
+ * across cores (such as parallel asset loading), so that threads are created
+ * once rather than for every job.
+ *
+ * Tasks must not block waiting on other tasks in the same pool, since the pool
+ * does not grow.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_THREADPOOL_H
+#define CJELLY_THREADPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#include <cjelly/types.h>
+
+#include <stdbool.h>
+
+
+/**
+ * @brief Opaque structure representing a pool of worker threads.
+ */
+typedef struct CJellyThreadPool CJellyThreadPool;
+
+
+/**
+ * @brief Signature of a task executed by the thread pool.
+ *
+ * @param arg The user data pointer that was passed to
+ *   cjelly_thread_pool_submit().
+ */
+typedef void (*CJellyThreadPoolTask)(void * arg);
+
+
+/**
+ * @brief Returns the number of processors available to the process.
+ *
+ * @return The number of online processors, or 1 if it cannot be determined.
+ */
+int cjelly_thread_pool_hardware_concurrency(void);
+
+
+/**
+ * @brief Creates a thread pool.
+ *
+ * @param thread_count The number of worker threads.  If zero or negative, the
+ *   value of cjelly_thread_pool_hardware_concurrency() is used.
+ * @return A pointer to the new pool, or NULL on failure.
+ */
+CJellyThreadPool * cjelly_thread_pool_create(int thread_count);
+
+
+/**
+ * @brief Destroys a thread pool.
+ *
+ * Tasks that are already queued are completed before the workers exit.
+ *
+ * @param pool The pool to destroy.  May be NULL.
+ */
+void cjelly_thread_pool_destroy(CJellyThreadPool * pool);
+
+
+/**
+ * @brief Returns the number of worker threads in the pool.
+ *
+ * @param pool The pool.
+ * @return The number of worker threads.
+ */
+int cjelly_thread_pool_size(const CJellyThreadPool * pool);
+
+
+/**
+ * @brief Queues a task for execution on a worker thread.
+ *
+ * @param pool The pool.
+ * @param task The function to run.
+ * @param arg The argument passed to `task`.
+ * @return true on success, false if the task could not be queued.
+ */
+bool cjelly_thread_pool_submit(CJellyThreadPool * pool, CJellyThreadPoolTask task, void * arg);
+
+
+/**
+ * @brief Blocks until every submitted task has finished executing.
+ *
+ * @param pool The pool.
+ */
+void cjelly_thread_pool_wait(CJellyThreadPool * pool);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_THREADPOOL_H
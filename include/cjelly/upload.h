@@ -0,0 +1,265 @@
+/**
+ * @file upload.h
+ * @brief CJelly asynchronous GPU upload queue.
+ *
+ * @details
+ * The uploader copies data into device-local buffers and images without
+ * stalling rendering.  Source data is written into a persistently mapped
+ * staging ring, and the copies (with the layout transitions they need) are
+ * recorded into a batch command buffer.  A batch is submitted to the transfer
+ * queue as a whole, either explicitly with cjelly_uploader_flush() or when it
+ * grows large, and a fence per batch tells the uploader when the staging space
+ * behind it can be reused.
+ *
+ * Each upload is identified by the ticket of the batch that contains it.
+ * Tickets increase monotonically, so a ticket is ready once every batch up to
+ * and including it has been completed and handed over to the graphics queue.
+ *
+ * When the transfer queue belongs to a different queue family than the
+ * graphics queue, the uploaded resources change ownership: the transfer batch
+ * releases them, and cjelly_uploader_poll() acquires them on the graphics
+ * queue once the batch has finished.  Resources must therefore be created
+ * with VK_SHARING_MODE_EXCLUSIVE (the default).
+ *
+ * Uploads may be queued from any thread.  cjelly_uploader_poll() and
+ * cjelly_uploader_wait() submit work to the graphics queue, and must be
+ * called from the thread that submits rendering work.  If the transfer queue
+ * is the graphics queue itself, every uploader function submits to it, and
+ * uploads must then also be made from that thread.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#ifndef CJELLY_UPLOAD_H
+#define CJELLY_UPLOAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+
+#include <cjelly/gpuallocator.h>
+#include <cjelly/types.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+
+/**
+ * @brief Default size of the staging ring, in bytes.
+ */
+#define CJELLY_UPLOADER_DEFAULT_STAGING_SIZE ((VkDeviceSize)32 << 20)
+
+
+/**
+ * @brief Opaque structure representing an upload queue.
+ */
+typedef struct CJellyUploader CJellyUploader;
+
+
+/**
+ * @brief Identifies the batch that an upload was recorded into.
+ *
+ * Zero is never a valid ticket, and is always ready.
+ */
+typedef uint64_t CJellyUploadTicket;
+
+
+/**
+ * @brief Creates an upload queue.
+ *
+ * @param device The logical device.
+ * @param allocator The allocator that provides the staging memory.
+ * @param graphicsQueueFamily The queue family of `graphicsQueue`.
+ * @param graphicsQueue The queue that uses the uploaded resources.
+ * @param graphicsQueueMutex Held while submitting to `graphicsQueue`, if
+ *   other threads use the queue as well, or NULL.
+ * @param transferQueueFamily The queue family of `transferQueue`.
+ * @param transferQueue The queue that executes the copies.  May be the same
+ *   as `graphicsQueue`.
+ * @param transferQueueMutex Held while submitting to `transferQueue`, or
+ *   NULL.  Must be the same as `graphicsQueueMutex` if the queues are the
+ *   same.
+ * @param stagingSize Size of the staging ring in bytes, or zero for
+ *   CJELLY_UPLOADER_DEFAULT_STAGING_SIZE.  Larger uploads still work, but use
+ *   a temporary staging buffer of their own.
+ * @return A pointer to the new uploader, or NULL on failure.
+ */
+CJellyUploader * cjelly_uploader_create(VkDevice device, CJellyGpuAllocator * allocator, uint32_t graphicsQueueFamily, VkQueue graphicsQueue, pthread_mutex_t * graphicsQueueMutex, uint32_t transferQueueFamily, VkQueue transferQueue, pthread_mutex_t * transferQueueMutex, VkDeviceSize stagingSize);
+
+
+/**
+ * @brief Destroys an upload queue, after waiting for all of its batches.
+ *
+ * Uploads that have not been flushed are discarded.
+ *
+ * @param uploader The uploader to destroy.  May be NULL.
+ */
+void cjelly_uploader_destroy(CJellyUploader * uploader);
+
+
+/**
+ * @brief Queues a copy of host data into a buffer.
+ *
+ * The data is copied into staging memory before the function returns.  The
+ * buffer must have been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT.
+ *
+ * @param uploader The uploader.
+ * @param buffer The destination buffer.
+ * @param offset The offset in `buffer` to copy to.
+ * @param data The data to copy.
+ * @param size The number of bytes to copy.
+ * @param outTicket Output pointer that receives the ticket of the upload.  May
+ *   be NULL.
+ * @return VK_SUCCESS, or the error that prevented the upload.
+ */
+VkResult cjelly_uploader_upload_buffer(CJellyUploader * uploader, VkBuffer buffer, VkDeviceSize offset, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket);
+
+
+/**
+ * @brief Queues a copy of host pixel data into the first mip level of a 2D
+ * color image.
+ *
+ * The image's previous contents are discarded, and it is left in
+ * VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.  The image must have been created
+ * with VK_IMAGE_USAGE_TRANSFER_DST_BIT.
+ *
+ * @param uploader The uploader.
+ * @param image The destination image.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param data The tightly packed pixel data.
+ * @param size The size of `data` in bytes.
+ * @param outTicket Output pointer that receives the ticket of the upload.  May
+ *   be NULL.
+ * @return VK_SUCCESS, or the error that prevented the upload.
+ */
+VkResult cjelly_uploader_upload_image(CJellyUploader * uploader, VkImage image, uint32_t width, uint32_t height, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket);
+
+
+/**
+ * @brief Queues a copy of host pixel data into the first mip level of a 2D
+ * color image, and the generation of the rest of its mip chain.
+ *
+ * Each level is blitted from the one before it on the graphics queue family,
+ * so the image must have been created with VK_IMAGE_USAGE_TRANSFER_SRC_BIT as
+ * well as VK_IMAGE_USAGE_TRANSFER_DST_BIT, and its format must support
+ * VK_FORMAT_FEATURE_BLIT_SRC_BIT and VK_FORMAT_FEATURE_BLIT_DST_BIT (and
+ * VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT for VK_FILTER_LINEAR) with
+ * optimal tiling.  Every level is left in
+ * VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once the upload is ready.
+ *
+ * @param uploader The uploader.
+ * @param image The destination image.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param mipLevels The number of mip levels of the image.  With 1, this is
+ *   the same as cjelly_uploader_upload_image().
+ * @param filter The filter used to shrink each level into the next.
+ * @param data The tightly packed pixel data of the first level.
+ * @param size The size of `data` in bytes.
+ * @param outTicket Output pointer that receives the ticket of the upload.  May
+ *   be NULL.
+ * @return VK_SUCCESS, or the error that prevented the upload.
+ */
+VkResult cjelly_uploader_upload_image_mipmapped(CJellyUploader * uploader, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkFilter filter, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket);
+
+
+/**
+ * @brief Queues a copy of host data into every mip level of a 2D color image.
+ *
+ * This is for mip chains that are built on the host, and in particular for
+ * block-compressed formats, which cannot be blitted.  Each level is tightly
+ * packed (rows of blocks, for a block-compressed format), and its offset must
+ * be a multiple of the format's texel block size.  Every level is left in
+ * VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, and the image must have been
+ * created with VK_IMAGE_USAGE_TRANSFER_DST_BIT.
+ *
+ * @param uploader The uploader.
+ * @param image The destination image.
+ * @param width The width of the first level in pixels.
+ * @param height The height of the first level in pixels.
+ * @param mipLevels The number of mip levels of the image.
+ * @param levelOffsets The offset of each level within `data`.
+ * @param data The data of every level.
+ * @param size The size of `data` in bytes.
+ * @param outTicket Output pointer that receives the ticket of the upload.  May
+ *   be NULL.
+ * @return VK_SUCCESS, or the error that prevented the upload.
+ */
+VkResult cjelly_uploader_upload_image_levels(CJellyUploader * uploader, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const VkDeviceSize * levelOffsets, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket);
+
+
+/**
+ * @brief Submits the batch that is currently being recorded.
+ *
+ * @param uploader The uploader.
+ * @param outTicket Output pointer that receives the ticket of the submitted
+ *   batch, or of the most recent batch if nothing was recorded.  May be NULL.
+ * @return VK_SUCCESS, or the error returned by vkQueueSubmit().
+ */
+VkResult cjelly_uploader_flush(CJellyUploader * uploader, CJellyUploadTicket * outTicket);
+
+
+/**
+ * @brief Retires finished batches without blocking.
+ *
+ * Staging memory behind finished batches becomes available again, and any
+ * resources that changed queue family ownership are acquired by the graphics
+ * queue.  Call this once per frame.
+ *
+ * @param uploader The uploader.
+ */
+void cjelly_uploader_poll(CJellyUploader * uploader);
+
+
+/**
+ * @brief Returns whether submitted work still needs cjelly_uploader_poll().
+ *
+ * An application that sleeps while it has nothing to draw should keep
+ * polling while this returns true, so that finished batches are retired and
+ * handed over to the graphics queue.  Uploads that have been queued but not
+ * flushed do not count.
+ *
+ * @param uploader The uploader.
+ * @return true if batches are pending or resources await their acquire.
+ */
+bool cjelly_uploader_is_busy(CJellyUploader * uploader);
+
+
+/**
+ * @brief Returns whether the resources of an upload may be used.
+ *
+ * Commands submitted to the graphics queue after this function returns true
+ * see the uploaded data.
+ *
+ * @param uploader The uploader.
+ * @param ticket The ticket of the upload.
+ * @return true if the upload is ready, or false if it is still in flight or
+ *   its batch could not be submitted (see cjelly_uploader_wait()).
+ */
+bool cjelly_uploader_is_ready(CJellyUploader * uploader, CJellyUploadTicket ticket);
+
+
+/**
+ * @brief Blocks until an upload is ready, flushing it first if necessary.
+ *
+ * @param uploader The uploader.
+ * @param ticket The ticket of the upload.
+ * @return VK_SUCCESS, or the error that prevented the upload from completing.
+ *   An upload whose batch could not be submitted is lost, and later calls
+ *   return the error of that submission for as long as the uploader
+ *   remembers it (at least the last 16 runs of consecutive failures).
+ */
+VkResult cjelly_uploader_wait(CJellyUploader * uploader, CJellyUploadTicket ticket);
+
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // CJELLY_UPLOAD_H
@@ -0,0 +1,616 @@
+/**
+ * @file bctexture.c
+ * @brief Block-compressed texture encoder implementation.
+ *
+ * @details
+ * Every encoder starts by fitting a line through the colors of a block: the
+ * line through their mean, along their principal axis (found by power
+ * iteration on the covariance matrix), from the projection of the lowest
+ * texel to that of the highest.  The ends of the line become the block's
+ * endpoints, and each texel is given the index of the nearest color that the
+ * quantized endpoints can interpolate.
+ *
+ * Blocks that hang over the right or bottom edge of a level are padded by
+ * repeating the edge texels, so that the padding does not skew the fit.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/bctexture.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Number of texels in a block (4 x 4).
+ */
+#define BLOCK_TEXELS 16
+
+/**
+ * @brief Number of power iterations used to find a block's principal axis.
+ */
+#define AXIS_ITERATIONS 8
+
+
+/**
+ * @brief The 4-bit interpolation weights of BC7, out of 64.
+ */
+static const uint8_t BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+
+/**
+ * @brief Copies a 4x4 block of RGBA texels out of a level.
+ *
+ * @param pixels The RGBA texels of the level.
+ * @param width The width of the level.
+ * @param height The height of the level.
+ * @param blockX The column of the block.
+ * @param blockY The row of the block.
+ * @param block Receives the texels of the block, in row-major order.
+ */
+static void load_block(const uint8_t * pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t block[BLOCK_TEXELS][4]) {
+  for (uint32_t y = 0; y < 4; ++y) {
+    uint32_t row = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+    for (uint32_t x = 0; x < 4; ++x) {
+      uint32_t column = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+      memcpy(block[y * 4 + x], pixels + ((size_t)row * width + column) * 4, 4);
+    }
+  }
+}
+
+
+/**
+ * @brief Fits a line through the texels of a block.
+ *
+ * @param block The texels of the block.
+ * @param channels The number of channels to fit (3 ignores alpha).
+ * @param low Receives the low end of the line.
+ * @param high Receives the high end of the line.
+ */
+static void fit_line(uint8_t block[BLOCK_TEXELS][4], int channels, float low[4], float high[4]) {
+  float mean[4] = {0};
+  for (int i = 0; i < BLOCK_TEXELS; ++i) {
+    for (int c = 0; c < channels; ++c) {
+      mean[c] += block[i][c];
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    mean[c] /= BLOCK_TEXELS;
+  }
+
+  float covariance[4][4] = {{0}};
+  for (int i = 0; i < BLOCK_TEXELS; ++i) {
+    for (int a = 0; a < channels; ++a) {
+      for (int b = 0; b < channels; ++b) {
+        covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+      }
+    }
+  }
+
+  // Start from the row of the channel that varies the most, which is never
+  // orthogonal to the principal axis unless the block is flat.
+  int widest = 0;
+  for (int c = 1; c < channels; ++c) {
+    if (covariance[c][c] > covariance[widest][widest]) {
+      widest = c;
+    }
+  }
+  float axis[4] = {0};
+  memcpy(axis, covariance[widest], sizeof(axis));
+  float length = 0;
+  for (int iteration = 0; iteration < AXIS_ITERATIONS; ++iteration) {
+    float next[4] = {0};
+    for (int a = 0; a < channels; ++a) {
+      for (int b = 0; b < channels; ++b) {
+        next[a] += covariance[a][b] * axis[b];
+      }
+    }
+    float largest = 0;
+    for (int c = 0; c < channels; ++c) {
+      float magnitude = next[c] < 0 ? -next[c] : next[c];
+      largest = magnitude > largest ? magnitude : largest;
+    }
+    if (largest == 0) {
+      break;
+    }
+    for (int c = 0; c < channels; ++c) {
+      axis[c] = next[c] / largest;
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    length += axis[c] * axis[c];
+  }
+
+  float lowest = 0;
+  float highest = 0;
+  if (length > 0) {
+    for (int i = 0; i < BLOCK_TEXELS; ++i) {
+      float t = 0;
+      for (int c = 0; c < channels; ++c) {
+        t += (block[i][c] - mean[c]) * axis[c];
+      }
+      t /= length;
+      lowest = t < lowest ? t : lowest;
+      highest = t > highest ? t : highest;
+    }
+  }
+  for (int c = 0; c < 4; ++c) {
+    low[c] = c < channels ? mean[c] + lowest * axis[c] : 255;
+    high[c] = c < channels ? mean[c] + highest * axis[c] : 255;
+    low[c] = low[c] < 0 ? 0 : low[c] > 255 ? 255 : low[c];
+    high[c] = high[c] < 0 ? 0 : high[c] > 255 ? 255 : high[c];
+  }
+}
+
+
+/**
+ * @brief Returns the squared distance between two colors.
+ */
+static inline int color_distance(const uint8_t a[4], const int b[4], int channels) {
+  int distance = 0;
+  for (int c = 0; c < channels; ++c) {
+    int d = a[c] - b[c];
+    distance += d * d;
+  }
+  return distance;
+}
+
+
+/**
+ * @brief Quantizes a color to RGB565.
+ */
+static uint16_t pack_565(const float color[4]) {
+  uint16_t r = (uint16_t)(color[0] * 31 / 255 + 0.5f);
+  uint16_t g = (uint16_t)(color[1] * 63 / 255 + 0.5f);
+  uint16_t b = (uint16_t)(color[2] * 31 / 255 + 0.5f);
+  return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+
+/**
+ * @brief Expands an RGB565 color to 8 bits per channel, as the GPU does.
+ */
+static void unpack_565(uint16_t packed, int color[4]) {
+  int r = packed >> 11;
+  int g = (packed >> 5) & 0x3F;
+  int b = packed & 0x1F;
+  color[0] = r << 3 | r >> 2;
+  color[1] = g << 2 | g >> 4;
+  color[2] = b << 3 | b >> 2;
+  color[3] = 255;
+}
+
+
+/**
+ * @brief Encodes the color of a block as a BC1 block.
+ *
+ * The first endpoint is always the larger, which selects the four-color mode
+ * (the only mode that BC3 supports).
+ *
+ * @param block The texels of the block.
+ * @param out Receives the 8 bytes of the block.
+ */
+static void encode_color_block(uint8_t block[BLOCK_TEXELS][4], uint8_t out[8]) {
+  float low[4];
+  float high[4];
+  fit_line(block, 3, low, high);
+  uint16_t color0 = pack_565(high);
+  uint16_t color1 = pack_565(low);
+  if (color0 < color1) {
+    uint16_t swap = color0;
+    color0 = color1;
+    color1 = swap;
+  }
+
+  // With equal endpoints, every index selects the same color.
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    int palette[4][4];
+    unpack_565(color0, palette[0]);
+    unpack_565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < BLOCK_TEXELS; ++i) {
+      uint32_t best = 0;
+      int bestDistance = color_distance(block[i], palette[0], 3);
+      for (uint32_t entry = 1; entry < 4; ++entry) {
+        int distance = color_distance(block[i], palette[entry], 3);
+        if (distance < bestDistance) {
+          best = entry;
+          bestDistance = distance;
+        }
+      }
+      indices |= best << (2 * i);
+    }
+  }
+
+  out[0] = (uint8_t)color0;
+  out[1] = (uint8_t)(color0 >> 8);
+  out[2] = (uint8_t)color1;
+  out[3] = (uint8_t)(color1 >> 8);
+  for (int i = 0; i < 4; ++i) {
+    out[4 + i] = (uint8_t)(indices >> (8 * i));
+  }
+}
+
+
+/**
+ * @brief Encodes the alpha of a block as a BC3 alpha block.
+ *
+ * The endpoints are the extremes of the block, in the order that selects the
+ * eight-value mode, so each index is the alpha's rounded step between them.
+ *
+ * @param block The texels of the block.
+ * @param out Receives the 8 bytes of the block.
+ */
+static void encode_alpha_block(uint8_t block[BLOCK_TEXELS][4], uint8_t out[8]) {
+  int lowest = 255;
+  int highest = 0;
+  for (int i = 0; i < BLOCK_TEXELS; ++i) {
+    lowest = block[i][3] < lowest ? block[i][3] : lowest;
+    highest = block[i][3] > highest ? block[i][3] : highest;
+  }
+
+  uint64_t indices = 0;
+  if (highest > lowest) {
+    int range = highest - lowest;
+    for (int i = 0; i < BLOCK_TEXELS; ++i) {
+      // Step 7 is the first endpoint (index 0), step 0 the second (index 1),
+      // and the steps between are stored in reverse from index 2.
+      int step = ((block[i][3] - lowest) * 14 + range) / (2 * range);
+      uint64_t index = step == 7 ? 0 : step == 0 ? 1 : (uint64_t)(8 - step);
+      indices |= index << (3 * i);
+    }
+  }
+
+  out[0] = (uint8_t)highest;
+  out[1] = (uint8_t)lowest;
+  for (int i = 0; i < 6; ++i) {
+    out[2 + i] = (uint8_t)(indices >> (8 * i));
+  }
+}
+
+
+/**
+ * @brief Quantizes a BC7 mode 6 endpoint to 7 bits per channel and a shared
+ * low bit, picking whichever low bit fits better.
+ *
+ * @param color The endpoint.
+ * @param outQuantized Receives the 7-bit channels.
+ * @param outBit Receives the shared low bit.
+ */
+static void quantize_bc7_endpoint(const float color[4], uint8_t outQuantized[4], uint8_t * outBit) {
+  float bestError = -1;
+  for (uint8_t bit = 0; bit < 2; ++bit) {
+    uint8_t quantized[4];
+    float error = 0;
+    for (int c = 0; c < 4; ++c) {
+      int value = (int)((color[c] - bit) / 2 + 0.5f);
+      value = value < 0 ? 0 : value > 127 ? 127 : value;
+      quantized[c] = (uint8_t)value;
+      float d = (float)(value << 1 | bit) - color[c];
+      error += d * d;
+    }
+    if (bestError < 0 || error < bestError) {
+      bestError = error;
+      memcpy(outQuantized, quantized, 4);
+      *outBit = bit;
+    }
+  }
+}
+
+
+/**
+ * @brief Appends a field to a block, least significant bit first.
+ */
+static void put_bits(uint8_t out[16], uint32_t * position, uint32_t value, uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i, ++*position) {
+    out[*position >> 3] |= (uint8_t)(((value >> i) & 1) << (*position & 7));
+  }
+}
+
+
+/**
+ * @brief Encodes a block as a BC7 mode 6 block.
+ *
+ * @param block The texels of the block.
+ * @param out Receives the 16 bytes of the block.
+ */
+static void encode_bc7_block(uint8_t block[BLOCK_TEXELS][4], uint8_t out[16]) {
+  float low[4];
+  float high[4];
+  fit_line(block, 4, low, high);
+  uint8_t endpoints[2][4];
+  uint8_t bits[2];
+  quantize_bc7_endpoint(low, endpoints[0], &bits[0]);
+  quantize_bc7_endpoint(high, endpoints[1], &bits[1]);
+
+  int palette[16][4];
+  for (int c = 0; c < 4; ++c) {
+    int e0 = endpoints[0][c] << 1 | bits[0];
+    int e1 = endpoints[1][c] << 1 | bits[1];
+    for (int entry = 0; entry < 16; ++entry) {
+      palette[entry][c] = ((64 - BC7_WEIGHTS[entry]) * e0 + BC7_WEIGHTS[entry] * e1 + 32) >> 6;
+    }
+  }
+  uint32_t indices[BLOCK_TEXELS];
+  for (int i = 0; i < BLOCK_TEXELS; ++i) {
+    indices[i] = 0;
+    int bestDistance = color_distance(block[i], palette[0], 4);
+    for (uint32_t entry = 1; entry < 16; ++entry) {
+      int distance = color_distance(block[i], palette[entry], 4);
+      if (distance < bestDistance) {
+        indices[i] = entry;
+        bestDistance = distance;
+      }
+    }
+  }
+
+  // The first index is stored without its high bit, which must therefore be
+  // clear.  Swapping the endpoints mirrors every index.
+  if (indices[0] & 0x8) {
+    uint8_t swap[4];
+    memcpy(swap, endpoints[0], 4);
+    memcpy(endpoints[0], endpoints[1], 4);
+    memcpy(endpoints[1], swap, 4);
+    uint8_t bit = bits[0];
+    bits[0] = bits[1];
+    bits[1] = bit;
+    for (int i = 0; i < BLOCK_TEXELS; ++i) {
+      indices[i] = 15 - indices[i];
+    }
+  }
+
+  memset(out, 0, 16);
+  uint32_t position = 0;
+  put_bits(out, &position, 1 << 6, 7);
+  for (int c = 0; c < 4; ++c) {
+    put_bits(out, &position, endpoints[0][c], 7);
+    put_bits(out, &position, endpoints[1][c], 7);
+  }
+  put_bits(out, &position, bits[0], 1);
+  put_bits(out, &position, bits[1], 1);
+  put_bits(out, &position, indices[0], 3);
+  for (int i = 1; i < BLOCK_TEXELS; ++i) {
+    put_bits(out, &position, indices[i], 4);
+  }
+}
+
+
+/**
+ * @brief Encodes one level of a texture.
+ *
+ * @param pixels The RGBA texels of the level.
+ * @param width The width of the level.
+ * @param height The height of the level.
+ * @param format The block-compressed format.
+ * @param out Receives the blocks of the level.
+ */
+static void encode_level(const uint8_t * pixels, uint32_t width, uint32_t height, VkFormat format, uint8_t * out) {
+  uint32_t blockSize = cjelly_bc_texture_block_size(format);
+  uint8_t block[BLOCK_TEXELS][4];
+  for (uint32_t blockY = 0; blockY < (height + 3) / 4; ++blockY) {
+    for (uint32_t blockX = 0; blockX < (width + 3) / 4; ++blockX, out += blockSize) {
+      load_block(pixels, width, height, blockX, blockY, block);
+      switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+          encode_color_block(block, out);
+          break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+          encode_alpha_block(block, out);
+          encode_color_block(block, out + 8);
+          break;
+        default:
+          encode_bc7_block(block, out);
+          break;
+      }
+    }
+  }
+}
+
+
+/**
+ * @brief Shrinks a level to half its size with a 2x2 box filter.
+ *
+ * An odd edge repeats its last texel.
+ *
+ * @param source The RGBA texels of the level.
+ * @param width The width of the level.
+ * @param height The height of the level.
+ * @param destination Receives the RGBA texels of the next level.
+ */
+static void downsample(const uint8_t * source, uint32_t width, uint32_t height, uint8_t * destination) {
+  uint32_t nextWidth = width > 1 ? width / 2 : 1;
+  uint32_t nextHeight = height > 1 ? height / 2 : 1;
+  for (uint32_t y = 0; y < nextHeight; ++y) {
+    const uint8_t * row0 = source + (size_t)(2 * y < height ? 2 * y : height - 1) * width * 4;
+    const uint8_t * row1 = source + (size_t)(2 * y + 1 < height ? 2 * y + 1 : height - 1) * width * 4;
+    for (uint32_t x = 0; x < nextWidth; ++x) {
+      uint32_t x0 = (2 * x < width ? 2 * x : width - 1) * 4;
+      uint32_t x1 = (2 * x + 1 < width ? 2 * x + 1 : width - 1) * 4;
+      for (uint32_t c = 0; c < 4; ++c) {
+        *destination++ = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+      }
+    }
+  }
+}
+
+
+/**
+ * @brief Returns whether the device can sample and filter a format.
+ */
+static bool can_sample(VkPhysicalDevice physicalDevice, VkFormat format) {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+  VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+    | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (properties.optimalTilingFeatures & required) == required;
+}
+
+
+bool cjelly_bc_texture_choose_formats(VkPhysicalDevice physicalDevice, VkFormat * outOpaqueFormat, VkFormat * outAlphaFormat) {
+  if (!can_sample(physicalDevice, VK_FORMAT_BC1_RGB_UNORM_BLOCK)) {
+    return false;
+  }
+  *outOpaqueFormat = VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+  if (can_sample(physicalDevice, VK_FORMAT_BC7_UNORM_BLOCK)) {
+    *outAlphaFormat = VK_FORMAT_BC7_UNORM_BLOCK;
+    return true;
+  }
+  if (can_sample(physicalDevice, VK_FORMAT_BC3_UNORM_BLOCK)) {
+    *outAlphaFormat = VK_FORMAT_BC3_UNORM_BLOCK;
+    return true;
+  }
+  return false;
+}
+
+
+bool cjelly_bc_texture_image_has_alpha(const CJellyFormatImageRaw * image) {
+  if (image->channels != 4 || !image->data) {
+    return false;
+  }
+  size_t count = (size_t)image->width * image->height;
+  for (size_t i = 0; i < count; ++i) {
+    if (image->data[i * 4 + 3] != 255) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+uint32_t cjelly_bc_texture_block_size(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+      return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+
+bool cjelly_bc_texture_layout(CJellyBcTexture * texture) {
+  uint32_t blockSize = cjelly_bc_texture_block_size(texture->format);
+  if (!blockSize || !texture->width || !texture->height) {
+    return false;
+  }
+  texture->mipLevels = 0;
+  texture->size = 0;
+  uint32_t width = texture->width;
+  uint32_t height = texture->height;
+  for (;;) {
+    uint32_t level = texture->mipLevels++;
+    texture->levelOffsets[level] = texture->size;
+    texture->levelSizes[level] = (VkDeviceSize)((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+    texture->size += texture->levelSizes[level];
+    if (width == 1 && height == 1) {
+      return true;
+    }
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+}
+
+
+CJellyBcTextureError cjelly_bc_texture_encode(const CJellyFormatImageRaw * image, VkFormat format, CJellyBcTexture * * outTexture) {
+  CJellyBcTextureError err = CJELLY_BC_TEXTURE_SUCCESS;
+
+  // Check for invalid input.
+  if (!image || !outTexture) {
+    return CJELLY_BC_TEXTURE_ERR_IMAGE;
+  }
+  uint32_t blockSize = cjelly_bc_texture_block_size(format);
+  if (!blockSize) {
+    return CJELLY_BC_TEXTURE_ERR_FORMAT;
+  }
+  if (!image->data || image->width <= 0 || image->height <= 0
+      || (image->channels != 3 && image->channels != 4)
+      || image->bitdepth != (size_t)image->channels * 8
+      || image->data_size < (size_t)image->width * (size_t)image->height * (size_t)image->channels) {
+    return CJELLY_BC_TEXTURE_ERR_IMAGE;
+  }
+
+  CJellyBcTexture * texture = (CJellyBcTexture *)calloc(1, sizeof(CJellyBcTexture));
+  if (!texture) {
+    return CJELLY_BC_TEXTURE_ERR_OUT_OF_MEMORY;
+  }
+  texture->format = format;
+  texture->width = (uint32_t)image->width;
+  texture->height = (uint32_t)image->height;
+  cjelly_bc_texture_layout(texture);
+
+  size_t texelCount = (size_t)texture->width * texture->height;
+  texture->data = (unsigned char *)malloc((size_t)texture->size);
+  uint8_t * pixels = (uint8_t *)malloc(texelCount * 4);
+  uint8_t * next = (uint8_t *)malloc((size_t)(texture->width > 1 ? texture->width / 2 : 1)
+    * (texture->height > 1 ? texture->height / 2 : 1) * 4);
+  if (!texture->data || !pixels || !next) {
+    err = CJELLY_BC_TEXTURE_ERR_OUT_OF_MEMORY;
+    goto ERROR_CLEANUP;
+  }
+
+  // Expand the image to RGBA, which every level is built and encoded from.
+  for (size_t i = 0; i < texelCount; ++i) {
+    memcpy(pixels + i * 4, image->data + i * image->channels, (size_t)image->channels);
+    if (image->channels == 3) {
+      pixels[i * 4 + 3] = 255;
+    }
+  }
+
+  uint32_t width = texture->width;
+  uint32_t height = texture->height;
+  for (uint32_t level = 0; level < texture->mipLevels; ++level) {
+    encode_level(pixels, width, height, format, texture->data + texture->levelOffsets[level]);
+    if (level + 1 < texture->mipLevels) {
+      // Each level is smaller than the last, so the buffers can be swapped.
+      downsample(pixels, width, height, next);
+      uint8_t * swap = pixels;
+      pixels = next;
+      next = swap;
+      width = width > 1 ? width / 2 : 1;
+      height = height > 1 ? height / 2 : 1;
+    }
+  }
+
+  free(pixels);
+  free(next);
+  *outTexture = texture;
+  return CJELLY_BC_TEXTURE_SUCCESS;
+
+  // Error handling.
+ERROR_CLEANUP:
+  free(pixels);
+  free(next);
+  cjelly_bc_texture_free(texture);
+  return err;
+}
+
+
+void cjelly_bc_texture_free(CJellyBcTexture * texture) {
+  if (!texture) return;
+  free(texture->data);
+  free(texture);
+}
+
+
+const char * cjelly_bc_texture_strerror(CJellyBcTextureError err) {
+  switch (err) {
+    case CJELLY_BC_TEXTURE_SUCCESS:
+      return "No error";
+    case CJELLY_BC_TEXTURE_ERR_OUT_OF_MEMORY:
+      return "Out of memory";
+    case CJELLY_BC_TEXTURE_ERR_IMAGE:
+      return "The image is empty, or not 8-bit RGB or RGBA";
+    case CJELLY_BC_TEXTURE_ERR_FORMAT:
+      return "The format cannot be encoded";
+    default:
+      return "Unknown error";
+  }
+}
@@ -0,0 +1,392 @@
+/**
+ * @file bctexturecache.c
+ * @brief Binary cache of block-compressed textures.
+ *
+ * @details
+ * File layout (all values in host byte order):
+ *
+ *   offset 0    BcTextureCacheHeader
+ *   offset 128  block section: every mip level, laid out by
+ *               cjelly_bc_texture_layout()
+ *
+ * The level offsets are not stored, since they follow from the format and
+ * dimensions, and the block section starts on a SECTION_ALIGNMENT boundary,
+ * which keeps every level aligned to its block size.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/bctexturecache.h>
+#include <cjelly/cachefile.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * @brief Identifies a BC texture cache file.
+ */
+#define BC_TEXTURE_CACHE_MAGIC "CJBC"
+
+/**
+ * @brief Version of the file layout.  Bump it whenever the layout, or the
+ * output of the encoders, changes.
+ */
+#define BC_TEXTURE_CACHE_VERSION 1
+
+/**
+ * @brief A known value, stored in host byte order, that detects caches written
+ * on a host with a different byte order.
+ */
+#define BC_TEXTURE_CACHE_BYTE_ORDER 0x01020304u
+
+/**
+ * @brief The cache records the stamp of its source image.
+ */
+#define BC_TEXTURE_CACHE_FLAG_HAS_SOURCE 0x1u
+
+/**
+ * @brief Alignment of the block section within the file.
+ */
+#define SECTION_ALIGNMENT 64
+
+
+/**
+ * @brief The header at the start of every cache file.
+ */
+typedef struct {
+  char magic[4];          /**< BC_TEXTURE_CACHE_MAGIC */
+  uint32_t version;       /**< BC_TEXTURE_CACHE_VERSION */
+  uint32_t byte_order;    /**< BC_TEXTURE_CACHE_BYTE_ORDER, as written by the host */
+  uint32_t header_size;   /**< sizeof(BcTextureCacheHeader) */
+  uint32_t format;        /**< VkFormat of the blocks */
+  uint32_t width;         /**< Width of the first level in pixels */
+  uint32_t height;        /**< Height of the first level in pixels */
+  uint32_t mip_levels;    /**< Number of levels */
+  uint32_t flags;         /**< BC_TEXTURE_CACHE_FLAG_* bits */
+  uint32_t reserved;      /**< Zero */
+  uint64_t source_size;   /**< Size of the source image in bytes */
+  int64_t source_mtime;   /**< Modification time of the source image */
+  uint64_t source_hash;   /**< Hash of the source image's contents */
+  uint64_t data_offset;   /**< Offset of the block section */
+  uint64_t data_bytes;    /**< Size of the block section */
+  uint64_t checksum;      /**< Hash of the block section */
+} BcTextureCacheHeader;
+
+_Static_assert(sizeof(BcTextureCacheHeader) == 88, "The BC texture cache header must not contain padding");
+
+
+struct CJellyBcTextureCache {
+  CJellyBcTexture mapped;    /**< The texture, with data that points into `view` */
+  CJellyBcTexture * owned;   /**< A heap-allocated texture that is used instead of `mapped`, or NULL */
+  CJellyCacheFileView view;  /**< The mapping of the cache file */
+};
+
+
+/**
+ * @brief Rounds an offset up to the next section boundary.
+ */
+static inline uint64_t align_section(uint64_t offset) {
+  return (offset + SECTION_ALIGNMENT - 1) & ~(uint64_t)(SECTION_ALIGNMENT - 1);
+}
+
+
+/**
+ * @brief Converts an error of the cache file helpers to a bc texture cache error.
+ */
+static CJellyBcTextureCacheError file_error(CJellyCacheFileError err) {
+  switch (err) {
+    case CJELLY_CACHE_FILE_SUCCESS:
+      return CJELLY_BC_TEXTURE_CACHE_SUCCESS;
+    case CJELLY_CACHE_FILE_ERR_OUT_OF_MEMORY:
+      return CJELLY_BC_TEXTURE_CACHE_ERR_OUT_OF_MEMORY;
+    case CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND:
+      return CJELLY_BC_TEXTURE_CACHE_ERR_FILE_NOT_FOUND;
+    default:
+      return CJELLY_BC_TEXTURE_CACHE_ERR_IO;
+  }
+}
+
+
+bool cjelly_bc_texture_cache_name(const char * source_path, char * buffer, size_t size) {
+  uint64_t hash = cjelly_hash_bytes(source_path, strlen(source_path), CJELLY_HASH_SEED);
+  int length = snprintf(buffer, size, "texture-%016llx.bc", (unsigned long long)hash);
+  return length > 0 && (size_t)length < size;
+}
+
+
+/**
+ * @brief Writes a texture to a cache file.
+ *
+ * @param texture The texture to store.
+ * @param stamp The stamp of the source image, or NULL to write a cache that
+ *   is never considered stale.
+ * @param cache_path Path of the cache file to write.
+ * @return CJellyBcTextureCacheError Error code indicating success or the type of failure.
+ */
+static CJellyBcTextureCacheError write_cache(const CJellyBcTexture * texture, const CJellyCacheFileStamp * stamp, const char * cache_path) {
+  CJellyBcTextureCacheError err = CJELLY_BC_TEXTURE_CACHE_SUCCESS;
+
+  // Check for invalid input.
+  if (!texture || !cache_path) {
+    return CJELLY_BC_TEXTURE_CACHE_ERR_INVALID;
+  }
+  CJellyBcTexture layout = {0};
+  layout.format = texture->format;
+  layout.width = texture->width;
+  layout.height = texture->height;
+  if (!cjelly_bc_texture_layout(&layout) || layout.mipLevels != texture->mipLevels || layout.size != texture->size) {
+    return CJELLY_BC_TEXTURE_CACHE_ERR_INVALID;
+  }
+
+  BcTextureCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BC_TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+  header.version = BC_TEXTURE_CACHE_VERSION;
+  header.byte_order = BC_TEXTURE_CACHE_BYTE_ORDER;
+  header.header_size = sizeof(BcTextureCacheHeader);
+  header.format = (uint32_t)texture->format;
+  header.width = texture->width;
+  header.height = texture->height;
+  header.mip_levels = texture->mipLevels;
+  header.data_offset = align_section(sizeof(BcTextureCacheHeader));
+  header.data_bytes = texture->size;
+  header.checksum = cjelly_hash_bytes(texture->data, (size_t)header.data_bytes, CJELLY_HASH_SEED);
+
+  if (stamp) {
+    header.flags |= BC_TEXTURE_CACHE_FLAG_HAS_SOURCE;
+    header.source_size = stamp->size;
+    header.source_mtime = stamp->mtime;
+    header.source_hash = stamp->hash;
+  }
+
+  // Write to a temporary file, and only replace the cache once it is complete.
+  CJellyCacheFileWriter writer;
+  err = file_error(cjelly_cache_file_begin(cache_path, &writer));
+  if (err != CJELLY_BC_TEXTURE_CACHE_SUCCESS) {
+    return err;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, writer.file) == 1
+    && cjelly_cache_file_pad(&writer, header.data_offset - sizeof(header))
+    && fwrite(texture->data, 1, (size_t)header.data_bytes, writer.file) == header.data_bytes;
+  return file_error(cjelly_cache_file_commit(&writer, written));
+}
+
+
+CJellyBcTextureCacheError cjelly_bc_texture_cache_write(const CJellyBcTexture * texture, const char * source_path, const char * cache_path) {
+  // Stamp the cache with the current state of its source.
+  CJellyCacheFileStamp stamp;
+  if (source_path) {
+    CJellyBcTextureCacheError err = file_error(cjelly_cache_file_stamp(source_path, &stamp));
+    if (err != CJELLY_BC_TEXTURE_CACHE_SUCCESS) {
+      return err;
+    }
+  }
+  return write_cache(texture, source_path ? &stamp : NULL, cache_path);
+}
+
+
+/**
+ * @brief Checks that a mapped cache file is intact and compatible, and lays
+ * out its texture.
+ *
+ * @param view The mapped file.
+ * @param texture Receives the layout of the texture.
+ * @return true if the cache can be used.
+ */
+static bool validate_cache(const CJellyCacheFileView * view, CJellyBcTexture * texture) {
+  BcTextureCacheHeader header;
+  if (view->size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, view->data, sizeof(header));
+
+  if (memcmp(header.magic, BC_TEXTURE_CACHE_MAGIC, sizeof(header.magic))
+      || header.version != BC_TEXTURE_CACHE_VERSION
+      || header.byte_order != BC_TEXTURE_CACHE_BYTE_ORDER
+      || header.header_size != sizeof(BcTextureCacheHeader)) {
+    return false;
+  }
+
+  // The format and dimensions determine the layout, which must match the
+  // header and fit inside the file.
+  memset(texture, 0, sizeof(*texture));
+  texture->format = (VkFormat)header.format;
+  texture->width = header.width;
+  texture->height = header.height;
+  if (!cjelly_bc_texture_layout(texture)
+      || texture->mipLevels != header.mip_levels
+      || texture->size != header.data_bytes
+      || header.data_offset % SECTION_ALIGNMENT
+      || header.data_offset < sizeof(header)
+      || header.data_offset > view->size || header.data_bytes > view->size - header.data_offset) {
+    return false;
+  }
+
+  return cjelly_hash_bytes(view->data + header.data_offset, (size_t)header.data_bytes, CJELLY_HASH_SEED) == header.checksum;
+}
+
+
+/**
+ * @brief Checks whether a cache's source image has changed.
+ *
+ * @param header The cache header.
+ * @param source_path The source image.
+ * @return true if the source has changed.  A source that cannot be found is
+ *   not considered changed, so that a cache can be shipped without its source.
+ */
+static bool source_changed(const BcTextureCacheHeader * header, const char * source_path) {
+  if (!(header->flags & BC_TEXTURE_CACHE_FLAG_HAS_SOURCE)) {
+    return false;
+  }
+  CJellyCacheFileStamp stamp;
+  stamp.size = header->source_size;
+  stamp.mtime = header->source_mtime;
+  stamp.hash = header->source_hash;
+  return cjelly_cache_file_stamp_changed(&stamp, source_path);
+}
+
+
+CJellyBcTextureCacheError cjelly_bc_texture_cache_open(const char * cache_path, const char * source_path, CJellyBcTextureCache * * outCache) {
+  CJellyBcTextureCacheError err = CJELLY_BC_TEXTURE_CACHE_SUCCESS;
+
+  // Check for invalid input.
+  if (!cache_path || !outCache) {
+    return CJELLY_BC_TEXTURE_CACHE_ERR_INVALID;
+  }
+
+  CJellyBcTextureCache * cache = (CJellyBcTextureCache *)calloc(1, sizeof(CJellyBcTextureCache));
+  if (!cache) {
+    return CJELLY_BC_TEXTURE_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  err = file_error(cjelly_cache_file_map(cache_path, &cache->view));
+  if (err != CJELLY_BC_TEXTURE_CACHE_SUCCESS) {
+    free(cache);
+    return err;
+  }
+
+  if (!validate_cache(&cache->view, &cache->mapped)) {
+    err = CJELLY_BC_TEXTURE_CACHE_ERR_INVALID;
+    goto ERROR_CLEANUP;
+  }
+  BcTextureCacheHeader header;
+  memcpy(&header, cache->view.data, sizeof(header));
+  if (source_path && source_changed(&header, source_path)) {
+    err = CJELLY_BC_TEXTURE_CACHE_ERR_STALE;
+    goto ERROR_CLEANUP;
+  }
+
+  // Point the texture straight at the mapped blocks.
+  cache->mapped.data = (unsigned char *)(cache->view.data + header.data_offset);
+
+  *outCache = cache;
+  return CJELLY_BC_TEXTURE_CACHE_SUCCESS;
+
+  // Error handling.
+ERROR_CLEANUP:
+  cjelly_bc_texture_cache_close(cache);
+  return err;
+}
+
+
+CJellyBcTextureCacheError cjelly_bc_texture_cache_load_image(const char * image_path, const char * cache_path, VkFormat opaqueFormat, VkFormat alphaFormat, CJellyBcTextureCache * * outCache) {
+  // Check for invalid input.
+  if (!image_path || !cache_path || !outCache) {
+    return CJELLY_BC_TEXTURE_CACHE_ERR_INVALID;
+  }
+
+  // A cache in a format that was not chosen for this device (for example,
+  // BC3 where BC7 is now available) is encoded again.
+  CJellyBcTextureCacheError err = cjelly_bc_texture_cache_open(cache_path, image_path, outCache);
+  if (err == CJELLY_BC_TEXTURE_CACHE_SUCCESS) {
+    VkFormat format = (*outCache)->mapped.format;
+    if (format == opaqueFormat || format == alphaFormat) {
+      return err;
+    }
+    cjelly_bc_texture_cache_close(*outCache);
+    *outCache = NULL;
+  }
+  else if (err == CJELLY_BC_TEXTURE_CACHE_ERR_OUT_OF_MEMORY) {
+    return err;
+  }
+
+  // The cache is missing, invalid, or stale, so encode it from the source.
+  // The source is stamped before it is read, so that if it changes while it
+  // is being encoded, the cache records the older stamp and is rebuilt the
+  // next time, rather than holding old blocks under the new stamp.
+  CJellyCacheFileStamp stamp;
+  if (cjelly_cache_file_stamp(image_path, &stamp) != CJELLY_CACHE_FILE_SUCCESS) {
+    return CJELLY_BC_TEXTURE_CACHE_ERR_SOURCE;
+  }
+  CJellyFormatImage * image;
+  if (cjelly_format_image_load(image_path, &image) != CJELLY_FORMAT_IMAGE_SUCCESS) {
+    return CJELLY_BC_TEXTURE_CACHE_ERR_SOURCE;
+  }
+  VkFormat format = cjelly_bc_texture_image_has_alpha(image->raw) ? alphaFormat : opaqueFormat;
+  CJellyBcTexture * texture = NULL;
+  CJellyBcTextureError textureErr = cjelly_bc_texture_encode(image->raw, format, &texture);
+  cjelly_format_image_free(image);
+  if (textureErr != CJELLY_BC_TEXTURE_SUCCESS) {
+    return textureErr == CJELLY_BC_TEXTURE_ERR_OUT_OF_MEMORY
+      ? CJELLY_BC_TEXTURE_CACHE_ERR_OUT_OF_MEMORY
+      : CJELLY_BC_TEXTURE_CACHE_ERR_SOURCE;
+  }
+
+  if (write_cache(texture, &stamp, cache_path) == CJELLY_BC_TEXTURE_CACHE_SUCCESS
+      && cjelly_bc_texture_cache_open(cache_path, NULL, outCache) == CJELLY_BC_TEXTURE_CACHE_SUCCESS) {
+    cjelly_bc_texture_free(texture);
+    return CJELLY_BC_TEXTURE_CACHE_SUCCESS;
+  }
+
+  // The cache could not be written, so hand out the texture that was just
+  // encoded.
+  CJellyBcTextureCache * cache = (CJellyBcTextureCache *)calloc(1, sizeof(CJellyBcTextureCache));
+  if (!cache) {
+    cjelly_bc_texture_free(texture);
+    return CJELLY_BC_TEXTURE_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  cache->owned = texture;
+  *outCache = cache;
+  return CJELLY_BC_TEXTURE_CACHE_SUCCESS;
+}
+
+
+const CJellyBcTexture * cjelly_bc_texture_cache_texture(const CJellyBcTextureCache * cache) {
+  return cache->owned ? cache->owned : &cache->mapped;
+}
+
+
+void cjelly_bc_texture_cache_close(CJellyBcTextureCache * cache) {
+  if (!cache) return;
+  cjelly_bc_texture_free(cache->owned);
+  cjelly_cache_file_unmap(&cache->view);
+  free(cache);
+}
+
+
+const char * cjelly_bc_texture_cache_strerror(CJellyBcTextureCacheError err) {
+  switch (err) {
+    case CJELLY_BC_TEXTURE_CACHE_SUCCESS:
+      return "No error";
+    case CJELLY_BC_TEXTURE_CACHE_ERR_OUT_OF_MEMORY:
+      return "Out of memory";
+    case CJELLY_BC_TEXTURE_CACHE_ERR_FILE_NOT_FOUND:
+      return "File not found or cannot be opened";
+    case CJELLY_BC_TEXTURE_CACHE_ERR_IO:
+      return "File could not be read, written, or mapped";
+    case CJELLY_BC_TEXTURE_CACHE_ERR_INVALID:
+      return "Not a compatible texture cache, or the cache is corrupt";
+    case CJELLY_BC_TEXTURE_CACHE_ERR_STALE:
+      return "The source image has changed since the cache was written";
+    case CJELLY_BC_TEXTURE_CACHE_ERR_SOURCE:
+      return "The source image could not be loaded or encoded";
+    default:
+      return "Unknown error";
+  }
+}
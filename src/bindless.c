@@ -0,0 +1,206 @@
+/**
+ * @file bindless.c
+ * @brief CJelly bindless texture table implementation.
+ *
+ * @details
+ * The table owns a descriptor pool that holds exactly its one set.  Slots are
+ * handed out from a stack of freed indices first, and then from the part of
+ * the array that has never been used, so no slot is ever searched for.  A
+ * mutex protects the stack and serializes writes to the set, which Vulkan
+ * requires even for update-after-bind descriptors.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/bindless.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct CJellyBindlessTable {
+  VkDevice device;                 /**< The logical device */
+  VkDescriptorPool descriptorPool; /**< Pool that holds the set */
+  VkDescriptorSet descriptorSet;   /**< The table's descriptors */
+  uint32_t capacity;               /**< Number of slots */
+  uint32_t nextUnused;             /**< Slots from here on have never been used */
+  uint32_t * freeSlots;            /**< Stack of freed slots */
+  uint32_t freeCount;              /**< Number of entries in `freeSlots` */
+  pthread_mutex_t mutex;           /**< Protects the slots and the set */
+};
+
+
+/**
+ * @brief Writes a texture to a slot.  The mutex must be held.
+ */
+static void write_slot(CJellyBindlessTable * table, uint32_t index, VkImageView imageView, VkSampler sampler) {
+  VkDescriptorImageInfo imageInfo = {0};
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  imageInfo.imageView = imageView;
+  imageInfo.sampler = sampler;
+
+  VkWriteDescriptorSet write = {0};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = table->descriptorSet;
+  write.dstBinding = 0;
+  write.dstArrayElement = index;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.descriptorCount = 1;
+  write.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(table->device, 1, &write, 0, NULL);
+}
+
+
+void cjelly_bindless_table_describe(uint32_t capacity, VkShaderStageFlags stageFlags, CJellyDescriptorSetLayoutDesc * desc) {
+  memset(desc, 0, sizeof(*desc));
+  desc->flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+  desc->bindingCount = 1;
+  desc->bindings[0].binding = 0;
+  desc->bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  desc->bindings[0].descriptorCount = capacity;
+  desc->bindings[0].stageFlags = stageFlags;
+  desc->bindingFlags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+      | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+      | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+}
+
+
+CJellyBindlessTable * cjelly_bindless_table_create(VkDevice device, VkDescriptorSetLayout layout, uint32_t capacity) {
+  if (capacity == 0) {
+    return NULL;
+  }
+
+  CJellyBindlessTable * table = malloc(sizeof(CJellyBindlessTable));
+  if (!table) {
+    goto ERROR_RETURN;
+  }
+  memset(table, 0, sizeof(CJellyBindlessTable));
+  table->device = device;
+  table->capacity = capacity;
+
+  table->freeSlots = malloc(sizeof(uint32_t) * capacity);
+  if (!table->freeSlots) {
+    goto ERROR_FREE_TABLE;
+  }
+
+  if (pthread_mutex_init(&table->mutex, NULL) != 0) {
+    goto ERROR_FREE_SLOTS;
+  }
+
+  VkDescriptorPoolSize poolSize = {0};
+  poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSize.descriptorCount = capacity;
+
+  VkDescriptorPoolCreateInfo poolInfo = {0};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  if (vkCreateDescriptorPool(device, &poolInfo, NULL, &table->descriptorPool) != VK_SUCCESS) {
+    goto ERROR_DESTROY_MUTEX;
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo = {0};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = table->descriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+  if (vkAllocateDescriptorSets(device, &allocInfo, &table->descriptorSet) != VK_SUCCESS) {
+    goto ERROR_DESTROY_POOL;
+  }
+
+  return table;
+
+  // Error handling.
+ERROR_DESTROY_POOL:
+  vkDestroyDescriptorPool(device, table->descriptorPool, NULL);
+
+ERROR_DESTROY_MUTEX:
+  pthread_mutex_destroy(&table->mutex);
+
+ERROR_FREE_SLOTS:
+  free(table->freeSlots);
+
+ERROR_FREE_TABLE:
+  free(table);
+
+ERROR_RETURN:
+  return NULL;
+}
+
+
+void cjelly_bindless_table_destroy(CJellyBindlessTable * table) {
+  if (!table) {
+    return;
+  }
+
+  // The set is freed with its pool.
+  vkDestroyDescriptorPool(table->device, table->descriptorPool, NULL);
+  pthread_mutex_destroy(&table->mutex);
+  free(table->freeSlots);
+  free(table);
+}
+
+
+CJellyBindlessError cjelly_bindless_table_add(CJellyBindlessTable * table, VkImageView imageView, VkSampler sampler, uint32_t * outIndex) {
+  pthread_mutex_lock(&table->mutex);
+
+  uint32_t index;
+  if (table->freeCount) {
+    index = table->freeSlots[--table->freeCount];
+  }
+  else if (table->nextUnused < table->capacity) {
+    index = table->nextUnused++;
+  }
+  else {
+    pthread_mutex_unlock(&table->mutex);
+    return CJELLY_BINDLESS_ERR_FULL;
+  }
+
+  write_slot(table, index, imageView, sampler);
+  pthread_mutex_unlock(&table->mutex);
+
+  *outIndex = index;
+  return CJELLY_BINDLESS_SUCCESS;
+}
+
+
+void cjelly_bindless_table_update(CJellyBindlessTable * table, uint32_t index, VkImageView imageView, VkSampler sampler) {
+  pthread_mutex_lock(&table->mutex);
+  if (index < table->nextUnused) {
+    write_slot(table, index, imageView, sampler);
+  }
+  pthread_mutex_unlock(&table->mutex);
+}
+
+
+void cjelly_bindless_table_remove(CJellyBindlessTable * table, uint32_t index) {
+  pthread_mutex_lock(&table->mutex);
+  // Every slot below nextUnused is either in use or on the stack, so the stack
+  // cannot overflow unless a slot is freed twice.
+  if (index < table->nextUnused && table->freeCount < table->nextUnused) {
+    table->freeSlots[table->freeCount++] = index;
+  }
+  pthread_mutex_unlock(&table->mutex);
+}
+
+
+VkDescriptorSet cjelly_bindless_table_set(const CJellyBindlessTable * table) {
+  return table->descriptorSet;
+}
+
+
+const char * cjelly_bindless_strerror(CJellyBindlessError err) {
+  switch (err) {
+    case CJELLY_BINDLESS_SUCCESS:
+      return "No error";
+    case CJELLY_BINDLESS_ERR_FULL:
+      return "The bindless table is full";
+    default:
+      return "Unknown error";
+  }
+}
@@ -0,0 +1,373 @@
+/**
+ * @file cachefile.c
+ * @brief File and hashing helpers shared by CJelly's caches.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/cachefile.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/**
+ * @brief Number of zero bytes written at a time by cjelly_cache_file_pad().
+ */
+#define PAD_CHUNK 64
+
+
+uint64_t cjelly_hash_bytes(const void * data, size_t size, uint64_t hash) {
+  const unsigned char * p = (const unsigned char *)data;
+  for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), p += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    hash = (hash ^ word) * CJELLY_HASH_PRIME;
+  }
+  for (; size; --size, ++p) {
+    hash = (hash ^ *p) * CJELLY_HASH_PRIME;
+  }
+  return hash;
+}
+
+
+/**
+ * @brief Creates a directory, unless it already exists.
+ */
+static bool make_directory(const char * path) {
+#ifdef _WIN32
+  if (CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS) {
+    return true;
+  }
+  DWORD attributes = GetFileAttributesA(path);
+  return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+  if (mkdir(path, 0755) == 0 || errno == EEXIST) {
+    return true;
+  }
+  // Some systems report EACCES rather than EEXIST for a directory that exists
+  // in a parent that the process may not write to.
+  struct stat info;
+  return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+
+/**
+ * @brief Creates a directory and every missing directory above it, like
+ * `mkdir -p`.
+ *
+ * The path is cut short at each separator in turn, and restored afterwards.
+ */
+static bool make_directories(char * path) {
+  for (char * cursor = path + 1; *cursor; ++cursor) {
+#ifdef _WIN32
+    // A drive such as "C:" cannot be created.
+    if ((*cursor != '\\' && *cursor != '/') || cursor[-1] == ':') {
+      continue;
+    }
+#else
+    if (*cursor != '/') {
+      continue;
+    }
+#endif
+    char separator = *cursor;
+    *cursor = '\0';
+    bool made = make_directory(path);
+    *cursor = separator;
+    if (!made) {
+      return false;
+    }
+  }
+  return make_directory(path);
+}
+
+
+CJellyCacheFileError cjelly_cache_file_path(const char * name, char * buffer, size_t size) {
+#ifdef _WIN32
+  const char * base = getenv("LOCALAPPDATA");
+  const char * parent = "";
+  const char separator = '\\';
+#else
+  const char * base = getenv("XDG_CACHE_HOME");
+  const char * parent = "";
+  const char separator = '/';
+  if (!base || !*base) {
+    base = getenv("HOME");
+    parent = "/.cache";
+  }
+#endif
+  if (!base || !*base) {
+    return CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND;
+  }
+
+  // Create every missing level of the directory, since neither the cache
+  // directory nor its parents need exist yet, then append the file name.
+  int length = snprintf(buffer, size, "%s%s%ccjelly", base, parent, separator);
+  if (length < 0 || (size_t)length >= size) {
+    return CJELLY_CACHE_FILE_ERR_INVALID;
+  }
+  if (!make_directories(buffer)) {
+    return CJELLY_CACHE_FILE_ERR_IO;
+  }
+  length = snprintf(buffer, size, "%s%s%ccjelly%c%s", base, parent, separator, separator, name);
+  if (length < 0 || (size_t)length >= size) {
+    return CJELLY_CACHE_FILE_ERR_INVALID;
+  }
+  return CJELLY_CACHE_FILE_SUCCESS;
+}
+
+
+CJellyCacheFileError cjelly_cache_file_map(const char * path, CJellyCacheFileView * view) {
+  view->data = NULL;
+  view->size = 0;
+
+#ifdef _WIN32
+
+  view->mapping = NULL;
+  view->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (view->file == INVALID_HANDLE_VALUE) {
+    return CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(view->file, &size)) {
+    CloseHandle(view->file);
+    return CJELLY_CACHE_FILE_ERR_IO;
+  }
+  view->size = (size_t)size.QuadPart;
+  if (view->size == 0) {
+    return CJELLY_CACHE_FILE_SUCCESS;
+  }
+  view->mapping = CreateFileMappingA(view->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!view->mapping) {
+    CloseHandle(view->file);
+    return CJELLY_CACHE_FILE_ERR_IO;
+  }
+  view->data = (const unsigned char *)MapViewOfFile(view->mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view->data) {
+    CloseHandle(view->mapping);
+    CloseHandle(view->file);
+    return CJELLY_CACHE_FILE_ERR_IO;
+  }
+
+#else
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return CJELLY_CACHE_FILE_ERR_IO;
+  }
+  view->size = (size_t)st.st_size;
+  if (view->size == 0) {
+    close(fd);
+    return CJELLY_CACHE_FILE_SUCCESS;
+  }
+  void * data = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return CJELLY_CACHE_FILE_ERR_IO;
+  }
+#ifdef POSIX_MADV_SEQUENTIAL
+  // Every caller reads the file from front to back.
+  posix_madvise(data, view->size, POSIX_MADV_SEQUENTIAL);
+#endif
+  view->data = (const unsigned char *)data;
+
+#endif
+
+  return CJELLY_CACHE_FILE_SUCCESS;
+}
+
+
+void cjelly_cache_file_unmap(CJellyCacheFileView * view) {
+#ifdef _WIN32
+
+  if (view->data) {
+    UnmapViewOfFile(view->data);
+  }
+  if (view->mapping) {
+    CloseHandle(view->mapping);
+  }
+  if (view->file && view->file != INVALID_HANDLE_VALUE) {
+    CloseHandle(view->file);
+  }
+  view->mapping = NULL;
+  view->file = NULL;
+
+#else
+
+  if (view->data) {
+    munmap((void *)view->data, view->size);
+  }
+
+#endif
+
+  view->data = NULL;
+  view->size = 0;
+}
+
+
+/**
+ * @brief Reads the size and modification time of a file.
+ *
+ * The modification time is in the platform's native resolution (nanoseconds
+ * on POSIX, 100 ns ticks on Windows); it is only ever compared for equality.
+ *
+ * @param path Path to the file.
+ * @param size Receives the size of the file.
+ * @param mtime Receives the modification time of the file.
+ * @return CJellyCacheFileError Error code indicating success or failure.
+ */
+static CJellyCacheFileError stat_file(const char * path, uint64_t * size, int64_t * mtime) {
+#ifdef _WIN32
+
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes)) {
+    return CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND;
+  }
+  *size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+  *mtime = (int64_t)(((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32)
+    | attributes.ftLastWriteTime.dwLowDateTime);
+
+#else
+
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND;
+  }
+  *size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+  *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+
+#endif
+
+  return CJELLY_CACHE_FILE_SUCCESS;
+}
+
+
+/**
+ * @brief Hashes the contents of a file.
+ *
+ * @param path Path to the file.
+ * @param hash Receives the hash.
+ * @return CJellyCacheFileError Error code indicating success or failure.
+ */
+static CJellyCacheFileError hash_file(const char * path, uint64_t * hash) {
+  CJellyCacheFileView view;
+  CJellyCacheFileError err = cjelly_cache_file_map(path, &view);
+  if (err != CJELLY_CACHE_FILE_SUCCESS) {
+    return err;
+  }
+  *hash = cjelly_hash_bytes(view.data, view.size, CJELLY_HASH_SEED);
+  cjelly_cache_file_unmap(&view);
+  return CJELLY_CACHE_FILE_SUCCESS;
+}
+
+
+CJellyCacheFileError cjelly_cache_file_stamp(const char * path, CJellyCacheFileStamp * stamp) {
+  CJellyCacheFileError err = stat_file(path, &stamp->size, &stamp->mtime);
+  if (err != CJELLY_CACHE_FILE_SUCCESS) {
+    return err;
+  }
+  return hash_file(path, &stamp->hash);
+}
+
+
+bool cjelly_cache_file_stamp_changed(const CJellyCacheFileStamp * stamp, const char * path) {
+  uint64_t size;
+  int64_t mtime;
+  if (stat_file(path, &size, &mtime) != CJELLY_CACHE_FILE_SUCCESS) {
+    return false;
+  }
+  if (size != stamp->size) {
+    return true;
+  }
+  if (mtime == stamp->mtime) {
+    return false;
+  }
+
+  // The file was touched, but its contents may well be the same (e.g., after
+  // a fresh checkout), so compare the contents before giving up on the cache.
+  uint64_t hash;
+  return hash_file(path, &hash) != CJELLY_CACHE_FILE_SUCCESS
+    || hash != stamp->hash;
+}
+
+
+CJellyCacheFileError cjelly_cache_file_begin(const char * path, CJellyCacheFileWriter * writer) {
+  writer->file = NULL;
+  writer->path = path;
+
+  size_t length = strlen(path);
+  writer->tempPath = (char *)malloc(length + sizeof(".tmp"));
+  if (!writer->tempPath) {
+    return CJELLY_CACHE_FILE_ERR_OUT_OF_MEMORY;
+  }
+  memcpy(writer->tempPath, path, length);
+  memcpy(writer->tempPath + length, ".tmp", sizeof(".tmp"));
+
+  writer->file = fopen(writer->tempPath, "wb");
+  if (!writer->file) {
+    free(writer->tempPath);
+    writer->tempPath = NULL;
+    return CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND;
+  }
+  return CJELLY_CACHE_FILE_SUCCESS;
+}
+
+
+bool cjelly_cache_file_pad(CJellyCacheFileWriter * writer, uint64_t count) {
+  static const unsigned char zeros[PAD_CHUNK] = {0};
+  while (count) {
+    size_t chunk = count < PAD_CHUNK ? (size_t)count : PAD_CHUNK;
+    if (fwrite(zeros, 1, chunk, writer->file) != chunk) {
+      return false;
+    }
+    count -= chunk;
+  }
+  return true;
+}
+
+
+CJellyCacheFileError cjelly_cache_file_commit(CJellyCacheFileWriter * writer, bool written) {
+  CJellyCacheFileError err = CJELLY_CACHE_FILE_SUCCESS;
+  if (fclose(writer->file) != 0) {
+    written = false;
+  }
+
+#ifdef _WIN32
+  // rename() does not replace an existing file on Windows.
+  if (written) {
+    remove(writer->path);
+  }
+#endif
+  if (!written || rename(writer->tempPath, writer->path) != 0) {
+    remove(writer->tempPath);
+    err = CJELLY_CACHE_FILE_ERR_IO;
+  }
+  free(writer->tempPath);
+  writer->file = NULL;
+  writer->tempPath = NULL;
+  return err;
+}
@@ -17,19 +17,51 @@
  * @copyright Copyright (C) 2025 Ghoti.io
  */
 
+// poll() and clock_gettime() are POSIX.
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <cjelly/cjelly.h>
+#include <cjelly/bctexturecache.h>
+#include <cjelly/cachefile.h>
 #include <cjelly/format/image.h>
+#include <cjelly/gpuallocator.h>
 #include <cjelly/macros.h>
+#include <cjelly/mesh.h>
+#include <cjelly/pipelinecache.h>
+#include <cjelly/pipelineregistry.h>
+#include <cjelly/recorder.h>
+#include <cjelly/scheduler.h>
+#include <cjelly/shadercache.h>
+#include <cjelly/threadpool.h>
+#include <cjelly/upload.h>
 #include <shaders/basic.frag.h>
 #include <shaders/basic.vert.h>
+#include <shaders/mesh.frag.h>
+#include <shaders/mesh.vert.h>
+#include <shaders/sprite.frag.h>
+#include <shaders/sprite.vert.h>
 #include <shaders/textured.frag.h>
 
+#ifndef _WIN32
+#include <X11/Xutil.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 // Global Vulkan objects shared among all windows.
 
 #ifdef _WIN32
@@ -46,25 +78,100 @@ VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 VkDevice device;
 VkQueue graphicsQueue;
 VkQueue presentQueue;
+VkQueue transferQueue;
+VkQueue computeQueue;
+
+// Vulkan requires that access to a queue is externally synchronized.  Frames
+// are submitted and presented by present threads, and uploads by the
+// uploader, so every use of a queue holds its mutex.  Queues that turn out to
+// be the same VkQueue share one.
+static pthread_mutex_t queueMutexes[3] = {PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+static pthread_mutex_t * graphicsQueueMutex = &queueMutexes[0];
+static pthread_mutex_t * presentQueueMutex = &queueMutexes[1];
+static pthread_mutex_t * transferQueueMutex = &queueMutexes[2];
+uint32_t graphicsQueueFamilyIndex;
+uint32_t presentQueueFamilyIndex;
+uint32_t transferQueueFamilyIndex;
+uint32_t computeQueueFamilyIndex;
 VkRenderPass renderPass;
 VkPipelineLayout pipelineLayout;
 VkPipeline graphicsPipeline;
 VkCommandPool commandPool;
 VkBuffer vertexBuffer;
-VkDeviceMemory vertexBufferMemory;
+CJellyGpuAllocation * vertexBufferMemory;
+
+// Global allocator for all device memory.
+CJellyGpuAllocator * gpuAllocator;
+
+// Global upload queue for buffer and image contents.
+CJellyUploader * uploader;
+
+// Global worker threads for command recording.
+CJellyThreadPool * threadPool;
+
+// Global pipeline cache, persisted in the per-user cache directory.
+VkPipelineCache pipelineCache;
+CJellyPipelineCacheError pipelineCacheStatus;
+uint64_t pipelineCreationTime;
+static char pipelineCachePath[4096];
+
+// Global pipeline registry, which owns every pipeline and layout.
+CJellyPipelineRegistry * pipelineRegistry;
+
+// Global shader module cache, and the optional directory of .spv files that
+// are loaded (and reloaded when they change) instead of the embedded shaders.
+CJellyShaderCache * shaderCache;
+const char * shaderDirectory;
+
+// Built-in shader modules, owned by shaderCache.  Each holds a reference,
+// which is moved to the new module when its file is reloaded, so that a
+// replaced module is destroyed once the registry has stopped using it.
+static VkShaderModule basicVertShader;
+static VkShaderModule basicFragShader;
+static VkShaderModule texturedFragShader;
+static VkShaderModule meshVertShader;
+static VkShaderModule meshFragShader;
+static VkShaderModule spriteVertShader;
+static VkShaderModule spriteFragShader;
+
+// Registry entries of the pipelines that the pre-recorded command buffers use.
+static CJellyPipeline * graphicsPipelineEntry;
+static CJellyPipeline * texturedPipelineEntry;
 
 // Global texture variables (declared in your header, defined here)
 VkPipeline texturedPipeline;
 VkPipelineLayout texturedPipelineLayout;
 VkImage textureImage;
-VkDeviceMemory textureImageMemory;
+CJellyGpuAllocation * textureImageMemory;
 VkImageView textureImageView;
 VkSampler textureSampler;
-VkDescriptorPool textureDescriptorPool;
-VkDescriptorSetLayout textureDescriptorSetLayout;
-VkDescriptorSet textureDescriptorSet;
+
+// The format and number of mip levels of textureImage.
+static VkFormat textureFormat;
+static uint32_t textureMipLevels;
+
+// Global bindless texture table, and the slot of the texture in it.
+CJellyBindlessTable * bindlessTextures;
+uint32_t textureTableIndex;
+
+// The number of slots in the bindless texture table, at most
+// BINDLESS_TEXTURE_CAPACITY, but fewer if the device cannot hold that many.
+#define BINDLESS_TEXTURE_CAPACITY 4096
+static uint32_t bindlessTextureCapacity;
+
+// Global cache of textures loaded from files, and its memory budget.
+CJellyTextureCache * textureCache;
+VkDeviceSize textureCacheBudget;
+
+// Whether VK_EXT_memory_budget is enabled on the device.
+static int memoryBudgetEnabled;
+
 VkBuffer vertexBufferTextured;
-VkDeviceMemory vertexBufferTexturedMemory;
+CJellyGpuAllocation * vertexBufferTexturedMemory;
+
+// Registry entry of the mesh pipeline (shared by all meshes).
+static CJellyPipeline * meshPipeline;
 
 
 // Global flag to indicate that the window should close.
@@ -97,17 +204,11 @@ typedef struct VertexTextured {
 // Forward declarations for helper functions (for texture loading):
 void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties, VkBuffer * buffer,
-    VkDeviceMemory * bufferMemory);
-void createImage(uint32_t width, uint32_t height, VkFormat format,
-    VkImageTiling tiling, VkImageUsageFlags usage,
+    CJellyGpuAllocation * * bufferMemory);
+void createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
+    VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
     VkMemoryPropertyFlags properties, VkImage * image,
-    VkDeviceMemory * imageMemory);
-VkCommandBuffer beginSingleTimeCommands(void);
-void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-void transitionImageLayout(VkImage image, VkFormat format,
-    VkImageLayout oldLayout, VkImageLayout newLayout);
-void copyBufferToImage(
-    VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+    CJellyGpuAllocation * * imageMemory);
 
 
 //
@@ -199,18 +300,52 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
 // Window procedure for Windows.
 #ifdef _WIN32
 
+// The thread that runs the window loop, woken by present threads with a
+// posted message.
+static DWORD loopThreadId;
+
 LRESULT CALLBACK WindowProc(
     HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+  CJellyWindow * win = (CJellyWindow *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
   switch (uMsg) {
   case WM_CLOSE:
     shouldClose = 1;
     PostQuitMessage(0);
     return 0;
+  case WM_PAINT:
+    // Let DefWindowProc() validate the window, so that the message is not sent
+    // again before the next frame.
+    if (win) {
+      win->needsRedraw = 1;
+    }
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+  case WM_SIZE:
+    // Messages sent while the window is being created arrive before the
+    // window has been associated with its CJellyWindow.
+    if (win) {
+      win->width = LOWORD(lParam);
+      win->height = HIWORD(lParam);
+      win->framebufferResized = 1;
+      win->needsRedraw = 1;
+    }
+    return 0;
   default:
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
   }
 }
 
+#else
+
+// Associates X11 window handles with their CJellyWindow structures.
+static XContext windowContext;
+
+// The WM_DELETE_WINDOW atom, looked up once when the first window is created.
+static Atom wmDeleteWindow;
+
+// Written to by present threads to wake the loop from waitForWindowEvents().
+// Created with the first present thread.
+static int wakePipe[2] = {-1, -1};
+
 #endif
 
 
@@ -232,6 +367,7 @@ void createPlatformWindow(
   win->handle = CreateWindowEx(0, "VulkanWindowClass", title,
       WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT, width, height, NULL,
       NULL, hInstance, NULL);
+  SetWindowLongPtr(win->handle, GWLP_USERDATA, (LONG_PTR)win);
   ShowWindow(win->handle, SW_SHOW);
 
 #else
@@ -240,9 +376,14 @@ void createPlatformWindow(
   win->handle =
       XCreateSimpleWindow(display, RootWindow(display, screen), 0, 0, width,
           height, 1, BlackPixel(display, screen), WhitePixel(display, screen));
-  Atom wmDelete = XInternAtom(display, "WM_DELETE_WINDOW", False);
+  if (!windowContext) {
+    windowContext = XUniqueContext();
+    wmDeleteWindow = XInternAtom(display, "WM_DELETE_WINDOW", False);
+  }
   XStoreName(display, win->handle, title);
-  XSetWMProtocols(display, win->handle, &wmDelete, 1);
+  XSetWMProtocols(display, win->handle, &wmDeleteWindow, 1);
+  XSelectInput(display, win->handle, StructureNotifyMask | ExposureMask);
+  XSaveContext(display, win->handle, windowContext, (XPointer)win);
   XMapWindow(display, win->handle);
 
 #endif
@@ -258,6 +399,25 @@ void createPlatformWindow(
 
 #ifdef _WIN32
 
+uint64_t getCurrentTimeInNanoseconds(void) {
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  // Split the conversion, so that the multiplication cannot overflow.
+  uint64_t seconds = (uint64_t)(counter.QuadPart / frequency.QuadPart);
+  uint64_t ticks = (uint64_t)(counter.QuadPart % frequency.QuadPart);
+  return seconds * 1000000000ULL +
+      ticks * 1000000000ULL / (uint64_t)frequency.QuadPart;
+}
+
+void waitForWindowEvents(int timeout) {
+  // Returns when a message arrives, or when the timeout expires.  Present
+  // threads post a message when a frame is ready.
+  MsgWaitForMultipleObjects(
+      0, NULL, FALSE, timeout < 0 ? INFINITE : (DWORD)timeout, QS_ALLINPUT);
+}
+
 void processWindowEvents() {
   MSG msg;
   while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
@@ -268,15 +428,58 @@ void processWindowEvents() {
 
 #else
 
+uint64_t getCurrentTimeInNanoseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void waitForWindowEvents(int timeout) {
+  // Xlib may already have read events into its queue, where poll() cannot
+  // see them.  XPending() also flushes requests that are still buffered.
+  if (XPending(display)) {
+    return;
+  }
+  // Present threads write to the wake pipe when a frame is ready.  poll()
+  // ignores the negative descriptor if there are none.
+  struct pollfd fds[2] = {0};
+  fds[0].fd = ConnectionNumber(display);
+  fds[0].events = POLLIN;
+  fds[1].fd = wakePipe[0];
+  fds[1].events = POLLIN;
+  poll(fds, 2, timeout);
+}
+
 void processWindowEvents() {
   while (XPending(display)) {
     XEvent event;
     XNextEvent(display, &event);
     if (event.type == ClientMessage) {
-      Atom wmDelete = XInternAtom(display, "WM_DELETE_WINDOW", False);
-      if ((Atom)event.xclient.data.l[0] == wmDelete) {
+      if ((Atom)event.xclient.data.l[0] == wmDeleteWindow) {
         shouldClose = 1;
       }
+      continue;
+    }
+
+    XPointer data;
+    if (XFindContext(display, event.xany.window, windowContext, &data)) {
+      continue;
+    }
+    CJellyWindow * win = (CJellyWindow *)data;
+    switch (event.type) {
+      case ConfigureNotify:
+        // ConfigureNotify is also sent when the window only moves.
+        if (event.xconfigure.width != win->width ||
+            event.xconfigure.height != win->height) {
+          win->width = event.xconfigure.width;
+          win->height = event.xconfigure.height;
+          win->framebufferResized = 1;
+          win->needsRedraw = 1;
+        }
+        break;
+      case Expose:
+        win->needsRedraw = 1;
+        break;
     }
   }
 }
@@ -284,6 +487,168 @@ void processWindowEvents() {
 #endif
 
 
+//
+// === RUN LOOP ===
+//
+
+// How long a window whose frame was deferred waits before it is retried.
+#define FRAME_RETRY_NANOSECONDS 1000000ULL
+
+static void collectPresentedFrames(
+    CJellyWindow * const * windows, int windowCount);
+static uint64_t completedFrameSerial(void);
+static void pollShaderFiles(void);
+static void settlePresentThreads(
+    CJellyWindow * const * windows, int windowCount);
+
+uint64_t getCurrentTimeInMilliseconds(void) {
+  return getCurrentTimeInNanoseconds() / 1000000ULL;
+}
+
+
+// Advance a fixed-rate window's deadline by one frame, carrying the
+// sub-nanosecond remainder so that the rate is exact over time.  Frames that
+// were missed entirely are skipped rather than rendered in a burst.
+static void advanceFixedFrameTime(CJellyWindow * win, uint64_t now) {
+  uint64_t period = 1000000000ULL / win->fixedFramerate;
+  win->nextFrameTime += period;
+  win->frameTimeRemainder += 1000000000U % win->fixedFramerate;
+  if (win->frameTimeRemainder >= win->fixedFramerate) {
+    win->frameTimeRemainder -= win->fixedFramerate;
+    win->nextFrameTime++;
+  }
+  if (win->nextFrameTime <= now) {
+    win->nextFrameTime += ((now - win->nextFrameTime) / period + 1) * period;
+  }
+}
+
+
+void runWindowLoop(CJellyWindow * const * windows, int windowCount) {
+  CJellyFrameScheduler * scheduler = cjelly_frame_scheduler_create();
+  uint32_t * ids = malloc(sizeof(uint32_t) * windowCount);
+  if (!scheduler || !ids) {
+    fprintf(stderr, "Failed to create frame scheduler\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint64_t now = getCurrentTimeInNanoseconds();
+  for (int i = 0; i < windowCount; ++i) {
+    CJellyWindow * win = windows[i];
+    ids[i] = cjelly_frame_scheduler_add(scheduler, win);
+    if (ids[i] == CJELLY_FRAME_SCHEDULER_INVALID_ID) {
+      fprintf(stderr, "Failed to create frame scheduler\n");
+      exit(EXIT_FAILURE);
+    }
+    if (win->updateMode != CJELLY_UPDATE_MODE_EVENT_DRIVEN) {
+      win->nextFrameTime = now;
+      win->frameTimeRemainder = 0;
+      cjelly_frame_scheduler_set_deadline(scheduler, ids[i], now);
+    }
+  }
+
+  while (!shouldClose) {
+    processWindowEvents();
+    uint64_t completedSerial = completedFrameSerial();
+    cjelly_texture_cache_next_frame(textureCache, completedSerial);
+    cjelly_pipeline_registry_next_frame(pipelineRegistry, completedSerial);
+    cjelly_uploader_poll(uploader);
+    collectPresentedFrames(windows, windowCount);
+    if (shaderDirectory) {
+      pollShaderFiles();
+    }
+
+    // Events mark event-driven windows for redraw.  Scanning the flags is
+    // cheap next to processing the events that set them.
+    now = getCurrentTimeInNanoseconds();
+    for (int i = 0; i < windowCount; ++i) {
+      if (windows[i]->updateMode == CJELLY_UPDATE_MODE_EVENT_DRIVEN &&
+          windows[i]->needsRedraw) {
+        cjelly_frame_scheduler_set_deadline_min(scheduler, ids[i], now);
+      }
+    }
+
+    // Render every window whose deadline has passed.  Each one is given a
+    // new deadline later than `now`, so that it is rendered at most once per
+    // iteration.
+    CJellyWindow * win;
+    uint32_t id;
+    while ((win = cjelly_frame_scheduler_pop(scheduler, now, &id))) {
+      switch (win->updateMode) {
+        case CJELLY_UPDATE_MODE_VSYNC:
+          // The swap chain throttles VSync windows: once every image is
+          // queued, frames are deferred until one is handed back.
+          if (win->renderCallback) {
+            win->renderCallback(win);
+          }
+          cjelly_frame_scheduler_set_deadline(scheduler, id,
+              win->frameDeferred ? now + FRAME_RETRY_NANOSECONDS : now + 1);
+          break;
+        case CJELLY_UPDATE_MODE_FIXED:
+          if (!win->fixedFramerate) {
+            break;
+          }
+          if (win->renderCallback) {
+            win->renderCallback(win);
+          }
+          if (win->frameDeferred) {
+            cjelly_frame_scheduler_set_deadline(
+                scheduler, id, now + FRAME_RETRY_NANOSECONDS);
+          }
+          else {
+            advanceFixedFrameTime(win, now);
+            cjelly_frame_scheduler_set_deadline(
+                scheduler, id, win->nextFrameTime);
+          }
+          break;
+        case CJELLY_UPDATE_MODE_EVENT_DRIVEN:
+          // The flag is cleared first, so that a frame which could not be
+          // drawn (e.g., because the swap chain was out of date) can set it
+          // again.
+          win->needsRedraw = 0;
+          if (win->renderCallback) {
+            win->renderCallback(win);
+          }
+          if (win->frameDeferred) {
+            win->needsRedraw = 1;
+            cjelly_frame_scheduler_set_deadline(
+                scheduler, id, now + FRAME_RETRY_NANOSECONDS);
+          }
+          else if (win->needsRedraw) {
+            cjelly_frame_scheduler_set_deadline(scheduler, id, now + 1);
+          }
+          break;
+      }
+    }
+
+    // Sleep until the earliest deadline, or until an event arrives.  The
+    // timeout is rounded up, so that the loop does not wake before the
+    // deadline and spin.
+    int timeout = -1;
+    uint64_t deadline;
+    if (cjelly_frame_scheduler_next_deadline(scheduler, &deadline)) {
+      now = getCurrentTimeInNanoseconds();
+      uint64_t milliseconds =
+          deadline > now ? (deadline - now + 999999ULL) / 1000000ULL : 0;
+      timeout = milliseconds > INT_MAX ? INT_MAX : (int)milliseconds;
+    }
+
+    // Finished uploads are only handed over to the graphics queue when the
+    // uploader is polled, so keep waking up while any are in flight.
+    if (timeout != 0 && cjelly_uploader_is_busy(uploader)) {
+      timeout = 1;
+    }
+
+    if (timeout != 0 && !shouldClose) {
+      waitForWindowEvents(timeout);
+    }
+  }
+
+  settlePresentThreads(windows, windowCount);
+  free(ids);
+  cjelly_frame_scheduler_destroy(scheduler);
+}
+
+
 //
 // === PER-WINDOW VULKAN OBJECTS ===
 //
@@ -316,6 +681,71 @@ void createSurfaceForWindow(CJellyWindow * win) {
   }
 
 #endif
+
+  // The present family was chosen before the window had a surface.
+  VkBool32 supported = VK_FALSE;
+  vkGetPhysicalDeviceSurfaceSupportKHR(
+      physicalDevice, presentQueueFamilyIndex, win->surface, &supported);
+  if (!supported) {
+    fprintf(stderr, "Present queue family cannot present to the surface\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+// Choose the present mode for a window from the modes its surface supports.
+static VkPresentModeKHR choosePresentMode(CJellyWindow * win) {
+  CJellyPresentMode requested = win->presentMode;
+  if (requested == CJELLY_PRESENT_MODE_DEFAULT) {
+    // VSync windows rely on FIFO to throttle them.  Windows that pace their
+    // own frames want the newest frame on screen at the next vertical blank,
+    // which MAILBOX provides without tearing.
+    requested = win->updateMode == CJELLY_UPDATE_MODE_VSYNC
+        ? CJELLY_PRESENT_MODE_FIFO
+        : CJELLY_PRESENT_MODE_MAILBOX;
+  }
+
+  // Each mode lists its preferred fallbacks.  FIFO is always supported.
+  VkPresentModeKHR candidates[3];
+  uint32_t candidateCount = 0;
+  switch (requested) {
+    case CJELLY_PRESENT_MODE_IMMEDIATE:
+      candidates[candidateCount++] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+      candidates[candidateCount++] = VK_PRESENT_MODE_MAILBOX_KHR;
+      break;
+    case CJELLY_PRESENT_MODE_MAILBOX:
+      candidates[candidateCount++] = VK_PRESENT_MODE_MAILBOX_KHR;
+      break;
+    case CJELLY_PRESENT_MODE_FIFO_RELAXED:
+      candidates[candidateCount++] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+      break;
+    default:
+      break;
+  }
+
+  uint32_t modeCount = 0;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(
+      physicalDevice, win->surface, &modeCount, NULL);
+  VkPresentModeKHR * modes = malloc(sizeof(VkPresentModeKHR) * modeCount);
+  if (modeCount && !modes) {
+    fprintf(stderr, "Failed to allocate present modes\n");
+    exit(EXIT_FAILURE);
+  }
+  vkGetPhysicalDeviceSurfacePresentModesKHR(
+      physicalDevice, win->surface, &modeCount, modes);
+
+  VkPresentModeKHR chosen = VK_PRESENT_MODE_FIFO_KHR;
+  for (uint32_t i = 0; i < candidateCount && chosen == VK_PRESENT_MODE_FIFO_KHR;
+      i++) {
+    for (uint32_t j = 0; j < modeCount; j++) {
+      if (modes[j] == candidates[i]) {
+        chosen = candidates[i];
+        break;
+      }
+    }
+  }
+  free(modes);
+  return chosen;
 }
 
 
@@ -325,23 +755,72 @@ void createSwapChainForWindow(CJellyWindow * win) {
   vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
       physicalDevice, win->surface, &capabilities);
 
-  // Setting the swap chain extent to the window's extent.
+  // Setting the swap chain extent to the window's extent.  Some platforms
+  // let the swap chain decide, and report a current extent of UINT32_MAX.
   win->swapChainExtent = capabilities.currentExtent;
+  if (capabilities.currentExtent.width == UINT32_MAX) {
+    win->swapChainExtent.width = (uint32_t)win->width;
+    win->swapChainExtent.height = (uint32_t)win->height;
+    if (win->swapChainExtent.width < capabilities.minImageExtent.width) {
+      win->swapChainExtent.width = capabilities.minImageExtent.width;
+    }
+    if (win->swapChainExtent.width > capabilities.maxImageExtent.width) {
+      win->swapChainExtent.width = capabilities.maxImageExtent.width;
+    }
+    if (win->swapChainExtent.height < capabilities.minImageExtent.height) {
+      win->swapChainExtent.height = capabilities.minImageExtent.height;
+    }
+    if (win->swapChainExtent.height > capabilities.maxImageExtent.height) {
+      win->swapChainExtent.height = capabilities.maxImageExtent.height;
+    }
+  }
+
+  win->swapChainPresentMode = choosePresentMode(win);
+
+  // FIFO modes get one image more than the minimum, so that a new image can
+  // be acquired while the presentation engine holds the others.  Without it,
+  // frames in flight would still wait on vkAcquireNextImageKHR().  MAILBOX
+  // needs at least three images: one on screen, one queued to replace it, and
+  // one to render to.  IMMEDIATE hands images back as soon as they are shown,
+  // and extra images would only add memory.
+  uint32_t imageCount = capabilities.minImageCount + 1;
+  if (win->swapChainPresentMode == VK_PRESENT_MODE_MAILBOX_KHR &&
+      imageCount < 3) {
+    imageCount = 3;
+  }
+  else if (win->swapChainPresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
+    imageCount = capabilities.minImageCount;
+  }
+  if (capabilities.maxImageCount > 0 &&
+      imageCount > capabilities.maxImageCount) {
+    imageCount = capabilities.maxImageCount;
+  }
 
   VkSwapchainCreateInfoKHR createInfo = {0};
   createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
   createInfo.surface = win->surface;
-  createInfo.minImageCount = capabilities.minImageCount;
+  createInfo.minImageCount = imageCount;
   createInfo.imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
   createInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
   createInfo.imageExtent = win->swapChainExtent;
   createInfo.imageArrayLayers = 1;
   createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // Images rendered by one queue family and presented by another are shared,
+  // rather than transferred between the families every frame.
+  uint32_t queueFamilyIndices[] = {
+      graphicsQueueFamilyIndex, presentQueueFamilyIndex};
+  if (graphicsQueueFamilyIndex != presentQueueFamilyIndex) {
+    createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+    createInfo.queueFamilyIndexCount = 2;
+    createInfo.pQueueFamilyIndices = queueFamilyIndices;
+  }
   createInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
   createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-  createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+  createInfo.presentMode = win->swapChainPresentMode;
   createInfo.clipped = VK_TRUE;
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+  // Handing over the old swap chain lets the driver reuse its resources, and
+  // lets images that are still being presented from it complete.
+  createInfo.oldSwapchain = win->swapChain;
 
   if (vkCreateSwapchainKHR(device, &createInfo, NULL, &win->swapChain) !=
       VK_SUCCESS) {
@@ -410,8 +889,41 @@ void createFramebuffersForWindow(CJellyWindow * win) {
 }
 
 
+// Hold the current version of a pipeline for the window's pre-recorded
+// command buffers.  It is released when they are freed.
+static VkPipeline holdPipelineForWindow(
+    CJellyWindow * win, CJellyPipeline * pipeline) {
+  VkPipeline handle = cjelly_pipeline_registry_hold(pipelineRegistry, pipeline);
+  if (handle == VK_NULL_HANDLE) {
+    fprintf(stderr, "Failed to create pipeline\n");
+    exit(EXIT_FAILURE);
+  }
+  win->heldPipeline = pipeline;
+  win->heldPipelineHandle = handle;
+  return handle;
+}
+
+// Free the window's pre-recorded command buffers, and release the pipeline
+// that they use.  None of them may still be executing.
+static void freeCommandBuffersForWindow(CJellyWindow * win) {
+  if (win->commandBuffers) {
+    vkFreeCommandBuffers(
+        device, commandPool, win->swapChainImageCount, win->commandBuffers);
+    free(win->commandBuffers);
+    win->commandBuffers = NULL;
+  }
+  if (win->heldPipeline) {
+    cjelly_pipeline_registry_release(
+        pipelineRegistry, win->heldPipeline, win->heldPipelineHandle);
+    win->heldPipeline = NULL;
+    win->heldPipelineHandle = VK_NULL_HANDLE;
+  }
+}
+
 // Allocate and record command buffers for a window.
 void createCommandBuffersForWindow(CJellyWindow * win) {
+  win->recordCommandBuffers = createCommandBuffersForWindow;
+  graphicsPipeline = holdPipelineForWindow(win, graphicsPipelineEntry);
   win->commandBuffers =
       malloc(sizeof(VkCommandBuffer) * win->swapChainImageCount);
   VkCommandBufferAllocateInfo allocInfo = {0};
@@ -487,58 +999,389 @@ void createCommandBuffersForWindow(CJellyWindow * win) {
 
 // Create synchronization objects for a window.
 void createSyncObjectsForWindow(CJellyWindow * win) {
-  VkSemaphoreCreateInfo semaphoreInfo = {0};
-  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-  if (vkCreateSemaphore(device, &semaphoreInfo, NULL,
-          &win->imageAvailableSemaphore) != VK_SUCCESS ||
-      vkCreateSemaphore(device, &semaphoreInfo, NULL,
-          &win->renderFinishedSemaphore) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create semaphores\n");
+  if (win->framesInFlight == 0) {
+    win->framesInFlight = CJELLY_DEFAULT_FRAMES_IN_FLIGHT;
+  }
+  win->frames = calloc(win->framesInFlight, sizeof(CJellyFrameSync));
+  win->imagesInFlight = calloc(win->swapChainImageCount, sizeof(VkFence));
+  if (!win->frames || !win->imagesInFlight) {
+    fprintf(stderr, "Failed to allocate frame synchronization objects\n");
     exit(EXIT_FAILURE);
   }
+  win->currentFrame = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {0};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
+  // Fences start signaled, so that the first use of each frame does not wait.
   VkFenceCreateInfo fenceInfo = {0};
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  if (vkCreateFence(device, &fenceInfo, NULL, &win->inFlightFence) !=
-      VK_SUCCESS) {
-    fprintf(stderr, "Failed to create fence\n");
+  for (uint32_t i = 0; i < win->framesInFlight; i++) {
+    CJellyFrameSync * frame = &win->frames[i];
+    if (vkCreateSemaphore(device, &semaphoreInfo, NULL,
+            &frame->imageAvailableSemaphore) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, NULL,
+            &frame->renderFinishedSemaphore) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to create semaphores\n");
+      exit(EXIT_FAILURE);
+    }
+
+    if (vkCreateFence(device, &fenceInfo, NULL, &frame->inFlightFence) !=
+        VK_SUCCESS) {
+      fprintf(stderr, "Failed to create fence\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// Destroy the swap chain that the window's last recreation replaced, once the
+// first frame rendered to its successor has finished, or at once if `force`
+// is set.  The frames of the window must not be in use by its present thread.
+static void releaseRetiredSwapChain(CJellyWindow * win, bool force) {
+  if (win->retiredSwapChain == VK_NULL_HANDLE) {
+    return;
+  }
+  if (!force && (!win->retiredSwapChainSerial ||
+                    completedFrameSerial() < win->retiredSwapChainSerial)) {
+    return;
+  }
+  vkDestroySwapchainKHR(device, win->retiredSwapChain, NULL);
+  win->retiredSwapChain = VK_NULL_HANDLE;
+  win->retiredSwapChainSerial = 0;
+}
+
+// Recreate the swap chain of a window, and everything that depends on it.
+int recreateSwapChainForWindow(CJellyWindow * win) {
+  // A minimized window has no area to render to.  Keep the old swap chain
+  // until the window is restored.
+  VkSurfaceCapabilitiesKHR capabilities;
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+      physicalDevice, win->surface, &capabilities);
+  if (capabilities.currentExtent.width == 0 ||
+      capabilities.currentExtent.height == 0 || win->width == 0 ||
+      win->height == 0) {
+    return 0;
+  }
+
+  // Wait for this window's own frames, rather than the whole device, so that
+  // the other windows keep rendering.
+  for (uint32_t i = 0; i < win->framesInFlight; i++) {
+    vkWaitForFences(
+        device, 1, &win->frames[i].inFlightFence, VK_TRUE, UINT64_MAX);
+  }
+
+  for (uint32_t i = 0; i < win->swapChainImageCount; i++) {
+    vkDestroyFramebuffer(device, win->swapChainFramebuffers[i], NULL);
+    vkDestroyImageView(device, win->swapChainImageViews[i], NULL);
+  }
+  free(win->swapChainFramebuffers);
+  free(win->swapChainImageViews);
+  free(win->swapChainImages);
+  freeCommandBuffersForWindow(win);
+
+  // The fences do not cover presentation, so presents of the old swap chain
+  // may still be pending.  It is kept until a frame rendered to the new one,
+  // which is presented after them, has finished, or at the latest until the
+  // swap chain is recreated again.
+  releaseRetiredSwapChain(win, true);
+  VkSwapchainKHR oldSwapChain = win->swapChain;
+  createSwapChainForWindow(win);
+  win->retiredSwapChain = oldSwapChain;
+  win->retiredSwapChainSerial = 0;
+
+  createImageViewsForWindow(win);
+  createFramebuffersForWindow(win);
+  if (win->recordCommandBuffers) {
+    win->recordCommandBuffers(win);
+  }
+
+  // The new swap chain may have a different number of images, none of which
+  // are in flight yet.
+  free(win->imagesInFlight);
+  win->imagesInFlight = calloc(win->swapChainImageCount, sizeof(VkFence));
+  if (!win->imagesInFlight) {
+    fprintf(stderr, "Failed to allocate frame synchronization objects\n");
+    exit(EXIT_FAILURE);
+  }
+
+  win->framebufferResized = 0;
+  return 1;
+}
+
+// Re-record the window's pre-recorded command buffers once the pipeline that
+// they use has been replaced, e.g., because one of its shaders was reloaded.
+// The frames of the window must not be in use by its present thread.
+static void refreshCommandBuffersForWindow(CJellyWindow * win) {
+  if (!win->heldPipeline ||
+      cjelly_pipeline_registry_is_current(
+          pipelineRegistry, win->heldPipeline, win->heldPipelineHandle)) {
+    return;
+  }
+  for (uint32_t i = 0; i < win->framesInFlight; i++) {
+    vkWaitForFences(
+        device, 1, &win->frames[i].inFlightFence, VK_TRUE, UINT64_MAX);
+  }
+  freeCommandBuffersForWindow(win);
+  win->recordCommandBuffers(win);
+}
+
+
+// Create the recorder that re-records the window's commands every frame.
+void createCommandRecorderForWindow(CJellyWindow * win) {
+  if (win->framesInFlight == 0) {
+    win->framesInFlight = CJELLY_DEFAULT_FRAMES_IN_FLIGHT;
+  }
+  if (win->recordJobCount == 0) {
+    win->recordJobCount = (uint32_t)cjelly_thread_pool_size(threadPool);
+  }
+
+  win->recorder = cjelly_command_recorder_create(
+      device, graphicsQueueFamilyIndex, win->framesInFlight, threadPool);
+  if (!win->recorder) {
+    fprintf(stderr, "Failed to create command recorder\n");
     exit(EXIT_FAILURE);
   }
 }
 
+//
+// === FRAME SERIALS ===
+//
+
+// Every frame that is recorded is numbered with the next serial, and stays
+// outstanding until its fence is seen signaled after it was submitted.
+// Resources that a frame's commands refer to, such as cached textures, are
+// tagged with its serial, and may be freed once completedFrameSerial() has
+// reached it.  Frames are recorded and submitted by present threads as well
+// as by the loop thread, so the list is guarded by a mutex.
+static pthread_mutex_t frameSerialMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t lastFrameSerial;
+static CJellyFrameSync * outstandingFrames;
+
+
+// Unlink a frame from outstandingFrames.  frameSerialMutex must be held.
+static void unlinkOutstandingFrame(CJellyFrameSync * frame) {
+  for (CJellyFrameSync ** link = &outstandingFrames; *link;
+       link = &(*link)->nextOutstanding) {
+    if (*link == frame) {
+      *link = frame->nextOutstanding;
+      break;
+    }
+  }
+  frame->serial = 0;
+}
+
+
+// Number a frame that is about to be recorded.  The previous submission of
+// its slot must have finished.
+static uint64_t beginFrameSerial(CJellyFrameSync * frame) {
+  pthread_mutex_lock(&frameSerialMutex);
+  if (!frame->serial) {
+    frame->nextOutstanding = outstandingFrames;
+    outstandingFrames = frame;
+  }
+  frame->serial = ++lastFrameSerial;
+  frame->submitted = false;
+  uint64_t serial = frame->serial;
+  pthread_mutex_unlock(&frameSerialMutex);
+  return serial;
+}
+
+
+// Record that a numbered frame was submitted, after which its fence tells
+// when it finishes.  A frame that could not be submitted never executes, so
+// it is finished at once.
+static void endFrameSerial(CJellyFrameSync * frame, bool submitted) {
+  pthread_mutex_lock(&frameSerialMutex);
+  if (submitted) {
+    frame->submitted = true;
+  }
+  else if (frame->serial) {
+    unlinkOutstandingFrame(frame);
+  }
+  pthread_mutex_unlock(&frameSerialMutex);
+}
+
+
+// The serial up to which every frame has finished executing on the GPU.
+static uint64_t completedFrameSerial(void) {
+  pthread_mutex_lock(&frameSerialMutex);
+  uint64_t completed = lastFrameSerial;
+  CJellyFrameSync ** link = &outstandingFrames;
+  while (*link) {
+    CJellyFrameSync * frame = *link;
+    // The fence is only queried once the frame has been submitted, since
+    // until then it is still signaled from the slot's previous frame.
+    if (frame->submitted &&
+        vkGetFenceStatus(device, frame->inFlightFence) == VK_SUCCESS) {
+      *link = frame->nextOutstanding;
+      frame->serial = 0;
+      continue;
+    }
+    if (frame->serial <= completed) {
+      completed = frame->serial - 1;
+    }
+    link = &frame->nextOutstanding;
+  }
+  pthread_mutex_unlock(&frameSerialMutex);
+  return completed;
+}
+
+
+// Forget the frames of a window that is being destroyed.
+static void forgetFrameSerials(CJellyWindow * win) {
+  pthread_mutex_lock(&frameSerialMutex);
+  for (uint32_t i = 0; i < win->framesInFlight; i++) {
+    if (win->frames[i].serial) {
+      unlinkOutstandingFrame(&win->frames[i]);
+    }
+  }
+  pthread_mutex_unlock(&frameSerialMutex);
+}
+
 //
 // === DRAWING A FRAME PER WINDOW ===
 //
 
-void drawFrameForWindow(CJellyWindow * win) {
-  vkWaitForFences(device, 1, &win->inFlightFence, VK_TRUE, UINT64_MAX);
-  vkResetFences(device, 1, &win->inFlightFence);
+// Acquire the next image of the window's swap chain for the current frame
+// slot, whose previous submission must have finished, and get the frame's
+// command buffer ready.  The frame is only prepared if the result is
+// VK_SUCCESS or VK_SUBOPTIMAL_KHR.  The graphics queue is not used, so this
+// may be called from a present thread.
+static VkResult prepareFrame(CJellyWindow * win, uint64_t timeout,
+    uint32_t * imageIndex, VkCommandBuffer * commandBuffer) {
+  CJellyFrameSync * frame = &win->frames[win->currentFrame];
+
+  // The swap chain may be out of date even though no resize was reported.
+  // Its semaphore was not signaled in that case, and the fence was not reset,
+  // so the frame can simply be retried with a new swap chain.  A suboptimal
+  // swap chain can still be presented to, and is recreated after presenting.
+  VkResult result = vkAcquireNextImageKHR(device, win->swapChain, timeout,
+      frame->imageAvailableSemaphore, VK_NULL_HANDLE, imageIndex);
+  if (result == VK_NOT_READY || result == VK_TIMEOUT ||
+      result == VK_ERROR_OUT_OF_DATE_KHR) {
+    return result;
+  }
+  if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+    fprintf(stderr, "Failed to acquire swap chain image\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // The swapchain may hand out images out of order, so the acquired image can
+  // still be in use by a different frame slot, whose command buffer is the
+  // one recorded for this image.  Wait for that frame before resubmitting it.
+  if (win->imagesInFlight[*imageIndex] != VK_NULL_HANDLE &&
+      win->imagesInFlight[*imageIndex] != frame->inFlightFence) {
+    vkWaitForFences(device, 1, &win->imagesInFlight[*imageIndex], VK_TRUE,
+        UINT64_MAX);
+  }
+  win->imagesInFlight[*imageIndex] = frame->inFlightFence;
+  uint64_t serial = beginFrameSerial(frame);
+  if (win->retiredSwapChain != VK_NULL_HANDLE && !win->retiredSwapChainSerial) {
+    win->retiredSwapChainSerial = serial;
+  }
+
+  // Windows with a recorder rebuild their commands for this frame, now that
+  // the frame's previous command buffers are no longer in use.
+  if (win->recorder) {
+    VkRenderPassBeginInfo renderPassInfo = {0};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = win->swapChainFramebuffers[*imageIndex];
+    renderPassInfo.renderArea.offset = (VkOffset2D){0, 0};
+    renderPassInfo.renderArea.extent = win->swapChainExtent;
+    VkClearValue clearColor = {{{0.1f, 0.1f, 0.1f, 1.0f}}};
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+
+    if (cjelly_command_recorder_record(win->recorder, win->currentFrame,
+            serial, &renderPassInfo, win->recordJobCount, win->recordJob,
+            win->recordUser, commandBuffer) != VK_SUCCESS) {
+      fprintf(stderr, "Failed to record frame command buffer\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  else {
+    *commandBuffer = win->commandBuffers[*imageIndex];
+  }
+  return result;
+}
+
+
+// Signal the fence of a frame whose submission failed, since every later use
+// of the slot waits on it.  An empty batch also consumes the wait on the
+// image-available semaphore, so that the semaphore can be signaled again.  If
+// even that fails, the fence is replaced by one that starts signaled.
+static void signalFrameFence(CJellyWindow * win, CJellyFrameSync * frame) {
+  VkSubmitInfo submitInfo = {0};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.pWaitSemaphores = &frame->imageAvailableSemaphore;
+  submitInfo.pWaitDstStageMask = &waitStage;
+
+  pthread_mutex_lock(graphicsQueueMutex);
+  VkResult result =
+      vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame->inFlightFence);
+  pthread_mutex_unlock(graphicsQueueMutex);
+  if (result == VK_SUCCESS) {
+    return;
+  }
+
+  VkFenceCreateInfo fenceInfo = {0};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  VkFence fence;
+  if (vkCreateFence(device, &fenceInfo, NULL, &fence) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to create fence\n");
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t i = 0; i < win->swapChainImageCount; i++) {
+    if (win->imagesInFlight[i] == frame->inFlightFence) {
+      win->imagesInFlight[i] = fence;
+    }
+  }
+  vkDestroyFence(device, frame->inFlightFence, NULL);
+  frame->inFlightFence = fence;
+}
 
-  uint32_t imageIndex;
-  vkAcquireNextImageKHR(device, win->swapChain, UINT64_MAX,
-      win->imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+
+// Submit a prepared frame and present its image.  Any thread may call this,
+// since the queues are only used with their mutexes held.  Returns the result
+// of presenting, which tells whether the swap chain has to be recreated, or
+// the error of the submission, in which case the image is not presented: its
+// render-finished semaphore would never be signaled.
+static VkResult submitFrame(CJellyWindow * win, uint32_t frameIndex,
+    uint32_t imageIndex, VkCommandBuffer commandBuffer) {
+  CJellyFrameSync * frame = &win->frames[frameIndex];
 
   VkSubmitInfo submitInfo = {0};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  VkSemaphore waitSemaphores[] = {win->imageAvailableSemaphore};
+  VkSemaphore waitSemaphores[] = {frame->imageAvailableSemaphore};
   VkPipelineStageFlags waitStages[] = {
       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
   submitInfo.waitSemaphoreCount = 1;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &win->commandBuffers[imageIndex];
-  VkSemaphore signalSemaphores[] = {win->renderFinishedSemaphore};
+  submitInfo.pCommandBuffers = &commandBuffer;
+  VkSemaphore signalSemaphores[] = {frame->renderFinishedSemaphore};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, win->inFlightFence) !=
-      VK_SUCCESS) {
+  vkResetFences(device, 1, &frame->inFlightFence);
+  pthread_mutex_lock(graphicsQueueMutex);
+  VkResult result =
+      vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame->inFlightFence);
+  pthread_mutex_unlock(graphicsQueueMutex);
+  if (result != VK_SUCCESS) {
     fprintf(stderr, "Failed to submit draw command buffer\n");
+    endFrameSerial(frame, false);
+    signalFrameFence(win, frame);
+    return result;
   }
+  endFrameSerial(frame, true);
 
   VkPresentInfoKHR presentInfo = {0};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -548,39 +1391,378 @@ void drawFrameForWindow(CJellyWindow * win) {
   presentInfo.pSwapchains = &win->swapChain;
   presentInfo.pImageIndices = &imageIndex;
 
-  vkQueuePresentKHR(presentQueue, &presentInfo);
+  pthread_mutex_lock(presentQueueMutex);
+  result = vkQueuePresentKHR(presentQueue, &presentInfo);
+  pthread_mutex_unlock(presentQueueMutex);
+  if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR &&
+      result != VK_ERROR_OUT_OF_DATE_KHR) {
+    fprintf(stderr, "Failed to present swap chain image\n");
+  }
+  return result;
 }
 
 
 //
-// === CLEANUP FOR A WINDOW ===
+// === PRESENT THREADS ===
 //
 
-void cleanupWindow(CJellyWindow * win) {
-  vkDestroySemaphore(device, win->renderFinishedSemaphore, NULL);
-  vkDestroySemaphore(device, win->imageAvailableSemaphore, NULL);
-  vkDestroyFence(device, win->inFlightFence, NULL);
-
-  free(win->commandBuffers);
-
-  for (uint32_t i = 0; i < win->swapChainImageCount; i++) {
-    vkDestroyFramebuffer(device, win->swapChainFramebuffers[i], NULL);
-    vkDestroyImageView(device, win->swapChainImageViews[i], NULL);
+// How long a present thread waits for an image before checking whether its
+// frame has been cancelled.
+#define PRESENT_THREAD_ACQUIRE_TIMEOUT 50000000ULL
+
+// A window's present thread, and the outcome of the frame that it finished
+// last.  The thread prepares, submits, and presents each requested frame on
+// its own, and the loop thread only collects the outcome afterwards.
+struct CJellyPresentThread {
+  CJellyWindow * win;            /**< The window whose frames are drawn */
+  pthread_t thread;              /**< The present thread */
+  pthread_mutex_t mutex;         /**< Guards the fields below */
+  pthread_cond_t cond;           /**< Signaled when requested or stop is set,
+                                    and when a frame is finished */
+  bool requested;                /**< A frame is waiting to be drawn */
+  bool cancel;                   /**< Give up waiting for an image */
+  bool stop;                     /**< The thread should exit */
+  bool busy;                     /**< A frame was requested and is not
+                                    finished yet */
+  bool finished;                 /**< A frame was finished, and its outcome
+                                    has not been collected yet */
+  bool presented;                /**< Whether the finished frame was
+                                    presented */
+  VkResult result;               /**< Result of presenting the finished frame,
+                                    or of acquiring its image if it was not
+                                    presented */
+};
+
+
+// Wake the loop thread from waitForWindowEvents(), so that it collects the
+// outcome of a frame that was just finished.
+static void wakeWindowLoop(void) {
+#ifdef _WIN32
+  PostThreadMessage(loopThreadId, WM_NULL, 0, 0);
+#else
+  char byte = 0;
+  if (write(wakePipe[1], &byte, 1) < 0) {
+    // The pipe is full, so the loop will wake up anyway.
   }
+#endif
+}
 
-  free(win->swapChainFramebuffers);
-  free(win->swapChainImageViews);
-  free(win->swapChainImages);
 
-  vkDestroySwapchainKHR(device, win->swapChain, NULL);
-  vkDestroySurfaceKHR(instance, win->surface, NULL);
+static bool isPresentThreadCancelled(CJellyPresentThread * presentThread) {
+  pthread_mutex_lock(&presentThread->mutex);
+  bool cancelled = presentThread->cancel || presentThread->stop;
+  pthread_mutex_unlock(&presentThread->mutex);
+  return cancelled;
+}
 
-#ifdef _WIN32
 
-  DestroyWindow(win->handle);
+// Body of a present thread.  While a frame is being drawn, the thread owns
+// the window's frame state (currentFrame, imagesInFlight, and the recorder);
+// the loop thread does not touch it, or the swap chain, until the frame is
+// finished.  Every request results in exactly one finished frame, even if it
+// was cancelled.
+static void * presentThreadMain(void * arg) {
+  CJellyPresentThread * presentThread = (CJellyPresentThread *)arg;
+  CJellyWindow * win = presentThread->win;
 
-#else
+  pthread_mutex_lock(&presentThread->mutex);
+  while (true) {
+    while (!presentThread->requested && !presentThread->stop) {
+      pthread_cond_wait(&presentThread->cond, &presentThread->mutex);
+    }
+    if (!presentThread->requested) {
+      break;
+    }
+    presentThread->requested = false;
+    pthread_mutex_unlock(&presentThread->mutex);
+
+    // Unlike drawFrameForWindow(), the thread is free to block here.
+    CJellyFrameSync * frame = &win->frames[win->currentFrame];
+    vkWaitForFences(device, 1, &frame->inFlightFence, VK_TRUE, UINT64_MAX);
+
+    uint32_t imageIndex;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkResult result;
+    do {
+      result = prepareFrame(win, PRESENT_THREAD_ACQUIRE_TIMEOUT, &imageIndex,
+          &commandBuffer);
+    } while (result == VK_TIMEOUT && !isPresentThreadCancelled(presentThread));
+
+    bool presented = result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+    if (presented) {
+      uint32_t frameIndex = win->currentFrame;
+      win->currentFrame = (win->currentFrame + 1) % win->framesInFlight;
+      result = submitFrame(win, frameIndex, imageIndex, commandBuffer);
+    }
+
+    pthread_mutex_lock(&presentThread->mutex);
+    presentThread->busy = false;
+    presentThread->finished = true;
+    presentThread->presented = presented;
+    presentThread->result = result;
+    pthread_cond_broadcast(&presentThread->cond);
+    pthread_mutex_unlock(&presentThread->mutex);
+    wakeWindowLoop();
+
+    pthread_mutex_lock(&presentThread->mutex);
+  }
+  pthread_mutex_unlock(&presentThread->mutex);
+  return NULL;
+}
+
+
+// Apply the outcome of the frame that the window's present thread finished
+// last, if it has not been collected yet.  Returns whether the thread is
+// still drawing a frame.
+static bool collectPresentedFrame(CJellyWindow * win) {
+  CJellyPresentThread * presentThread = win->presentThread;
+  pthread_mutex_lock(&presentThread->mutex);
+  bool busy = presentThread->busy;
+  bool finished = presentThread->finished;
+  bool presented = presentThread->presented;
+  VkResult result = presentThread->result;
+  presentThread->finished = false;
+  pthread_mutex_unlock(&presentThread->mutex);
+
+  if (finished) {
+    // The swap chain is recreated before the next frame is requested, while
+    // the thread is idle.
+    if (result == VK_ERROR_OUT_OF_DATE_KHR ||
+        (presented && result == VK_SUBOPTIMAL_KHR)) {
+      win->framebufferResized = 1;
+    }
+    if (presented && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+      win->framesPresented++;
+    }
+
+    // A frame that was cancelled, or whose swap chain was out of date, was
+    // never drawn, but the window still needs to be.
+    if (!presented) {
+      win->needsRedraw = 1;
+    }
+  }
+  return busy;
+}
+
+
+// Collect the outcome of every frame that the windows' present threads have
+// finished.
+static void collectPresentedFrames(
+    CJellyWindow * const * windows, int windowCount) {
+#ifndef _WIN32
+  // Empty the wake pipe first, so that a frame finished while the windows are
+  // being checked wakes the loop again.
+  char buffer[64];
+  while (wakePipe[0] >= 0 && read(wakePipe[0], buffer, sizeof(buffer)) > 0) {
+  }
+#endif
+
+  for (int i = 0; i < windowCount; ++i) {
+    if (windows[i]->presentThread) {
+      collectPresentedFrame(windows[i]);
+    }
+  }
+}
+
+
+// Ask a window's present thread for a frame.  If it is still drawing the
+// previous one, the frame is deferred instead.
+static void requestPresentThreadFrame(CJellyWindow * win) {
+  CJellyPresentThread * presentThread = win->presentThread;
+  win->frameDeferred = 0;
+  if (collectPresentedFrame(win)) {
+    win->frameDeferred = 1;
+    return;
+  }
+
+  // The thread is idle, so the swap chain can be replaced safely.
+  releaseRetiredSwapChain(win, false);
+  if (win->framebufferResized && !recreateSwapChainForWindow(win)) {
+    return;
+  }
+  refreshCommandBuffersForWindow(win);
+
+  pthread_mutex_lock(&presentThread->mutex);
+  presentThread->busy = true;
+  presentThread->requested = true;
+  pthread_cond_signal(&presentThread->cond);
+  pthread_mutex_unlock(&presentThread->mutex);
+}
+
+
+// Wait until no present thread is drawing a frame.  Frames still waiting for
+// an image are cancelled.
+static void settlePresentThreads(
+    CJellyWindow * const * windows, int windowCount) {
+  for (int i = 0; i < windowCount; ++i) {
+    CJellyPresentThread * presentThread = windows[i]->presentThread;
+    if (presentThread) {
+      pthread_mutex_lock(&presentThread->mutex);
+      presentThread->cancel = true;
+      pthread_mutex_unlock(&presentThread->mutex);
+    }
+  }
+
+  for (int i = 0; i < windowCount; ++i) {
+    CJellyPresentThread * presentThread = windows[i]->presentThread;
+    if (presentThread) {
+      pthread_mutex_lock(&presentThread->mutex);
+      while (presentThread->busy) {
+        pthread_cond_wait(&presentThread->cond, &presentThread->mutex);
+      }
+      presentThread->cancel = false;
+      pthread_mutex_unlock(&presentThread->mutex);
+    }
+  }
+  collectPresentedFrames(windows, windowCount);
+}
+
+
+void createPresentThreadForWindow(CJellyWindow * win) {
+#ifdef _WIN32
+  loopThreadId = GetCurrentThreadId();
+#else
+  if (wakePipe[0] < 0) {
+    if (pipe(wakePipe) != 0) {
+      fprintf(stderr, "Failed to create present thread wake pipe\n");
+      exit(EXIT_FAILURE);
+    }
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+  }
+#endif
+
+  CJellyPresentThread * presentThread =
+      (CJellyPresentThread *)calloc(1, sizeof(CJellyPresentThread));
+  if (!presentThread) {
+    fprintf(stderr, "Failed to allocate present thread\n");
+    exit(EXIT_FAILURE);
+  }
+  presentThread->win = win;
+  pthread_mutex_init(&presentThread->mutex, NULL);
+  pthread_cond_init(&presentThread->cond, NULL);
+  if (pthread_create(&presentThread->thread, NULL, presentThreadMain,
+          presentThread) != 0) {
+    fprintf(stderr, "Failed to create present thread\n");
+    exit(EXIT_FAILURE);
+  }
+  win->presentThread = presentThread;
+}
+
+
+// Stop a window's present thread.  A frame that it is still drawing, because
+// it was requested outside of runWindowLoop(), is finished first, or
+// cancelled if it is waiting for an image.
+static void destroyPresentThreadForWindow(CJellyWindow * win) {
+  CJellyPresentThread * presentThread = win->presentThread;
+  if (!presentThread) {
+    return;
+  }
+
+  pthread_mutex_lock(&presentThread->mutex);
+  presentThread->stop = true;
+  pthread_cond_signal(&presentThread->cond);
+  pthread_mutex_unlock(&presentThread->mutex);
+  pthread_join(presentThread->thread, NULL);
+
+  pthread_cond_destroy(&presentThread->cond);
+  pthread_mutex_destroy(&presentThread->mutex);
+  free(presentThread);
+  win->presentThread = NULL;
+}
 
+
+void drawFrameForWindow(CJellyWindow * win) {
+  if (win->presentThread) {
+    requestPresentThreadFrame(win);
+    return;
+  }
+
+  releaseRetiredSwapChain(win, false);
+  if (win->framebufferResized && !recreateSwapChainForWindow(win)) {
+    return;
+  }
+  refreshCommandBuffersForWindow(win);
+
+  CJellyFrameSync * frame = &win->frames[win->currentFrame];
+  win->frameDeferred = 0;
+
+  // Only the frame that used this slot framesInFlight frames ago must have
+  // finished.  The frames submitted since then may still be running on the
+  // GPU.  Rather than waiting for it, and holding up every other window,
+  // defer the frame.
+  if (vkGetFenceStatus(device, frame->inFlightFence) == VK_NOT_READY) {
+    win->frameDeferred = 1;
+    return;
+  }
+
+  uint32_t imageIndex;
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  VkResult result = prepareFrame(win, 0, &imageIndex, &commandBuffer);
+  if (result == VK_NOT_READY || result == VK_TIMEOUT) {
+    // Every image is queued for presentation, as with FIFO when the GPU is
+    // ahead of the display.
+    win->frameDeferred = 1;
+    return;
+  }
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    win->framebufferResized = 1;
+    win->needsRedraw = 1;
+    return;
+  }
+
+  uint32_t frameIndex = win->currentFrame;
+  win->currentFrame = (win->currentFrame + 1) % win->framesInFlight;
+  result = submitFrame(win, frameIndex, imageIndex, commandBuffer);
+  if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+    win->framesPresented++;
+  }
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
+      win->framebufferResized) {
+    win->framebufferResized = 1;
+    recreateSwapChainForWindow(win);
+  }
+}
+
+//
+// === CLEANUP FOR A WINDOW ===
+//
+
+void cleanupWindow(CJellyWindow * win) {
+  destroyPresentThreadForWindow(win);
+  forgetFrameSerials(win);
+
+  for (uint32_t i = 0; i < win->framesInFlight; i++) {
+    vkDestroySemaphore(device, win->frames[i].renderFinishedSemaphore, NULL);
+    vkDestroySemaphore(device, win->frames[i].imageAvailableSemaphore, NULL);
+    vkDestroyFence(device, win->frames[i].inFlightFence, NULL);
+  }
+  free(win->frames);
+  free(win->imagesInFlight);
+
+  cjelly_command_recorder_destroy(win->recorder);
+  freeCommandBuffersForWindow(win);
+
+  for (uint32_t i = 0; i < win->swapChainImageCount; i++) {
+    vkDestroyFramebuffer(device, win->swapChainFramebuffers[i], NULL);
+    vkDestroyImageView(device, win->swapChainImageViews[i], NULL);
+  }
+
+  free(win->swapChainFramebuffers);
+  free(win->swapChainImageViews);
+  free(win->swapChainImages);
+
+  releaseRetiredSwapChain(win, true);
+  vkDestroySwapchainKHR(device, win->swapChain, NULL);
+  vkDestroySurfaceKHR(instance, win->surface, NULL);
+
+#ifdef _WIN32
+
+  DestroyWindow(win->handle);
+
+#else
+
+  XDeleteContext(display, win->handle, windowContext);
   XDestroyWindow(display, win->handle);
 
 #endif
@@ -598,7 +1780,9 @@ void createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "CjellyEngine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  // Vulkan 1.1 is needed to query the descriptor indexing features, and
+  // devices that support 1.2 provide them without an extension.
+  appInfo.apiVersion = VK_API_VERSION_1_2;
 
   // Specify required extensions for the platform.
   const char * extensions[10];
@@ -683,6 +1867,144 @@ void destroyDebugMessenger() {
 }
 
 
+// Queue families chosen for a physical device.
+typedef struct QueueFamilies {
+  uint32_t graphics; // Renders
+  uint32_t present;  // Presents to windows
+  uint32_t compute;  // Runs compute work alongside rendering
+  uint32_t transfer; // Uploads
+} QueueFamilies;
+
+
+// Whether a queue family can present to windows.  The device is chosen before
+// any window has a surface, so this asks the window system rather than a
+// surface.  createSurfaceForWindow() checks each surface once it exists.
+static int supportsPresentation(VkPhysicalDevice device, uint32_t family) {
+#ifdef _WIN32
+  return vkGetPhysicalDeviceWin32PresentationSupportKHR(device, family);
+#else
+  Visual * visual = DefaultVisual(display, DefaultScreen(display));
+  return vkGetPhysicalDeviceXlibPresentationSupportKHR(
+      device, family, display, XVisualIDFromVisual(visual));
+#endif
+}
+
+
+// Choose the queue families of a device.  Returns 0 if the device cannot both
+// render and present.
+static int findQueueFamilies(VkPhysicalDevice device, QueueFamilies * out) {
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, NULL);
+  if (familyCount == 0) {
+    return 0;
+  }
+  VkQueueFamilyProperties families[familyCount];
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, families);
+
+  // Prefer a graphics family that can also present, so that swap chain images
+  // never have to change queue family.
+  out->graphics = UINT32_MAX;
+  out->present = UINT32_MAX;
+  for (uint32_t i = 0; i < familyCount; ++i) {
+    if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      continue;
+    }
+    if (supportsPresentation(device, i)) {
+      out->graphics = i;
+      out->present = i;
+      break;
+    }
+    if (out->graphics == UINT32_MAX) {
+      out->graphics = i;
+    }
+  }
+  if (out->graphics == UINT32_MAX) {
+    return 0;
+  }
+  for (uint32_t i = 0; i < familyCount && out->present == UINT32_MAX; ++i) {
+    if (supportsPresentation(device, i)) {
+      out->present = i;
+    }
+  }
+  if (out->present == UINT32_MAX) {
+    return 0;
+  }
+
+  // A compute family without graphics usually runs on its own hardware queue,
+  // so that compute work overlaps with rendering.
+  out->compute = out->graphics;
+  for (uint32_t i = 0; i < familyCount; ++i) {
+    if ((families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+        !(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      out->compute = i;
+      break;
+    }
+  }
+
+  // A family that only does transfers is usually backed by a dedicated DMA
+  // engine, which copies data while the graphics queue keeps rendering.
+  out->transfer = out->graphics;
+  for (uint32_t i = 0; i < familyCount; ++i) {
+    if ((families[i].queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+        !(families[i].queueFlags &
+            (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      out->transfer = i;
+      break;
+    }
+  }
+  return 1;
+}
+
+
+// Whether a device supports a device extension.
+static int hasDeviceExtension(VkPhysicalDevice device, const char * name) {
+  uint32_t extensionCount = 0;
+  vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
+  VkExtensionProperties availableExtensions[extensionCount];
+  vkEnumerateDeviceExtensionProperties(
+      device, NULL, &extensionCount, availableExtensions);
+  for (uint32_t i = 0; i < extensionCount; ++i) {
+    if (strcmp(availableExtensions[i].extensionName, name) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+// Whether a device has the descriptor indexing features of the bindless
+// texture table.  They are core in Vulkan 1.2, and come from
+// VK_EXT_descriptor_indexing on Vulkan 1.1 devices, in which case
+// `usesExtension` is set.
+static int supportsBindlessTextures(
+    VkPhysicalDevice device, int * usesExtension) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_1) {
+    return 0;
+  }
+
+  *usesExtension = properties.apiVersion < VK_API_VERSION_1_2;
+  if (*usesExtension &&
+      !hasDeviceExtension(device, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+    return 0;
+  }
+
+  VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {0};
+  indexingFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {0};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &indexingFeatures;
+  vkGetPhysicalDeviceFeatures2(device, &features);
+  return indexingFeatures.runtimeDescriptorArray &&
+      indexingFeatures.descriptorBindingPartiallyBound &&
+      indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+      indexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+      indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+}
+
+
 void pickPhysicalDevice() {
   uint32_t deviceCount = 0;
   vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
@@ -727,6 +2049,18 @@ void pickPhysicalDevice() {
       continue;
     }
 
+    // Skip this device if it cannot hold a bindless texture table.
+    int usesIndexingExtension;
+    if (!supportsBindlessTextures(device, &usesIndexingExtension)) {
+      continue;
+    }
+
+    // Skip this device if none of its queues can render, or present.
+    QueueFamilies families;
+    if (!findQueueFamilies(device, &families)) {
+      continue;
+    }
+
     // Score the device:
     // Prefer discrete GPUs over integrated ones.
     int score = 0;
@@ -751,25 +2085,116 @@ void pickPhysicalDevice() {
 }
 
 
+// Claim a queue of a family for one role.  Each role gets a queue of its own
+// while the family has one to spare, and otherwise shares the family's last
+// queue.
+static uint32_t claimQueue(uint32_t * claimed,
+    const VkQueueFamilyProperties * families, uint32_t family) {
+  if (claimed[family] < families[family].queueCount) {
+    return claimed[family]++;
+  }
+  return claimed[family] - 1;
+}
+
+
 void createLogicalDevice() {
-  uint32_t queueFamilyIndex =
-      0; // Simplified: assume family 0 supports both graphics and present.
-  float queuePriority = 1.0f;
-  VkDeviceQueueCreateInfo queueCreateInfo = {0};
-  queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-  queueCreateInfo.queueCount = 1;
-  queueCreateInfo.pQueuePriorities = &queuePriority;
-
-  // Specify the swapchain extension.
-  const char * deviceExtensions[] = {"VK_KHR_swapchain"};
+  QueueFamilies chosen;
+  if (!findQueueFamilies(physicalDevice, &chosen)) {
+    fprintf(stderr, "Failed to find graphics and present queue families\n");
+    exit(EXIT_FAILURE);
+  }
+  graphicsQueueFamilyIndex = chosen.graphics;
+  presentQueueFamilyIndex = chosen.present;
+  computeQueueFamilyIndex = chosen.compute;
+  transferQueueFamilyIndex = chosen.transfer;
+
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, NULL);
+  VkQueueFamilyProperties families[familyCount];
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      physicalDevice, &familyCount, families);
+
+  // Presentation stays on the graphics queue when it can, since the loop
+  // thread already owns that queue.  Uploads are claimed before compute, so
+  // that a graphics family with two queues gives its second one to uploads.
+  uint32_t claimed[familyCount];
+  memset(claimed, 0, sizeof(claimed));
+  uint32_t graphicsQueueIndex =
+      claimQueue(claimed, families, graphicsQueueFamilyIndex);
+  uint32_t presentQueueIndex = graphicsQueueIndex;
+  if (presentQueueFamilyIndex != graphicsQueueFamilyIndex) {
+    presentQueueIndex = claimQueue(claimed, families, presentQueueFamilyIndex);
+  }
+  uint32_t transferQueueIndex =
+      claimQueue(claimed, families, transferQueueFamilyIndex);
+  uint32_t computeQueueIndex =
+      claimQueue(claimed, families, computeQueueFamilyIndex);
+
+  uint32_t maxQueueCount = 1;
+  for (uint32_t i = 0; i < familyCount; ++i) {
+    if (claimed[i] > maxQueueCount) {
+      maxQueueCount = claimed[i];
+    }
+  }
+  float queuePriorities[maxQueueCount];
+  for (uint32_t i = 0; i < maxQueueCount; ++i) {
+    queuePriorities[i] = 1.0f;
+  }
+
+  VkDeviceQueueCreateInfo queueCreateInfos[familyCount];
+  memset(queueCreateInfos, 0, sizeof(queueCreateInfos));
+  uint32_t queueCreateInfoCount = 0;
+  for (uint32_t i = 0; i < familyCount; ++i) {
+    if (claimed[i] == 0) {
+      continue;
+    }
+    VkDeviceQueueCreateInfo * info = &queueCreateInfos[queueCreateInfoCount++];
+    info->sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    info->queueFamilyIndex = i;
+    info->queueCount = claimed[i];
+    info->pQueuePriorities = queuePriorities;
+  }
+
+  // Enable the features of the bindless texture table, which
+  // pickPhysicalDevice() has checked for.
+  int usesIndexingExtension = 0;
+  supportsBindlessTextures(physicalDevice, &usesIndexingExtension);
+  VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {0};
+  indexingFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+  indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+  indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  VkPhysicalDeviceFeatures2 enabledFeatures = {0};
+  enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  enabledFeatures.pNext = &indexingFeatures;
+
+  // Specify the swapchain extension, descriptor indexing on devices that
+  // predate Vulkan 1.2, and the memory budget, which the texture cache uses
+  // when it is available.
+  const char * deviceExtensions[3];
+  uint32_t deviceExtensionCount = 0;
+  deviceExtensions[deviceExtensionCount++] = "VK_KHR_swapchain";
+  if (usesIndexingExtension) {
+    deviceExtensions[deviceExtensionCount++] =
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+  }
+  memoryBudgetEnabled =
+      hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memoryBudgetEnabled) {
+    deviceExtensions[deviceExtensionCount++] =
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+  }
 
   VkDeviceCreateInfo createInfo = {0};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  createInfo.queueCreateInfoCount = 1;
-  createInfo.pQueueCreateInfos = &queueCreateInfo;
-  createInfo.enabledExtensionCount = 1;
+  createInfo.queueCreateInfoCount = queueCreateInfoCount;
+  createInfo.pQueueCreateInfos = queueCreateInfos;
+  createInfo.enabledExtensionCount = deviceExtensionCount;
   createInfo.ppEnabledExtensionNames = deviceExtensions;
+  createInfo.pNext = &enabledFeatures;
 
   if (vkCreateDevice(physicalDevice, &createInfo, NULL, &device) !=
       VK_SUCCESS) {
@@ -777,10 +2202,102 @@ void createLogicalDevice() {
     exit(EXIT_FAILURE);
   }
 
-  vkGetDeviceQueue(device, queueFamilyIndex, 0, &graphicsQueue);
-  presentQueue = graphicsQueue;
+  vkGetDeviceQueue(
+      device, graphicsQueueFamilyIndex, graphicsQueueIndex, &graphicsQueue);
+  vkGetDeviceQueue(
+      device, presentQueueFamilyIndex, presentQueueIndex, &presentQueue);
+  vkGetDeviceQueue(
+      device, transferQueueFamilyIndex, transferQueueIndex, &transferQueue);
+  vkGetDeviceQueue(
+      device, computeQueueFamilyIndex, computeQueueIndex, &computeQueue);
+
+  presentQueueMutex = presentQueue == graphicsQueue ? &queueMutexes[0]
+                                                    : &queueMutexes[1];
+  transferQueueMutex = transferQueue == graphicsQueue  ? &queueMutexes[0]
+                       : transferQueue == presentQueue ? presentQueueMutex
+                                                       : &queueMutexes[2];
+}
+
+
+//
+// === QUEUE FAMILY OWNERSHIP TRANSFERS ===
+//
+
+void releaseBufferOwnership(VkCommandBuffer commandBuffer, VkBuffer buffer,
+    uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask) {
+  if (srcQueueFamilyIndex == dstQueueFamilyIndex) {
+    return;
+  }
+  VkBufferMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccessMask;
+  barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+  barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+  barrier.buffer = buffer;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, srcStageMask,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
 }
 
+void acquireBufferOwnership(VkCommandBuffer commandBuffer, VkBuffer buffer,
+    uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask) {
+  if (srcQueueFamilyIndex == dstQueueFamilyIndex) {
+    return;
+  }
+  VkBufferMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.dstAccessMask = dstAccessMask;
+  barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+  barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+  barrier.buffer = buffer;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      dstStageMask, 0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+void releaseImageOwnership(VkCommandBuffer commandBuffer, VkImage image,
+    const VkImageSubresourceRange * range, VkImageLayout oldLayout,
+    VkImageLayout newLayout, uint32_t srcQueueFamilyIndex,
+    uint32_t dstQueueFamilyIndex, VkPipelineStageFlags srcStageMask,
+    VkAccessFlags srcAccessMask) {
+  if (srcQueueFamilyIndex == dstQueueFamilyIndex) {
+    return;
+  }
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccessMask;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+  barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+  barrier.image = image;
+  barrier.subresourceRange = *range;
+  vkCmdPipelineBarrier(commandBuffer, srcStageMask,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+void acquireImageOwnership(VkCommandBuffer commandBuffer, VkImage image,
+    const VkImageSubresourceRange * range, VkImageLayout oldLayout,
+    VkImageLayout newLayout, uint32_t srcQueueFamilyIndex,
+    uint32_t dstQueueFamilyIndex, VkPipelineStageFlags dstStageMask,
+    VkAccessFlags dstAccessMask) {
+  if (srcQueueFamilyIndex == dstQueueFamilyIndex) {
+    return;
+  }
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.dstAccessMask = dstAccessMask;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+  barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+  barrier.image = image;
+  barrier.subresourceRange = *range;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      dstStageMask, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
 
 // Creates a vertex buffer and uploads the vertex data for a square (two
 // triangles).
@@ -796,39 +2313,13 @@ void createVertexBuffer() {
   };
   VkDeviceSize bufferSize = sizeof(vertices);
 
-  VkBufferCreateInfo bufferInfo = {0};
-  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  bufferInfo.size = bufferSize;
-  bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-  if (vkCreateBuffer(device, &bufferInfo, NULL, &vertexBuffer) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create vertex buffer\n");
-    exit(EXIT_FAILURE);
-  }
-
-  VkMemoryRequirements memRequirements;
-  vkGetBufferMemoryRequirements(device, vertexBuffer, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
+  createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-  if (vkAllocateMemory(device, &allocInfo, NULL, &vertexBufferMemory) !=
-      VK_SUCCESS) {
-    fprintf(stderr, "Failed to allocate vertex buffer memory\n");
-    exit(EXIT_FAILURE);
-  }
-
-  vkBindBufferMemory(device, vertexBuffer, vertexBufferMemory, 0);
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      &vertexBuffer, &vertexBufferMemory);
 
-  void * data;
-  vkMapMemory(device, vertexBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, vertices, (size_t)bufferSize);
-  vkUnmapMemory(device, vertexBufferMemory);
+  // Host-visible memory stays mapped for the lifetime of the allocation.
+  memcpy(vertexBufferMemory->mapped, vertices, (size_t)bufferSize);
 }
 
 
@@ -867,153 +2358,170 @@ void createRenderPass() {
 }
 
 
-void createGraphicsPipeline() {
-  // Load SPIR-V binaries and create shader modules.
-  VkShaderModule vertShaderModule =
-      createShaderModuleFromMemory(device, basic_vert_spv, basic_vert_spv_len);
-  VkShaderModule fragShaderModule =
-      createShaderModuleFromMemory(device, basic_frag_spv, basic_frag_spv_len);
-
-  if (vertShaderModule == VK_NULL_HANDLE ||
-      fragShaderModule == VK_NULL_HANDLE) {
-    fprintf(stderr, "Failed to create shader modules\n");
+/**
+ * @brief Number of threads that compile pipelines in the background.
+ *
+ * One is enough to keep compiles out of the frame, without taking cores from
+ * the command recording threads.
+ */
+#define PIPELINE_COMPILE_THREADS 1
+
+
+/**
+ * @brief Loads a built-in shader.
+ *
+ * The shader is read from shaderDirectory, if it is set, so that it can be
+ * reloaded when it changes.  Otherwise, or if the file cannot be loaded, the
+ * copy embedded in the program is used.
+ *
+ * @param name The name of the .spv file.
+ * @param code The embedded SPIR-V code.
+ * @param codeSize The size of the embedded code in bytes.
+ * @return The module, which is owned by shaderCache.
+ */
+static VkShaderModule loadShader(
+    const char * name, const unsigned char * code, size_t codeSize) {
+  VkShaderModule module;
+  if (shaderDirectory) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", shaderDirectory, name);
+    CJellyShaderCacheError err =
+        cjelly_shader_cache_load_file(shaderCache, path, &module);
+    if (err == CJELLY_SHADER_CACHE_SUCCESS) {
+      return module;
+    }
+    fprintf(stderr, "Failed to load %s (%s), using the embedded shader\n",
+        path, cjelly_shader_cache_strerror(err));
+  }
+  if (cjelly_shader_cache_load_memory(shaderCache, code, codeSize, &module) !=
+      CJELLY_SHADER_CACHE_SUCCESS) {
+    fprintf(stderr, "Failed to create shader module %s\n", name);
     exit(EXIT_FAILURE);
   }
+  return module;
+}
 
-  VkPipelineShaderStageCreateInfo shaderStages[2] = {0};
-
-  // Vertex shader stage.
-  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = vertShaderModule;
-  shaderStages[0].pName = "main";
-
-  // Fragment shader stage.
-  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = fragShaderModule;
-  shaderStages[1].pName = "main";
-
-  // Define a binding description for our Vertex structure.
-  VkVertexInputBindingDescription bindingDescription = {0};
-  bindingDescription.binding = 0;
-  bindingDescription.stride = sizeof(Vertex);
-  bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-  // Define attribute descriptions for the vertex shader inputs.
-  VkVertexInputAttributeDescription attributeDescriptions[2] = {0};
-
-  // Attribute 0: position (vec2)
-  attributeDescriptions[0].binding = 0;
-  attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-  attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-  // Attribute 1: color (vec3)
-  attributeDescriptions[1].binding = 0;
-  attributeDescriptions[1].location = 1;
-  attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
-  vertexInputInfo.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-  vertexInputInfo.vertexAttributeDescriptionCount = 2;
-  vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
-
-  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {0};
-  inputAssembly.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-  inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-  // Instead of hard-coding the viewport and scissor,
-  // we define a viewport state with counts and use dynamic states to set actual
-  // values later.
-  VkPipelineViewportStateCreateInfo viewportState = {0};
-  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-  viewportState.viewportCount = 1; // Only the count is used.
-  viewportState.scissorCount = 1;
-
-  VkDynamicState dynamicStates[] = {
-      VK_DYNAMIC_STATE_VIEWPORT,
-      VK_DYNAMIC_STATE_SCISSOR,
-  };
 
-  VkPipelineDynamicStateCreateInfo dynamicState = {0};
-  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-  dynamicState.dynamicStateCount = 2;
-  dynamicState.pDynamicStates = dynamicStates;
-
-  VkPipelineRasterizationStateCreateInfo rasterizer = {0};
-  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  rasterizer.depthClampEnable = VK_FALSE;
-  rasterizer.rasterizerDiscardEnable = VK_FALSE;
-  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-  rasterizer.lineWidth = 1.0f;
-  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-  rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-
-  VkPipelineMultisampleStateCreateInfo multisampling = {0};
-  multisampling.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-  multisampling.sampleShadingEnable = VK_FALSE;
-  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-  VkPipelineColorBlendAttachmentState colorBlendAttachment = {0};
-  colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-      VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
-      VK_COLOR_COMPONENT_A_BIT;
-  colorBlendAttachment.blendEnable = VK_FALSE;
-
-  VkPipelineColorBlendStateCreateInfo colorBlending = {0};
-  colorBlending.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-  colorBlending.logicOpEnable = VK_FALSE;
-  colorBlending.attachmentCount = 1;
-  colorBlending.pAttachments = &colorBlendAttachment;
-
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  if (vkCreatePipelineLayout(
-          device, &pipelineLayoutInfo, NULL, &pipelineLayout) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create pipeline layout\n");
-    exit(EXIT_FAILURE);
+/**
+ * @brief Loads the built-in shader modules.
+ */
+static void createShaderModules(void) {
+  basicVertShader =
+      loadShader("basic.vert.spv", basic_vert_spv, basic_vert_spv_len);
+  basicFragShader =
+      loadShader("basic.frag.spv", basic_frag_spv, basic_frag_spv_len);
+  texturedFragShader = loadShader(
+      "textured.frag.spv", textured_frag_spv, textured_frag_spv_len);
+  meshVertShader =
+      loadShader("mesh.vert.spv", mesh_vert_spv, mesh_vert_spv_len);
+  meshFragShader =
+      loadShader("mesh.frag.spv", mesh_frag_spv, mesh_frag_spv_len);
+  spriteVertShader =
+      loadShader("sprite.vert.spv", sprite_vert_spv, sprite_vert_spv_len);
+  spriteFragShader =
+      loadShader("sprite.frag.spv", sprite_frag_spv, sprite_frag_spv_len);
+}
+
+
+/**
+ * @brief Switches everything that uses a reloaded shader to its new module.
+ *
+ * Only the pipelines that use the module are rebuilt.  Pipelines that are
+ * fetched from the registry while recording pick up the new version once it
+ * is compiled; command buffers that were recorded once keep the pipeline that
+ * they were recorded with.
+ */
+static void reloadShader(void * user, const char * path,
+    VkShaderModule oldModule, VkShaderModule newModule) {
+  (void)user;
+  (void)path;
+
+  // The registry is done with the old module once this returns.
+  cjelly_pipeline_registry_replace_shader(
+      pipelineRegistry, oldModule, newModule);
+
+  // Pipelines requested from now on use the new module as well.
+  VkShaderModule * modules[] = {
+      &basicVertShader,
+      &basicFragShader,
+      &texturedFragShader,
+      &meshVertShader,
+      &meshFragShader,
+      &spriteVertShader,
+      &spriteFragShader,
+  };
+  for (size_t i = 0; i < sizeof(modules) / sizeof(modules[0]); ++i) {
+    if (*modules[i] == oldModule) {
+      *modules[i] = newModule;
+      cjelly_shader_cache_retain(shaderCache, newModule);
+      cjelly_shader_cache_release(shaderCache, oldModule);
+    }
   }
+}
+
 
-  VkGraphicsPipelineCreateInfo pipelineInfo = {0};
-  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipelineInfo.stageCount = 2;
-  pipelineInfo.pStages = shaderStages;
-  pipelineInfo.pVertexInputState = &vertexInputInfo;
-  pipelineInfo.pInputAssemblyState = &inputAssembly;
-  pipelineInfo.pViewportState = &viewportState;
-  pipelineInfo.pDynamicState = &dynamicState;
-  pipelineInfo.pRasterizationState = &rasterizer;
-  pipelineInfo.pMultisampleState = &multisampling;
-  pipelineInfo.pColorBlendState = &colorBlending;
-  pipelineInfo.layout = pipelineLayout;
-  pipelineInfo.renderPass = renderPass;
-  pipelineInfo.subpass = 0;
-
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL,
-          &graphicsPipeline) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create graphics pipeline\n");
+/**
+ * @brief Reloads the shader files that have changed since the last call.
+ */
+static void pollShaderFiles(void) {
+  cjelly_shader_cache_poll(shaderCache, reloadShader, NULL);
+}
+
+
+/**
+ * @brief Requests a pipeline from the registry, and waits until it is
+ * compiled.
+ *
+ * @param desc The description of the pipeline.
+ * @param name Name of the pipeline, for the error message.
+ * @param outPipeline Receives the pipeline.
+ * @param outLayout Receives the pipeline layout.
+ * @return The registry's entry for the pipeline.
+ */
+static CJellyPipeline * requirePipeline(const CJellyPipelineDesc * desc,
+    const char * name, VkPipeline * outPipeline, VkPipelineLayout * outLayout) {
+  CJellyPipeline * pipeline =
+      cjelly_pipeline_registry_request(pipelineRegistry, desc);
+  VkPipeline handle = pipeline
+      ? cjelly_pipeline_registry_get(pipelineRegistry, pipeline)
+      : VK_NULL_HANDLE;
+  if (handle == VK_NULL_HANDLE) {
+    fprintf(stderr, "Failed to create %s pipeline\n", name);
     exit(EXIT_FAILURE);
   }
-
-  // Clean up shader modules after pipeline creation.
-  vkDestroyShaderModule(device, vertShaderModule, NULL);
-  vkDestroyShaderModule(device, fragShaderModule, NULL);
+  if (outPipeline) {
+    *outPipeline = handle;
+  }
+  if (outLayout) {
+    *outLayout = cjelly_pipeline_layout(pipeline);
+  }
+  return pipeline;
 }
 
 
+void createGraphicsPipeline() {
+  CJellyPipelineDesc desc;
+  cjelly_pipeline_desc_init(&desc);
+  desc.vertexShader = basicVertShader;
+  desc.fragmentShader = basicFragShader;
+  desc.renderPass = renderPass;
+
+  // Attribute 0: position (vec2), attribute 1: color (vec3).
+  desc.vertexStride = sizeof(Vertex);
+  desc.attributeCount = 2;
+  desc.attributes[0] = (VkVertexInputAttributeDescription){
+      0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, pos)};
+  desc.attributes[1] = (VkVertexInputAttributeDescription){
+      1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)};
+
+  graphicsPipelineEntry =
+      requirePipeline(&desc, "graphics", &graphicsPipeline, &pipelineLayout);
+}
+
 void createCommandPool() {
   VkCommandPoolCreateInfo poolInfo = {0};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  poolInfo.queueFamilyIndex = 0;
+  poolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
   if (vkCreateCommandPool(device, &poolInfo, NULL, &commandPool) !=
       VK_SUCCESS) {
     fprintf(stderr, "Failed to create command pool\n");
@@ -1023,219 +2531,183 @@ void createCommandPool() {
 
 
 //
-// === TEXTURED SQUARE ===
+// === BINDLESS TEXTURES ===
 //
 
 /**
- * @brief Creates a descriptor pool for texture descriptor sets.
- *
- * This function creates a descriptor pool that can allocate descriptor sets
- * containing combined image samplers.
+ * @brief Describes the descriptor set layout of the bindless texture table.
  */
-void createTextureDescriptorPool() {
-  VkDescriptorPoolSize poolSize = {0};
-  poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSize.descriptorCount = 1; // Change this if you need more descriptors.
-
-  VkDescriptorPoolCreateInfo poolInfo = {0};
-  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  poolInfo.poolSizeCount = 1;
-  poolInfo.pPoolSizes = &poolSize;
-  poolInfo.maxSets = 1; // Adjust if allocating multiple descriptor sets.
-
-  if (vkCreateDescriptorPool(device, &poolInfo, NULL, &textureDescriptorPool) !=
-      VK_SUCCESS) {
-    fprintf(stderr, "Failed to create texture descriptor pool!\n");
-    exit(EXIT_FAILURE);
-  }
+static void describeBindlessSetLayout(CJellyDescriptorSetLayoutDesc * desc) {
+  cjelly_bindless_table_describe(
+      bindlessTextureCapacity, VK_SHADER_STAGE_FRAGMENT_BIT, desc);
 }
 
-void createDescriptorSetLayouts() {
-  // Define a descriptor set layout for the texture.
-  VkDescriptorSetLayoutBinding layoutBinding = {0};
-  layoutBinding.binding = 0;
-  layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  layoutBinding.descriptorCount = 1;
-  layoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+void createBindlessTextureTable() {
+  // Fit the table in the device's limits on update-after-bind descriptors.  A
+  // combined image sampler counts as both a sampler and a sampled image.
+  VkPhysicalDeviceDescriptorIndexingProperties indexingProperties = {0};
+  indexingProperties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+  VkPhysicalDeviceProperties2 properties = {0};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &indexingProperties;
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+  uint32_t limits[] = {
+      indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+      indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+      indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+      indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+  };
+  bindlessTextureCapacity = BINDLESS_TEXTURE_CAPACITY;
+  for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); ++i) {
+    if (limits[i] < bindlessTextureCapacity) {
+      bindlessTextureCapacity = limits[i];
+    }
+  }
 
-  VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
-  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  layoutInfo.bindingCount = 1;
-  layoutInfo.pBindings = &layoutBinding;
+  // The layout is shared with the pipelines through the registry.
+  CJellyDescriptorSetLayoutDesc desc;
+  describeBindlessSetLayout(&desc);
+  VkDescriptorSetLayout layout =
+      cjelly_pipeline_registry_descriptor_set_layout(pipelineRegistry, &desc);
+  if (layout == VK_NULL_HANDLE) {
+    fprintf(stderr, "Failed to create bindless texture set layout\n");
+    exit(EXIT_FAILURE);
+  }
 
-  if (vkCreateDescriptorSetLayout(device, &layoutInfo, NULL,
-          &textureDescriptorSetLayout) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create texture descriptor set layout\n");
+  bindlessTextures =
+      cjelly_bindless_table_create(device, layout, bindlessTextureCapacity);
+  if (!bindlessTextures) {
+    fprintf(stderr, "Failed to create bindless texture table\n");
     exit(EXIT_FAILURE);
   }
 }
 
-/**
- * @brief Allocates a descriptor set for the texture.
- *
- * This function allocates a descriptor set from the descriptor pool using
- * the layout defined by textureDescriptorSetLayout.
- */
-void allocateTextureDescriptorSet() {
-  VkDescriptorSetAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.descriptorPool = textureDescriptorPool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &textureDescriptorSetLayout;
-
-  if (vkAllocateDescriptorSets(device, &allocInfo, &textureDescriptorSet) !=
-      VK_SUCCESS) {
-    fprintf(stderr, "Failed to allocate texture descriptor set!\n");
+uint32_t addBindlessTexture(VkImageView imageView, VkSampler sampler) {
+  uint32_t index;
+  CJellyBindlessError err = cjelly_bindless_table_add(
+      bindlessTextures, imageView, sampler, &index);
+  if (err != CJELLY_BINDLESS_SUCCESS) {
+    fprintf(stderr, "Failed to add texture: %s\n",
+        cjelly_bindless_strerror(err));
     exit(EXIT_FAILURE);
   }
+  return index;
 }
 
+
+//
+// === TEXTURED SQUARE ===
+//
+
 void createTexturedGraphicsPipeline() {
-  // Load SPIR-V binaries and create shader modules for texturing.
-  VkShaderModule vertShaderModule =
-      createShaderModuleFromMemory(device, basic_vert_spv, basic_vert_spv_len);
-  VkShaderModule fragShaderModule = createShaderModuleFromMemory(
-      device, textured_frag_spv, textured_frag_spv_len);
-
-  if (vertShaderModule == VK_NULL_HANDLE ||
-      fragShaderModule == VK_NULL_HANDLE) {
-    fprintf(stderr, "Failed to create textured shader modules\n");
-    exit(EXIT_FAILURE);
+  CJellyPipelineDesc desc;
+  cjelly_pipeline_desc_init(&desc);
+  desc.vertexShader = basicVertShader;
+  desc.fragmentShader = texturedFragShader;
+  desc.renderPass = renderPass;
+
+  // Attribute 0: position (vec2), attribute 1: texture coordinate (vec2).
+  desc.vertexStride = sizeof(VertexTextured);
+  desc.attributeCount = 2;
+  desc.attributes[0] = (VkVertexInputAttributeDescription){
+      0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexTextured, pos)};
+  desc.attributes[1] = (VkVertexInputAttributeDescription){
+      1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexTextured, texCoord)};
+
+  // Set 0 is the bindless texture table, and the slot of the texture is
+  // pushed to the fragment shader.
+  desc.layout.setCount = 1;
+  describeBindlessSetLayout(&desc.layout.sets[0]);
+  desc.layout.pushConstantRangeCount = 1;
+  desc.layout.pushConstantRanges[0] = (VkPushConstantRange){
+      VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t)};
+
+  texturedPipelineEntry = requirePipeline(
+      &desc, "textured", &texturedPipeline, &texturedPipelineLayout);
+}
+
+/// The number of levels in a full mip chain of an image, down to 1x1.
+static uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  for (uint32_t size = width > height ? width : height; size > 1; size >>= 1) {
+    ++levels;
   }
+  return levels;
+}
 
-  VkPipelineShaderStageCreateInfo shaderStages[2] = {0};
-
-  // Vertex shader stage (expects texture coordinates).
-  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = vertShaderModule;
-  shaderStages[0].pName = "main";
-
-  // Fragment shader stage (samples from texture).
-  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = fragShaderModule;
-  shaderStages[1].pName = "main";
-
-  // Define a binding description for our textured vertex structure.
-  VkVertexInputBindingDescription bindingDescription = {0};
-  bindingDescription.binding = 0;
-  bindingDescription.stride = sizeof(VertexTextured);
-  bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-  // Define attribute descriptions for the textured vertex shader inputs.
-  VkVertexInputAttributeDescription attributeDescriptions[2] = {0};
-
-  // Attribute 0: position (vec2)
-  attributeDescriptions[0].binding = 0;
-  attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-  attributeDescriptions[0].offset = offsetof(VertexTextured, pos);
-
-  // Attribute 1: texture coordinate (vec2)
-  attributeDescriptions[1].binding = 0;
-  attributeDescriptions[1].location = 1;
-  attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-  attributeDescriptions[1].offset = offsetof(VertexTextured, texCoord);
-
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
-  vertexInputInfo.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-  vertexInputInfo.vertexAttributeDescriptionCount = 2;
-  vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
-
-  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {0};
-  inputAssembly.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-  inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-  // Keep viewport and dynamic state as before.
-  VkPipelineViewportStateCreateInfo viewportState = {0};
-  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-  viewportState.viewportCount = 1;
-  viewportState.scissorCount = 1;
-
-  VkDynamicState dynamicStates[] = {
-      VK_DYNAMIC_STATE_VIEWPORT,
-      VK_DYNAMIC_STATE_SCISSOR,
-  };
+/// Chooses the filter that shrinks each mip level of an optimally tiled image
+/// into the next.  Returns 0 if the format cannot be blitted at all, in which
+/// case the image gets a single level.
+static int findMipmapFilter(VkFormat format, VkFilter * filter) {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+  VkFormatFeatureFlags features = properties.optimalTilingFeatures;
 
-  VkPipelineDynamicStateCreateInfo dynamicState = {0};
-  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-  dynamicState.dynamicStateCount = 2;
-  dynamicState.pDynamicStates = dynamicStates;
-
-  VkPipelineRasterizationStateCreateInfo rasterizer = {0};
-  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  rasterizer.depthClampEnable = VK_FALSE;
-  rasterizer.rasterizerDiscardEnable = VK_FALSE;
-  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-  rasterizer.lineWidth = 1.0f;
-  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-  rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-
-  VkPipelineMultisampleStateCreateInfo multisampling = {0};
-  multisampling.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-  multisampling.sampleShadingEnable = VK_FALSE;
-  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-  VkPipelineColorBlendAttachmentState colorBlendAttachment = {0};
-  colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
-      VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
-      VK_COLOR_COMPONENT_A_BIT;
-  colorBlendAttachment.blendEnable = VK_FALSE;
-
-  VkPipelineColorBlendStateCreateInfo colorBlending = {0};
-  colorBlending.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-  colorBlending.logicOpEnable = VK_FALSE;
-  colorBlending.attachmentCount = 1;
-  colorBlending.pAttachments = &colorBlendAttachment;
-
-  VkDescriptorSetLayout descriptorSetLayouts[] = {textureDescriptorSetLayout};
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts;
-
-  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL,
-          &texturedPipelineLayout) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create textured pipeline layout\n");
-    exit(EXIT_FAILURE);
+  if (!(features & VK_FORMAT_FEATURE_BLIT_SRC_BIT) ||
+      !(features & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+    return 0;
   }
+  *filter = (features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+      ? VK_FILTER_LINEAR
+      : VK_FILTER_NEAREST;
+  return 1;
+}
 
-  VkGraphicsPipelineCreateInfo pipelineInfo = {0};
-  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipelineInfo.stageCount = 2;
-  pipelineInfo.pStages = shaderStages;
-  pipelineInfo.pVertexInputState = &vertexInputInfo;
-  pipelineInfo.pInputAssemblyState = &inputAssembly;
-  pipelineInfo.pViewportState = &viewportState;
-  pipelineInfo.pDynamicState = &dynamicState;
-  pipelineInfo.pRasterizationState = &rasterizer;
-  pipelineInfo.pMultisampleState = &multisampling;
-  pipelineInfo.pColorBlendState = &colorBlending;
-  pipelineInfo.layout = texturedPipelineLayout; // Use the new layout.
-  pipelineInfo.renderPass = renderPass;
-  pipelineInfo.subpass = 0;
-
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL,
-          &texturedPipeline) != VK_SUCCESS) {
-    fprintf(stderr, "Failed to create textured graphics pipeline\n");
-    exit(EXIT_FAILURE);
+/// Creates a block-compressed texture image from a BMP file, if the device
+/// can sample a suitable format.  The encoded mip chain is kept in the
+/// per-user cache directory, so only the first run pays for the encoding.
+/// Returns 0 if the image should be uploaded uncompressed instead.
+static int createCompressedTextureImage(const char * filePath) {
+  VkFormat opaqueFormat;
+  VkFormat alphaFormat;
+  if (!cjelly_bc_texture_choose_formats(
+          physicalDevice, &opaqueFormat, &alphaFormat)) {
+    return 0;
+  }
+  char cacheName[64];
+  char cachePath[4096];
+  if (!cjelly_bc_texture_cache_name(filePath, cacheName, sizeof(cacheName)) ||
+      cjelly_cache_file_path(cacheName, cachePath, sizeof(cachePath)) !=
+          CJELLY_CACHE_FILE_SUCCESS) {
+    return 0;
+  }
+  CJellyBcTextureCache * cache;
+  CJellyBcTextureCacheError error = cjelly_bc_texture_cache_load_image(
+      filePath, cachePath, opaqueFormat, alphaFormat, &cache);
+  if (error != CJELLY_BC_TEXTURE_CACHE_SUCCESS) {
+    fprintf(stderr, "Failed to compress texture %s: %s\n", filePath,
+        cjelly_bc_texture_cache_strerror(error));
+    return 0;
   }
 
-  // Clean up shader modules after pipeline creation.
-  vkDestroyShaderModule(device, vertShaderModule, NULL);
-  vkDestroyShaderModule(device, fragShaderModule, NULL);
+  const CJellyBcTexture * texture = cjelly_bc_texture_cache_texture(cache);
+  textureFormat = texture->format;
+  textureMipLevels = texture->mipLevels;
+  createImage(texture->width, texture->height, textureMipLevels, textureFormat,
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &textureImage, &textureImageMemory);
+
+  // The uploader copies the blocks into staging, so the cache can be closed
+  // as soon as the upload is queued.
+  VkResult result = cjelly_uploader_upload_image_levels(uploader,
+      textureImage, texture->width, texture->height, texture->mipLevels,
+      texture->levelOffsets, texture->data, texture->size, NULL);
+  cjelly_bc_texture_cache_close(cache);
+  if (result != VK_SUCCESS) {
+    fprintf(stderr, "Failed to upload texture image\n");
+    exit(EXIT_FAILURE);
+  }
+  return 1;
 }
 
 /// Creates a texture image from a BMP file.
 void createTextureImage(const char * filePath) {
+  if (createCompressedTextureImage(filePath)) {
+    return;
+  }
+
   // Load BMP data (assumed to be in 24-bit RGB format)
   CJellyFormatImage * image;
   CJellyFormatImageError error = cjelly_format_image_load(filePath, &image);
@@ -1272,44 +2744,30 @@ void createTextureImage(const char * filePath) {
   // Clean up the original RGB image.
   cjelly_format_image_free(image);
 
-  VkDeviceSize bufferSize = rgbaImageSize;
-
-  // Create a staging buffer to hold the pixel data.
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      &stagingBuffer, &stagingBufferMemory);
-
-  // Map memory and copy the pixel data.
-  void * data;
-  vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, pixels, (size_t)bufferSize);
-  vkUnmapMemory(device, stagingBufferMemory);
-  free(pixels);
-
-  // Create the Vulkan texture image.
+  // Create the Vulkan texture image, with a full mip chain so that it does not
+  // alias when it is drawn smaller than it is.
   // We choose VK_FORMAT_R8G8B8A8_UNORM for the RGBA data.
-  createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM,
+  VkFilter mipmapFilter = VK_FILTER_LINEAR;
+  textureFormat = VK_FORMAT_R8G8B8A8_UNORM;
+  textureMipLevels = findMipmapFilter(textureFormat, &mipmapFilter)
+      ? mipLevelCount(texWidth, texHeight)
+      : 1;
+  createImage(texWidth, texHeight, textureMipLevels, textureFormat,
       VK_IMAGE_TILING_OPTIMAL,
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+          VK_IMAGE_USAGE_SAMPLED_BIT,
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &textureImage, &textureImageMemory);
 
-  // Transition image layout to prepare for the data copy.
-  transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM,
-      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-  // Copy the pixel data from the staging buffer into the texture image.
-  copyBufferToImage(stagingBuffer, textureImage, texWidth, texHeight);
-
-  // Transition the image layout for shader access.
-  transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-  vkDestroyBuffer(device, stagingBuffer, NULL);
-  vkFreeMemory(device, stagingBufferMemory, NULL);
+  // Queue the pixel data for upload.  The uploader takes care of the layout
+  // transitions and of blitting the rest of the mip chain, and leaves the
+  // image ready for sampling.
+  if (cjelly_uploader_upload_image_mipmapped(uploader, textureImage, texWidth,
+          texHeight, textureMipLevels, mipmapFilter, pixels, rgbaImageSize,
+          NULL) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to upload texture image\n");
+    exit(EXIT_FAILURE);
+  }
+  free(pixels);
 }
 
 /// Creates an image view for the texture image.
@@ -1318,10 +2776,10 @@ void createTextureImageView() {
   viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   viewInfo.image = textureImage;
   viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-  viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+  viewInfo.format = textureFormat;
   viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   viewInfo.subresourceRange.baseMipLevel = 0;
-  viewInfo.subresourceRange.levelCount = 1;
+  viewInfo.subresourceRange.levelCount = textureMipLevels;
   viewInfo.subresourceRange.baseArrayLayer = 0;
   viewInfo.subresourceRange.layerCount = 1;
 
@@ -1352,10 +2810,11 @@ void createTextureSampler() {
   samplerInfo.compareEnable = VK_FALSE;
   samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
 
+  // Trilinear filtering over every level that the image has.
   samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   samplerInfo.mipLodBias = 0.0f;
   samplerInfo.minLod = 0.0f;
-  samplerInfo.maxLod = 0.0f;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
   if (vkCreateSampler(device, &samplerInfo, NULL, &textureSampler) !=
       VK_SUCCESS) {
@@ -1364,29 +2823,9 @@ void createTextureSampler() {
   }
 }
 
-/// Updates a descriptor set with the texture image view and sampler.
-void updateTextureDescriptorSet(VkDescriptorSet descriptorSet) {
-  VkDescriptorImageInfo imageInfo = {0};
-  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  imageInfo.imageView = textureImageView;
-  imageInfo.sampler = textureSampler;
-
-  VkWriteDescriptorSet descriptorWrite = {0};
-  descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  descriptorWrite.dstSet = descriptorSet;
-  descriptorWrite.dstBinding =
-      0; // Must match the binding in the descriptor set layout.
-  descriptorWrite.dstArrayElement = 0;
-  descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  descriptorWrite.descriptorCount = 1;
-  descriptorWrite.pImageInfo = &imageInfo;
-
-  vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, NULL);
-}
-
 void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties, VkBuffer * buffer,
-    VkDeviceMemory * bufferMemory) {
+    CJellyGpuAllocation * * bufferMemory) {
   VkBufferCreateInfo bufferInfo = {0};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -1401,31 +2840,28 @@ void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex =
-      findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device, &allocInfo, NULL, bufferMemory) != VK_SUCCESS) {
+  if (cjelly_gpu_allocator_alloc(gpuAllocator, &memRequirements,
+          findMemoryType(memRequirements.memoryTypeBits, properties),
+          CJELLY_GPU_RESOURCE_BUFFER, bufferMemory) != VK_SUCCESS) {
     fprintf(stderr, "Failed to allocate buffer memory\n");
     exit(EXIT_FAILURE);
   }
 
-  vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+  vkBindBufferMemory(
+      device, *buffer, (*bufferMemory)->memory, (*bufferMemory)->offset);
 }
 
-void createImage(uint32_t width, uint32_t height, VkFormat format,
-    VkImageTiling tiling, VkImageUsageFlags usage,
+void createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
+    VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
     VkMemoryPropertyFlags properties, VkImage * image,
-    VkDeviceMemory * imageMemory) {
+    CJellyGpuAllocation * * imageMemory) {
   VkImageCreateInfo imageInfo = {0};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
   imageInfo.extent.width = width;
   imageInfo.extent.height = height;
   imageInfo.extent.depth = 1;
-  imageInfo.mipLevels = 1;
+  imageInfo.mipLevels = mipLevels;
   imageInfo.arrayLayers = 1;
   imageInfo.format = format;
   imageInfo.tiling = tiling;
@@ -1442,120 +2878,20 @@ void createImage(uint32_t width, uint32_t height, VkFormat format,
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device, *image, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex =
-      findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device, &allocInfo, NULL, imageMemory) != VK_SUCCESS) {
+  if (cjelly_gpu_allocator_alloc(gpuAllocator, &memRequirements,
+          findMemoryType(memRequirements.memoryTypeBits, properties),
+          CJELLY_GPU_RESOURCE_IMAGE, imageMemory) != VK_SUCCESS) {
     fprintf(stderr, "Failed to allocate image memory\n");
     exit(EXIT_FAILURE);
   }
 
-  vkBindImageMemory(device, *image, *imageMemory, 0);
-}
-
-VkCommandBuffer beginSingleTimeCommands(void) {
-  VkCommandBufferAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandPool = commandPool;
-  allocInfo.commandBufferCount = 1;
-
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-  VkCommandBufferBeginInfo beginInfo = {0};
-  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
-  return commandBuffer;
-}
-
-void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-  vkEndCommandBuffer(commandBuffer);
-
-  VkSubmitInfo submitInfo = {0};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffer;
-
-  vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue);
-
-  vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-}
-
-void transitionImageLayout(VkImage image, GCJ_MAYBE_UNUSED(VkFormat format),
-    VkImageLayout oldLayout, VkImageLayout newLayout) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkImageMemoryBarrier barrier = {0};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.oldLayout = oldLayout;
-  barrier.newLayout = newLayout;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.image = image;
-
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-
-  VkPipelineStageFlags sourceStage;
-  VkPipelineStageFlags destinationStage;
-
-  if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
-      newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  }
-  else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-      newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  }
-  else {
-    fprintf(stderr, "Unsupported layout transition!\n");
-    exit(EXIT_FAILURE);
-  }
-
-  vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, NULL,
-      0, NULL, 1, &barrier);
-
-  endSingleTimeCommands(commandBuffer);
-}
-
-void copyBufferToImage(
-    VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkBufferImageCopy region = {0};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0; // Tightly packed.
-  region.bufferImageHeight = 0;
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
-  region.imageOffset = (VkOffset3D){0, 0, 0};
-  region.imageExtent = (VkExtent3D){width, height, 1};
-
-  vkCmdCopyBufferToImage(commandBuffer, buffer, image,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-  endSingleTimeCommands(commandBuffer);
+  vkBindImageMemory(
+      device, *image, (*imageMemory)->memory, (*imageMemory)->offset);
 }
 
 void createTexturedCommandBuffersForWindow(CJellyWindow * win) {
+  win->recordCommandBuffers = createTexturedCommandBuffersForWindow;
+  texturedPipeline = holdPipelineForWindow(win, texturedPipelineEntry);
   win->commandBuffers =
       malloc(sizeof(VkCommandBuffer) * win->swapChainImageCount);
   VkCommandBufferAllocateInfo allocInfo = {0};
@@ -1615,13 +2951,15 @@ void createTexturedCommandBuffersForWindow(CJellyWindow * win) {
     vkCmdBindPipeline(win->commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
         texturedPipeline);
 
-    // Bind descriptor sets containing the texture (assuming descriptor set is
-    // allocated and updated).
-    assert(textureDescriptorSet != VK_NULL_HANDLE);
+    // Bind the bindless texture table, and select the texture by its slot.
     assert(texturedPipelineLayout != VK_NULL_HANDLE);
+    VkDescriptorSet textureTable = cjelly_bindless_table_set(bindlessTextures);
     vkCmdBindDescriptorSets(win->commandBuffers[i],
         VK_PIPELINE_BIND_POINT_GRAPHICS, texturedPipelineLayout, 0, 1,
-        &textureDescriptorSet, 0, NULL);
+        &textureTable, 0, NULL);
+    vkCmdPushConstants(win->commandBuffers[i], texturedPipelineLayout,
+        VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(textureTableIndex),
+        &textureTableIndex);
 
     // Issue draw call (the count may vary based on your vertex buffer).
     vkCmdDraw(win->commandBuffers[i], 6, 1, 0, 0);
@@ -1654,41 +2992,405 @@ void createTexturedVertexBuffer() {
 
   VkDeviceSize bufferSize = sizeof(verticesTextured);
 
-  VkBufferCreateInfo bufferInfo = {0};
-  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  bufferInfo.size = bufferSize;
-  bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      &vertexBufferTextured, &vertexBufferTexturedMemory);
 
-  if (vkCreateBuffer(device, &bufferInfo, NULL, &vertexBufferTextured) !=
+  memcpy(vertexBufferTexturedMemory->mapped, verticesTextured,
+      (size_t)bufferSize);
+}
+
+//
+// === INDEXED MESHES ===
+//
+
+void createMeshGraphicsPipeline() {
+  CJellyPipelineDesc desc;
+  cjelly_pipeline_desc_init(&desc);
+  desc.vertexShader = meshVertShader;
+  desc.fragmentShader = meshFragShader;
+  desc.renderPass = renderPass;
+
+  // A single interleaved binding for CJellyMeshVertex: position (vec3),
+  // texture coordinate (vec2), and normal (vec3).
+  desc.vertexStride = sizeof(CJellyMeshVertex);
+  desc.attributeCount = 3;
+  desc.attributes[0] = (VkVertexInputAttributeDescription){
+      0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(CJellyMeshVertex, position)};
+  desc.attributes[1] = (VkVertexInputAttributeDescription){
+      1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(CJellyMeshVertex, texcoord)};
+  desc.attributes[2] = (VkVertexInputAttributeDescription){
+      2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(CJellyMeshVertex, normal)};
+
+  // OBJ faces are counter-clockwise, which becomes clockwise once the vertex
+  // shader flips the y axis.  Both that and culling back faces are the
+  // defaults.  The render pass has no depth attachment, so culling is all
+  // that hides the far side of a mesh: a closed convex mesh draws correctly,
+  // but where the front faces of a concave mesh overlap, the one drawn last
+  // wins.
+
+  // The mesh transform is passed as a push constant.
+  desc.layout.pushConstantRangeCount = 1;
+  desc.layout.pushConstantRanges[0] = (VkPushConstantRange){
+      VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(float) * 4};
+
+  meshPipeline = requirePipeline(&desc, "mesh", NULL, NULL);
+}
+
+
+/**
+ * @brief Creates a device-local buffer, and queues the upload of its contents.
+ */
+static void createDeviceLocalBuffer(const void * data, VkDeviceSize size,
+    VkBufferUsageFlags usage, VkBuffer * buffer,
+    CJellyGpuAllocation * * bufferMemory) {
+  createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+  if (cjelly_uploader_upload_buffer(uploader, *buffer, 0, data, size, NULL) !=
       VK_SUCCESS) {
-    fprintf(stderr, "Failed to create textured vertex buffer\n");
+    fprintf(stderr, "Failed to upload buffer\n");
     exit(EXIT_FAILURE);
   }
+}
 
-  VkMemoryRequirements memRequirements;
-  vkGetBufferMemoryRequirements(device, vertexBufferTextured, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo = {0};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
+void createGpuMesh(const CJellyMesh * mesh, CJellyGpuMesh * gpuMesh) {
+  createDeviceLocalBuffer(mesh->vertices,
+      (VkDeviceSize)mesh->vertex_count * sizeof(CJellyMeshVertex),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &gpuMesh->vertexBuffer,
+      &gpuMesh->vertexBufferMemory);
+  createDeviceLocalBuffer(mesh->indices,
+      (VkDeviceSize)mesh->index_count * cjelly_mesh_index_size(mesh),
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &gpuMesh->indexBuffer,
+      &gpuMesh->indexBufferMemory);
+  gpuMesh->indexCount = mesh->index_count;
+  gpuMesh->pipeline = meshPipeline;
+  gpuMesh->indexType = mesh->index_type == CJELLY_MESH_INDEX_TYPE_UINT16
+      ? VK_INDEX_TYPE_UINT16
+      : VK_INDEX_TYPE_UINT32;
+
+  // Center the bounding box on the origin, and scale its largest dimension to
+  // 90% of the clip space.
+  float extent = 0.0f;
+  for (int axis = 0; axis < 3; ++axis) {
+    float size = mesh->bounds_max[axis] - mesh->bounds_min[axis];
+    if (size > extent) {
+      extent = size;
+    }
+    gpuMesh->transform[axis] =
+        -0.5f * (mesh->bounds_min[axis] + mesh->bounds_max[axis]);
+  }
+  gpuMesh->transform[3] = extent > 0.0f ? 1.8f / extent : 1.0f;
+}
+
+
+void destroyGpuMesh(CJellyGpuMesh * gpuMesh) {
+  vkDestroyBuffer(device, gpuMesh->indexBuffer, NULL);
+  cjelly_gpu_allocator_free(gpuAllocator, gpuMesh->indexBufferMemory);
+  vkDestroyBuffer(device, gpuMesh->vertexBuffer, NULL);
+  cjelly_gpu_allocator_free(gpuAllocator, gpuMesh->vertexBufferMemory);
+}
+
+
+void recordMeshJob(void * user, VkCommandBuffer commandBuffer,
+    const CJellyRecordContext * context) {
+  const CJellyGpuMesh * gpuMesh = (const CJellyGpuMesh *)user;
+
+  // Skip the mesh while its pipeline is still being compiled, rather than
+  // holding up the frame.
+  VkPipeline pipeline =
+      cjelly_pipeline_registry_try_get(
+          pipelineRegistry, gpuMesh->pipeline, context->serial);
+  if (pipeline == VK_NULL_HANDLE) {
+    return;
+  }
+
+  // Divide the triangles evenly between the jobs.
+  uint64_t triangleCount = gpuMesh->indexCount / 3;
+  uint32_t firstTriangle =
+      (uint32_t)(triangleCount * context->jobIndex / context->jobCount);
+  uint32_t lastTriangle =
+      (uint32_t)(triangleCount * (context->jobIndex + 1) / context->jobCount);
+  if (firstTriangle == lastTriangle) {
+    return;
+  }
+
+  // Set dynamic viewport and scissor.  The viewport is square, so that the
+  // mesh keeps its aspect ratio.
+  uint32_t side = context->extent.width < context->extent.height
+      ? context->extent.width
+      : context->extent.height;
+  VkViewport viewport = {0};
+  viewport.x = (float)(context->extent.width - side) / 2.0f;
+  viewport.y = (float)(context->extent.height - side) / 2.0f;
+  viewport.width = (float)side;
+  viewport.height = (float)side;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+  VkRect2D scissor = {0};
+  scissor.offset = (VkOffset2D){0, 0};
+  scissor.extent = context->extent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  vkCmdBindPipeline(
+      commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  vkCmdPushConstants(commandBuffer, cjelly_pipeline_layout(gpuMesh->pipeline),
+      VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(gpuMesh->transform),
+      gpuMesh->transform);
+
+  VkDeviceSize offsets[] = {0};
+  vkCmdBindVertexBuffers(
+      commandBuffer, 0, 1, &gpuMesh->vertexBuffer, offsets);
+  vkCmdBindIndexBuffer(
+      commandBuffer, gpuMesh->indexBuffer, 0, gpuMesh->indexType);
+  vkCmdDrawIndexed(commandBuffer, (lastTriangle - firstTriangle) * 3, 1,
+      firstTriangle * 3, 0, 0);
+}
+
+
+void createMeshRecorderForWindow(CJellyWindow * win, CJellyGpuMesh * gpuMesh) {
+  win->recordJob = recordMeshJob;
+  win->recordUser = gpuMesh;
+  createCommandRecorderForWindow(win);
+}
+
+//
+// === SPRITE BATCHES ===
+//
+
+// The smallest instance buffer that a frame of a sprite batch allocates.
+#define SPRITE_BATCH_MIN_CAPACITY 1024
+
+/**
+ * @brief The instance buffer of one frame in flight.
+ */
+typedef struct SpriteFrame {
+  VkBuffer buffer;              /**< Host-visible instance buffer */
+  CJellyGpuAllocation * memory; /**< Mapped memory bound to the buffer */
+  uint32_t capacity;            /**< Number of sprites that fit in the buffer */
+  uint32_t count;               /**< Number of sprites added so far */
+} SpriteFrame;
+
+struct CJellySpriteBatch {
+  SpriteFrame * frames;       /**< One entry per frame in flight */
+  uint32_t frameCount;        /**< Number of entries in `frames` */
+  SpriteFrame * current;      /**< The frame being filled, or NULL */
+  CJellySpriteBatchFill fill; /**< Adds the sprites of each frame */
+  void * fillUser;            /**< User data passed to `fill` */
+};
+
+// Registry entry of the sprite pipeline (shared by all batches).
+static CJellyPipeline * spritePipeline;
+
+
+void createSpriteGraphicsPipeline() {
+  CJellyPipelineDesc desc;
+  cjelly_pipeline_desc_init(&desc);
+  desc.vertexShader = spriteVertShader;
+  desc.fragmentShader = spriteFragShader;
+  desc.renderPass = renderPass;
+
+  // Binding 0 advances once per sprite: the transform's columns (three vec2),
+  // the texture rectangle (vec4), and the texture slot (uint).
+  desc.vertexStride = sizeof(CJellySprite);
+  desc.vertexInputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  desc.attributeCount = 5;
+  desc.attributes[0] = (VkVertexInputAttributeDescription){
+      0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(CJellySprite, transform)};
+  desc.attributes[1] = (VkVertexInputAttributeDescription){
+      1, 0, VK_FORMAT_R32G32_SFLOAT,
+      offsetof(CJellySprite, transform) + sizeof(float) * 2};
+  desc.attributes[2] = (VkVertexInputAttributeDescription){
+      2, 0, VK_FORMAT_R32G32_SFLOAT,
+      offsetof(CJellySprite, transform) + sizeof(float) * 4};
+  desc.attributes[3] = (VkVertexInputAttributeDescription){
+      3, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(CJellySprite, uvRect)};
+  desc.attributes[4] = (VkVertexInputAttributeDescription){
+      4, 0, VK_FORMAT_R32_UINT, offsetof(CJellySprite, textureIndex)};
+
+  // Each quad is a four-vertex strip.  Sprites may be mirrored by their
+  // transform, so neither winding is culled.
+  desc.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+  desc.cullMode = VK_CULL_MODE_NONE;
+  desc.blendMode = CJELLY_BLEND_MODE_ALPHA;
+
+  // Set 0 is the bindless texture table.
+  desc.layout.setCount = 1;
+  describeBindlessSetLayout(&desc.layout.sets[0]);
+
+  spritePipeline = requirePipeline(&desc, "sprite", NULL, NULL);
+}
+
+
+CJellySpriteBatch * createSpriteBatch() {
+  CJellySpriteBatch * batch = calloc(1, sizeof(CJellySpriteBatch));
+  if (!batch) {
+    fprintf(stderr, "Failed to allocate sprite batch\n");
+    exit(EXIT_FAILURE);
+  }
+  return batch;
+}
+
+
+void destroySpriteBatch(CJellySpriteBatch * batch) {
+  for (uint32_t i = 0; i < batch->frameCount; ++i) {
+    SpriteFrame * frame = &batch->frames[i];
+    if (frame->buffer != VK_NULL_HANDLE) {
+      vkDestroyBuffer(device, frame->buffer, NULL);
+      cjelly_gpu_allocator_free(gpuAllocator, frame->memory);
+    }
+  }
+  free(batch->frames);
+  free(batch);
+}
+
+
+void beginSpriteBatch(CJellySpriteBatch * batch, uint32_t frameIndex) {
+  // Frames are added as they are first used, so the batch does not need to
+  // know how many frames its window keeps in flight.
+  if (frameIndex >= batch->frameCount) {
+    SpriteFrame * frames =
+        realloc(batch->frames, sizeof(SpriteFrame) * (frameIndex + 1));
+    if (!frames) {
+      fprintf(stderr, "Failed to allocate sprite batch frames\n");
+      exit(EXIT_FAILURE);
+    }
+    memset(&frames[batch->frameCount], 0,
+        sizeof(SpriteFrame) * (frameIndex + 1 - batch->frameCount));
+    batch->frames = frames;
+    batch->frameCount = frameIndex + 1;
+  }
+
+  batch->current = &batch->frames[frameIndex];
+  batch->current->count = 0;
+}
+
+
+/**
+ * @brief Replaces a frame's instance buffer with one that holds at least
+ * `needed` sprites, keeping the sprites that were already added.
+ */
+static void growSpriteFrame(SpriteFrame * frame, uint32_t needed) {
+  uint32_t capacity = frame->capacity < SPRITE_BATCH_MIN_CAPACITY
+      ? SPRITE_BATCH_MIN_CAPACITY
+      : frame->capacity;
+  while (capacity < needed) {
+    capacity = capacity > UINT32_MAX / 2 ? needed : capacity * 2;
+  }
+
+  VkBuffer buffer;
+  CJellyGpuAllocation * memory;
+  createBuffer((VkDeviceSize)capacity * sizeof(CJellySprite),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      &buffer, &memory);
 
-  if (vkAllocateMemory(device, &allocInfo, NULL, &vertexBufferTexturedMemory) !=
-      VK_SUCCESS) {
-    fprintf(stderr, "Failed to allocate textured vertex buffer memory\n");
+  if (frame->buffer != VK_NULL_HANDLE) {
+    memcpy(memory->mapped, frame->memory->mapped,
+        (size_t)frame->count * sizeof(CJellySprite));
+    vkDestroyBuffer(device, frame->buffer, NULL);
+    cjelly_gpu_allocator_free(gpuAllocator, frame->memory);
+  }
+  frame->buffer = buffer;
+  frame->memory = memory;
+  frame->capacity = capacity;
+}
+
+
+void addSprites(
+    CJellySpriteBatch * batch, const CJellySprite * sprites, uint32_t count) {
+  SpriteFrame * frame = batch->current;
+  assert(frame);
+  if (count > UINT32_MAX - frame->count) {
+    fprintf(stderr, "Too many sprites in batch\n");
     exit(EXIT_FAILURE);
   }
+  if (frame->count + count > frame->capacity) {
+    growSpriteFrame(frame, frame->count + count);
+  }
+
+  // The memory is coherent, so the sprites only have to be copied.
+  memcpy((CJellySprite *)frame->memory->mapped + frame->count, sprites,
+      (size_t)count * sizeof(CJellySprite));
+  frame->count += count;
+}
+
+
+void recordSpriteBatch(
+    CJellySpriteBatch * batch, VkCommandBuffer commandBuffer, uint64_t serial) {
+  const SpriteFrame * frame = batch->current;
+  if (!frame || frame->count == 0) {
+    return;
+  }
+
+  // Skip the sprites while their pipeline is still being compiled, rather
+  // than holding up the frame.
+  VkPipeline pipeline =
+      cjelly_pipeline_registry_try_get(pipelineRegistry, spritePipeline, serial);
+  if (pipeline == VK_NULL_HANDLE) {
+    return;
+  }
+
+  vkCmdBindPipeline(
+      commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  VkDescriptorSet textureTable = cjelly_bindless_table_set(bindlessTextures);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+      cjelly_pipeline_layout(spritePipeline), 0, 1, &textureTable, 0, NULL);
+
+  VkDeviceSize offsets[] = {0};
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &frame->buffer, offsets);
+
+  // Each sprite picks its texture from the bindless table, so the whole batch
+  // is a single draw.
+  vkCmdDraw(commandBuffer, 4, frame->count, 0, 0);
+}
+
+
+/**
+ * @brief Records a frame of a window that draws a sprite batch.
+ *
+ * @param user The CJellySpriteBatch to draw.
+ * @param commandBuffer The secondary command buffer to record into.
+ * @param context Describes the job.
+ */
+static void recordSpriteJob(void * user, VkCommandBuffer commandBuffer,
+    const CJellyRecordContext * context) {
+  CJellySpriteBatch * batch = (CJellySpriteBatch *)user;
+
+  beginSpriteBatch(batch, context->frameIndex);
+  if (batch->fill) {
+    batch->fill(batch->fillUser, batch, context);
+  }
+
+  // Sprites are placed in clip space, so they cover the whole window.
+  VkViewport viewport = {0};
+  viewport.width = (float)context->extent.width;
+  viewport.height = (float)context->extent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+  VkRect2D scissor = {0};
+  scissor.offset = (VkOffset2D){0, 0};
+  scissor.extent = context->extent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  recordSpriteBatch(batch, commandBuffer, context->serial);
+}
 
-  vkBindBufferMemory(
-      device, vertexBufferTextured, vertexBufferTexturedMemory, 0);
 
-  void * data;
-  vkMapMemory(device, vertexBufferTexturedMemory, 0, bufferSize, 0, &data);
-  memcpy(data, verticesTextured, (size_t)bufferSize);
-  vkUnmapMemory(device, vertexBufferTexturedMemory);
+void createSpriteRecorderForWindow(CJellyWindow * win, CJellySpriteBatch * batch,
+    CJellySpriteBatchFill fill, void * user) {
+  batch->fill = fill;
+  batch->fillUser = user;
+  win->recordJob = recordSpriteJob;
+  win->recordUser = batch;
+  win->recordJobCount = 1;
+  createCommandRecorderForWindow(win);
 }
 
 //
@@ -1701,42 +3403,98 @@ void initVulkanGlobal() {
     createDebugMessenger();
   pickPhysicalDevice();
   createLogicalDevice();
+  gpuAllocator = cjelly_gpu_allocator_create(physicalDevice, device, 0);
+  if (!gpuAllocator) {
+    fprintf(stderr, "Failed to create GPU memory allocator\n");
+    exit(EXIT_FAILURE);
+  }
+  if (memoryBudgetEnabled) {
+    cjelly_gpu_allocator_use_memory_budget(gpuAllocator);
+  }
+  uploader = cjelly_uploader_create(device, gpuAllocator,
+      graphicsQueueFamilyIndex, graphicsQueue, graphicsQueueMutex,
+      transferQueueFamilyIndex, transferQueue, transferQueueMutex, 0);
+  if (!uploader) {
+    fprintf(stderr, "Failed to create upload queue\n");
+    exit(EXIT_FAILURE);
+  }
+  threadPool = cjelly_thread_pool_create(0);
+  if (!threadPool) {
+    fprintf(stderr, "Failed to create thread pool\n");
+    exit(EXIT_FAILURE);
+  }
+  // Compiled pipelines from the previous run, if the device and driver have
+  // not changed since.
+  if (cjelly_pipeline_cache_path("pipeline.cache", pipelineCachePath,
+          sizeof(pipelineCachePath)) != CJELLY_PIPELINE_CACHE_SUCCESS) {
+    pipelineCachePath[0] = '\0';
+  }
+  pipelineCacheStatus = cjelly_pipeline_cache_load(physicalDevice, device,
+      pipelineCachePath[0] ? pipelineCachePath : NULL, &pipelineCache);
+  if (pipelineCacheStatus == CJELLY_PIPELINE_CACHE_ERR_VULKAN) {
+    fprintf(stderr, "Failed to create pipeline cache\n");
+    exit(EXIT_FAILURE);
+  }
+  pipelineRegistry = cjelly_pipeline_registry_create(
+      device, pipelineCache, PIPELINE_COMPILE_THREADS);
+  if (!pipelineRegistry) {
+    fprintf(stderr, "Failed to create pipeline registry\n");
+    exit(EXIT_FAILURE);
+  }
+  shaderCache = cjelly_shader_cache_create(device);
+  if (!shaderCache) {
+    fprintf(stderr, "Failed to create shader cache\n");
+    exit(EXIT_FAILURE);
+  }
+  createShaderModules();
+  createBindlessTextureTable();
   createRenderPass();
   createCommandPool();
 
   createVertexBuffer();
-  createGraphicsPipeline();
 
   // Textured square setup.
   createTextureImage("test/images/bmp/tang.bmp");
   createTexturedVertexBuffer();
   createTextureImageView();
   createTextureSampler();
-  createDescriptorSetLayouts();
-  createTextureDescriptorPool();
-  allocateTextureDescriptorSet();
-  updateTextureDescriptorSet(textureDescriptorSet);
+  textureTableIndex = addBindlessTexture(textureImageView, textureSampler);
+  textureCache = cjelly_texture_cache_create(physicalDevice, device,
+      gpuAllocator, uploader, bindlessTextures, textureSampler,
+      textureCacheBudget);
+  if (!textureCache) {
+    fprintf(stderr, "Failed to create texture cache\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // The pipelines are created together, so that the time that the pipeline
+  // cache saves can be measured.
+  uint64_t pipelineStart = getCurrentTimeInNanoseconds();
+  createGraphicsPipeline();
   createTexturedGraphicsPipeline();
+  createMeshGraphicsPipeline();
+  createSpriteGraphicsPipeline();
+  pipelineCreationTime = getCurrentTimeInNanoseconds() - pipelineStart;
 }
 
 void cleanupVulkanGlobal() {
-  // Destroy pipeline and related objects.
-  vkDestroyPipeline(device, graphicsPipeline, NULL);
-  vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+  // Destroy the cached textures, the texture table, and every other
+  // descriptor set, then every pipeline, pipeline layout, and descriptor set
+  // layout, once any background compiles have finished.
+  cjelly_texture_cache_destroy(textureCache);
+  cjelly_bindless_table_destroy(bindlessTextures);
+  cjelly_pipeline_registry_destroy(pipelineRegistry);
+  cjelly_shader_cache_destroy(shaderCache);
   vkDestroyRenderPass(device, renderPass, NULL);
 
   // Clean up the vertex buffer for the colorful square.
   vkDestroyBuffer(device, vertexBuffer, NULL);
-  vkFreeMemory(device, vertexBufferMemory, NULL);
+  cjelly_gpu_allocator_free(gpuAllocator, vertexBufferMemory);
 
   // --- Begin Texture Cleanup ---
-  // Destroy the textured pipeline and layout.
-  vkDestroyPipeline(device, texturedPipeline, NULL);
-  vkDestroyPipelineLayout(device, texturedPipelineLayout, NULL);
-
   // Destroy the textured vertex buffer.
   vkDestroyBuffer(device, vertexBufferTextured, NULL);
-  vkFreeMemory(device, vertexBufferTexturedMemory, NULL);
+  cjelly_gpu_allocator_free(gpuAllocator, vertexBufferTexturedMemory);
 
   // Destroy the texture sampler and image view.
   vkDestroySampler(device, textureSampler, NULL);
@@ -1744,24 +3502,39 @@ void cleanupVulkanGlobal() {
 
   // Destroy the texture image and free its memory.
   vkDestroyImage(device, textureImage, NULL);
-  vkFreeMemory(device, textureImageMemory, NULL);
-
-  // Destroy the descriptor pool and layout for the texture.
-  vkDestroyDescriptorPool(device, textureDescriptorPool, NULL);
-  vkDestroyDescriptorSetLayout(device, textureDescriptorSetLayout, NULL);
-  // Note: The textureDescriptorSet is automatically freed when the descriptor
-  // pool is destroyed.
+  cjelly_gpu_allocator_free(gpuAllocator, textureImageMemory);
   // --- End Texture Cleanup ---
 
   // Clean up the command pool.
   vkDestroyCommandPool(device, commandPool, NULL);
 
+  // Save the compiled pipelines for the next run.  A failure only costs the
+  // next run its warm start.
+  if (pipelineCachePath[0]) {
+    cjelly_pipeline_cache_save(
+        physicalDevice, device, pipelineCache, pipelineCachePath);
+  }
+  vkDestroyPipelineCache(device, pipelineCache, NULL);
+
   // Destroy the debug messenger if validation layers are enabled.
   if (enableValidationLayers) {
     destroyDebugMessenger();
   }
 
-  // Destroy the device and instance.
+  cjelly_thread_pool_destroy(threadPool);
+
+#ifndef _WIN32
+  if (wakePipe[0] >= 0) {
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    wakePipe[0] = wakePipe[1] = -1;
+  }
+#endif
+
+  // Release the upload queue's staging memory and the remaining device memory
+  // blocks, then destroy the device and instance.
+  cjelly_uploader_destroy(uploader);
+  cjelly_gpu_allocator_destroy(gpuAllocator);
   vkDestroyDevice(device, NULL);
   vkDestroyInstance(instance, NULL);
 }
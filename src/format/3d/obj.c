@@ -1,9 +1,14 @@
+#include <cjelly/format/3d/obj.h>
+
 #include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-#include <cjelly/format/3d/obj.h>
+#include <cjelly/cachefile.h>
 
 
 // Reference documents:
@@ -12,27 +17,666 @@
 // https://paulbourke.net/dataformats/obj/obj_spec.pdf
 
 
-#define LINE_SIZE 256
+/**
+ * @brief Maximum length of a number token that is handed to strtof().
+ *
+ * The fast float scanner falls back to strtof() for the rare numbers that it
+ * cannot convert exactly (very long mantissas, large exponents, inf/nan).  The
+ * token is copied into a stack buffer of this size first, because the mapped
+ * file is not NUL-terminated.
+ */
+#define NUMBER_BUFFER_SIZE 64
 
 
-CJellyFormat3dObjError cjelly_format_3d_obj_load(const char * filename, CJellyFormat3dObjModel * * outModel) {
-  CJellyFormat3dObjError err = CJELLY_FORMAT_3D_OBJ_SUCCESS;
+/**
+ * @brief Maps a file into memory for reading.
+ *
+ * The parser works directly on the mapped bytes, so no per-line copy is ever
+ * made.
+ *
+ * @param filename Path to the file.
+ * @param view The view to initialize.
+ * @return CJellyFormat3dObjError Error code indicating success or failure.
+ */
+static CJellyFormat3dObjError map_file(const char * filename, CJellyCacheFileView * view) {
+  switch (cjelly_cache_file_map(filename, view)) {
+    case CJELLY_CACHE_FILE_SUCCESS:
+      return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+    case CJELLY_CACHE_FILE_ERR_OUT_OF_MEMORY:
+      return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+    case CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND:
+      return CJELLY_FORMAT_3D_OBJ_ERR_FILE_NOT_FOUND;
+    default:
+      return CJELLY_FORMAT_3D_OBJ_ERR_IO;
+  }
+}
 
-  // Check for invalid input.
-  if (!filename || !outModel) {
-    return CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+
+// The scanners below rely on every line being terminated by '\n'.  The
+// newline acts as a sentinel: none of the character classes accept it, so the
+// scanners stop at the end of a line without checking the buffer bounds for
+// every character.  parse_lines() is only ever handed such a buffer.
+
+// Character classification helpers.  The <ctype.h> functions are locale
+// dependent and noticeably slower, and OBJ files are plain ASCII.
+static inline bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool is_digit(char c) {
+  return (unsigned char)(c - '0') < 10;
+}
+
+
+/**
+ * @brief Advances past spaces and tabs, but never past the end of the line.
+ */
+static inline const char * skip_blanks(const char * p) {
+  while (is_blank(*p)) {
+    ++p;
   }
+  return p;
+}
 
-  // Open the file for reading.
-  FILE* fp = fopen(filename, "r");
-  if (!fp) {
-    fprintf(stderr, "Cannot open file %s\n", filename);
-    return CJELLY_FORMAT_3D_OBJ_ERR_FILE_NOT_FOUND;
+
+/**
+ * @brief Returns a pointer to the first character of the next line.
+ */
+static inline const char * next_line(const char * p, const char * end) {
+  // Most records are parsed up to their newline, so check for that first.
+  if (*p == '\n') {
+    return p + 1;
+  }
+  const char * nl = memchr(p, '\n', (size_t)(end - p));
+  return nl ? nl + 1 : end;
+}
+
+
+/**
+ * @brief Returns true if the token ends at `p` (whitespace or end of line).
+ */
+static inline bool at_token_end(const char * p) {
+  return is_blank(*p) || *p == '\n';
+}
+
+
+/**
+ * @brief Returns true if the line at `p` starts with `keyword` followed by
+ * whitespace or the end of the line.
+ *
+ * On success, `*after` points to the first character after the keyword.
+ */
+static inline bool match_keyword(const char * p, const char * keyword, const char * * after) {
+  // Compare one character at a time, so that the newline stops the comparison
+  // before it can run past the end of the buffer.
+  while (*keyword) {
+    if (*p != *keyword) {
+      return false;
+    }
+    ++p;
+    ++keyword;
+  }
+  if (!at_token_end(p)) {
+    return false;
+  }
+  *after = p;
+  return true;
+}
+
+
+/**
+ * @brief Parses a (possibly signed) decimal integer.
+ *
+ * @param p In/out pointer to the current position.  On success, it points to
+ *   the first character after the number.
+ * @param out The parsed value.
+ * @return true on success, false if no digits were found or on overflow.
+ */
+static inline bool parse_int(const char * * p, int * out) {
+  const char * s = *p;
+  bool negative = false;
+  if (*s == '-' || *s == '+') {
+    negative = *s == '-';
+    ++s;
+  }
+  if (!is_digit(*s)) {
+    return false;
+  }
+  uint32_t value = 0;
+  while (is_digit(*s)) {
+    if (value > (INT32_MAX - 9) / 10) {
+      // Reject anything that might not fit in an int.
+      return false;
+    }
+    value = value * 10 + (uint32_t)(*s - '0');
+    ++s;
+  }
+  *out = negative ? -(int)value : (int)value;
+  *p = s;
+  return true;
+}
+
+
+/**
+ * @brief Parses a floating point number.
+ *
+ * The common OBJ case (a short decimal mantissa with a small exponent) is
+ * converted with a single IEEE float operation, which is exact.  Anything else
+ * is converted by strtof(), so the result is always identical to what the
+ * standard library (and therefore sscanf("%f")) would produce.
+ *
+ * @param p In/out pointer to the current position.  On success, it points to
+ *   the first character after the number.
+ * @param out The parsed value.
+ * @return true on success, false if no number was found.
+ */
+static inline bool parse_float(const char * * p, float * out) {
+  // Powers of ten that are exactly representable as a float.
+  static const float powers[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+  };
+
+  const char * s = *p;
+  bool negative = false;
+  if (*s == '-' || *s == '+') {
+    negative = *s == '-';
+    ++s;
+  }
+
+  // Accumulate at most 24 bits of mantissa, which is exact as a float.
+  uint32_t mantissa = 0;
+  int exponent = 0;
+  bool digits = false;
+  bool exact = true;
+  while (is_digit(*s)) {
+    if (mantissa < (1u << 24) / 10) {
+      mantissa = mantissa * 10 + (uint32_t)(*s - '0');
+    }
+    else {
+      exact = false;
+    }
+    digits = true;
+    ++s;
+  }
+  if (*s == '.') {
+    ++s;
+    while (is_digit(*s)) {
+      if (mantissa < (1u << 24) / 10) {
+        mantissa = mantissa * 10 + (uint32_t)(*s - '0');
+        --exponent;
+      }
+      else if (*s != '0') {
+        exact = false;
+      }
+      digits = true;
+      ++s;
+    }
+  }
+  if (!digits) {
+    // Not a decimal number.  It may still be "inf" or "nan", so let strtof()
+    // decide.
+    exact = false;
+  }
+  else if (*s == 'e' || *s == 'E') {
+    const char * e = s + 1;
+    int exp_value = 0;
+    if (parse_int(&e, &exp_value) && exp_value > -100 && exp_value < 100) {
+      exponent += exp_value;
+      s = e;
+    }
+    else {
+      exact = false;
+    }
+  }
+
+  if (exact && exponent >= -10 && exponent <= 10) {
+    float value = (float)mantissa;
+    value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+    *out = negative ? -value : value;
+    *p = s;
+    return true;
+  }
+
+  // Slow path: copy the token so that strtof() sees a NUL-terminated string.
+  char buffer[NUMBER_BUFFER_SIZE];
+  size_t length = 0;
+  s = *p;
+  while (!at_token_end(s + length) && length < sizeof(buffer) - 1) {
+    buffer[length] = s[length];
+    ++length;
+  }
+  buffer[length] = '\0';
+  char * stop;
+  float value = strtof(buffer, &stop);
+  if (stop == buffer) {
+    return false;
+  }
+  *out = value;
+  *p = s + (stop - buffer);
+  return true;
+}
+
+
+/**
+ * @brief Parses `count` whitespace-separated floats from a line.
+ *
+ * Any trailing values (such as the optional `w` component of a vertex) are
+ * ignored.
+ *
+ * @return A pointer to the first character after the last parsed value, or
+ *   NULL if the line does not contain `count` valid numbers.
+ */
+static inline const char * parse_floats(const char * p, float * out, int count) {
+  for (int i = 0; i < count; ++i) {
+    p = skip_blanks(p);
+    if (!parse_float(&p, &out[i]) || !at_token_end(p)) {
+      return NULL;
+    }
+  }
+  return p;
+}
+
+
+/**
+ * @brief Copies the first whitespace-delimited word of a line.
+ *
+ * At most `size - 1` characters are copied, and the result is always
+ * NUL-terminated.
+ *
+ * @return true if a word was found, false if the rest of the line is empty.
+ */
+static bool parse_name(const char * p, char * out, size_t size) {
+  p = skip_blanks(p);
+  size_t length = 0;
+  while (!at_token_end(p + length)) {
+    ++length;
+  }
+  if (!length) {
+    return false;
+  }
+  if (length > size - 1) {
+    length = size - 1;
+  }
+  memcpy(out, p, length);
+  out[length] = '\0';
+  return true;
+}
+
+
+/**
+ * @brief Converts a 1-based (or negative, relative) OBJ index to 0-based.
+ *
+ * @param index The index as it appears in the file.
+ * @param count The number of elements defined so far.
+ * @return The 0-based index.
+ */
+static inline int resolve_index(int index, int count) {
+  return index < 0 ? count + index : index - 1;
+}
+
+
+/**
+ * @brief Grows the per-face arrays to hold at least `count` faces.
+ *
+ * The capacity is at least doubled, so that repeated calls for one more face
+ * are amortized.  The offset array always has room for one extra entry.
+ *
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool reserve_faces(CJellyFormat3dObjModel * model, int count) {
+  if (count <= model->face_capacity) {
+    return true;
+  }
+  int capacity = model->face_capacity * 2 > count ? model->face_capacity * 2 : count;
+  int * offsets = realloc(model->face_offsets, ((size_t)capacity + 1) * sizeof(int));
+  if (!offsets) { return false; }
+  model->face_offsets = offsets;
+  int * materials = realloc(model->face_materials, (size_t)capacity * sizeof(int));
+  if (!materials) { return false; }
+  model->face_materials = materials;
+  model->face_capacity = capacity;
+  return true;
+}
+
+
+/**
+ * @brief Grows the corner streams to hold at least `count` corners.
+ *
+ * The capacity is at least doubled, so that repeated calls for one more
+ * corner are amortized.
+ *
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool reserve_corners(CJellyFormat3dObjModel * model, int count) {
+  if (count <= model->corner_capacity) {
+    return true;
   }
+  int capacity = model->corner_capacity * 2 > count ? model->corner_capacity * 2 : count;
+  int * vertices = realloc(model->corner_vertices, (size_t)capacity * sizeof(int));
+  if (!vertices) { return false; }
+  model->corner_vertices = vertices;
+  int * texcoords = realloc(model->corner_texcoords, (size_t)capacity * sizeof(int));
+  if (!texcoords) { return false; }
+  model->corner_texcoords = texcoords;
+  int * normals = realloc(model->corner_normals, (size_t)capacity * sizeof(int));
+  if (!normals) { return false; }
+  model->corner_normals = normals;
+  model->corner_capacity = capacity;
+  return true;
+}
+
+
+/**
+ * @brief Placeholder for a group or material that is set in an earlier chunk.
+ *
+ * When a file is parsed in parallel, a chunk cannot know which group or
+ * material is active when it starts.  Faces parsed before the chunk's first
+ * "g" or "usemtl" line use this value, and it is replaced during the merge.
+ */
+#define OBJ_INHERITED (-2)
+
+
+/**
+ * @brief Parser state that persists from one line to the next.
+ */
+typedef struct {
+  CJellyFormat3dObjModel * model; /**< The model being populated */
+  int current_group;              /**< Index of the current active group */
+  int current_material_index;     /**< Current material index (updated by "usemtl" directive) */
+  int vertex_base;                /**< Number of vertices defined before `model` */
+  int texcoord_base;              /**< Number of texture coordinates defined before `model` */
+  int normal_base;                /**< Number of normals defined before `model` */
+  int inherited_face_count;       /**< Faces added while `current_group` is OBJ_INHERITED */
+} ObjParseState;
+
+
+/**
+ * @brief Initializes the parser state for a model.
+ *
+ * @param state The state to initialize.
+ * @param model The model to populate.
+ * @param chunked True if the lines are a chunk in the middle of a file, in
+ *   which case the active group and material are not yet known.
+ */
+static void parse_state_init(ObjParseState * state, CJellyFormat3dObjModel * model, bool chunked) {
+  state->model = model;
+  state->current_group = chunked ? OBJ_INHERITED : -1;
+  state->current_material_index = chunked ? OBJ_INHERITED : -1;
+  state->vertex_base = 0;
+  state->texcoord_base = 0;
+  state->normal_base = 0;
+  state->inherited_face_count = 0;
+}
+
+
+/**
+ * @brief Parses a run of complete lines into the model.
+ *
+ * @param state The parser state.
+ * @param begin The first character of the first line.
+ * @param end One past the last character.  If `begin < end`, then `end[-1]`
+ *   must be '\n'.
+ * @return CJellyFormat3dObjError Error code indicating success or failure.
+ */
+static CJellyFormat3dObjError parse_lines(ObjParseState * state, const char * begin, const char * end) {
+  CJellyFormat3dObjError err = CJELLY_FORMAT_3D_OBJ_SUCCESS;
+  CJellyFormat3dObjModel * model = state->model;
+
+  assert(begin == end || end[-1] == '\n');
+
+  // `line` points to the first character of a line, and `rest` to the first
+  // character after the line's keyword.  Records that are parsed to the end
+  // move `line` forward, so that the search for the next newline does not
+  // scan the same bytes twice.
+  const char * rest;
+  for (const char * line = begin; line < end; line = next_line(line, end)) {
+    line = skip_blanks(line);
+
+    // Dispatch on the first character, so that the most common records
+    // ("v" and "f") are recognized with as few comparisons as possible.
+    switch (*line) {
+      case 'v':
+        if (match_keyword(line, "v", &rest)) {
+          // Read a vertex line.
+          CJellyFormat3dObjVertex v;
+          float xyz[3];
+          line = parse_floats(rest, xyz, 3);
+          if (!line) {
+            err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+            goto ERROR_RETURN;
+          }
+          v.x = xyz[0];
+          v.y = xyz[1];
+          v.z = xyz[2];
+          if (model->vertex_count >= model->vertex_capacity) {
+            model->vertex_capacity *= 2;
+            CJellyFormat3dObjVertex* temp = realloc(model->vertices, model->vertex_capacity * sizeof(CJellyFormat3dObjVertex));
+            if (!temp) { goto ERROR_RETURN; }
+            model->vertices = temp;
+          }
+          model->vertices[model->vertex_count++] = v;
+        }
+        else if (match_keyword(line, "vt", &rest)) {
+          // Read a texture coordinate line.
+          CJellyFormat3dObjTexCoord vt;
+          float uv[2];
+          line = parse_floats(rest, uv, 2);
+          if (!line) {
+            err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+            goto ERROR_RETURN;
+          }
+          vt.u = uv[0];
+          vt.v = uv[1];
+          if (model->texcoord_count >= model->texcoord_capacity) {
+            model->texcoord_capacity *= 2;
+            CJellyFormat3dObjTexCoord* temp = realloc(model->texcoords, model->texcoord_capacity * sizeof(CJellyFormat3dObjTexCoord));
+            if (!temp) { goto ERROR_RETURN; }
+            model->texcoords = temp;
+          }
+          model->texcoords[model->texcoord_count++] = vt;
+        }
+        else if (match_keyword(line, "vn", &rest)) {
+          // Read a normal line.
+          CJellyFormat3dObjNormal vn;
+          float xyz[3];
+          line = parse_floats(rest, xyz, 3);
+          if (!line) {
+            err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+            goto ERROR_RETURN;
+          }
+          vn.x = xyz[0];
+          vn.y = xyz[1];
+          vn.z = xyz[2];
+          if (model->normal_count >= model->normal_capacity) {
+            model->normal_capacity *= 2;
+            CJellyFormat3dObjNormal* temp = realloc(model->normals, model->normal_capacity * sizeof(CJellyFormat3dObjNormal));
+            if (!temp) { goto ERROR_RETURN; }
+            model->normals = temp;
+          }
+          model->normals[model->normal_count++] = vn;
+        }
+        break;
 
-  // Allocate memory for the model structure.
-  CJellyFormat3dObjModel * model = (CJellyFormat3dObjModel *)malloc(sizeof(CJellyFormat3dObjModel));
-  if (!model) { goto ERROR_CLEANUP; }
+      case 'f':
+        if (match_keyword(line, "f", &rest)) {
+          // Read a face line.  The corners are appended directly to the
+          // corner streams, and the corner count is only advanced once the
+          // whole line is valid.  The streams and the element counts are
+          // held in locals, since the compiler cannot otherwise tell that
+          // storing a corner leaves them unchanged.
+          int first_corner = model->corner_count;
+          int corner = first_corner;
+          int * corner_vertices = model->corner_vertices;
+          int * corner_texcoords = model->corner_texcoords;
+          int * corner_normals = model->corner_normals;
+
+          // Relative indices count back from the last element defined so
+          // far, which may be in an earlier chunk.
+          int vertex_count = state->vertex_base + model->vertex_count;
+          int texcoord_count = state->texcoord_base + model->texcoord_count;
+          int normal_count = state->normal_base + model->normal_count;
+
+          // Each corner is "v", "v/vt", "v//vn", or "v/vt/vn".
+          const char * p = skip_blanks(rest);
+          while (*p != '\n') {
+            int vIndex = 0, vtIndex = 0, vnIndex = 0;
+            if (!parse_int(&p, &vIndex)) {
+              goto FACE_INVALID_FORMAT;
+            }
+            if (*p == '/') {
+              ++p;
+              if (*p != '/' && !parse_int(&p, &vtIndex)) {
+                goto FACE_INVALID_FORMAT;
+              }
+              if (*p == '/') {
+                ++p;
+                if (!parse_int(&p, &vnIndex)) {
+                  goto FACE_INVALID_FORMAT;
+                }
+              }
+            }
+            if (!at_token_end(p) || !vIndex) {
+              goto FACE_INVALID_FORMAT;
+            }
+            p = skip_blanks(p);
+
+            if (corner >= model->corner_capacity) {
+              if (!reserve_corners(model, corner + 1)) {
+                goto ERROR_RETURN;
+              }
+              corner_vertices = model->corner_vertices;
+              corner_texcoords = model->corner_texcoords;
+              corner_normals = model->corner_normals;
+            }
+            corner_vertices[corner] = resolve_index(vIndex, vertex_count);
+            corner_texcoords[corner] = vtIndex ? resolve_index(vtIndex, texcoord_count) : -1;
+            corner_normals[corner] = vnIndex ? resolve_index(vnIndex, normal_count) : -1;
+            ++corner;
+          }
+          if (corner == first_corner) {
+            goto FACE_INVALID_FORMAT;
+          }
+          model->corner_count = corner;
+          line = p;
+
+          // Append the face.
+          if (!reserve_faces(model, model->face_count + 1)) {
+            model->corner_count = first_corner;
+            goto ERROR_RETURN;
+          }
+          model->face_offsets[model->face_count] = first_corner;
+          model->face_materials[model->face_count] = state->current_material_index;
+          model->face_count++;
+          model->face_offsets[model->face_count] = model->corner_count;
+          if (state->current_group >= 0) {
+            model->groups[state->current_group].face_count++;
+          }
+          else if (state->current_group == OBJ_INHERITED) {
+            state->inherited_face_count++;
+          }
+          break;
+
+        FACE_INVALID_FORMAT:
+          err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+          goto ERROR_RETURN;
+        }
+        break;
+
+      case 'g':
+      case 'o':
+        if (match_keyword(line, "g", &rest) || match_keyword(line, "o", &rest)) {
+          // Read a group or object name line.  A bare "g" (no name) selects
+          // the default group, which is not recorded.
+          char name[CJELLY_FORMAT_3D_OBJ_MAX_NAME_LENGTH];
+          if (parse_name(rest, name, sizeof(name))) {
+            if (model->group_count >= model->group_capacity) {
+              model->group_capacity *= 2;
+              CJellyFormat3dObjGroup* temp = realloc(model->groups, model->group_capacity * sizeof(CJellyFormat3dObjGroup));
+              if (!temp) { goto ERROR_RETURN; }
+              model->groups = temp;
+            }
+            strcpy(model->groups[model->group_count].name, name);
+            model->groups[model->group_count].start_face = model->face_count;
+            model->groups[model->group_count].face_count = 0;
+            state->current_group = model->group_count;
+            model->group_count++;
+          }
+        }
+        break;
+
+      case 'u':
+        if (match_keyword(line, "usemtl", &rest)) {
+          // Read a material usage directive.
+          char mtl_name[CJELLY_FORMAT_3D_OBJ_MAX_NAME_LENGTH];
+          if (parse_name(rest, mtl_name, sizeof(mtl_name))) {
+            int found = 0;
+            int mapped_index = -1;
+            // Search for an existing mapping.
+            for (int i = 0; i < model->material_mapping_count; i++) {
+              if (strcmp(model->material_mappings[i].name, mtl_name) == 0) {
+                found = 1;
+                mapped_index = model->material_mappings[i].index;
+                break;
+              }
+            }
+            if (!found) {
+              // Add a new mapping.
+              if (model->material_mapping_count >= model->material_mapping_capacity) {
+                model->material_mapping_capacity *= 2;
+                CJellyFormat3dObjMaterialMapping* temp = realloc(model->material_mappings, model->material_mapping_capacity * sizeof(CJellyFormat3dObjMaterialMapping));
+                if (!temp) { goto ERROR_RETURN; }
+                model->material_mappings = temp;
+              }
+              strcpy(model->material_mappings[model->material_mapping_count].name, mtl_name);
+              model->material_mappings[model->material_mapping_count].index = model->material_mapping_count;
+              mapped_index = model->material_mapping_count;
+              model->material_mapping_count++;
+            }
+            state->current_material_index = mapped_index;
+          }
+          else {
+            err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+            goto ERROR_RETURN;
+          }
+        }
+        break;
+
+      case 'm':
+        if (match_keyword(line, "mtllib", &rest)) {
+          // Read the material library name.
+          parse_name(rest, model->mtllib, sizeof(model->mtllib));
+        }
+        break;
+
+      default:
+        // Blank lines, comments ('#') and unsupported statements are ignored.
+        break;
+    }
+  }
+
+  return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+
+  // Error handling.
+ERROR_RETURN:
+  // If an error is not set, then default to out-of-memory.
+  // This approach is used in this function because out-of-memory is the most
+  // common reason to error out, so it was chosen to be the default.
+  return err == CJELLY_FORMAT_3D_OBJ_SUCCESS
+      ? CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY
+      : err;
+}
+
+
+/**
+ * @brief Allocates an empty model with the default initial capacities.
+ *
+ * @return The new model, or NULL if memory could not be allocated.
+ */
+static CJellyFormat3dObjModel * model_create(void) {
+  // Allocate memory for the model structure.  It is zeroed so that the
+  // cleanup code can safely free a partially constructed model.
+  CJellyFormat3dObjModel * model = (CJellyFormat3dObjModel *)calloc(1, sizeof(CJellyFormat3dObjModel));
+  if (!model) { return NULL; }
 
   // Initialize all counts and capacities, and preallocate memory.
   model->vertex_count = 0;
@@ -52,8 +696,20 @@ CJellyFormat3dObjError cjelly_format_3d_obj_load(const char * filename, CJellyFo
 
   model->face_count = 0;
   model->face_capacity = 128;
-  model->faces = (CJellyFormat3dObjFace *)malloc(model->face_capacity * sizeof(CJellyFormat3dObjFace));
-  if (!model->faces) { goto ERROR_CLEANUP; }
+  model->face_offsets = (int *)malloc((model->face_capacity + 1) * sizeof(int));
+  if (!model->face_offsets) { goto ERROR_CLEANUP; }
+  model->face_offsets[0] = 0;
+  model->face_materials = (int *)malloc(model->face_capacity * sizeof(int));
+  if (!model->face_materials) { goto ERROR_CLEANUP; }
+
+  model->corner_count = 0;
+  model->corner_capacity = 512;
+  model->corner_vertices = (int *)malloc(model->corner_capacity * sizeof(int));
+  if (!model->corner_vertices) { goto ERROR_CLEANUP; }
+  model->corner_texcoords = (int *)malloc(model->corner_capacity * sizeof(int));
+  if (!model->corner_texcoords) { goto ERROR_CLEANUP; }
+  model->corner_normals = (int *)malloc(model->corner_capacity * sizeof(int));
+  if (!model->corner_normals) { goto ERROR_CLEANUP; }
 
   model->group_count = 0;
   model->group_capacity = 16;
@@ -67,254 +723,811 @@ CJellyFormat3dObjError cjelly_format_3d_obj_load(const char * filename, CJellyFo
 
   // Initialize the material library name.
   model->mtllib[0] = '\0';
+  return model;
 
-  int current_group = -1;            // Index of the current active group
-  int current_material_index = -1;   // Current material index (updated by "usemtl" directive)
-
-  // Begin parsing the file line by line.
-  char line[LINE_SIZE];
-  while (fgets(line, LINE_SIZE, fp)) {
-    // Remove newline characters.
-    line[strcspn(line, "\r\n")] = 0;
-
-    if (strncmp(line, "v ", 2) == 0) {
-      // Read a vertex line.
-      CJellyFormat3dObjVertex v;
-      if (sscanf(line + 2, "%f %f %f", &v.x, &v.y, &v.z) == 3) {
-        if (model->vertex_count >= model->vertex_capacity) {
-          model->vertex_capacity *= 2;
-          CJellyFormat3dObjVertex* temp = realloc(model->vertices, model->vertex_capacity * sizeof(CJellyFormat3dObjVertex));
-          if (!temp) { goto ERROR_CLEANUP; }
-          model->vertices = temp;
-        }
-        model->vertices[model->vertex_count++] = v;
-      }
-      else {
-        err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
-        goto ERROR_CLEANUP;
-      }
-    }
-    else if (strncmp(line, "vt ", 3) == 0) {
-      // Read a texture coordinate line.
-      CJellyFormat3dObjTexCoord vt;
-      if (sscanf(line + 3, "%f %f", &vt.u, &vt.v) == 2) {
-        if (model->texcoord_count >= model->texcoord_capacity) {
-          model->texcoord_capacity *= 2;
-          CJellyFormat3dObjTexCoord* temp = realloc(model->texcoords, model->texcoord_capacity * sizeof(CJellyFormat3dObjTexCoord));
-          if (!temp) { goto ERROR_CLEANUP; }
-          model->texcoords = temp;
-        }
-        model->texcoords[model->texcoord_count++] = vt;
-      }
-      else {
-        err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
-        goto ERROR_CLEANUP;
-      }
+ERROR_CLEANUP:
+  cjelly_format_3d_obj_free(model);
+  return NULL;
+}
+
+
+/**
+ * @brief Returns the start of the final line if it is not newline-terminated.
+ *
+ * @return A pointer one past the last '\n' in the buffer, or `begin` if there
+ *   is none.
+ */
+static const char * find_unterminated_tail(const char * begin, const char * end) {
+  const char * last = end;
+  while (last > begin && last[-1] != '\n') {
+    --last;
+  }
+  return last;
+}
+
+
+/**
+ * @brief Parses a final line that is not terminated by a newline.
+ *
+ * The line is copied and terminated, so that the scanners can rely on the
+ * newline sentinel.
+ *
+ * @param state The parser state.
+ * @param begin The first character of the line.
+ * @param end One past the last character of the line.
+ * @return CJellyFormat3dObjError Error code indicating success or failure.
+ */
+static CJellyFormat3dObjError parse_tail(ObjParseState * state, const char * begin, const char * end) {
+  if (begin == end) {
+    return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+  }
+  size_t length = (size_t)(end - begin);
+  char * tail = (char *)malloc(length + 1);
+  if (!tail) {
+    return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+  }
+  memcpy(tail, begin, length);
+  tail[length] = '\n';
+  CJellyFormat3dObjError err = parse_lines(state, tail, tail + length + 1);
+  free(tail);
+  return err;
+}
+
+
+/**
+ * @brief Parses an entire mapped file on the calling thread.
+ *
+ * @param view The mapped file.
+ * @param outModel Output pointer for the parsed model.
+ * @return CJellyFormat3dObjError Error code indicating success or failure.
+ */
+static CJellyFormat3dObjError parse_view(const CJellyCacheFileView * view, CJellyFormat3dObjModel * * outModel) {
+  CJellyFormat3dObjModel * model = model_create();
+  if (!model) {
+    return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+  }
+
+  ObjParseState state;
+  parse_state_init(&state, model, false);
+
+  // Everything up to (and including) the last newline is parsed in place.
+  const char * begin = (const char *)view->data;
+  const char * end = begin + view->size;
+  const char * last = find_unterminated_tail(begin, end);
+  CJellyFormat3dObjError err = parse_lines(&state, begin, last);
+  if (err == CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    err = parse_tail(&state, last, end);
+  }
+  if (err != CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    cjelly_format_3d_obj_free(model);
+    return err;
+  }
+
+  *outModel = model;
+  return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+}
+
+
+CJellyFormat3dObjError cjelly_format_3d_obj_load(const char * filename, CJellyFormat3dObjModel * * outModel) {
+  // Check for invalid input.
+  if (!filename || !outModel) {
+    return CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+  }
+
+  // Map the file into memory.
+  CJellyCacheFileView view;
+  CJellyFormat3dObjError err = map_file(filename, &view);
+  if (err != CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    fprintf(stderr, "Cannot open file %s\n", filename);
+    return err;
+  }
+
+  err = parse_view(&view, outModel);
+  cjelly_cache_file_unmap(&view);
+  return err;
+}
+
+
+//
+// === Parallel loading ===
+//
+// The file is split into newline-aligned chunks, which are first scanned on
+// the thread pool to count their vertices, texture coordinates, and normals.
+// Classifying the lines is far cheaper than parsing them, and tells where each
+// chunk's elements go in the merged model, so those arrays are allocated once
+// and every chunk is then parsed straight into its own slice of them.  Knowing
+// the number of elements before each chunk also lets relative (negative)
+// indices be resolved on the first and only parse.
+//
+// Counting the corners of the faces would mean scanning every face line
+// character by character, which costs almost half as much as parsing it, so
+// each chunk keeps its faces and corners in a partial model of its own.  The
+// faces depend on earlier chunks in ways that are fixed up afterwards:
+//
+//   - Group start_face values are offset by the number of faces before the
+//     chunk, and faces at the start of a chunk are credited to the group that
+//     was active at the end of the previous chunk.
+//   - Material indices are chunk-local, and are remapped to the global table,
+//     which is rebuilt in order of first use.  Faces at the start of a chunk
+//     use the material that was active at the end of the previous chunk.
+//   - Face offsets are relative to the chunk's first corner.
+//
+// Finally, the faces and corners are copied into the result in parallel.
+//
+
+/**
+ * @brief Files smaller than this many bytes per thread are parsed serially.
+ */
+#define OBJ_PARALLEL_MIN_CHUNK_SIZE (256 * 1024)
+
+
+/**
+ * @brief A newline-aligned slice of the file and its partial model.
+ */
+typedef struct {
+  const char * begin;            /**< The first character of the chunk */
+  const char * end;              /**< One past the last character ('\n') */
+  ObjParseState state;           /**< Parser state, including the partial model */
+  CJellyFormat3dObjError err;    /**< Result of parsing the chunk */
+  CJellyFormat3dObjModel * target; /**< The merged model, once the chunk's
+                                        bulk arrays point into it */
+  int vertex_count;              /**< Vertices counted in this chunk */
+  int texcoord_count;            /**< Texture coordinates counted in this chunk */
+  int normal_count;              /**< Normals counted in this chunk */
+  int vertex_offset;             /**< Vertices defined before this chunk */
+  int texcoord_offset;           /**< Texture coordinates defined before this chunk */
+  int normal_offset;             /**< Normals defined before this chunk */
+  int face_offset;               /**< Faces defined before this chunk */
+  int corner_offset;             /**< Face corners defined before this chunk */
+  int material_in;               /**< Material active at the start of the chunk */
+  int * material_remap;          /**< Chunk-local to global material indices */
+} ObjChunk;
+
+
+/**
+ * @brief Chunks that are processed by the calling thread and the thread pool
+ * together.
+ *
+ * Every thread claims chunks one at a time, so the caller only ever waits for
+ * chunks that another thread has already started.  This keeps a load that
+ * runs on the pool itself from waiting on tasks that are queued behind it.
+ * Pool tasks that find nothing left to claim may run after the caller has
+ * returned, so the batch is freed by whoever drops the last reference.
+ */
+typedef struct {
+  pthread_mutex_t mutex;      /**< Protects the counters below */
+  pthread_cond_t done;        /**< Signaled when every chunk has finished */
+  CJellyThreadPoolTask task;  /**< Processes one chunk */
+  ObjChunk * chunks;          /**< The chunks */
+  int count;                  /**< Number of chunks */
+  int next;                   /**< Next chunk to claim */
+  int finished;               /**< Chunks that have been processed */
+  int references;             /**< The caller, plus each queued pool task */
+} ObjChunkBatch;
+
+
+/**
+ * @brief Processes chunks until none are left to claim.
+ *
+ * The batch's mutex must be held, and is held again on return.
+ */
+static void chunk_batch_claim(ObjChunkBatch * batch) {
+  while (batch->next < batch->count) {
+    ObjChunk * chunk = &batch->chunks[batch->next++];
+    pthread_mutex_unlock(&batch->mutex);
+    batch->task(chunk);
+    pthread_mutex_lock(&batch->mutex);
+    if (++batch->finished == batch->count) {
+      pthread_cond_signal(&batch->done);
     }
-    else if (strncmp(line, "vn ", 3) == 0) {
-      // Read a normal line.
-      CJellyFormat3dObjNormal vn;
-      if (sscanf(line + 3, "%f %f %f", &vn.x, &vn.y, &vn.z) == 3) {
-        if (model->normal_count >= model->normal_capacity) {
-          model->normal_capacity *= 2;
-          CJellyFormat3dObjNormal* temp = realloc(model->normals, model->normal_capacity * sizeof(CJellyFormat3dObjNormal));
-          if (!temp) { goto ERROR_CLEANUP; }
-          model->normals = temp;
-        }
-        model->normals[model->normal_count++] = vn;
-      }
-      else {
-        err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
-        goto ERROR_CLEANUP;
-      }
+  }
+}
+
+
+/**
+ * @brief Drops a reference to a batch, freeing it if it was the last one.
+ *
+ * The batch's mutex must be held, and is released.
+ */
+static void chunk_batch_release(ObjChunkBatch * batch) {
+  bool last = --batch->references == 0;
+  pthread_mutex_unlock(&batch->mutex);
+  if (last) {
+    pthread_cond_destroy(&batch->done);
+    pthread_mutex_destroy(&batch->mutex);
+    free(batch);
+  }
+}
+
+
+/**
+ * @brief Thread pool task that helps with a batch.
+ */
+static void chunk_batch_task(void * arg) {
+  ObjChunkBatch * batch = (ObjChunkBatch *)arg;
+  pthread_mutex_lock(&batch->mutex);
+  chunk_batch_claim(batch);
+  chunk_batch_release(batch);
+}
+
+
+/**
+ * @brief Runs a task on every chunk, on the calling thread and the thread
+ * pool, and waits for it to finish.
+ *
+ * Only the tasks of this call are waited for, so other work on the pool is
+ * not, and the function may be called from a task of the pool.  If the batch
+ * cannot be set up, the chunks are processed on the calling thread.
+ */
+static void run_chunks(CJellyThreadPool * pool, CJellyThreadPoolTask task, ObjChunk * chunks, int count) {
+  ObjChunkBatch * batch = (ObjChunkBatch *)malloc(sizeof(ObjChunkBatch));
+  if (!batch) {
+    goto ERROR_SERIAL;
+  }
+  if (pthread_mutex_init(&batch->mutex, NULL)) {
+    goto ERROR_FREE_BATCH;
+  }
+  if (pthread_cond_init(&batch->done, NULL)) {
+    goto ERROR_DESTROY_MUTEX;
+  }
+  batch->task = task;
+  batch->chunks = chunks;
+  batch->count = count;
+  batch->next = 0;
+  batch->finished = 0;
+  batch->references = 1;
+
+  // The calling thread works on the batch as well, so one fewer task is
+  // needed than there are chunks.
+  pthread_mutex_lock(&batch->mutex);
+  for (int c = 1; c < count; ++c) {
+    ++batch->references;
+    if (!cjelly_thread_pool_submit(pool, chunk_batch_task, batch)) {
+      --batch->references;
+      break;
     }
-    else if (strncmp(line, "f ", 2) == 0) {
-      // Read a face line.
-      CJellyFormat3dObjFace face;
-      face.count = 0;
-      face.material_index = current_material_index;
-      face.overflow = NULL; // Initialize overflow to NULL.
-      int extra_count = 0;  // Number of vertices stored in overflow.
-      int extra_capacity = 0; // Capacity for overflow array.
-
-      // Tokenize the line after "f ".
-      char * token = strtok(line + 2, " ");
-      while (token != NULL) {
-        int vIndex = 0, vtIndex = 0, vnIndex = 0;
-        if (strchr(token, '/')) {
-          /* Replace '/' with space for easier parsing */
-          char temp[64];
-          strncpy(temp, token, 63);
-          temp[63] = '\0';
-          for (int i = 0; i < (int)strlen(temp); i++) {
-            if (temp[i] == '/')
-              temp[i] = ' ';
-          }
-          // Parse the indices (some may be missing).
-          int parsed = sscanf(temp, "%d %d %d", &vIndex, &vtIndex, &vnIndex);
-          if (parsed < 3)
-            vtIndex = 0; // If texture coordinate is missing, set to 0 (or use -1).
-        }
-        else {
-          vIndex = atoi(token);
-        }
+  }
+  chunk_batch_claim(batch);
+  while (batch->finished < batch->count) {
+    pthread_cond_wait(&batch->done, &batch->mutex);
+  }
+  chunk_batch_release(batch);
+  return;
+
+  // Error handling.
+ERROR_DESTROY_MUTEX:
+  pthread_mutex_destroy(&batch->mutex);
 
-        // For the first four vertices, store in fixed arrays.
-        if (face.count < 4) {
-          face.vertex[face.count] = vIndex - 1;
-          face.texcoord[face.count] = vtIndex ? (vtIndex - 1) : -1;
-          face.normal[face.count] = vnIndex ? (vnIndex - 1) : -1;
-          face.count++;
+ERROR_FREE_BATCH:
+  free(batch);
+
+ERROR_SERIAL:
+  for (int c = 0; c < count; ++c) {
+    task(&chunks[c]);
+  }
+}
+
+
+/**
+ * @brief Thread pool task that parses one chunk.
+ */
+static void chunk_parse_task(void * arg) {
+  ObjChunk * chunk = (ObjChunk *)arg;
+  chunk->err = parse_lines(&chunk->state, chunk->begin, chunk->end);
+}
+
+
+/**
+ * @brief Thread pool task that counts the elements of one chunk.
+ *
+ * The records are recognized exactly as parse_lines() recognizes them, so the
+ * counts are exact.
+ */
+static void chunk_count_task(void * arg) {
+  ObjChunk * chunk = (ObjChunk *)arg;
+  int vertices = 0, texcoords = 0, normals = 0;
+
+  const char * rest;
+  for (const char * line = chunk->begin; line < chunk->end; line = next_line(line, chunk->end)) {
+    line = skip_blanks(line);
+    switch (*line) {
+      case 'v':
+        if (match_keyword(line, "v", &rest)) {
+          ++vertices;
         }
-        else {
-          // For extra vertices, allocate or grow the overflow array.
-          if (face.overflow == NULL) {
-            extra_capacity = 4;
-            face.overflow = (CJellyFormat3dObjFaceOverflow *)malloc(extra_capacity * sizeof(CJellyFormat3dObjFaceOverflow));
-            if (!face.overflow) { goto ERROR_CLEANUP; }
-            extra_count = 0;
-          }
-          if (extra_count >= extra_capacity) {
-            extra_capacity *= 2;
-            CJellyFormat3dObjFaceOverflow * tmp = realloc(face.overflow, extra_capacity * sizeof(CJellyFormat3dObjFaceOverflow));
-            if (!tmp) { goto ERROR_CLEANUP; }
-            face.overflow = tmp;
-          }
-          face.overflow[extra_count].vertex = vIndex - 1;
-          face.overflow[extra_count].texcoord = vtIndex ? (vtIndex - 1) : -1;
-          face.overflow[extra_count].normal = vnIndex ? (vnIndex - 1) : -1;
-          extra_count++;
-          face.count++; // Increase total vertex count.
+        else if (match_keyword(line, "vt", &rest)) {
+          ++texcoords;
         }
-        token = strtok(NULL, " ");
-      }
-      // Append the face to the model's face array.
-      if (model->face_count >= model->face_capacity) {
-        model->face_capacity *= 2;
-        CJellyFormat3dObjFace * temp = realloc(model->faces, model->face_capacity * sizeof(CJellyFormat3dObjFace));
-        if (!temp) {
-          // Free the overflow array if it was allocated.
-          // The code pattern is different for this case because the operation
-          // to add the face to the faces array failed.  Therefore, it will
-          // not be automatically freed when the model itself is freed.
-          if (face.overflow) free(face.overflow);
-          goto ERROR_CLEANUP;
+        else if (match_keyword(line, "vn", &rest)) {
+          ++normals;
         }
-        model->faces = temp;
-      }
-      model->faces[model->face_count++] = face;
-      if (current_group >= 0) {
-        model->groups[current_group].face_count++;
-      }
+        break;
+
+      default:
+        break;
     }
-    else if (strncmp(line, "g ", 2) == 0 || strncmp(line, "o ", 2) == 0) {
-      // Read a group or object name line.
-      char name[CJELLY_FORMAT_3D_OBJ_MAX_NAME_LENGTH];
-      // 128 is hard-coded because "%127s" is used in the sscanf call.
-      // The assert is used to ensure that the buffer cannot be smaller
-      // than this hard-coded value.
-      assert(sizeof(name) >= 128);
-      if (sscanf(line + 2, "%127s", name) == 1) {
-        if (model->group_count >= model->group_capacity) {
-          model->group_capacity *= 2;
-          CJellyFormat3dObjGroup* temp = realloc(model->groups, model->group_capacity * sizeof(CJellyFormat3dObjGroup));
-          if (!temp) { goto ERROR_CLEANUP; }
-          model->groups = temp;
-        }
-        strcpy(model->groups[model->group_count].name, name);
-        model->groups[model->group_count].start_face = model->face_count;
-        model->groups[model->group_count].face_count = 0;
-        current_group = model->group_count;
-        model->group_count++;
-      }
-      else {
-        err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
-        goto ERROR_CLEANUP;
+  }
+
+  chunk->vertex_count = vertices;
+  chunk->texcoord_count = texcoords;
+  chunk->normal_count = normals;
+}
+
+
+/**
+ * @brief Points a chunk's vertex, texture coordinate, and normal arrays at
+ * its slices of the merged model.
+ *
+ * The slices are exactly as large as the counts, so parsing the chunk never
+ * grows (and so never reallocates) them.
+ */
+static void chunk_lend(ObjChunk * chunk, CJellyFormat3dObjModel * target) {
+  CJellyFormat3dObjModel * model = chunk->state.model;
+  free(model->vertices);
+  free(model->texcoords);
+  free(model->normals);
+  chunk->target = target;
+
+  model->vertices = target->vertices + chunk->vertex_offset;
+  model->vertex_capacity = chunk->vertex_count;
+  model->texcoords = target->texcoords + chunk->texcoord_offset;
+  model->texcoord_capacity = chunk->texcoord_count;
+  model->normals = target->normals + chunk->normal_offset;
+  model->normal_capacity = chunk->normal_count;
+}
+
+
+/**
+ * @brief Detaches a chunk's partial model from the slices of the merged
+ * model, so that freeing it leaves the merged model intact.
+ */
+static void chunk_unlend(ObjChunk * chunk) {
+  CJellyFormat3dObjModel * model = chunk->state.model;
+  if (!model || !chunk->target) {
+    return;
+  }
+  model->vertices = NULL;
+  model->texcoords = NULL;
+  model->normals = NULL;
+  chunk->target = NULL;
+}
+
+
+/**
+ * @brief Thread pool task that copies one chunk's faces and corners into the
+ * merged model.
+ */
+static void chunk_copy_task(void * arg) {
+  ObjChunk * chunk = (ObjChunk *)arg;
+  CJellyFormat3dObjModel * source = chunk->state.model;
+  CJellyFormat3dObjModel * target = chunk->target;
+
+  memcpy(target->corner_vertices + chunk->corner_offset, source->corner_vertices, source->corner_count * sizeof(int));
+  memcpy(target->corner_texcoords + chunk->corner_offset, source->corner_texcoords, source->corner_count * sizeof(int));
+  memcpy(target->corner_normals + chunk->corner_offset, source->corner_normals, source->corner_count * sizeof(int));
+
+  int * offsets = target->face_offsets + chunk->face_offset;
+  int * materials = target->face_materials + chunk->face_offset;
+  for (int i = 0; i < source->face_count; ++i) {
+    offsets[i] = source->face_offsets[i] + chunk->corner_offset;
+    int index = source->face_materials[i];
+    materials[i] = index == OBJ_INHERITED
+      ? chunk->material_in
+      : index >= 0 ? chunk->material_remap[index] : index;
+  }
+}
+
+
+/**
+ * @brief Grows an array to hold at least `count` elements.
+ *
+ * The capacity is at least doubled, so that repeated calls for one more
+ * element are amortized.
+ *
+ * @return true on success, false if memory could not be allocated.
+ */
+static bool reserve(void * * array, int * capacity, int count, size_t element_size) {
+  if (count <= *capacity) {
+    return true;
+  }
+  int new_capacity = *capacity * 2 > count ? *capacity * 2 : count;
+  void * temp = realloc(*array, (size_t)new_capacity * element_size);
+  if (!temp) {
+    return false;
+  }
+  *array = temp;
+  *capacity = new_capacity;
+  return true;
+}
+
+
+/**
+ * @brief Allocates the merged model's vertex, texture coordinate, and normal
+ * arrays from the chunks' counts, and lends each chunk its slices of them.
+ *
+ * The bases of the chunks' parser states are set as well, so that relative
+ * indices resolve to the right elements.
+ *
+ * @param chunks The counted chunks, in file order.
+ * @param chunk_count The number of chunks.
+ * @param model The merged model.
+ * @return CJellyFormat3dObjError Error code indicating success or failure.
+ */
+static CJellyFormat3dObjError lend_chunks(ObjChunk * chunks, int chunk_count, CJellyFormat3dObjModel * model) {
+  int vertex_count = 0, texcoord_count = 0, normal_count = 0;
+  for (int c = 0; c < chunk_count; ++c) {
+    ObjChunk * chunk = &chunks[c];
+    chunk->vertex_offset = chunk->state.vertex_base = vertex_count;
+    chunk->texcoord_offset = chunk->state.texcoord_base = texcoord_count;
+    chunk->normal_offset = chunk->state.normal_base = normal_count;
+    vertex_count += chunk->vertex_count;
+    texcoord_count += chunk->texcoord_count;
+    normal_count += chunk->normal_count;
+  }
+
+  if (!reserve((void * *)&model->vertices, &model->vertex_capacity, vertex_count, sizeof(CJellyFormat3dObjVertex))
+      || !reserve((void * *)&model->texcoords, &model->texcoord_capacity, texcoord_count, sizeof(CJellyFormat3dObjTexCoord))
+      || !reserve((void * *)&model->normals, &model->normal_capacity, normal_count, sizeof(CJellyFormat3dObjNormal))) {
+    return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+  }
+  for (int c = 0; c < chunk_count; ++c) {
+    chunk_lend(&chunks[c], model);
+  }
+  model->vertex_count = vertex_count;
+  model->texcoord_count = texcoord_count;
+  model->normal_count = normal_count;
+  return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+}
+
+
+/**
+ * @brief Merges the parsed chunks into a single model.
+ *
+ * The chunks must already be parsed into the slices lent by lend_chunks().
+ * Groups, material mappings, and the material library are merged on the
+ * calling thread, and the faces and corners are copied on the thread pool.
+ *
+ * @param chunks The parsed chunks, in file order.
+ * @param chunk_count The number of chunks.
+ * @param pool The thread pool.
+ * @param state The state of the merged model.  On return, the active group
+ *   and material reflect the end of the last chunk.
+ * @return CJellyFormat3dObjError Error code indicating success or failure.
+ */
+static CJellyFormat3dObjError merge_chunks(ObjChunk * chunks, int chunk_count, CJellyThreadPool * pool, ObjParseState * state) {
+  CJellyFormat3dObjModel * model = state->model;
+  int face_count = 0, corner_count = 0;
+
+  for (int c = 0; c < chunk_count; ++c) {
+    ObjChunk * chunk = &chunks[c];
+    CJellyFormat3dObjModel * source = chunk->state.model;
+    chunk->face_offset = face_count;
+    chunk->corner_offset = corner_count;
+    chunk->material_in = state->current_material_index;
+
+    // Credit the faces at the start of the chunk to the group that was active
+    // at the end of the previous chunk.
+    if (state->current_group >= 0) {
+      model->groups[state->current_group].face_count += chunk->state.inherited_face_count;
+    }
+
+    // Append the chunk's groups.
+    if (!reserve((void * *)&model->groups, &model->group_capacity, model->group_count + source->group_count, sizeof(CJellyFormat3dObjGroup))) {
+      return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+    }
+    for (int i = 0; i < source->group_count; ++i) {
+      CJellyFormat3dObjGroup * group = &model->groups[model->group_count + i];
+      *group = source->groups[i];
+      group->start_face += face_count;
+    }
+    if (chunk->state.current_group >= 0) {
+      state->current_group = model->group_count + chunk->state.current_group;
+    }
+    model->group_count += source->group_count;
+
+    // Map the chunk's materials to the global table, adding the new ones in
+    // order of first use.
+    if (source->material_mapping_count) {
+      chunk->material_remap = (int *)malloc(source->material_mapping_count * sizeof(int));
+      if (!chunk->material_remap) {
+        return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
       }
     }
-    else if (strncmp(line, "usemtl", 6) == 0) {
-      // Read a material usage directive.
-      char mtl_name[CJELLY_FORMAT_3D_OBJ_MAX_NAME_LENGTH];
-      // 128 is hard-coded because "%127s" is used in the sscanf call.
-      // The assert is used to ensure that the buffer cannot be smaller
-      // than this hard-coded value.
-      assert(sizeof(mtl_name) >= 128);
-      if (sscanf(line + 6, "%127s", mtl_name) == 1) {
-        int found = 0;
-        int mapped_index = -1;
-        // Search for an existing mapping.
-        for (int i = 0; i < model->material_mapping_count; i++) {
-          if (strcmp(model->material_mappings[i].name, mtl_name) == 0) {
-            found = 1;
-            mapped_index = model->material_mappings[i].index;
-            break;
-          }
+    for (int i = 0; i < source->material_mapping_count; ++i) {
+      const char * name = source->material_mappings[i].name;
+      int mapped_index = -1;
+      for (int j = 0; j < model->material_mapping_count; ++j) {
+        if (strcmp(model->material_mappings[j].name, name) == 0) {
+          mapped_index = model->material_mappings[j].index;
+          break;
         }
-        if (!found) {
-          // Add a new mapping.
-          if (model->material_mapping_count >= model->material_mapping_capacity) {
-            model->material_mapping_capacity *= 2;
-            CJellyFormat3dObjMaterialMapping* temp = realloc(model->material_mappings, model->material_mapping_capacity * sizeof(CJellyFormat3dObjMaterialMapping));
-            if (!temp) { goto ERROR_CLEANUP; }
-            model->material_mappings = temp;
-          }
-          strcpy(model->material_mappings[model->material_mapping_count].name, mtl_name);
-          model->material_mappings[model->material_mapping_count].index = model->material_mapping_count;
-          mapped_index = model->material_mapping_count;
-          model->material_mapping_count++;
-        }
-        current_material_index = mapped_index;
       }
-      else {
-        err = CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
-        goto ERROR_CLEANUP;
+      if (mapped_index < 0) {
+        if (!reserve((void * *)&model->material_mappings, &model->material_mapping_capacity, model->material_mapping_count + 1, sizeof(CJellyFormat3dObjMaterialMapping))) {
+          return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+        }
+        strcpy(model->material_mappings[model->material_mapping_count].name, name);
+        model->material_mappings[model->material_mapping_count].index = model->material_mapping_count;
+        mapped_index = model->material_mapping_count;
+        model->material_mapping_count++;
       }
+      chunk->material_remap[i] = mapped_index;
+    }
+    if (chunk->state.current_material_index >= 0) {
+      state->current_material_index = chunk->material_remap[chunk->state.current_material_index];
     }
-    else if (strncmp(line, "mtllib", 6) == 0) {
-      // Read the material library name.
-      sscanf(line + 6, "%255s", model->mtllib);
+
+    // The last "mtllib" line wins.
+    if (source->mtllib[0]) {
+      strcpy(model->mtllib, source->mtllib);
     }
+
+    face_count += source->face_count;
+    corner_count += source->corner_count;
   }
 
-  // Close the file and return the model.
-  fclose(fp);
-  *outModel = model;
+  // Size the face and corner arrays exactly, then copy the chunks into them.
+  if (!reserve_faces(model, face_count) || !reserve_corners(model, corner_count)) {
+    return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+  }
+  run_chunks(pool, chunk_copy_task, chunks, chunk_count);
+
+  model->face_count = face_count;
+  model->face_offsets[face_count] = corner_count;
+  model->corner_count = corner_count;
   return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+}
 
-  // Error handling.
-ERROR_CLEANUP:
-  // If an error is not set, then default to out-of-memory.
-  // This approach is used in this function because out-of-memory is the most
-  // common reason to error out, so it was chosen to be the default.
-  if (err == CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+
+/**
+ * @brief Parses the chunks on the thread pool and waits for them to finish.
+ *
+ * @return The error of the first chunk that failed, in file order.
+ */
+static CJellyFormat3dObjError parse_chunks(ObjChunk * chunks, int chunk_count, CJellyThreadPool * pool) {
+  run_chunks(pool, chunk_parse_task, chunks, chunk_count);
+
+  for (int c = 0; c < chunk_count; ++c) {
+    if (chunks[c].err != CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+      return chunks[c].err;
+    }
+  }
+  return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+}
+
+
+CJellyFormat3dObjError cjelly_format_3d_obj_load_parallel(const char * filename, CJellyThreadPool * pool, CJellyFormat3dObjModel * * outModel) {
+  // Check for invalid input.
+  if (!filename || !outModel) {
+    return CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
+  }
+
+  // Map the file into memory.
+  CJellyCacheFileView view;
+  CJellyFormat3dObjError err = map_file(filename, &view);
+  if (err != CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    fprintf(stderr, "Cannot open file %s\n", filename);
+    return err;
+  }
+
+  // Decide how many chunks to use.  Small files are not worth splitting.
+  CJellyThreadPool * own_pool = NULL;
+  int thread_count = pool
+    ? cjelly_thread_pool_size(pool)
+    : cjelly_thread_pool_hardware_concurrency();
+  size_t max_chunks = view.size / OBJ_PARALLEL_MIN_CHUNK_SIZE;
+  int chunk_count = (size_t)thread_count < max_chunks ? thread_count : (int)max_chunks;
+  if (chunk_count > 1 && !pool) {
+    pool = own_pool = cjelly_thread_pool_create(thread_count);
+  }
+  if (chunk_count <= 1 || !pool) {
+    err = parse_view(&view, outModel);
+    cjelly_cache_file_unmap(&view);
+    return err;
+  }
+
+  CJellyFormat3dObjModel * model = NULL;
+  ObjChunk * chunks = (ObjChunk *)calloc(chunk_count, sizeof(ObjChunk));
+  if (!chunks) {
     err = CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+    goto CLEANUP;
+  }
+
+  // Split the file at newlines into roughly equal chunks.  The unterminated
+  // final line, if any, is handled after the merge.
+  const char * begin = (const char *)view.data;
+  const char * end = begin + view.size;
+  const char * last = find_unterminated_tail(begin, end);
+  size_t chunk_size = (size_t)(last - begin) / chunk_count;
+  const char * chunk_begin = begin;
+  int used = 0;
+  for (int c = 0; c < chunk_count && chunk_begin < last; ++c) {
+    const char * chunk_end = last;
+    if (c < chunk_count - 1 && (size_t)(last - chunk_begin) > chunk_size) {
+      chunk_end = memchr(chunk_begin + chunk_size, '\n', (size_t)(last - chunk_begin - chunk_size));
+      chunk_end = chunk_end ? chunk_end + 1 : last;
+    }
+    chunks[c].begin = chunk_begin;
+    chunks[c].end = chunk_end;
+    chunks[c].state.model = model_create();
+    if (!chunks[c].state.model) {
+      err = CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+      goto CLEANUP;
+    }
+    parse_state_init(&chunks[c].state, chunks[c].state.model, c > 0);
+    chunk_begin = chunk_end;
+    used = c + 1;
+  }
+  chunk_count = used;
+
+  // Count the elements of every chunk, allocate the merged model to fit, and
+  // parse each chunk straight into its slice of it.
+  run_chunks(pool, chunk_count_task, chunks, chunk_count);
+  model = model_create();
+  if (!model) {
+    err = CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+    goto CLEANUP;
+  }
+  err = lend_chunks(chunks, chunk_count, model);
+  if (err != CJELLY_FORMAT_3D_OBJ_SUCCESS) { goto CLEANUP; }
+  err = parse_chunks(chunks, chunk_count, pool);
+  if (err != CJELLY_FORMAT_3D_OBJ_SUCCESS) { goto CLEANUP; }
+
+  // Merge the chunks, then parse the final line in the context of the merged
+  // model.
+  ObjParseState state;
+  parse_state_init(&state, model, false);
+  err = merge_chunks(chunks, chunk_count, pool, &state);
+  if (err != CJELLY_FORMAT_3D_OBJ_SUCCESS) { goto CLEANUP; }
+  err = parse_tail(&state, last, end);
+  if (err != CJELLY_FORMAT_3D_OBJ_SUCCESS) { goto CLEANUP; }
+
+  *outModel = model;
+  model = NULL;
+
+  // Release the intermediate state, on success and failure alike.  The model
+  // is only non-NULL here if an error occurred.
+CLEANUP:
+  if (chunks) {
+    for (int c = 0; c < chunk_count; ++c) {
+      chunk_unlend(&chunks[c]);
+      cjelly_format_3d_obj_free(chunks[c].state.model);
+      free(chunks[c].material_remap);
+    }
+    free(chunks);
   }
   cjelly_format_3d_obj_free(model);
-  fclose(fp);
+  cjelly_thread_pool_destroy(own_pool);
+  cjelly_cache_file_unmap(&view);
   return err;
 }
 
 
+CJellyFormat3dObjError cjelly_format_3d_obj_faces(CJellyFormat3dObjModel * model, const CJellyFormat3dObjFace * * outFaces) {
+  *outFaces = NULL;
+  if (!model || !model->face_count) return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+  if (model->faces) {
+    *outFaces = model->faces;
+    return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+  }
+
+  // Count the corners past the fourth, so that all of the overflow corners
+  // can share one allocation.
+  int overflow_count = 0;
+  for (int i = 0; i < model->face_count; ++i) {
+    int count = model->face_offsets[i + 1] - model->face_offsets[i];
+    if (count > 4) {
+      overflow_count += count - 4;
+    }
+  }
+
+  CJellyFormat3dObjFace * faces = (CJellyFormat3dObjFace *)malloc(model->face_count * sizeof(CJellyFormat3dObjFace));
+  CJellyFormat3dObjFaceOverflow * overflow = overflow_count
+    ? (CJellyFormat3dObjFaceOverflow *)malloc(overflow_count * sizeof(CJellyFormat3dObjFaceOverflow))
+    : NULL;
+  if (!faces || (overflow_count && !overflow)) {
+    free(faces);
+    free(overflow);
+    return CJELLY_FORMAT_3D_OBJ_ERR_OUT_OF_MEMORY;
+  }
+
+  CJellyFormat3dObjFaceOverflow * next_overflow = overflow;
+  for (int i = 0; i < model->face_count; ++i) {
+    CJellyFormat3dObjFace * face = &faces[i];
+    int first = model->face_offsets[i];
+    face->count = model->face_offsets[i + 1] - first;
+    face->material_index = model->face_materials[i];
+    face->overflow = NULL;
+    for (int j = 0; j < face->count; ++j) {
+      int corner = first + j;
+      if (j < 4) {
+        face->vertex[j] = model->corner_vertices[corner];
+        face->texcoord[j] = model->corner_texcoords[corner];
+        face->normal[j] = model->corner_normals[corner];
+      }
+      else {
+        if (!face->overflow) {
+          face->overflow = next_overflow;
+        }
+        next_overflow->vertex = model->corner_vertices[corner];
+        next_overflow->texcoord = model->corner_texcoords[corner];
+        next_overflow->normal = model->corner_normals[corner];
+        next_overflow++;
+      }
+    }
+  }
+
+  model->faces = faces;
+  model->face_overflow = overflow;
+  *outFaces = faces;
+  return CJELLY_FORMAT_3D_OBJ_SUCCESS;
+}
+
+
 void cjelly_format_3d_obj_free(CJellyFormat3dObjModel* model) {
   if (!model) return;
   if (model->vertices) free(model->vertices);
   if (model->texcoords) free(model->texcoords);
   if (model->normals) free(model->normals);
-  if (model->faces) {
-    // Free per-face overflow arrays.
-    for (int i = 0; i < model->face_count; ++i) {
-      if (model->faces[i].overflow) {
-        free(model->faces[i].overflow);
-      }
-    }
-    free(model->faces);
-  }
+  free(model->face_offsets);
+  free(model->face_materials);
+  free(model->corner_vertices);
+  free(model->corner_texcoords);
+  free(model->corner_normals);
+  free(model->faces);
+  free(model->face_overflow);
   if (model->groups) free(model->groups);
   if (model->material_mappings) free(model->material_mappings);
   free(model);
 }
 
 
+/**
+ * @brief Finds the name of a material by its mapped index.
+ *
+ * @return The material name, or NULL if no mapping has the index.
+ */
+static const char * find_material_name(const CJellyFormat3dObjModel * model, int material_index) {
+  for (int j = 0; j < model->material_mapping_count; ++j) {
+    if (model->material_mappings[j].index == material_index) {
+      return model->material_mappings[j].name;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * @brief Writes a single "f" line.
+ *
+ * @return A negative value on an I/O error.
+ */
+static int dump_face(const CJellyFormat3dObjModel * model, int face, FILE * fd) {
+  int ret = fprintf(fd, "f");
+  if (ret < 0) return ret;
+  for (int corner = model->face_offsets[face]; corner < model->face_offsets[face + 1]; ++corner) {
+    int v = model->corner_vertices[corner] + 1;
+    int vt = model->corner_texcoords[corner];
+    int vn = model->corner_normals[corner];
+    ret = fprintf(fd, " %d", v);
+    if (ret < 0) return ret;
+    if (vt != -1 || vn != -1) {
+      ret = fprintf(fd, "/");
+      if (ret < 0) return ret;
+      if (vt != -1) {
+        ret = fprintf(fd, "%d", vt + 1);
+        if (ret < 0) return ret;
+      }
+      if (vn != -1) {
+        ret = fprintf(fd, "/%d", vn + 1);
+        if (ret < 0) return ret;
+      }
+    }
+  }
+  return fprintf(fd, "\n");
+}
+
+
 CJellyFormat3dObjError cjelly_format_3d_obj_dump(const CJellyFormat3dObjModel *model, FILE *fd) {
   if (!model || !fd)
     return CJELLY_FORMAT_3D_OBJ_ERR_INVALID_FORMAT;
@@ -355,15 +1568,10 @@ CJellyFormat3dObjError cjelly_format_3d_obj_dump(const CJellyFormat3dObjModel *m
       int last_material_index = -2;
       for (int i = start; i < start + count; ++i) {
         // Only print "usemtl" if material has changed.
-        if (model->faces[i].material_index != last_material_index) {
-          if (model->faces[i].material_index != -1) {
-            const char * mtl_name = NULL;
-            for (int j = 0; j < model->material_mapping_count; ++j) {
-              if (model->material_mappings[j].index == model->faces[i].material_index) {
-                mtl_name = model->material_mappings[j].name;
-                break;
-              }
-            }
+        int material_index = model->face_materials[i];
+        if (material_index != last_material_index) {
+          if (material_index != -1) {
+            const char * mtl_name = find_material_name(model, material_index);
             if (mtl_name) {
               ret = fprintf(fd, "usemtl %s\n", mtl_name);
               if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
@@ -376,124 +1584,28 @@ CJellyFormat3dObjError cjelly_format_3d_obj_dump(const CJellyFormat3dObjModel *m
               if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
             }
           }
-          last_material_index = model->faces[i].material_index;
+          last_material_index = material_index;
         }
-        // Print the face line.
-        ret = fprintf(fd, "f");
-        if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-        // Print the first four vertices.
-        for (int j = 0; j < (model->faces[i].count > 4 ? 4 : model->faces[i].count); ++j) {
-          int v = model->faces[i].vertex[j] + 1;
-          int vt = model->faces[i].texcoord[j];
-          int vn = model->faces[i].normal[j];
-          ret = fprintf(fd, " %d", v);
-          if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-          if (vt != -1 || vn != -1) {
-            ret = fprintf(fd, "/");
-            if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-            if (vt != -1) {
-              ret = fprintf(fd, "%d", vt + 1);
-              if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-            }
-            if (vn != -1) {
-              ret = fprintf(fd, "/%d", vn + 1);
-              if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-            }
-          }
-        }
-        // Print overflow vertices, if any.
-        if (model->faces[i].count > 4 && model->faces[i].overflow != NULL) {
-          int overflow_count = model->faces[i].count - 4;
-          for (int j = 0; j < overflow_count; j++) {
-            int v = model->faces[i].overflow[j].vertex + 1;
-            int vt = model->faces[i].overflow[j].texcoord;
-            int vn = model->faces[i].overflow[j].normal;
-            ret = fprintf(fd, " %d", v);
-            if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-            if (vt != -1 || vn != -1) {
-              ret = fprintf(fd, "/");
-              if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-              if (vt != -1) {
-                ret = fprintf(fd, "%d", vt + 1);
-                if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-              }
-              if (vn != -1) {
-                ret = fprintf(fd, "/%d", vn + 1);
-                if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-              }
-            }
-          }
-        }
-        ret = fprintf(fd, "\n");
-        if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
+        if (dump_face(model, i, fd) < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
+      }
     }
   }
-}
-else {
+  else {
     // No groups; dump all faces.
     int last_material_index = -2;
     for (int i = 0; i < model->face_count; ++i) {
-      if (model->faces[i].material_index != last_material_index) {
-        if (model->faces[i].material_index != -1) {
-          const char * mtl_name = NULL;
-          for (int j = 0; j < model->material_mapping_count; ++j) {
-            if (model->material_mappings[j].index == model->faces[i].material_index) {
-              mtl_name = model->material_mappings[j].name;
-              break;
-            }
-          }
+      int material_index = model->face_materials[i];
+      if (material_index != last_material_index) {
+        if (material_index != -1) {
+          const char * mtl_name = find_material_name(model, material_index);
           if (mtl_name) {
             ret = fprintf(fd, "usemtl %s\n", mtl_name);
             if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
           }
         }
-        last_material_index = model->faces[i].material_index;
+        last_material_index = material_index;
       }
-      ret = fprintf(fd, "f");
-      if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-      for (int j = 0; j < (model->faces[i].count > 4 ? 4 : model->faces[i].count); ++j) {
-        int v = model->faces[i].vertex[j] + 1;
-        int vt = model->faces[i].texcoord[j];
-        int vn = model->faces[i].normal[j];
-        ret = fprintf(fd, " %d", v);
-        if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-        if (vt != -1 || vn != -1) {
-          ret = fprintf(fd, "/");
-          if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-          if (vt != -1) {
-            ret = fprintf(fd, "%d", vt + 1);
-            if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-          }
-          if (vn != -1) {
-            ret = fprintf(fd, "/%d", vn + 1);
-            if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-          }
-        }
-      }
-      if (model->faces[i].count > 4 && model->faces[i].overflow != NULL) {
-        int overflow_count = model->faces[i].count - 4;
-        for (int j = 0; j < overflow_count; j++) {
-          int v = model->faces[i].overflow[j].vertex + 1;
-          int vt = model->faces[i].overflow[j].texcoord;
-          int vn = model->faces[i].overflow[j].normal;
-          ret = fprintf(fd, " %d", v);
-          if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-          if (vt != -1 || vn != -1) {
-            ret = fprintf(fd, "/");
-            if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-            if (vt != -1) {
-              ret = fprintf(fd, "%d", vt + 1);
-              if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-            }
-            if (vn != -1) {
-              ret = fprintf(fd, "/%d", vn + 1);
-              if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
-            }
-          }
-        }
-      }
-      ret = fprintf(fd, "\n");
-      if (ret < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
+      if (dump_face(model, i, fd) < 0) return CJELLY_FORMAT_3D_OBJ_ERR_IO;
     }
   }
   return CJELLY_FORMAT_3D_OBJ_SUCCESS;
@@ -0,0 +1,826 @@
+/**
+ * @file gpuallocator.c
+ * @brief CJelly GPU memory sub-allocator implementation.
+ *
+ * @details
+ * Each block keeps a list of its regions in address order, and the free
+ * regions are additionally linked into TLSF size classes.  The first level
+ * class of a size is the index of its most significant bit, and the second
+ * level splits each power of two into SL_COUNT linear steps, so a request
+ * is served by rounding it up to the next class and taking the head of the
+ * first non-empty list at or above it, located with two bitmap scans.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/gpuallocator.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/**
+ * @brief Number of bits used for the second level of the size classes.
+ */
+#define SL_BITS 3
+
+/**
+ * @brief Number of second level classes per first level class.
+ */
+#define SL_COUNT (1 << SL_BITS)
+
+/**
+ * @brief Sizes below 2^SMALL_SHIFT share the first level class 0.
+ */
+#define SMALL_SHIFT 8
+
+/**
+ * @brief Sizes below this value share the first level class 0.
+ */
+#define SMALL_SIZE ((VkDeviceSize)1 << SMALL_SHIFT)
+
+/**
+ * @brief Number of first level classes.
+ */
+#define FL_COUNT (64 - SMALL_SHIFT + 1)
+
+/**
+ * @brief Block size used for heaps larger than SMALL_HEAP_SIZE.
+ */
+#define DEFAULT_BLOCK_SIZE ((VkDeviceSize)64 << 20)
+
+/**
+ * @brief Heaps up to this size use blocks of an eighth of the heap.
+ */
+#define SMALL_HEAP_SIZE ((VkDeviceSize)1 << 30)
+
+/**
+ * @brief Smallest block that is tried when a block allocation fails.
+ */
+#define MIN_BLOCK_SIZE ((VkDeviceSize)1 << 20)
+
+
+typedef struct GpuBlock GpuBlock;
+typedef struct GpuAllocation GpuAllocation;
+
+
+/**
+ * @brief A contiguous range of a block, either free or allocated.
+ */
+typedef struct GpuRegion {
+  VkDeviceSize offset;             /**< Offset of the range in the block */
+  VkDeviceSize size;               /**< Size of the range in bytes */
+  struct GpuRegion * prevPhysical; /**< The region that ends where this one starts */
+  struct GpuRegion * nextPhysical; /**< The region that starts where this one ends */
+  struct GpuRegion * prevFree;     /**< Previous region in the same free list */
+  struct GpuRegion * nextFree;     /**< Next region in the same free list */
+  GpuAllocation * owner;           /**< The allocation, or NULL if the region is free */
+  bool isFree;                     /**< Whether the region is in a free list */
+} GpuRegion;
+
+
+/**
+ * @brief One device memory object that is shared by many allocations.
+ */
+struct GpuBlock {
+  VkDeviceMemory memory;                      /**< The device memory */
+  VkDeviceSize size;                          /**< Size of the device memory */
+  VkDeviceSize used;                          /**< Bytes handed out to allocations */
+  void * mapped;                              /**< Persistent mapping, or NULL */
+  uint32_t allocationCount;                   /**< Number of allocated regions */
+  GpuRegion * firstRegion;                    /**< The region at offset 0 */
+  uint64_t flBitmap;                          /**< Bit i is set if freeLists[i] has a non-empty list */
+  uint32_t slBitmap[FL_COUNT];                /**< Bit j is set if freeLists[i][j] is non-empty */
+  GpuRegion * freeLists[FL_COUNT][SL_COUNT];  /**< Free regions by size class */
+  GpuBlock * prev;                            /**< Previous block in the pool */
+  GpuBlock * next;                            /**< Next block in the pool */
+};
+
+
+/**
+ * @brief The private part of an allocation.
+ *
+ * The public structure is the first member, so that a CJellyGpuAllocation
+ * pointer can be converted back.
+ */
+struct GpuAllocation {
+  CJellyGpuAllocation info;   /**< The fields visible to the caller */
+  VkDeviceSize alignment;     /**< The alignment that was requested */
+  CJellyGpuResourceKind kind; /**< The pool that the allocation came from */
+  GpuBlock * block;           /**< The block, or NULL for a dedicated allocation */
+  GpuRegion * region;         /**< The region in the block, or NULL */
+};
+
+
+/**
+ * @brief The blocks of one memory type and resource kind.
+ */
+typedef struct {
+  GpuBlock * blocks; /**< Doubly linked list of blocks */
+} GpuPool;
+
+
+struct CJellyGpuAllocator {
+  VkPhysicalDevice physicalDevice;                 /**< The physical device */
+  VkDevice device;                                 /**< The logical device */
+  bool memoryBudget;                               /**< Whether to query VK_EXT_memory_budget */
+  VkPhysicalDeviceMemoryProperties memory;         /**< Memory types and heaps of the device */
+  VkDeviceSize blockSize[VK_MAX_MEMORY_HEAPS];     /**< Preferred block size of each heap */
+  uint32_t maxMemoryObjects;                       /**< maxMemoryAllocationCount of the device */
+  uint32_t memoryObjects;                          /**< Number of live device memory objects */
+  GpuPool pools[VK_MAX_MEMORY_TYPES][2];           /**< Pools by memory type and resource kind */
+  CJellyGpuHeapStats heaps[VK_MAX_MEMORY_HEAPS];   /**< Usage of each heap */
+  pthread_mutex_t mutex;                           /**< Protects all of the fields above */
+};
+
+
+//
+// === TLSF ===
+//
+
+/**
+ * @brief Returns the index of the most significant set bit of a non-zero value.
+ */
+static uint32_t find_msb(uint64_t value) {
+  uint32_t bit = 0;
+  for (uint32_t shift = 32; shift; shift >>= 1) {
+    if (value >> shift) {
+      value >>= shift;
+      bit += shift;
+    }
+  }
+  return bit;
+}
+
+
+/**
+ * @brief Returns the index of the least significant set bit of a non-zero value.
+ */
+static uint32_t find_lsb(uint64_t value) {
+  return find_msb(value & (~value + 1));
+}
+
+
+/**
+ * @brief Computes the size class that a free region of `size` bytes is filed under.
+ */
+static void mapping(VkDeviceSize size, uint32_t * fl, uint32_t * sl) {
+  if (size < SMALL_SIZE) {
+    *fl = 0;
+    *sl = (uint32_t)(size / (SMALL_SIZE / SL_COUNT));
+    return;
+  }
+  uint32_t msb = find_msb(size);
+  *fl = msb - SMALL_SHIFT + 1;
+  *sl = (uint32_t)(size >> (msb - SL_BITS)) - SL_COUNT;
+}
+
+
+static void free_list_insert(GpuBlock * block, GpuRegion * region) {
+  uint32_t fl, sl;
+  mapping(region->size, &fl, &sl);
+  region->owner = NULL;
+  region->isFree = true;
+  region->prevFree = NULL;
+  region->nextFree = block->freeLists[fl][sl];
+  if (region->nextFree) {
+    region->nextFree->prevFree = region;
+  }
+  block->freeLists[fl][sl] = region;
+  block->flBitmap |= (uint64_t)1 << fl;
+  block->slBitmap[fl] |= 1u << sl;
+}
+
+
+static void free_list_remove(GpuBlock * block, GpuRegion * region) {
+  uint32_t fl, sl;
+  mapping(region->size, &fl, &sl);
+  if (region->prevFree) {
+    region->prevFree->nextFree = region->nextFree;
+  }
+  else {
+    block->freeLists[fl][sl] = region->nextFree;
+    if (!region->nextFree) {
+      block->slBitmap[fl] &= ~(1u << sl);
+      if (!block->slBitmap[fl]) {
+        block->flBitmap &= ~((uint64_t)1 << fl);
+      }
+    }
+  }
+  if (region->nextFree) {
+    region->nextFree->prevFree = region->prevFree;
+  }
+  region->isFree = false;
+  region->prevFree = region->nextFree = NULL;
+}
+
+
+/**
+ * @brief Finds a free region of at least `size` bytes, or returns NULL.
+ */
+static GpuRegion * free_list_search(GpuBlock * block, VkDeviceSize size) {
+  // Round up to the next size class, so that every region in the chosen list
+  // is large enough.
+  VkDeviceSize round = size < SMALL_SIZE
+    ? SMALL_SIZE / SL_COUNT - 1
+    : ((VkDeviceSize)1 << (find_msb(size) - SL_BITS)) - 1;
+  if (size + round < size) {
+    return NULL;
+  }
+  uint32_t fl, sl;
+  mapping(size + round, &fl, &sl);
+
+  uint32_t slMap = block->slBitmap[fl] & (~0u << sl);
+  if (!slMap) {
+    if (fl + 1 >= FL_COUNT) {
+      return NULL;
+    }
+    uint64_t flMap = block->flBitmap & (~(uint64_t)0 << (fl + 1));
+    if (!flMap) {
+      return NULL;
+    }
+    fl = find_lsb(flMap);
+    slMap = block->slBitmap[fl];
+  }
+  return block->freeLists[fl][find_lsb(slMap)];
+}
+
+
+/**
+ * @brief Carves an aligned range out of a block.
+ *
+ * Any alignment padding in front of the range, and any space left after it,
+ * remain as free regions.
+ *
+ * @return The allocated region, or NULL if the block has no room (or the
+ *   bookkeeping could not be allocated).
+ */
+static GpuRegion * block_alloc(GpuBlock * block, VkDeviceSize size, VkDeviceSize alignment) {
+  GpuRegion * region = free_list_search(block, size + alignment - 1);
+  if (!region) {
+    return NULL;
+  }
+
+  VkDeviceSize aligned = (region->offset + alignment - 1) & ~(alignment - 1);
+  VkDeviceSize padding = aligned - region->offset;
+  VkDeviceSize remainder = region->size - padding - size;
+
+  // Allocate the bookkeeping before modifying anything.
+  GpuRegion * head = NULL;
+  GpuRegion * tail = NULL;
+  if (padding && !(head = malloc(sizeof(GpuRegion)))) {
+    return NULL;
+  }
+  if (remainder && !(tail = malloc(sizeof(GpuRegion)))) {
+    free(head);
+    return NULL;
+  }
+
+  free_list_remove(block, region);
+
+  // The padding moves to the new `head` struct, taking the original region's
+  // place in the physical list (and as the block's first region, if it was),
+  // while the original struct becomes the allocated range.
+  if (head) {
+    *head = *region;
+    head->size = padding;
+    region->offset = aligned;
+    region->size -= padding;
+    region->prevPhysical = head;
+    head->nextPhysical = region;
+    if (head->prevPhysical) {
+      head->prevPhysical->nextPhysical = head;
+    }
+    else {
+      block->firstRegion = head;
+    }
+    free_list_insert(block, head);
+  }
+
+  if (tail) {
+    tail->offset = region->offset + size;
+    tail->size = remainder;
+    tail->prevPhysical = region;
+    tail->nextPhysical = region->nextPhysical;
+    if (tail->nextPhysical) {
+      tail->nextPhysical->prevPhysical = tail;
+    }
+    region->nextPhysical = tail;
+    region->size = size;
+    free_list_insert(block, tail);
+  }
+
+  block->used += size;
+  ++block->allocationCount;
+  return region;
+}
+
+
+/**
+ * @brief Returns a region to its block, merging it with free neighbors.
+ *
+ * @return The free region that now contains the released range.
+ */
+static GpuRegion * block_release(GpuBlock * block, GpuRegion * region) {
+  block->used -= region->size;
+  --block->allocationCount;
+  region->owner = NULL;
+
+  GpuRegion * next = region->nextPhysical;
+  if (next && next->isFree) {
+    free_list_remove(block, next);
+    region->size += next->size;
+    region->nextPhysical = next->nextPhysical;
+    if (region->nextPhysical) {
+      region->nextPhysical->prevPhysical = region;
+    }
+    free(next);
+  }
+
+  GpuRegion * prev = region->prevPhysical;
+  if (prev && prev->isFree) {
+    free_list_remove(block, prev);
+    prev->size += region->size;
+    prev->nextPhysical = region->nextPhysical;
+    if (prev->nextPhysical) {
+      prev->nextPhysical->prevPhysical = prev;
+    }
+    free(region);
+    region = prev;
+  }
+
+  free_list_insert(block, region);
+  return region;
+}
+
+
+//
+// === Blocks ===
+//
+
+/**
+ * @brief Allocates a device memory object, mapping it if it is host-visible.
+ */
+static VkResult allocate_memory(CJellyGpuAllocator * allocator, uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory * outMemory, void * * outMapped) {
+  if (allocator->memoryObjects >= allocator->maxMemoryObjects) {
+    return VK_ERROR_TOO_MANY_OBJECTS;
+  }
+
+  VkMemoryAllocateInfo allocInfo = {0};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+  VkResult result = vkAllocateMemory(allocator->device, &allocInfo, NULL, outMemory);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+
+  *outMapped = NULL;
+  if (allocator->memory.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    result = vkMapMemory(allocator->device, *outMemory, 0, VK_WHOLE_SIZE, 0, outMapped);
+    if (result != VK_SUCCESS) {
+      vkFreeMemory(allocator->device, *outMemory, NULL);
+      return result;
+    }
+  }
+
+  uint32_t heapIndex = allocator->memory.memoryTypes[memoryTypeIndex].heapIndex;
+  allocator->heaps[heapIndex].blockBytes += size;
+  ++allocator->heaps[heapIndex].blockCount;
+  ++allocator->memoryObjects;
+  return VK_SUCCESS;
+}
+
+
+static void free_memory(CJellyGpuAllocator * allocator, uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory memory) {
+  vkFreeMemory(allocator->device, memory, NULL);
+
+  uint32_t heapIndex = allocator->memory.memoryTypes[memoryTypeIndex].heapIndex;
+  allocator->heaps[heapIndex].blockBytes -= size;
+  --allocator->heaps[heapIndex].blockCount;
+  --allocator->memoryObjects;
+}
+
+
+static VkResult block_create(CJellyGpuAllocator * allocator, uint32_t memoryTypeIndex, CJellyGpuResourceKind kind, VkDeviceSize size, GpuBlock * * outBlock) {
+  GpuBlock * block = calloc(1, sizeof(GpuBlock));
+  GpuRegion * region = calloc(1, sizeof(GpuRegion));
+  if (!block || !region) {
+    free(block);
+    free(region);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+
+  VkResult result = allocate_memory(allocator, memoryTypeIndex, size, &block->memory, &block->mapped);
+  if (result != VK_SUCCESS) {
+    free(block);
+    free(region);
+    return result;
+  }
+
+  block->size = size;
+  region->size = size;
+  block->firstRegion = region;
+  free_list_insert(block, region);
+
+  GpuPool * pool = &allocator->pools[memoryTypeIndex][kind];
+  block->next = pool->blocks;
+  if (block->next) {
+    block->next->prev = block;
+  }
+  pool->blocks = block;
+
+  *outBlock = block;
+  return VK_SUCCESS;
+}
+
+
+static void block_destroy(CJellyGpuAllocator * allocator, uint32_t memoryTypeIndex, CJellyGpuResourceKind kind, GpuBlock * block) {
+  GpuPool * pool = &allocator->pools[memoryTypeIndex][kind];
+  if (block->prev) {
+    block->prev->next = block->next;
+  }
+  else {
+    pool->blocks = block->next;
+  }
+  if (block->next) {
+    block->next->prev = block->prev;
+  }
+
+  GpuRegion * region = block->firstRegion;
+  while (region) {
+    GpuRegion * next = region->nextPhysical;
+    free(region->owner);
+    free(region);
+    region = next;
+  }
+
+  free_memory(allocator, memoryTypeIndex, block->size, block->memory);
+  free(block);
+}
+
+
+/**
+ * @brief Releases a block that has just become empty, unless it is the only
+ * empty block of its pool.
+ *
+ * Keeping one empty block avoids allocating and freeing device memory over
+ * and over when a single resource is repeatedly created and destroyed.
+ */
+static void block_trim(CJellyGpuAllocator * allocator, uint32_t memoryTypeIndex, CJellyGpuResourceKind kind, GpuBlock * block) {
+  if (block->allocationCount) {
+    return;
+  }
+  for (GpuBlock * other = allocator->pools[memoryTypeIndex][kind].blocks; other; other = other->next) {
+    if (other != block && !other->allocationCount) {
+      block_destroy(allocator, memoryTypeIndex, kind, block);
+      return;
+    }
+  }
+}
+
+
+/**
+ * @brief Points an allocation at a region of a block.
+ */
+static void place_allocation(GpuAllocation * allocation, GpuBlock * block, GpuRegion * region) {
+  region->owner = allocation;
+  allocation->block = block;
+  allocation->region = region;
+  allocation->info.memory = block->memory;
+  allocation->info.offset = region->offset;
+  allocation->info.mapped = block->mapped
+    ? (char *)block->mapped + region->offset
+    : NULL;
+}
+
+
+//
+// === Allocator ===
+//
+
+CJellyGpuAllocator * cjelly_gpu_allocator_create(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize) {
+  CJellyGpuAllocator * allocator = calloc(1, sizeof(CJellyGpuAllocator));
+  if (!allocator) {
+    return NULL;
+  }
+  if (pthread_mutex_init(&allocator->mutex, NULL)) {
+    free(allocator);
+    return NULL;
+  }
+
+  allocator->physicalDevice = physicalDevice;
+  allocator->device = device;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &allocator->memory);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  allocator->maxMemoryObjects = properties.limits.maxMemoryAllocationCount;
+
+  for (uint32_t i = 0; i < allocator->memory.memoryHeapCount; ++i) {
+    VkDeviceSize heapSize = allocator->memory.memoryHeaps[i].size;
+    allocator->heaps[i].heapSize = heapSize;
+    allocator->heaps[i].budget = heapSize / 10 * 8;
+    allocator->blockSize[i] = blockSize
+      ? blockSize
+      : heapSize <= SMALL_HEAP_SIZE
+        ? heapSize / 8
+        : DEFAULT_BLOCK_SIZE;
+  }
+
+  return allocator;
+}
+
+
+void cjelly_gpu_allocator_destroy(CJellyGpuAllocator * allocator) {
+  if (!allocator) {
+    return;
+  }
+  for (uint32_t type = 0; type < allocator->memory.memoryTypeCount; ++type) {
+    for (int kind = 0; kind < 2; ++kind) {
+      while (allocator->pools[type][kind].blocks) {
+        block_destroy(allocator, type, (CJellyGpuResourceKind)kind, allocator->pools[type][kind].blocks);
+      }
+    }
+  }
+  pthread_mutex_destroy(&allocator->mutex);
+  free(allocator);
+}
+
+
+bool cjelly_gpu_allocator_find_memory_type(const CJellyGpuAllocator * allocator, uint32_t typeBits, VkMemoryPropertyFlags properties, uint32_t * outMemoryTypeIndex) {
+  for (uint32_t i = 0; i < allocator->memory.memoryTypeCount; ++i) {
+    if ((typeBits & (1u << i)) &&
+        (allocator->memory.memoryTypes[i].propertyFlags & properties) == properties) {
+      *outMemoryTypeIndex = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/**
+ * @brief Gives an allocation a device memory object of its own.
+ */
+static VkResult allocate_dedicated(CJellyGpuAllocator * allocator, GpuAllocation * allocation) {
+  VkResult result = allocate_memory(allocator, allocation->info.memoryTypeIndex, allocation->info.size, &allocation->info.memory, &allocation->info.mapped);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  allocation->info.offset = 0;
+  allocation->block = NULL;
+  allocation->region = NULL;
+  return VK_SUCCESS;
+}
+
+
+/**
+ * @brief Finds room for an allocation in its pool, adding a block if needed.
+ */
+static VkResult allocate_in_pool(CJellyGpuAllocator * allocator, GpuAllocation * allocation) {
+  uint32_t type = allocation->info.memoryTypeIndex;
+  VkDeviceSize size = allocation->info.size;
+  VkDeviceSize alignment = allocation->alignment;
+  GpuPool * pool = &allocator->pools[type][allocation->kind];
+
+  for (GpuBlock * block = pool->blocks; block; block = block->next) {
+    GpuRegion * region = block_alloc(block, size, alignment);
+    if (region) {
+      place_allocation(allocation, block, region);
+      return VK_SUCCESS;
+    }
+  }
+
+  // No block has room, so add one.  If the device cannot provide a full
+  // block, try smaller ones while they still comfortably fit the request.
+  VkDeviceSize blockSize = allocator->blockSize[allocator->memory.memoryTypes[type].heapIndex];
+  VkDeviceSize minimum = 2 * (size + alignment);
+  if (minimum < MIN_BLOCK_SIZE) {
+    minimum = MIN_BLOCK_SIZE;
+  }
+  VkResult result;
+  GpuBlock * block;
+  while ((result = block_create(allocator, type, allocation->kind, blockSize, &block)) != VK_SUCCESS) {
+    if (result == VK_ERROR_OUT_OF_HOST_MEMORY || blockSize / 2 < minimum) {
+      return result;
+    }
+    blockSize /= 2;
+  }
+
+  GpuRegion * region = block_alloc(block, size, alignment);
+  if (!region) {
+    block_trim(allocator, type, allocation->kind, block);
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+  place_allocation(allocation, block, region);
+  return VK_SUCCESS;
+}
+
+
+VkResult cjelly_gpu_allocator_alloc(CJellyGpuAllocator * allocator, const VkMemoryRequirements * requirements, uint32_t memoryTypeIndex, CJellyGpuResourceKind kind, CJellyGpuAllocation * * outAllocation) {
+  if (memoryTypeIndex >= allocator->memory.memoryTypeCount || !(requirements->memoryTypeBits & (1u << memoryTypeIndex))) {
+    return VK_ERROR_FEATURE_NOT_PRESENT;
+  }
+
+  GpuAllocation * allocation = calloc(1, sizeof(GpuAllocation));
+  if (!allocation) {
+    return VK_ERROR_OUT_OF_HOST_MEMORY;
+  }
+  allocation->info.size = requirements->size;
+  allocation->info.memoryTypeIndex = memoryTypeIndex;
+  allocation->alignment = requirements->alignment ? requirements->alignment : 1;
+  allocation->kind = kind;
+
+  uint32_t heapIndex = allocator->memory.memoryTypes[memoryTypeIndex].heapIndex;
+
+  pthread_mutex_lock(&allocator->mutex);
+
+  // Requests that would take up most of a block are not worth sharing one.
+  VkResult result;
+  if (requirements->size > allocator->blockSize[heapIndex] / 2) {
+    result = allocate_dedicated(allocator, allocation);
+  }
+  else {
+    result = allocate_in_pool(allocator, allocation);
+    if (result != VK_SUCCESS && result != VK_ERROR_OUT_OF_HOST_MEMORY) {
+      // The device may still have room for something smaller than a block.
+      result = allocate_dedicated(allocator, allocation);
+    }
+  }
+
+  if (result == VK_SUCCESS) {
+    allocator->heaps[heapIndex].usedBytes += requirements->size;
+    ++allocator->heaps[heapIndex].allocationCount;
+  }
+
+  pthread_mutex_unlock(&allocator->mutex);
+
+  if (result != VK_SUCCESS) {
+    free(allocation);
+    return result;
+  }
+  *outAllocation = &allocation->info;
+  return VK_SUCCESS;
+}
+
+
+void cjelly_gpu_allocator_free(CJellyGpuAllocator * allocator, CJellyGpuAllocation * allocation) {
+  if (!allocation) {
+    return;
+  }
+  GpuAllocation * internal = (GpuAllocation *)allocation;
+  uint32_t type = allocation->memoryTypeIndex;
+  uint32_t heapIndex = allocator->memory.memoryTypes[type].heapIndex;
+
+  pthread_mutex_lock(&allocator->mutex);
+
+  allocator->heaps[heapIndex].usedBytes -= allocation->size;
+  --allocator->heaps[heapIndex].allocationCount;
+
+  if (internal->block) {
+    block_release(internal->block, internal->region);
+    block_trim(allocator, type, internal->kind, internal->block);
+  }
+  else {
+    free_memory(allocator, type, allocation->size, allocation->memory);
+  }
+
+  pthread_mutex_unlock(&allocator->mutex);
+
+  free(internal);
+}
+
+
+uint32_t cjelly_gpu_allocator_heap_count(const CJellyGpuAllocator * allocator) {
+  return allocator->memory.memoryHeapCount;
+}
+
+
+void cjelly_gpu_allocator_use_memory_budget(CJellyGpuAllocator * allocator) {
+  pthread_mutex_lock(&allocator->mutex);
+  allocator->memoryBudget = true;
+  pthread_mutex_unlock(&allocator->mutex);
+}
+
+
+uint32_t cjelly_gpu_allocator_memory_type_heap(const CJellyGpuAllocator * allocator, uint32_t memoryTypeIndex) {
+  return allocator->memory.memoryTypes[memoryTypeIndex].heapIndex;
+}
+
+
+void cjelly_gpu_allocator_get_heap_stats(CJellyGpuAllocator * allocator, uint32_t heapIndex, CJellyGpuHeapStats * outStats) {
+  pthread_mutex_lock(&allocator->mutex);
+  *outStats = allocator->heaps[heapIndex];
+  outStats->usage = outStats->blockBytes;
+  if (allocator->memoryBudget) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {0};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = {0};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(allocator->physicalDevice, &properties);
+    outStats->budget = budget.heapBudget[heapIndex];
+    outStats->usage = budget.heapUsage[heapIndex];
+  }
+  pthread_mutex_unlock(&allocator->mutex);
+}
+
+
+//
+// === Defragmentation ===
+//
+
+static int compare_blocks_by_use(const void * a, const void * b) {
+  const GpuBlock * blockA = *(const GpuBlock * const *)a;
+  const GpuBlock * blockB = *(const GpuBlock * const *)b;
+  return (blockA->used > blockB->used) - (blockA->used < blockB->used);
+}
+
+
+/**
+ * @brief Empties the least used blocks of a pool into the fullest ones.
+ */
+static uint32_t defragment_pool(CJellyGpuAllocator * allocator, uint32_t type, CJellyGpuResourceKind kind, CJellyGpuDefragmentMove move, void * user) {
+  size_t count = 0;
+  for (GpuBlock * block = allocator->pools[type][kind].blocks; block; block = block->next) {
+    ++count;
+  }
+  if (count < 2) {
+    return 0;
+  }
+
+  GpuBlock * * blocks = malloc(count * sizeof(GpuBlock *));
+  if (!blocks) {
+    return 0;
+  }
+  size_t i = 0;
+  for (GpuBlock * block = allocator->pools[type][kind].blocks; block; block = block->next) {
+    blocks[i++] = block;
+  }
+  qsort(blocks, count, sizeof(GpuBlock *), compare_blocks_by_use);
+
+  uint32_t moved = 0;
+  for (size_t source = 0; source + 1 < count; ++source) {
+    GpuBlock * from = blocks[source];
+    GpuRegion * region = from->firstRegion;
+    while (region) {
+      GpuAllocation * allocation = region->owner;
+      if (!allocation) {
+        region = region->nextPhysical;
+        continue;
+      }
+
+      // Prefer the fullest block that has room.
+      GpuBlock * to = NULL;
+      GpuRegion * target = NULL;
+      for (size_t j = count - 1; j > source && !target; --j) {
+        to = blocks[j];
+        target = block_alloc(to, allocation->info.size, allocation->alignment);
+      }
+      if (!target) {
+        region = region->nextPhysical;
+        continue;
+      }
+
+      CJellyGpuAllocation destination = allocation->info;
+      destination.memory = to->memory;
+      destination.offset = target->offset;
+      destination.mapped = to->mapped
+        ? (char *)to->mapped + target->offset
+        : NULL;
+
+      if (move(user, &allocation->info, &destination)) {
+        region = block_release(from, region)->nextPhysical;
+        place_allocation(allocation, to, target);
+        ++moved;
+      }
+      else {
+        block_release(to, target);
+        region = region->nextPhysical;
+      }
+    }
+
+    if (!from->allocationCount) {
+      block_destroy(allocator, type, kind, from);
+    }
+  }
+
+  free(blocks);
+  return moved;
+}
+
+
+uint32_t cjelly_gpu_allocator_defragment(CJellyGpuAllocator * allocator, CJellyGpuDefragmentMove move, void * user) {
+  uint32_t moved = 0;
+  pthread_mutex_lock(&allocator->mutex);
+  for (uint32_t type = 0; type < allocator->memory.memoryTypeCount; ++type) {
+    for (int kind = 0; kind < 2; ++kind) {
+      moved += defragment_pool(allocator, type, (CJellyGpuResourceKind)kind, move, user);
+    }
+  }
+  pthread_mutex_unlock(&allocator->mutex);
+  return moved;
+}
@@ -1,45 +1,124 @@
-#define _POSIX_C_SOURCE 199309L
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 
-// #include <cjelly/format/3d/obj.h>
+#include <cjelly/format/3d/obj.h>
 // #include <cjelly/format/3d/mtl.h>
 #include <cjelly/format/image.h>
+#include <cjelly/mesh.h>
+#include <cjelly/meshcache.h>
 #include <cjelly/format/image/bmp.h>
 
-#ifdef _WIN32
-#include <windows.h>
-#include <stdint.h>
-uint64_t getCurrentTimeInMilliseconds(void) {
-  LARGE_INTEGER frequency;
-  LARGE_INTEGER counter;
-  QueryPerformanceFrequency(&frequency);
-  QueryPerformanceCounter(&counter);
-  return (uint64_t)((counter.QuadPart * 1000LL) / frequency.QuadPart);
-}
-#else
-#include <time.h>
-#include <stdint.h>
-uint64_t getCurrentTimeInMilliseconds(void) {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (uint64_t)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000ULL;
-}
-#endif
-
 #include <cjelly/cjelly.h>
 
 
+// The frame rate of a window, as reported once a second.
+typedef struct {
+  CJellyWindow * win;
+  uint64_t start;
+  uint64_t framesPresented;
+} FrameRate;
+
+#define FRAME_RATE_WINDOWS 2
+static FrameRate frameRates[FRAME_RATE_WINDOWS];
+
+// Print how many frames the window presented over the last second.
+static void reportFrameRate(CJellyWindow * win) {
+  FrameRate * rate = NULL;
+  for (int i = 0; i < FRAME_RATE_WINDOWS && !rate; ++i) {
+    if (frameRates[i].win == win || !frameRates[i].win) {
+      rate = &frameRates[i];
+    }
+  }
+  if (!rate) {
+    return;
+  }
+
+  uint64_t now = getCurrentTimeInMilliseconds();
+  if (!rate->win) {
+    rate->win = win;
+    rate->start = now;
+    rate->framesPresented = win->framesPresented;
+    return;
+  }
+  if (now - rate->start >= 1000) {
+    printf("Window %d: %.1f FPS\n", (int)(rate - frameRates) + 1,
+        (double)(win->framesPresented - rate->framesPresented) * 1000.0 /
+            (double)(now - rate->start));
+    rate->start = now;
+    rate->framesPresented = win->framesPresented;
+  }
+}
+
 void renderSquare(CJellyWindow *win) {
   drawFrameForWindow(win);
+  reportFrameRate(win);
+}
+
+// The sprite demo draws a grid of 100,000 spinning squares.
+#define SPRITE_COLUMNS 400
+#define SPRITE_ROWS 250
+
+// The texture of the sprites, from the texture cache.
+static CJellyTexture * spriteTexture;
+
+// Stream the sprites of one frame into the batch.
+void fillSprites(void * user, CJellySpriteBatch * batch,
+    const CJellyRecordContext * context) {
+  CJellySprite * sprites = (CJellySprite *)user;
+  float time = (float)(getCurrentTimeInMilliseconds() % 60000) / 1000.0f;
+  float cellWidth = 2.0f / SPRITE_COLUMNS;
+  float cellHeight = 2.0f / SPRITE_ROWS;
+
+  // Until the cached texture is resident, draw the one that is always loaded.
+  // The window redraws every frame, so the first frame recorded after the
+  // texture has been streamed in switches to it.
+  uint32_t textureIndex;
+  if (!cjelly_texture_cache_use(
+          textureCache, spriteTexture, context->serial, &textureIndex)) {
+    textureIndex = textureTableIndex;
+  }
+
+  for (int row = 0; row < SPRITE_ROWS; ++row) {
+    for (int column = 0; column < SPRITE_COLUMNS; ++column) {
+      CJellySprite * sprite = &sprites[row * SPRITE_COLUMNS + column];
+      float angle = time + (float)(row + column) * 0.05f;
+      float c = cosf(angle) * 0.9f;
+      float s = sinf(angle) * 0.9f;
+      float centerX = -1.0f + cellWidth * ((float)column + 0.5f);
+      float centerY = -1.0f + cellHeight * ((float)row + 0.5f);
+
+      // Rotate the unit square about its center, then scale it to the cell.
+      sprite->transform[0] = c * cellWidth;
+      sprite->transform[1] = s * cellHeight;
+      sprite->transform[2] = -s * cellWidth;
+      sprite->transform[3] = c * cellHeight;
+      sprite->transform[4] =
+          centerX - 0.5f * (sprite->transform[0] + sprite->transform[2]);
+      sprite->transform[5] =
+          centerY - 0.5f * (sprite->transform[1] + sprite->transform[3]);
+      sprite->uvRect[0] = 0.0f;
+      sprite->uvRect[1] = 0.0f;
+      sprite->uvRect[2] = 1.0f;
+      sprite->uvRect[3] = 1.0f;
+      sprite->textureIndex = textureIndex;
+    }
+  }
+  addSprites(batch, sprites, SPRITE_COLUMNS * SPRITE_ROWS);
 }
 
 int main(void) {
   #ifdef _WIN32
   // Windows: hInstance is set in createPlatformWindow.
 #else
-  // Linux: Open X display.
+  // Linux: Open X display.  The present threads reach the display through
+  // the swap chain while this thread reads events from it, so Xlib has to be
+  // made thread safe before the display is opened.
+  if (!XInitThreads()) {
+    fprintf(stderr, "Failed to initialize Xlib for threads\n");
+    exit(EXIT_FAILURE);
+  }
   display = XOpenDisplay(NULL);
   if (!display) {
     fprintf(stderr, "Failed to open X display\n");
@@ -54,75 +133,105 @@ int main(void) {
   win1.updateMode = CJELLY_UPDATE_MODE_FIXED;
   win1.fixedFramerate = 60;
 
+  // The sprites spin, so their window redraws at the display's refresh rate.
   win2.renderCallback = renderSquare;
-  win2.updateMode = CJELLY_UPDATE_MODE_EVENT_DRIVEN;
+  win2.updateMode = CJELLY_UPDATE_MODE_VSYNC;
+
+  // To measure throughput, e.g. with CJELLY_FRAMES_IN_FLIGHT=1 against the
+  // default, CJELLY_UNTHROTTLED=1 draws both windows as fast as they can be
+  // presented.
+  const char * framesInFlight = getenv("CJELLY_FRAMES_IN_FLIGHT");
+  if (framesInFlight) {
+    win1.framesInFlight = (uint32_t)strtoul(framesInFlight, NULL, 10);
+    win2.framesInFlight = win1.framesInFlight;
+  }
+  if (getenv("CJELLY_UNTHROTTLED")) {
+    win1.updateMode = CJELLY_UPDATE_MODE_VSYNC;
+    win1.presentMode = CJELLY_PRESENT_MODE_IMMEDIATE;
+    win2.presentMode = CJELLY_PRESENT_MODE_IMMEDIATE;
+  }
+
+  createPlatformWindow(&win1, "Vulkan Mesh - Window 1", WIDTH, HEIGHT);
+  createPlatformWindow(&win2, "Vulkan Sprites - Window 2", WIDTH, HEIGHT);
 
-  createPlatformWindow(&win1, "Vulkan Square - Window 1", WIDTH, HEIGHT);
-  createPlatformWindow(&win2, "Vulkan Square - Window 2", WIDTH, HEIGHT);
+  // Load the shaders from disk, and reload them when they are rebuilt, if a
+  // directory of .spv files is given (e.g., CJELLY_SHADER_DIR=shaders).
+  shaderDirectory = getenv("CJELLY_SHADER_DIR");
 
   // Global Vulkan initialization.
   initVulkanGlobal();
+  // Compare a cold start (e.g., after deleting the cache file) with a warm one.
+  printf("Pipelines created in %.2f ms (%s)\n", pipelineCreationTime / 1e6,
+      pipelineCacheStatus == CJELLY_PIPELINE_CACHE_SUCCESS
+        ? "warm pipeline cache"
+        : cjelly_pipeline_cache_strerror(pipelineCacheStatus));
+
+  // Load a model and upload it as an indexed mesh.  The optimized mesh is
+  // cached next to the model, so only the first run has to parse the OBJ.
+  uint64_t loadStart = getCurrentTimeInMilliseconds();
+  CJellyMeshCache * meshCache;
+  CJellyMeshCacheError cacheErr = cjelly_mesh_cache_load_obj(
+      "test/models/stanford-bunny/stanford-bunny.obj",
+      "test/models/stanford-bunny/stanford-bunny.cjmesh", &meshCache);
+  if (cacheErr != CJELLY_MESH_CACHE_SUCCESS) {
+    fprintf(stderr, "Failed to load model: %s\n",
+        cjelly_mesh_cache_strerror(cacheErr));
+    exit(EXIT_FAILURE);
+  }
+  const CJellyMesh * mesh = cjelly_mesh_cache_mesh(meshCache);
+  CJellyMeshCacheStats stats;
+  cjelly_mesh_analyze_vertex_cache(mesh, CJELLY_MESH_VERTEX_CACHE_SIZE, &stats);
+  printf("Mesh: %u vertices, %u triangles, ACMR %.3f, ATVR %.3f, loaded in %llu ms\n",
+      mesh->vertex_count, mesh->index_count / 3, stats.acmr, stats.atvr,
+      (unsigned long long)(getCurrentTimeInMilliseconds() - loadStart));
+  CJellyGpuMesh gpuMesh = {0};
+  createGpuMesh(mesh, &gpuMesh);
+  cjelly_mesh_cache_close(meshCache);
+
+  // The texture and mesh uploads were batched together.  Submit them, and wait
+  // for them before drawing anything.
+  CJellyUploadTicket uploads;
+  if (cjelly_uploader_flush(uploader, &uploads) != VK_SUCCESS ||
+      cjelly_uploader_wait(uploader, uploads) != VK_SUCCESS) {
+    fprintf(stderr, "Failed to upload resources\n");
+    exit(EXIT_FAILURE);
+  }
 
   // For each window, create the per-window Vulkan objects.
   createSurfaceForWindow(&win1);
   createSwapChainForWindow(&win1);
   createImageViewsForWindow(&win1);
   createFramebuffersForWindow(&win1);
-  createCommandBuffersForWindow(&win1);
   createSyncObjectsForWindow(&win1);
+  createMeshRecorderForWindow(&win1, &gpuMesh);
+  // The mesh window prepares its frames on a thread of its own.
+  createPresentThreadForWindow(&win1);
 
   createSurfaceForWindow(&win2);
   createSwapChainForWindow(&win2);
   createImageViewsForWindow(&win2);
   createFramebuffersForWindow(&win2);
-  createTexturedCommandBuffersForWindow(&win2);
   createSyncObjectsForWindow(&win2);
+  // Every sprite uses the same texture, through the texture cache.
+  CJellyTextureCacheError textureError = cjelly_texture_cache_acquire(
+      textureCache, "test/images/bmp/tang.bmp", &spriteTexture);
+  if (textureError != CJELLY_TEXTURE_CACHE_SUCCESS) {
+    fprintf(stderr, "Failed to load sprite texture: %s\n",
+        cjelly_texture_cache_strerror(textureError));
+    exit(EXIT_FAILURE);
+  }
+  CJellySprite * sprites =
+      malloc(sizeof(CJellySprite) * SPRITE_COLUMNS * SPRITE_ROWS);
+  if (!sprites) {
+    fprintf(stderr, "Failed to allocate sprites\n");
+    exit(EXIT_FAILURE);
+  }
+  CJellySpriteBatch * spriteBatch = createSpriteBatch();
+  createSpriteRecorderForWindow(&win2, spriteBatch, fillSprites, sprites);
 
   // Main render loop.
   CJellyWindow * windows[] = {&win1, &win2};
-  while (!shouldClose) {
-    processWindowEvents();
-    uint64_t currentTime = getCurrentTimeInMilliseconds();
-
-    for (int i = 0; i < 2; ++i) {
-      CJellyWindow * win = windows[i];
-      // Update window 1 independently:
-      switch (win->updateMode) {
-        case CJELLY_UPDATE_MODE_VSYNC:
-          // For VSync mode, the present call (with FIFO) will throttle rendering.
-          if (win->renderCallback) {
-            win->renderCallback(win);
-          }
-          break;
-        case CJELLY_UPDATE_MODE_FIXED:
-          // In fixed mode, only render if it’s time for the next frame.
-          if (currentTime >= win->nextFrameTime) {
-            if (win->renderCallback) {
-              win->renderCallback(win);
-            }
-            win->nextFrameTime = currentTime + (1000 / win->fixedFramerate);
-          }
-          break;
-        case CJELLY_UPDATE_MODE_EVENT_DRIVEN:
-          // In event-driven mode, only render when needed.
-          if (win->needsRedraw) {
-            if (win->renderCallback) {
-              win->renderCallback(win);
-            }
-            win->needsRedraw = 0;
-          }
-          break;
-      }
-    }
-
-    // Sleep for a short duration to avoid busy waiting.
-  #ifdef _WIN32
-    Sleep(1);
-  #else
-    struct timespec req = {0, 1000000}; // 1 millisecond
-    nanosleep(&req, NULL);
-  #endif
-  }
+  runWindowLoop(windows, 2);
   vkDeviceWaitIdle(device);
 
   // Clean up per-window resources.
@@ -130,6 +239,10 @@ int main(void) {
   cleanupWindow(&win2);
 
   // Clean up global Vulkan resources.
+  destroyGpuMesh(&gpuMesh);
+  destroySpriteBatch(spriteBatch);
+  free(sprites);
+  cjelly_texture_cache_release(textureCache, spriteTexture);
   cleanupVulkanGlobal();
 
 #ifndef _WIN32
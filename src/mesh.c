@@ -0,0 +1,731 @@
+#include <cjelly/mesh.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * @brief Key identifying a unique vertex: the OBJ indices of one corner.
+ */
+typedef struct {
+  int vertex;   /**< Position index (0-based) */
+  int texcoord; /**< Texture coordinate index (0-based or -1 if missing) */
+  int normal;   /**< Normal index (0-based or -1 if missing) */
+} MeshVertexKey;
+
+
+/**
+ * @brief Open-addressing hash map from MeshVertexKey to vertex index.
+ *
+ * The keys themselves are stored once, in `keys`, indexed by vertex.  The
+ * table only holds `vertex index + 1`, so that zero marks an empty slot.
+ */
+typedef struct {
+  uint32_t * slots;     /**< Hash table (vertex index + 1, or 0 if empty) */
+  uint32_t mask;        /**< Table size - 1 (the size is a power of two) */
+  MeshVertexKey * keys; /**< The key of each unique vertex */
+  uint32_t count;       /**< Number of unique vertices */
+} MeshVertexMap;
+
+
+/**
+ * @brief Hashes a vertex key.
+ *
+ * The three indices are mixed with large odd multipliers, then the high bits
+ * are folded down, since the table index is taken from the low bits.
+ */
+static inline uint32_t hash_key(const MeshVertexKey * key) {
+  uint32_t h = (uint32_t)key->vertex * 0x9E3779B1u;
+  h ^= (uint32_t)key->texcoord * 0x85EBCA77u;
+  h ^= (uint32_t)key->normal * 0xC2B2AE3Du;
+  return h ^ (h >> 15);
+}
+
+
+/**
+ * @brief Returns the vertex index for a key, adding a new vertex if needed.
+ */
+static inline uint32_t map_insert(MeshVertexMap * map, const MeshVertexKey * key) {
+  uint32_t slot = hash_key(key) & map->mask;
+  while (map->slots[slot]) {
+    uint32_t index = map->slots[slot] - 1;
+    const MeshVertexKey * other = &map->keys[index];
+    if (other->vertex == key->vertex && other->texcoord == key->texcoord && other->normal == key->normal) {
+      return index;
+    }
+    slot = (slot + 1) & map->mask;
+  }
+  uint32_t index = map->count++;
+  map->keys[index] = *key;
+  map->slots[slot] = index + 1;
+  return index;
+}
+
+
+/**
+ * @brief Checks that a corner only references elements that exist.
+ */
+static inline bool corner_is_valid(const CJellyFormat3dObjModel * model, const MeshVertexKey * key) {
+  return key->vertex >= 0 && key->vertex < model->vertex_count
+    && key->texcoord >= -1 && key->texcoord < model->texcoord_count
+    && key->normal >= -1 && key->normal < model->normal_count;
+}
+
+
+CJellyMeshError cjelly_mesh_build_from_obj(const CJellyFormat3dObjModel * model, CJellyMesh * * outMesh) {
+  CJellyMeshError err = CJELLY_MESH_SUCCESS;
+  MeshVertexMap map = {0};
+  uint32_t * indices = NULL;
+
+  // Check for invalid input.
+  if (!model || !outMesh) {
+    return CJELLY_MESH_ERR_INVALID_INDEX;
+  }
+
+  // Count the triangles produced by fan triangulation, and the corners that
+  // contribute to them.
+  uint64_t index_count = 0;
+  uint64_t corner_count = 0;
+  for (int face = 0; face < model->face_count; ++face) {
+    int count = model->face_offsets[face + 1] - model->face_offsets[face];
+    if (count >= 3) {
+      index_count += 3 * (uint64_t)(count - 2);
+      corner_count += (uint64_t)count;
+    }
+  }
+  if (index_count > UINT32_MAX || corner_count > (1u << 30)) {
+    return CJELLY_MESH_ERR_TOO_LARGE;
+  }
+
+  CJellyMesh * mesh = (CJellyMesh *)calloc(1, sizeof(CJellyMesh));
+  if (!mesh) { goto ERROR_CLEANUP; }
+
+  // The hash table is at least twice the size of the worst case (every corner
+  // is unique), which keeps the probe sequences short.
+  uint32_t table_size = 16;
+  while (table_size < corner_count * 2) {
+    table_size *= 2;
+  }
+  map.mask = table_size - 1;
+  map.slots = (uint32_t *)calloc(table_size, sizeof(uint32_t));
+  map.keys = (MeshVertexKey *)malloc((corner_count ? corner_count : 1) * sizeof(MeshVertexKey));
+  indices = (uint32_t *)malloc((index_count ? index_count : 1) * sizeof(uint32_t));
+  if (!map.slots || !map.keys || !indices) { goto ERROR_CLEANUP; }
+
+  // Triangulate each face as a fan around its first corner.
+  uint32_t * out = indices;
+  for (int face = 0; face < model->face_count; ++face) {
+    int first = model->face_offsets[face];
+    int count = model->face_offsets[face + 1] - first;
+    if (count < 3) {
+      continue;
+    }
+    uint32_t fan[2];
+    for (int i = 0; i < count; ++i) {
+      int corner = first + i;
+      MeshVertexKey key = {
+        model->corner_vertices[corner],
+        model->corner_texcoords[corner],
+        model->corner_normals[corner],
+      };
+      if (!corner_is_valid(model, &key)) {
+        err = CJELLY_MESH_ERR_INVALID_INDEX;
+        goto ERROR_CLEANUP;
+      }
+      uint32_t index = map_insert(&map, &key);
+      if (i < 2) {
+        fan[i] = index;
+        continue;
+      }
+      *out++ = fan[0];
+      *out++ = fan[1];
+      *out++ = index;
+      fan[1] = index;
+    }
+  }
+
+  // Expand the unique keys into interleaved vertices.
+  mesh->vertex_count = map.count;
+  mesh->vertices = (CJellyMeshVertex *)malloc((map.count ? map.count : 1) * sizeof(CJellyMeshVertex));
+  if (!mesh->vertices) { goto ERROR_CLEANUP; }
+  for (uint32_t i = 0; i < map.count; ++i) {
+    const MeshVertexKey * key = &map.keys[i];
+    CJellyMeshVertex * vertex = &mesh->vertices[i];
+    const CJellyFormat3dObjVertex * position = &model->vertices[key->vertex];
+    vertex->position[0] = position->x;
+    vertex->position[1] = position->y;
+    vertex->position[2] = position->z;
+    if (key->texcoord >= 0) {
+      vertex->texcoord[0] = model->texcoords[key->texcoord].u;
+      vertex->texcoord[1] = 1.0f - model->texcoords[key->texcoord].v;
+    }
+    else {
+      vertex->texcoord[0] = vertex->texcoord[1] = 0.0f;
+    }
+    if (key->normal >= 0) {
+      vertex->normal[0] = model->normals[key->normal].x;
+      vertex->normal[1] = model->normals[key->normal].y;
+      vertex->normal[2] = model->normals[key->normal].z;
+    }
+    else {
+      vertex->normal[0] = vertex->normal[1] = vertex->normal[2] = 0.0f;
+    }
+
+    // Grow the bounding box.
+    for (int axis = 0; axis < 3; ++axis) {
+      if (!i || vertex->position[axis] < mesh->bounds_min[axis]) {
+        mesh->bounds_min[axis] = vertex->position[axis];
+      }
+      if (!i || vertex->position[axis] > mesh->bounds_max[axis]) {
+        mesh->bounds_max[axis] = vertex->position[axis];
+      }
+    }
+  }
+
+  // Use 16-bit indices when every vertex can be addressed with them, which
+  // halves the size of the index buffer.
+  mesh->index_count = (uint32_t)index_count;
+  if (map.count <= UINT16_MAX + 1u) {
+    uint16_t * narrow = (uint16_t *)malloc((index_count ? index_count : 1) * sizeof(uint16_t));
+    if (!narrow) { goto ERROR_CLEANUP; }
+    for (uint32_t i = 0; i < mesh->index_count; ++i) {
+      narrow[i] = (uint16_t)indices[i];
+    }
+    free(indices);
+    indices = NULL;
+    mesh->indices = narrow;
+    mesh->index_type = CJELLY_MESH_INDEX_TYPE_UINT16;
+  }
+  else {
+    mesh->indices = indices;
+    indices = NULL;
+    mesh->index_type = CJELLY_MESH_INDEX_TYPE_UINT32;
+  }
+
+  free(map.slots);
+  free(map.keys);
+  *outMesh = mesh;
+  return CJELLY_MESH_SUCCESS;
+
+  // Error handling.
+ERROR_CLEANUP:
+  // If an error is not set, then default to out-of-memory.
+  if (err == CJELLY_MESH_SUCCESS) {
+    err = CJELLY_MESH_ERR_OUT_OF_MEMORY;
+  }
+  free(map.slots);
+  free(map.keys);
+  free(indices);
+  cjelly_mesh_free(mesh);
+  return err;
+}
+
+
+uint32_t cjelly_mesh_index_size(const CJellyMesh * mesh) {
+  return mesh->index_type == CJELLY_MESH_INDEX_TYPE_UINT16
+    ? (uint32_t)sizeof(uint16_t)
+    : (uint32_t)sizeof(uint32_t);
+}
+
+
+//
+// === Optimization ===
+//
+// The passes below work on a 32-bit copy of the index buffer, which is
+// written back (narrowed again, if the mesh uses 16-bit indices) at the end.
+//
+// The vertex cache is modeled as a FIFO with timestamps rather than as an
+// actual queue.  Each vertex remembers the value of a counter, incremented on
+// every cache miss, at the time that the vertex entered the cache.  A vertex
+// is therefore still cached as long as fewer than `cache_size` misses have
+// happened since.  Starting the counter past `cache_size` makes every vertex
+// initially absent, and advancing it by `cache_size + 1` flushes the cache.
+//
+
+/**
+ * @brief Marks an unassigned vertex or the absence of a vertex.
+ */
+#define NO_VERTEX UINT32_MAX
+
+/**
+ * @brief Ratio of a cluster's cache miss ratio under which the overdraw pass
+ * may cut it.
+ *
+ * Cutting a cluster flushes the simulated cache, so the cut is only made once
+ * the triangles since the previous cut have amortized that cost.  Larger
+ * values produce more (smaller) clusters: better overdraw, worse ACMR.
+ */
+#define OVERDRAW_THRESHOLD 1.05f
+
+
+/**
+ * @brief A run of consecutive triangles that is sorted as one unit.
+ */
+typedef struct {
+  float key;      /**< Sort key, larger is drawn first */
+  uint32_t first; /**< First triangle */
+  uint32_t count; /**< Number of triangles */
+} MeshCluster;
+
+
+/**
+ * @brief Reads index `i` of a mesh, whatever its index type.
+ */
+static inline uint32_t get_index(const CJellyMesh * mesh, uint32_t i) {
+  return mesh->index_type == CJELLY_MESH_INDEX_TYPE_UINT16
+    ? ((const uint16_t *)mesh->indices)[i]
+    : ((const uint32_t *)mesh->indices)[i];
+}
+
+
+/**
+ * @brief Simulates the cache for one vertex, returning 1 on a miss.
+ */
+static inline uint32_t touch_vertex(uint32_t * timestamps, uint32_t * time, uint32_t cache_size, uint32_t vertex) {
+  if (*time - timestamps[vertex] > cache_size) {
+    timestamps[vertex] = (*time)++;
+    return 1;
+  }
+  return 0;
+}
+
+
+/**
+ * @brief Simulates the cache for one triangle, returning the number of misses.
+ */
+static inline uint32_t touch_triangle(uint32_t * timestamps, uint32_t * time, uint32_t cache_size, const uint32_t * triangle) {
+  return touch_vertex(timestamps, time, cache_size, triangle[0])
+    + touch_vertex(timestamps, time, cache_size, triangle[1])
+    + touch_vertex(timestamps, time, cache_size, triangle[2]);
+}
+
+
+CJellyMeshError cjelly_mesh_analyze_vertex_cache(const CJellyMesh * mesh, uint32_t cache_size, CJellyMeshCacheStats * outStats) {
+  // Check for invalid input.
+  if (!mesh || !outStats) {
+    return CJELLY_MESH_ERR_INVALID_INDEX;
+  }
+
+  *outStats = (CJellyMeshCacheStats){0};
+  uint32_t * timestamps = (uint32_t *)calloc(mesh->vertex_count ? mesh->vertex_count : 1, sizeof(uint32_t));
+  if (!timestamps) {
+    return CJELLY_MESH_ERR_OUT_OF_MEMORY;
+  }
+
+  uint32_t time = cache_size + 1;
+  uint32_t misses = 0;
+  for (uint32_t i = 0; i < mesh->index_count; ++i) {
+    misses += touch_vertex(timestamps, &time, cache_size, get_index(mesh, i));
+  }
+
+  // Only the vertices that are actually referenced count towards the ATVR.
+  uint32_t referenced = 0;
+  for (uint32_t i = 0; i < mesh->vertex_count; ++i) {
+    referenced += timestamps[i] ? 1 : 0;
+  }
+  free(timestamps);
+
+  if (mesh->index_count >= 3) {
+    outStats->acmr = (float)misses / (float)(mesh->index_count / 3);
+    outStats->atvr = (float)misses / (float)referenced;
+  }
+  return CJELLY_MESH_SUCCESS;
+}
+
+
+/**
+ * @brief Reorders triangles for the vertex cache with Tipsify.
+ *
+ * Tipsify fans out around one vertex at a time, emitting all of its remaining
+ * triangles, then picks the next fanning vertex among those just emitted,
+ * preferring the one that entered the cache the earliest, as long as its
+ * remaining triangles would not push it out again.  When no such vertex is
+ * left (a dead end), it backs up to the most recently emitted vertex that
+ * still has triangles, or failing that, to the next one in input order.
+ *
+ * @param indices The triangle list, reordered in place.
+ * @param index_count Number of indices.
+ * @param vertex_count Number of vertices.
+ * @param cache_size Number of cache entries.
+ * @param clusters Receives the first triangle of each run that follows a dead
+ *   end.  Must have room for one entry per triangle.
+ * @param cluster_count Receives the number of entries written to `clusters`.
+ * @return false if memory could not be allocated.
+ */
+static bool tipsify(uint32_t * indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size, uint32_t * clusters, uint32_t * cluster_count) {
+  uint32_t triangle_count = index_count / 3;
+  uint32_t * offsets = (uint32_t *)calloc((size_t)vertex_count + 1, sizeof(uint32_t));
+  uint32_t * adjacency = (uint32_t *)malloc((index_count ? index_count : 1) * sizeof(uint32_t));
+  uint32_t * live = (uint32_t *)calloc(vertex_count ? vertex_count : 1, sizeof(uint32_t));
+  uint32_t * timestamps = (uint32_t *)calloc(vertex_count ? vertex_count : 1, sizeof(uint32_t));
+  uint32_t * dead_ends = (uint32_t *)malloc((index_count ? index_count : 1) * sizeof(uint32_t));
+  uint32_t * output = (uint32_t *)malloc((index_count ? index_count : 1) * sizeof(uint32_t));
+  bool * emitted = (bool *)calloc(triangle_count ? triangle_count : 1, sizeof(bool));
+  bool success = false;
+  if (!offsets || !adjacency || !live || !timestamps || !dead_ends || !output || !emitted) {
+    goto CLEANUP;
+  }
+
+  // Build the vertex to triangle adjacency in CSR form.  `live` holds the
+  // number of triangles of each vertex that have not been emitted yet.
+  for (uint32_t i = 0; i < index_count; ++i) {
+    live[indices[i]]++;
+  }
+  for (uint32_t v = 0; v < vertex_count; ++v) {
+    offsets[v + 1] = offsets[v] + live[v];
+  }
+  for (uint32_t t = 0; t < triangle_count; ++t) {
+    for (int c = 0; c < 3; ++c) {
+      uint32_t v = indices[3 * t + c];
+      // `timestamps` is still zero, so borrow it as the fill cursor.
+      adjacency[offsets[v] + timestamps[v]++] = t;
+    }
+  }
+  memset(timestamps, 0, vertex_count * sizeof(uint32_t));
+
+  uint32_t time = cache_size + 1;
+  uint32_t out = 0;
+  uint32_t dead_end_count = 0;
+  uint32_t cursor = 0;
+  uint32_t fanning = vertex_count ? 0 : NO_VERTEX;
+  bool after_dead_end = true;
+  *cluster_count = 0;
+  while (fanning != NO_VERTEX) {
+    // Emit the remaining triangles around the fanning vertex.
+    uint32_t candidates = out;
+    for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+      uint32_t t = adjacency[a];
+      if (emitted[t]) {
+        continue;
+      }
+      if (after_dead_end) {
+        clusters[(*cluster_count)++] = out / 3;
+        after_dead_end = false;
+      }
+      for (int c = 0; c < 3; ++c) {
+        uint32_t v = indices[3 * t + c];
+        output[out++] = v;
+        dead_ends[dead_end_count++] = v;
+        live[v]--;
+        touch_vertex(timestamps, &time, cache_size, v);
+      }
+      emitted[t] = true;
+    }
+
+    // Pick the next fanning vertex among the vertices just emitted.
+    fanning = NO_VERTEX;
+    int64_t best = -1;
+    for (uint32_t i = candidates; i < out; ++i) {
+      uint32_t v = output[i];
+      if (!live[v]) {
+        continue;
+      }
+      int64_t priority = 0;
+      uint32_t age = time - timestamps[v];
+      if ((uint64_t)age + 2 * (uint64_t)live[v] <= cache_size) {
+        priority = age;
+      }
+      if (priority > best) {
+        best = priority;
+        fanning = v;
+      }
+    }
+
+    // Handle a dead end.
+    if (fanning == NO_VERTEX) {
+      after_dead_end = true;
+      while (dead_end_count && fanning == NO_VERTEX) {
+        uint32_t v = dead_ends[--dead_end_count];
+        if (live[v]) {
+          fanning = v;
+        }
+      }
+      while (cursor < vertex_count && fanning == NO_VERTEX) {
+        if (live[cursor]) {
+          fanning = cursor;
+        }
+        ++cursor;
+      }
+    }
+  }
+
+  memcpy(indices, output, (size_t)out * sizeof(uint32_t));
+  success = true;
+
+CLEANUP:
+  free(offsets);
+  free(adjacency);
+  free(live);
+  free(timestamps);
+  free(dead_ends);
+  free(output);
+  free(emitted);
+  return success;
+}
+
+
+/**
+ * @brief Orders clusters by decreasing sort key.
+ */
+static int compare_clusters(const void * a, const void * b) {
+  float ka = ((const MeshCluster *)a)->key;
+  float kb = ((const MeshCluster *)b)->key;
+  return (ka < kb) - (ka > kb);
+}
+
+
+/**
+ * @brief Accumulates the area-weighted centroid and the normal of triangles.
+ *
+ * @param vertices The mesh vertices.
+ * @param indices The first triangle.
+ * @param triangle_count Number of triangles.
+ * @param centroid Receives the centroid.
+ * @param normal Receives the sum of the (area-weighted) triangle normals.
+ */
+static void measure_triangles(const CJellyMeshVertex * vertices, const uint32_t * indices, uint32_t triangle_count, float centroid[3], float normal[3]) {
+  float area = 0;
+  float mean[3] = {0, 0, 0};
+  for (int axis = 0; axis < 3; ++axis) {
+    centroid[axis] = normal[axis] = 0;
+  }
+  for (uint32_t t = 0; t < triangle_count; ++t) {
+    const float * p0 = vertices[indices[3 * t]].position;
+    const float * p1 = vertices[indices[3 * t + 1]].position;
+    const float * p2 = vertices[indices[3 * t + 2]].position;
+    float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    float n[3] = {
+      e1[1] * e2[2] - e1[2] * e2[1],
+      e1[2] * e2[0] - e1[0] * e2[2],
+      e1[0] * e2[1] - e1[1] * e2[0],
+    };
+    float weight = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    for (int axis = 0; axis < 3; ++axis) {
+      float center = (p0[axis] + p1[axis] + p2[axis]) / 3.0f;
+      centroid[axis] += center * weight;
+      mean[axis] += center;
+      normal[axis] += n[axis];
+    }
+    area += weight;
+  }
+
+  // Degenerate triangles have no area, so fall back to a plain average.
+  for (int axis = 0; axis < 3; ++axis) {
+    centroid[axis] = area > 0
+      ? centroid[axis] / area
+      : (triangle_count ? mean[axis] / (float)triangle_count : 0);
+  }
+}
+
+
+/**
+ * @brief Sorts the triangle clusters to reduce overdraw.
+ *
+ * The clusters produced by Tipsify are cut further wherever the cache
+ * behaviour allows it, then sorted so that clusters on the outside of the
+ * mesh, facing away from its center, come first.  Those are the triangles
+ * most likely to occlude the rest, whatever the viewpoint.
+ *
+ * @param vertices The mesh vertices.
+ * @param indices The triangle list, reordered in place.
+ * @param index_count Number of indices.
+ * @param vertex_count Number of vertices.
+ * @param cache_size Number of cache entries.
+ * @param boundaries The first triangle of each Tipsify cluster.
+ * @param boundary_count Number of Tipsify clusters.
+ * @return false if memory could not be allocated.
+ */
+static bool sort_clusters(const CJellyMeshVertex * vertices, uint32_t * indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size, const uint32_t * boundaries, uint32_t boundary_count) {
+  uint32_t triangle_count = index_count / 3;
+  MeshCluster * clusters = (MeshCluster *)malloc((triangle_count ? triangle_count : 1) * sizeof(MeshCluster));
+  uint32_t * timestamps = (uint32_t *)calloc(vertex_count ? vertex_count : 1, sizeof(uint32_t));
+  uint32_t * output = (uint32_t *)malloc((index_count ? index_count : 1) * sizeof(uint32_t));
+  bool success = false;
+  if (!clusters || !timestamps || !output) {
+    goto CLEANUP;
+  }
+
+  // Cut each Tipsify cluster wherever the triangles since the last cut reach
+  // (nearly) the cluster's own ACMR, even though the cache starts out cold.
+  uint32_t time = cache_size + 1;
+  uint32_t cluster_count = 0;
+  for (uint32_t b = 0; b < boundary_count; ++b) {
+    uint32_t begin = boundaries[b];
+    uint32_t end = b + 1 < boundary_count ? boundaries[b + 1] : triangle_count;
+
+    time += cache_size + 1;
+    uint32_t misses = 0;
+    for (uint32_t t = begin; t < end; ++t) {
+      misses += touch_triangle(timestamps, &time, cache_size, &indices[3 * t]);
+    }
+    float threshold = OVERDRAW_THRESHOLD * (float)misses / (float)(end - begin);
+
+    time += cache_size + 1;
+    uint32_t first = begin;
+    misses = 0;
+    for (uint32_t t = begin; t < end; ++t) {
+      misses += touch_triangle(timestamps, &time, cache_size, &indices[3 * t]);
+      if ((float)misses / (float)(t + 1 - first) <= threshold) {
+        clusters[cluster_count++] = (MeshCluster){0, first, t + 1 - first};
+        first = t + 1;
+        time += cache_size + 1;
+        misses = 0;
+      }
+    }
+
+    // The triangles after the last cut did not reach the threshold on their
+    // own, so they stay with the previous piece.
+    if (first < end) {
+      if (cluster_count && first > begin) {
+        clusters[cluster_count - 1].count += end - first;
+      }
+      else {
+        clusters[cluster_count++] = (MeshCluster){0, first, end - first};
+      }
+    }
+  }
+
+  // Sort by how far each cluster lies from the center of the mesh, along its
+  // own normal.
+  float center[3];
+  float normal[3];
+  measure_triangles(vertices, indices, triangle_count, center, normal);
+  for (uint32_t c = 0; c < cluster_count; ++c) {
+    float centroid[3];
+    measure_triangles(vertices, &indices[3 * clusters[c].first], clusters[c].count, centroid, normal);
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    float dot = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+      dot += (centroid[axis] - center[axis]) * normal[axis];
+    }
+    clusters[c].key = length > 0 ? dot / length : 0;
+  }
+  qsort(clusters, cluster_count, sizeof(MeshCluster), compare_clusters);
+
+  uint32_t out = 0;
+  for (uint32_t c = 0; c < cluster_count; ++c) {
+    memcpy(&output[out], &indices[3 * clusters[c].first], 3 * (size_t)clusters[c].count * sizeof(uint32_t));
+    out += 3 * clusters[c].count;
+  }
+  memcpy(indices, output, (size_t)out * sizeof(uint32_t));
+  success = true;
+
+CLEANUP:
+  free(clusters);
+  free(timestamps);
+  free(output);
+  return success;
+}
+
+
+/**
+ * @brief Renumbers the vertices in the order in which the indices use them.
+ *
+ * Vertices that are not referenced at all are moved to the end.
+ *
+ * @param mesh The mesh whose vertices are reordered.
+ * @param indices The triangle list, remapped in place.
+ * @return false if memory could not be allocated.
+ */
+static bool reorder_vertices(CJellyMesh * mesh, uint32_t * indices) {
+  uint32_t * remap = (uint32_t *)malloc((mesh->vertex_count ? mesh->vertex_count : 1) * sizeof(uint32_t));
+  CJellyMeshVertex * vertices = (CJellyMeshVertex *)malloc((mesh->vertex_count ? mesh->vertex_count : 1) * sizeof(CJellyMeshVertex));
+  if (!remap || !vertices) {
+    free(remap);
+    free(vertices);
+    return false;
+  }
+
+  memset(remap, 0xff, mesh->vertex_count * sizeof(uint32_t));
+  uint32_t next = 0;
+  for (uint32_t i = 0; i < mesh->index_count; ++i) {
+    uint32_t v = indices[i];
+    if (remap[v] == NO_VERTEX) {
+      remap[v] = next++;
+    }
+    indices[i] = remap[v];
+  }
+  for (uint32_t v = 0; v < mesh->vertex_count; ++v) {
+    if (remap[v] == NO_VERTEX) {
+      remap[v] = next++;
+    }
+    vertices[remap[v]] = mesh->vertices[v];
+  }
+
+  free(mesh->vertices);
+  mesh->vertices = vertices;
+  free(remap);
+  return true;
+}
+
+
+CJellyMeshError cjelly_mesh_optimize(CJellyMesh * mesh, uint32_t cache_size) {
+  // Check for invalid input.
+  if (!mesh) {
+    return CJELLY_MESH_ERR_INVALID_INDEX;
+  }
+  if (mesh->index_count < 3) {
+    return CJELLY_MESH_SUCCESS;
+  }
+
+  uint32_t triangle_count = mesh->index_count / 3;
+  uint32_t * indices = (uint32_t *)malloc(mesh->index_count * sizeof(uint32_t));
+  uint32_t * boundaries = (uint32_t *)malloc(triangle_count * sizeof(uint32_t));
+  if (!indices || !boundaries) { goto ERROR_CLEANUP; }
+  for (uint32_t i = 0; i < mesh->index_count; ++i) {
+    indices[i] = get_index(mesh, i);
+  }
+
+  uint32_t boundary_count;
+  if (!tipsify(indices, mesh->index_count, mesh->vertex_count, cache_size, boundaries, &boundary_count)) { goto ERROR_CLEANUP; }
+  if (!sort_clusters(mesh->vertices, indices, mesh->index_count, mesh->vertex_count, cache_size, boundaries, boundary_count)) { goto ERROR_CLEANUP; }
+  if (!reorder_vertices(mesh, indices)) { goto ERROR_CLEANUP; }
+
+  // Write the indices back, in the mesh's own index type.
+  if (mesh->index_type == CJELLY_MESH_INDEX_TYPE_UINT16) {
+    uint16_t * narrow = (uint16_t *)mesh->indices;
+    for (uint32_t i = 0; i < mesh->index_count; ++i) {
+      narrow[i] = (uint16_t)indices[i];
+    }
+  }
+  else {
+    memcpy(mesh->indices, indices, mesh->index_count * sizeof(uint32_t));
+  }
+
+  free(indices);
+  free(boundaries);
+  return CJELLY_MESH_SUCCESS;
+
+  // Error handling.
+ERROR_CLEANUP:
+  free(indices);
+  free(boundaries);
+  return CJELLY_MESH_ERR_OUT_OF_MEMORY;
+}
+
+
+void cjelly_mesh_free(CJellyMesh * mesh) {
+  if (!mesh) return;
+  free(mesh->vertices);
+  free(mesh->indices);
+  free(mesh);
+}
+
+
+const char * cjelly_mesh_strerror(CJellyMeshError err) {
+  switch (err) {
+    case CJELLY_MESH_SUCCESS:
+      return "No error";
+    case CJELLY_MESH_ERR_OUT_OF_MEMORY:
+      return "Out of memory";
+    case CJELLY_MESH_ERR_INVALID_INDEX:
+      return "A face references a vertex, texture coordinate, or normal that does not exist";
+    case CJELLY_MESH_ERR_TOO_LARGE:
+      return "The mesh is too large for 32-bit indices";
+    default:
+      return "Unknown error";
+  }
+}
@@ -0,0 +1,386 @@
+/**
+ * @file meshcache.c
+ * @brief Binary cache of GPU-ready meshes.
+ *
+ * @details
+ * File layout (all values in host byte order):
+ *
+ *   offset 0    MeshCacheHeader
+ *   offset 128  vertex section: vertex_count CJellyMeshVertex structures
+ *   (aligned)   index section: index_count uint16_t or uint32_t indices
+ *
+ * Each section starts on a SECTION_ALIGNMENT boundary, so that the mapped
+ * arrays are suitably aligned for direct use.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/meshcache.h>
+#include <cjelly/cachefile.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * @brief Identifies a mesh cache file.
+ */
+#define MESH_CACHE_MAGIC "CJMC"
+
+/**
+ * @brief Version of the file layout.  Bump it whenever the layout changes.
+ */
+#define MESH_CACHE_VERSION 1
+
+/**
+ * @brief A known value, stored in host byte order, that detects caches written
+ * on a host with a different byte order.
+ */
+#define MESH_CACHE_BYTE_ORDER 0x01020304u
+
+/**
+ * @brief The cache records the stamp of its source model.
+ */
+#define MESH_CACHE_FLAG_HAS_SOURCE 0x1u
+
+/**
+ * @brief Alignment of each section within the file.
+ */
+#define SECTION_ALIGNMENT 64
+
+
+/**
+ * @brief The header at the start of every cache file.
+ */
+typedef struct {
+  char magic[4];          /**< MESH_CACHE_MAGIC */
+  uint32_t version;       /**< MESH_CACHE_VERSION */
+  uint32_t byte_order;    /**< MESH_CACHE_BYTE_ORDER, as written by the host */
+  uint32_t header_size;   /**< sizeof(MeshCacheHeader) */
+  uint32_t vertex_size;   /**< sizeof(CJellyMeshVertex) */
+  uint32_t vertex_count;  /**< Number of vertices */
+  uint32_t index_count;   /**< Number of indices */
+  uint32_t index_type;    /**< CJellyMeshIndexType of the indices */
+  uint32_t flags;         /**< MESH_CACHE_FLAG_* bits */
+  float bounds_min[3];    /**< Minimum corner of the mesh's bounding box */
+  float bounds_max[3];    /**< Maximum corner of the mesh's bounding box */
+  uint32_t reserved;      /**< Zero */
+  uint64_t source_size;   /**< Size of the source model in bytes */
+  int64_t source_mtime;   /**< Modification time of the source model */
+  uint64_t source_hash;   /**< Hash of the source model's contents */
+  uint64_t vertex_offset; /**< Offset of the vertex section */
+  uint64_t vertex_bytes;  /**< Size of the vertex section */
+  uint64_t index_offset;  /**< Offset of the index section */
+  uint64_t index_bytes;   /**< Size of the index section */
+  uint64_t checksum;      /**< Hash of the vertex section followed by the index section */
+} MeshCacheHeader;
+
+_Static_assert(sizeof(MeshCacheHeader) == 128, "The mesh cache header must not contain padding");
+
+
+struct CJellyMeshCache {
+  CJellyMesh mapped;         /**< The mesh, with arrays that point into `view` */
+  CJellyMesh * owned;        /**< A heap-allocated mesh that is used instead of `mapped`, or NULL */
+  CJellyCacheFileView view;  /**< The mapping of the cache file */
+};
+
+
+/**
+ * @brief Rounds an offset up to the next section boundary.
+ */
+static inline uint64_t align_section(uint64_t offset) {
+  return (offset + SECTION_ALIGNMENT - 1) & ~(uint64_t)(SECTION_ALIGNMENT - 1);
+}
+
+
+/**
+ * @brief Converts an error of the cache file helpers to a mesh cache error.
+ */
+static CJellyMeshCacheError file_error(CJellyCacheFileError err) {
+  switch (err) {
+    case CJELLY_CACHE_FILE_SUCCESS:
+      return CJELLY_MESH_CACHE_SUCCESS;
+    case CJELLY_CACHE_FILE_ERR_OUT_OF_MEMORY:
+      return CJELLY_MESH_CACHE_ERR_OUT_OF_MEMORY;
+    case CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND:
+      return CJELLY_MESH_CACHE_ERR_FILE_NOT_FOUND;
+    default:
+      return CJELLY_MESH_CACHE_ERR_IO;
+  }
+}
+
+
+/**
+ * @brief Writes a mesh to a cache file.
+ *
+ * @param mesh The mesh to store.
+ * @param stamp The stamp of the source model, or NULL to write a cache that
+ *   is never considered stale.
+ * @param cache_path Path of the cache file to write.
+ * @return CJellyMeshCacheError Error code indicating success or the type of failure.
+ */
+static CJellyMeshCacheError write_cache(const CJellyMesh * mesh, const CJellyCacheFileStamp * stamp, const char * cache_path) {
+  CJellyMeshCacheError err = CJELLY_MESH_CACHE_SUCCESS;
+
+  // Check for invalid input.
+  if (!mesh || !cache_path) {
+    return CJELLY_MESH_CACHE_ERR_INVALID;
+  }
+
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MESH_CACHE_VERSION;
+  header.byte_order = MESH_CACHE_BYTE_ORDER;
+  header.header_size = sizeof(MeshCacheHeader);
+  header.vertex_size = sizeof(CJellyMeshVertex);
+  header.vertex_count = mesh->vertex_count;
+  header.index_count = mesh->index_count;
+  header.index_type = (uint32_t)mesh->index_type;
+  memcpy(header.bounds_min, mesh->bounds_min, sizeof(header.bounds_min));
+  memcpy(header.bounds_max, mesh->bounds_max, sizeof(header.bounds_max));
+  header.vertex_offset = align_section(sizeof(MeshCacheHeader));
+  header.vertex_bytes = (uint64_t)mesh->vertex_count * sizeof(CJellyMeshVertex);
+  header.index_offset = align_section(header.vertex_offset + header.vertex_bytes);
+  header.index_bytes = (uint64_t)mesh->index_count * cjelly_mesh_index_size(mesh);
+  header.checksum = cjelly_hash_bytes(mesh->vertices, (size_t)header.vertex_bytes, CJELLY_HASH_SEED);
+  header.checksum = cjelly_hash_bytes(mesh->indices, (size_t)header.index_bytes, header.checksum);
+
+  if (stamp) {
+    header.flags |= MESH_CACHE_FLAG_HAS_SOURCE;
+    header.source_size = stamp->size;
+    header.source_mtime = stamp->mtime;
+    header.source_hash = stamp->hash;
+  }
+
+  // Write to a temporary file, and only replace the cache once it is complete.
+  CJellyCacheFileWriter writer;
+  err = file_error(cjelly_cache_file_begin(cache_path, &writer));
+  if (err != CJELLY_MESH_CACHE_SUCCESS) {
+    return err;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, writer.file) == 1
+    && cjelly_cache_file_pad(&writer, header.vertex_offset - sizeof(header))
+    && fwrite(mesh->vertices, 1, (size_t)header.vertex_bytes, writer.file) == header.vertex_bytes
+    && cjelly_cache_file_pad(&writer, header.index_offset - header.vertex_offset - header.vertex_bytes)
+    && fwrite(mesh->indices, 1, (size_t)header.index_bytes, writer.file) == header.index_bytes;
+  return file_error(cjelly_cache_file_commit(&writer, written));
+}
+
+
+CJellyMeshCacheError cjelly_mesh_cache_write(const CJellyMesh * mesh, const char * source_path, const char * cache_path) {
+  // Stamp the cache with the current state of its source.
+  CJellyCacheFileStamp stamp;
+  if (source_path) {
+    CJellyMeshCacheError err = file_error(cjelly_cache_file_stamp(source_path, &stamp));
+    if (err != CJELLY_MESH_CACHE_SUCCESS) {
+      return err;
+    }
+  }
+  return write_cache(mesh, source_path ? &stamp : NULL, cache_path);
+}
+
+
+/**
+ * @brief Checks that a mapped cache file is intact and compatible.
+ *
+ * @param view The mapped file.
+ * @return true if the cache can be used.
+ */
+static bool validate_cache(const CJellyCacheFileView * view) {
+  MeshCacheHeader header;
+  if (view->size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, view->data, sizeof(header));
+
+  if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic))
+      || header.version != MESH_CACHE_VERSION
+      || header.byte_order != MESH_CACHE_BYTE_ORDER
+      || header.header_size != sizeof(MeshCacheHeader)
+      || header.vertex_size != sizeof(CJellyMeshVertex)) {
+    return false;
+  }
+  if (header.index_type != CJELLY_MESH_INDEX_TYPE_UINT16 && header.index_type != CJELLY_MESH_INDEX_TYPE_UINT32) {
+    return false;
+  }
+
+  // The sections must be aligned, sized for their counts, and inside the file.
+  uint64_t index_size = header.index_type == CJELLY_MESH_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+  if (header.vertex_offset % SECTION_ALIGNMENT || header.index_offset % SECTION_ALIGNMENT
+      || header.vertex_bytes != (uint64_t)header.vertex_count * sizeof(CJellyMeshVertex)
+      || header.index_bytes != (uint64_t)header.index_count * index_size
+      || header.vertex_offset < sizeof(header)
+      || header.vertex_offset > view->size || header.vertex_bytes > view->size - header.vertex_offset
+      || header.index_offset > view->size || header.index_bytes > view->size - header.index_offset) {
+    return false;
+  }
+
+  uint64_t checksum = cjelly_hash_bytes(view->data + header.vertex_offset, (size_t)header.vertex_bytes, CJELLY_HASH_SEED);
+  checksum = cjelly_hash_bytes(view->data + header.index_offset, (size_t)header.index_bytes, checksum);
+  return checksum == header.checksum;
+}
+
+
+/**
+ * @brief Checks whether a cache's source model has changed.
+ *
+ * @param header The cache header.
+ * @param source_path The source model.
+ * @return true if the source has changed.  A source that cannot be found is
+ *   not considered changed, so that a cache can be shipped without its source.
+ */
+static bool source_changed(const MeshCacheHeader * header, const char * source_path) {
+  if (!(header->flags & MESH_CACHE_FLAG_HAS_SOURCE)) {
+    return false;
+  }
+  CJellyCacheFileStamp stamp;
+  stamp.size = header->source_size;
+  stamp.mtime = header->source_mtime;
+  stamp.hash = header->source_hash;
+  return cjelly_cache_file_stamp_changed(&stamp, source_path);
+}
+
+
+CJellyMeshCacheError cjelly_mesh_cache_open(const char * cache_path, const char * source_path, CJellyMeshCache * * outCache) {
+  CJellyMeshCacheError err = CJELLY_MESH_CACHE_SUCCESS;
+
+  // Check for invalid input.
+  if (!cache_path || !outCache) {
+    return CJELLY_MESH_CACHE_ERR_INVALID;
+  }
+
+  CJellyMeshCache * cache = (CJellyMeshCache *)calloc(1, sizeof(CJellyMeshCache));
+  if (!cache) {
+    return CJELLY_MESH_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  err = file_error(cjelly_cache_file_map(cache_path, &cache->view));
+  if (err != CJELLY_MESH_CACHE_SUCCESS) {
+    free(cache);
+    return err;
+  }
+
+  if (!validate_cache(&cache->view)) {
+    err = CJELLY_MESH_CACHE_ERR_INVALID;
+    goto ERROR_CLEANUP;
+  }
+  MeshCacheHeader header;
+  memcpy(&header, cache->view.data, sizeof(header));
+  if (source_path && source_changed(&header, source_path)) {
+    err = CJELLY_MESH_CACHE_ERR_STALE;
+    goto ERROR_CLEANUP;
+  }
+
+  // Point the mesh straight at the mapped sections.
+  CJellyMesh * mesh = &cache->mapped;
+  mesh->vertices = (CJellyMeshVertex *)(cache->view.data + header.vertex_offset);
+  mesh->vertex_count = header.vertex_count;
+  mesh->indices = (void *)(cache->view.data + header.index_offset);
+  mesh->index_count = header.index_count;
+  mesh->index_type = (CJellyMeshIndexType)header.index_type;
+  memcpy(mesh->bounds_min, header.bounds_min, sizeof(mesh->bounds_min));
+  memcpy(mesh->bounds_max, header.bounds_max, sizeof(mesh->bounds_max));
+
+  *outCache = cache;
+  return CJELLY_MESH_CACHE_SUCCESS;
+
+  // Error handling.
+ERROR_CLEANUP:
+  cjelly_mesh_cache_close(cache);
+  return err;
+}
+
+
+CJellyMeshCacheError cjelly_mesh_cache_load_obj(const char * obj_path, const char * cache_path, CJellyMeshCache * * outCache) {
+  // Check for invalid input.
+  if (!obj_path || !cache_path || !outCache) {
+    return CJELLY_MESH_CACHE_ERR_INVALID;
+  }
+
+  CJellyMeshCacheError err = cjelly_mesh_cache_open(cache_path, obj_path, outCache);
+  if (err == CJELLY_MESH_CACHE_SUCCESS || err == CJELLY_MESH_CACHE_ERR_OUT_OF_MEMORY) {
+    return err;
+  }
+
+  // The cache is missing, invalid, or stale, so rebuild it from the source.
+  // The source is stamped before it is parsed, so that if it changes while it
+  // is being parsed, the cache records the older stamp and is rebuilt the
+  // next time, rather than holding the old mesh under the new stamp.
+  CJellyCacheFileStamp stamp;
+  if (cjelly_cache_file_stamp(obj_path, &stamp) != CJELLY_CACHE_FILE_SUCCESS) {
+    return CJELLY_MESH_CACHE_ERR_SOURCE;
+  }
+  CJellyFormat3dObjModel * model;
+  if (cjelly_format_3d_obj_load(obj_path, &model) != CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    return CJELLY_MESH_CACHE_ERR_SOURCE;
+  }
+  CJellyMesh * mesh = NULL;
+  CJellyMeshError meshErr = cjelly_mesh_build_from_obj(model, &mesh);
+  cjelly_format_3d_obj_free(model);
+  if (meshErr == CJELLY_MESH_SUCCESS) {
+    meshErr = cjelly_mesh_optimize(mesh, CJELLY_MESH_VERTEX_CACHE_SIZE);
+  }
+  if (meshErr != CJELLY_MESH_SUCCESS) {
+    cjelly_mesh_free(mesh);
+    return meshErr == CJELLY_MESH_ERR_OUT_OF_MEMORY
+      ? CJELLY_MESH_CACHE_ERR_OUT_OF_MEMORY
+      : CJELLY_MESH_CACHE_ERR_SOURCE;
+  }
+
+  if (write_cache(mesh, &stamp, cache_path) == CJELLY_MESH_CACHE_SUCCESS
+      && cjelly_mesh_cache_open(cache_path, NULL, outCache) == CJELLY_MESH_CACHE_SUCCESS) {
+    cjelly_mesh_free(mesh);
+    return CJELLY_MESH_CACHE_SUCCESS;
+  }
+
+  // The cache could not be written, so hand out the mesh that was just built.
+  CJellyMeshCache * cache = (CJellyMeshCache *)calloc(1, sizeof(CJellyMeshCache));
+  if (!cache) {
+    cjelly_mesh_free(mesh);
+    return CJELLY_MESH_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  cache->owned = mesh;
+  *outCache = cache;
+  return CJELLY_MESH_CACHE_SUCCESS;
+}
+
+
+const CJellyMesh * cjelly_mesh_cache_mesh(const CJellyMeshCache * cache) {
+  return cache->owned ? cache->owned : &cache->mapped;
+}
+
+
+void cjelly_mesh_cache_close(CJellyMeshCache * cache) {
+  if (!cache) return;
+  cjelly_mesh_free(cache->owned);
+  cjelly_cache_file_unmap(&cache->view);
+  free(cache);
+}
+
+
+const char * cjelly_mesh_cache_strerror(CJellyMeshCacheError err) {
+  switch (err) {
+    case CJELLY_MESH_CACHE_SUCCESS:
+      return "No error";
+    case CJELLY_MESH_CACHE_ERR_OUT_OF_MEMORY:
+      return "Out of memory";
+    case CJELLY_MESH_CACHE_ERR_FILE_NOT_FOUND:
+      return "File not found or cannot be opened";
+    case CJELLY_MESH_CACHE_ERR_IO:
+      return "File could not be read, written, or mapped";
+    case CJELLY_MESH_CACHE_ERR_INVALID:
+      return "Not a compatible mesh cache, or the cache is corrupt";
+    case CJELLY_MESH_CACHE_ERR_STALE:
+      return "The source model has changed since the cache was written";
+    case CJELLY_MESH_CACHE_ERR_SOURCE:
+      return "The source model could not be loaded";
+    default:
+      return "Unknown error";
+  }
+}
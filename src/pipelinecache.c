@@ -0,0 +1,291 @@
+/**
+ * @file pipelinecache.c
+ * @brief Vulkan pipeline cache persisted to disk.
+ *
+ * @details
+ * File layout (all values in host byte order):
+ *
+ *   offset 0    PipelineCacheHeader
+ *   offset 64   data_size bytes returned by vkGetPipelineCacheData()
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/pipelinecache.h>
+#include <cjelly/cachefile.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * @brief Identifies a pipeline cache file.
+ */
+#define PIPELINE_CACHE_MAGIC "CJPC"
+
+/**
+ * @brief Version of the file layout.  Bump it whenever the layout changes.
+ */
+#define PIPELINE_CACHE_VERSION 1
+
+/**
+ * @brief A known value, stored in host byte order, that detects caches written
+ * on a host with a different byte order.
+ */
+#define PIPELINE_CACHE_BYTE_ORDER 0x01020304u
+
+/**
+ * @brief Size of the driver's VkPipelineCacheHeaderVersionOne at the start of
+ * the data.
+ */
+#define DRIVER_HEADER_SIZE (16 + VK_UUID_SIZE)
+
+
+/**
+ * @brief The header at the start of every cache file.
+ */
+typedef struct {
+  char magic[4];                      /**< PIPELINE_CACHE_MAGIC */
+  uint32_t version;                   /**< PIPELINE_CACHE_VERSION */
+  uint32_t byte_order;                /**< PIPELINE_CACHE_BYTE_ORDER, as written by the host */
+  uint32_t header_size;               /**< sizeof(PipelineCacheHeader) */
+  uint32_t vendor_id;                 /**< VkPhysicalDeviceProperties::vendorID */
+  uint32_t device_id;                 /**< VkPhysicalDeviceProperties::deviceID */
+  uint32_t driver_version;            /**< VkPhysicalDeviceProperties::driverVersion */
+  uint32_t reserved;                  /**< Zero */
+  uint8_t cache_uuid[VK_UUID_SIZE];   /**< VkPhysicalDeviceProperties::pipelineCacheUUID */
+  uint64_t data_size;                 /**< Size of the driver's data */
+  uint64_t checksum;                  /**< Hash of the driver's data */
+} PipelineCacheHeader;
+
+_Static_assert(sizeof(PipelineCacheHeader) == 64, "The pipeline cache header must not contain padding");
+
+
+/**
+ * @brief Fills in the parts of a header that identify the device.
+ */
+static void describe_device(VkPhysicalDevice physicalDevice, PipelineCacheHeader * header) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, PIPELINE_CACHE_MAGIC, sizeof(header->magic));
+  header->version = PIPELINE_CACHE_VERSION;
+  header->byte_order = PIPELINE_CACHE_BYTE_ORDER;
+  header->header_size = sizeof(PipelineCacheHeader);
+  header->vendor_id = properties.vendorID;
+  header->device_id = properties.deviceID;
+  header->driver_version = properties.driverVersion;
+  memcpy(header->cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+
+/**
+ * @brief Checks the driver's own header at the start of the data against the
+ * device.
+ *
+ * @return true if the data was written by the same device and driver.
+ */
+static bool driver_header_matches(const PipelineCacheHeader * expected, const unsigned char * data, size_t size) {
+  if (size < DRIVER_HEADER_SIZE) {
+    return false;
+  }
+  uint32_t fields[4];
+  memcpy(fields, data, sizeof(fields));
+  return fields[0] >= DRIVER_HEADER_SIZE
+    && fields[0] <= size
+    && fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+    && fields[2] == expected->vendor_id
+    && fields[3] == expected->device_id
+    && memcmp(data + sizeof(fields), expected->cache_uuid, VK_UUID_SIZE) == 0;
+}
+
+
+/**
+ * @brief Reads and validates a cache file.
+ *
+ * @param expected A header describing the current device.
+ * @param path Path of the cache file.
+ * @param outData Receives the driver's data, to be freed by the caller.
+ * @param outSize Receives the size of the data.
+ * @return CJellyPipelineCacheError Error code indicating success or the type of failure.
+ */
+static CJellyPipelineCacheError read_cache(const PipelineCacheHeader * expected, const char * path, unsigned char * * outData, size_t * outSize) {
+  FILE * file = fopen(path, "rb");
+  if (!file) {
+    return CJELLY_PIPELINE_CACHE_ERR_FILE_NOT_FOUND;
+  }
+
+  CJellyPipelineCacheError err = CJELLY_PIPELINE_CACHE_SUCCESS;
+  unsigned char * data = NULL;
+  PipelineCacheHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1) {
+    err = CJELLY_PIPELINE_CACHE_ERR_INVALID;
+    goto ERROR_CLOSE;
+  }
+
+  // A different layout, or a different byte order, means the rest of the
+  // header cannot be interpreted.
+  if (memcmp(header.magic, expected->magic, sizeof(header.magic)) != 0
+      || header.version != expected->version
+      || header.byte_order != expected->byte_order
+      || header.header_size != expected->header_size) {
+    err = CJELLY_PIPELINE_CACHE_ERR_INVALID;
+    goto ERROR_CLOSE;
+  }
+  if (header.vendor_id != expected->vendor_id
+      || header.device_id != expected->device_id
+      || header.driver_version != expected->driver_version
+      || memcmp(header.cache_uuid, expected->cache_uuid, VK_UUID_SIZE) != 0) {
+    err = CJELLY_PIPELINE_CACHE_ERR_STALE;
+    goto ERROR_CLOSE;
+  }
+  if (header.data_size == 0 || header.data_size > SIZE_MAX) {
+    err = CJELLY_PIPELINE_CACHE_ERR_INVALID;
+    goto ERROR_CLOSE;
+  }
+
+  size_t size = (size_t)header.data_size;
+  data = (unsigned char *)malloc(size);
+  if (!data) {
+    err = CJELLY_PIPELINE_CACHE_ERR_OUT_OF_MEMORY;
+    goto ERROR_CLOSE;
+  }
+
+  // The file must end exactly where the data does.
+  if (fread(data, 1, size, file) != size || fgetc(file) != EOF) {
+    err = CJELLY_PIPELINE_CACHE_ERR_INVALID;
+    goto ERROR_FREE;
+  }
+  if (cjelly_hash_bytes(data, size, CJELLY_HASH_SEED) != header.checksum) {
+    err = CJELLY_PIPELINE_CACHE_ERR_INVALID;
+    goto ERROR_FREE;
+  }
+  if (!driver_header_matches(expected, data, size)) {
+    err = CJELLY_PIPELINE_CACHE_ERR_STALE;
+    goto ERROR_FREE;
+  }
+
+  fclose(file);
+  *outData = data;
+  *outSize = size;
+  return CJELLY_PIPELINE_CACHE_SUCCESS;
+
+ERROR_FREE:
+  free(data);
+ERROR_CLOSE:
+  fclose(file);
+  return err;
+}
+
+
+CJellyPipelineCacheError cjelly_pipeline_cache_path(const char * name, char * buffer, size_t size) {
+  if (!name || !buffer) {
+    return CJELLY_PIPELINE_CACHE_ERR_INVALID;
+  }
+  // The first codes of both enumerations match.
+  return (CJellyPipelineCacheError)cjelly_cache_file_path(name, buffer, size);
+}
+
+
+CJellyPipelineCacheError cjelly_pipeline_cache_load(VkPhysicalDevice physicalDevice, VkDevice device, const char * path, VkPipelineCache * outCache) {
+  *outCache = VK_NULL_HANDLE;
+
+  PipelineCacheHeader expected;
+  describe_device(physicalDevice, &expected);
+
+  unsigned char * data = NULL;
+  size_t size = 0;
+  CJellyPipelineCacheError err = path
+    ? read_cache(&expected, path, &data, &size)
+    : CJELLY_PIPELINE_CACHE_ERR_FILE_NOT_FOUND;
+
+  VkPipelineCacheCreateInfo createInfo = {0};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = size;
+  createInfo.pInitialData = data;
+  VkResult result = vkCreatePipelineCache(device, &createInfo, NULL, outCache);
+  free(data);
+
+  // The driver may still reject data that passed our checks.  Start over with
+  // an empty cache in that case.
+  if (result != VK_SUCCESS && size) {
+    createInfo.initialDataSize = 0;
+    createInfo.pInitialData = NULL;
+    result = vkCreatePipelineCache(device, &createInfo, NULL, outCache);
+    err = CJELLY_PIPELINE_CACHE_ERR_INVALID;
+  }
+  if (result != VK_SUCCESS) {
+    *outCache = VK_NULL_HANDLE;
+    return CJELLY_PIPELINE_CACHE_ERR_VULKAN;
+  }
+  return err;
+}
+
+
+CJellyPipelineCacheError cjelly_pipeline_cache_save(VkPhysicalDevice physicalDevice, VkDevice device, VkPipelineCache cache, const char * path) {
+  if (cache == VK_NULL_HANDLE || !path) {
+    return CJELLY_PIPELINE_CACHE_ERR_INVALID;
+  }
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, cache, &size, NULL) != VK_SUCCESS) {
+    return CJELLY_PIPELINE_CACHE_ERR_VULKAN;
+  }
+  unsigned char * data = (unsigned char *)malloc(size ? size : 1);
+  if (!data) {
+    return CJELLY_PIPELINE_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  if (vkGetPipelineCacheData(device, cache, &size, data) != VK_SUCCESS) {
+    free(data);
+    return CJELLY_PIPELINE_CACHE_ERR_VULKAN;
+  }
+
+  PipelineCacheHeader header;
+  describe_device(physicalDevice, &header);
+  header.data_size = size;
+  header.checksum = cjelly_hash_bytes(data, size, CJELLY_HASH_SEED);
+
+  // Write to a temporary file, and only replace the cache once it is complete.
+  CJellyCacheFileWriter writer;
+  CJellyCacheFileError err = cjelly_cache_file_begin(path, &writer);
+  if (err != CJELLY_CACHE_FILE_SUCCESS) {
+    free(data);
+    return err == CJELLY_CACHE_FILE_ERR_OUT_OF_MEMORY
+      ? CJELLY_PIPELINE_CACHE_ERR_OUT_OF_MEMORY
+      : CJELLY_PIPELINE_CACHE_ERR_FILE_NOT_FOUND;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, writer.file) == 1
+    && fwrite(data, 1, size, writer.file) == size;
+  free(data);
+  return cjelly_cache_file_commit(&writer, written) == CJELLY_CACHE_FILE_SUCCESS
+    ? CJELLY_PIPELINE_CACHE_SUCCESS
+    : CJELLY_PIPELINE_CACHE_ERR_IO;
+}
+
+
+const char * cjelly_pipeline_cache_strerror(CJellyPipelineCacheError err) {
+  switch (err) {
+    case CJELLY_PIPELINE_CACHE_SUCCESS:
+      return "No error";
+    case CJELLY_PIPELINE_CACHE_ERR_OUT_OF_MEMORY:
+      return "Out of memory";
+    case CJELLY_PIPELINE_CACHE_ERR_FILE_NOT_FOUND:
+      return "File not found or cannot be opened";
+    case CJELLY_PIPELINE_CACHE_ERR_IO:
+      return "File could not be read or written";
+    case CJELLY_PIPELINE_CACHE_ERR_INVALID:
+      return "Not a pipeline cache, or the cache is corrupt";
+    case CJELLY_PIPELINE_CACHE_ERR_STALE:
+      return "The cache was written for a different device or driver";
+    case CJELLY_PIPELINE_CACHE_ERR_VULKAN:
+      return "A Vulkan call failed";
+    default:
+      return "Unknown error";
+  }
+}
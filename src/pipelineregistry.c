@@ -0,0 +1,970 @@
+/**
+ * @file pipelineregistry.c
+ * @brief CJelly pipeline registry implementation.
+ *
+ * @details
+ * Descriptor set layouts, pipeline layouts, and pipelines share one chained
+ * hash table.  Each entry is keyed by a canonical encoding of its description
+ * as an array of 32-bit words, which includes only the entries that are in
+ * use and never any padding, so that equal descriptions always produce equal
+ * keys.  A pipeline layout's key holds the handles of its (already shared)
+ * descriptor set layouts, and a pipeline's key holds the handle of its
+ * pipeline layout, so comparing keys is enough to compare whole descriptions.
+ *
+ * A single mutex protects the table and the state of every pipeline.  Layouts
+ * are cheap and are created while the mutex is held; pipelines are compiled
+ * without it, and the `compiled` condition is signaled whenever a compile
+ * finishes.
+ *
+ * When a shader module is replaced, each pipeline that uses it is moved to the
+ * bucket of its new key and compiled again, while the old pipeline keeps being
+ * handed out.  Once the new pipeline is ready, the old one is retired, along
+ * with the serial of the last frame that fetched it and the number of holds
+ * on it.  Command buffers recorded with it may still be executed, so it is
+ * destroyed by cjelly_pipeline_registry_next_frame() once it is no longer held
+ * and that frame has finished.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/pipelineregistry.h>
+#include <cjelly/cachefile.h>
+#include <cjelly/threadpool.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Initial number of buckets in the hash table.
+ */
+#define INITIAL_BUCKET_COUNT 64
+
+/**
+ * @brief Capacity of an entry key, in 32-bit words.
+ *
+ * The longest key is that of a pipeline with every vertex attribute in use.
+ */
+#define MAX_KEY_WORDS 64
+
+
+/**
+ * @brief The kinds of objects in the registry.
+ */
+typedef enum {
+  ENTRY_DESCRIPTOR_SET_LAYOUT, /**< A SetLayoutEntry */
+  ENTRY_PIPELINE_LAYOUT,       /**< A LayoutEntry */
+  ENTRY_PIPELINE,              /**< A CJellyPipeline */
+} EntryKind;
+
+
+/**
+ * @brief The compile state of a pipeline.
+ */
+typedef enum {
+  PIPELINE_PENDING,   /**< Not compiled, and no compile has been started */
+  PIPELINE_COMPILING, /**< Being compiled, in the background or by a caller */
+  PIPELINE_READY,     /**< Compiled successfully */
+  PIPELINE_FAILED,    /**< The last compile failed */
+} PipelineState;
+
+
+/**
+ * @brief The canonical encoding of a description.
+ */
+typedef struct {
+  uint32_t count;                /**< Number of words used */
+  uint32_t words[MAX_KEY_WORDS]; /**< The encoded description */
+} EntryKey;
+
+
+/**
+ * @brief The part common to every object in the registry.
+ */
+typedef struct RegistryEntry {
+  struct RegistryEntry * next;  /**< Next entry in the same bucket */
+  struct RegistryEntry * older; /**< The entry that was added before this one */
+  uint64_t hash;                /**< Hash of `kind` and `key` */
+  EntryKind kind;               /**< The kind of object */
+  EntryKey key;                 /**< The object's description */
+} RegistryEntry;
+
+
+/**
+ * @brief A shared descriptor set layout.
+ */
+typedef struct {
+  RegistryEntry entry;          /**< Must be first */
+  VkDescriptorSetLayout layout; /**< The layout */
+} SetLayoutEntry;
+
+
+/**
+ * @brief A shared pipeline layout.
+ */
+typedef struct {
+  RegistryEntry entry;     /**< Must be first */
+  VkPipelineLayout layout; /**< The layout */
+} LayoutEntry;
+
+
+/**
+ * @brief A pipeline that has been replaced, and is destroyed once nothing can
+ * use it anymore.
+ */
+typedef struct {
+  VkPipeline pipeline;     /**< The replaced pipeline */
+  uint64_t lastUsedSerial; /**< Serial of the last frame that fetched it */
+  uint32_t holds;          /**< Number of holds that have not been released */
+} RetiredPipeline;
+
+
+struct CJellyPipeline {
+  RegistryEntry entry;               /**< Must be first */
+  CJellyPipelineRegistry * registry; /**< The registry that owns the pipeline */
+  CJellyPipelineDesc desc;           /**< Copy of the description */
+  VkPipelineLayout layout;           /**< The shared pipeline layout */
+  PipelineState state;               /**< Compile state, protected by the mutex */
+  VkPipeline pipeline;               /**< The latest pipeline that compiled, or VK_NULL_HANDLE */
+  uint64_t lastUsedSerial;           /**< Serial of the last frame that fetched `pipeline` */
+  uint32_t holds;                    /**< Number of holds on `pipeline` */
+};
+
+
+struct CJellyPipelineRegistry {
+  VkDevice device;           /**< The logical device */
+  VkPipelineCache cache;     /**< Cache that pipelines are created with */
+  CJellyThreadPool * pool;   /**< Compiles pipelines in the background, or NULL */
+  RegistryEntry ** buckets;  /**< Heads of the hash chains */
+  size_t bucketCount;        /**< Number of buckets, a power of two */
+  size_t entryCount;         /**< Number of entries in the table */
+  RegistryEntry * newest;    /**< The most recently added entry */
+  RetiredPipeline * retired; /**< Pipelines replaced after a shader changed */
+  size_t retiredCount;       /**< Number of entries in `retired` */
+  size_t retiredCapacity;    /**< Allocated capacity of `retired` */
+  pthread_mutex_t mutex;     /**< Protects the table, pipeline states, and `retired` */
+  pthread_cond_t compiled;   /**< Signaled when a compile finishes */
+};
+
+
+//
+// === KEYS ===
+//
+
+/**
+ * @brief Appends a word to a key.
+ */
+static void key_push(EntryKey * key, uint32_t word) {
+  key->words[key->count++] = word;
+}
+
+
+/**
+ * @brief Appends a Vulkan handle to a key.
+ *
+ * Non-dispatchable handles are pointers on 64-bit platforms and 64-bit
+ * integers elsewhere, so they are widened to 64 bits before being appended.
+ */
+static void key_push_handle(EntryKey * key, const void * handle, size_t size) {
+  uint64_t value = 0;
+  memcpy(&value, handle, size);
+  key_push(key, (uint32_t)value);
+  key_push(key, (uint32_t)(value >> 32));
+}
+
+
+/**
+ * @brief Hashes a key with FNV-1a.
+ */
+static uint64_t key_hash(EntryKind kind, const EntryKey * key) {
+  uint64_t hash = (CJELLY_HASH_SEED ^ (uint64_t)kind) * CJELLY_HASH_PRIME;
+  for (uint32_t i = 0; i < key->count; ++i) {
+    hash = (hash ^ key->words[i]) * CJELLY_HASH_PRIME;
+  }
+  return hash;
+}
+
+
+/**
+ * @brief Encodes a descriptor set layout description.
+ */
+static void encode_set_layout(const CJellyDescriptorSetLayoutDesc * desc, EntryKey * key) {
+  key->count = 0;
+  key_push(key, desc->flags);
+  key_push(key, desc->bindingCount);
+  for (uint32_t i = 0; i < desc->bindingCount; ++i) {
+    const VkDescriptorSetLayoutBinding * binding = &desc->bindings[i];
+    key_push(key, binding->binding);
+    key_push(key, (uint32_t)binding->descriptorType);
+    key_push(key, binding->descriptorCount);
+    key_push(key, binding->stageFlags);
+    key_push(key, desc->bindingFlags[i]);
+  }
+}
+
+
+/**
+ * @brief Encodes a pipeline layout description, given its set layouts.
+ */
+static void encode_layout(const CJellyPipelineLayoutDesc * desc, const VkDescriptorSetLayout * setLayouts, EntryKey * key) {
+  key->count = 0;
+  key_push(key, desc->setCount);
+  for (uint32_t i = 0; i < desc->setCount; ++i) {
+    key_push_handle(key, &setLayouts[i], sizeof(setLayouts[i]));
+  }
+  key_push(key, desc->pushConstantRangeCount);
+  for (uint32_t i = 0; i < desc->pushConstantRangeCount; ++i) {
+    const VkPushConstantRange * range = &desc->pushConstantRanges[i];
+    key_push(key, range->stageFlags);
+    key_push(key, range->offset);
+    key_push(key, range->size);
+  }
+}
+
+
+/**
+ * @brief Encodes a pipeline description, given its pipeline layout.
+ */
+static void encode_pipeline(const CJellyPipelineDesc * desc, VkPipelineLayout layout, EntryKey * key) {
+  key->count = 0;
+  key_push_handle(key, &desc->vertexShader, sizeof(desc->vertexShader));
+  key_push_handle(key, &desc->fragmentShader, sizeof(desc->fragmentShader));
+  key_push(key, desc->vertexStride);
+  key_push(key, desc->vertexStride ? (uint32_t)desc->vertexInputRate : 0);
+  key_push(key, desc->attributeCount);
+  for (uint32_t i = 0; i < desc->attributeCount; ++i) {
+    const VkVertexInputAttributeDescription * attribute = &desc->attributes[i];
+    key_push(key, attribute->location);
+    key_push(key, attribute->binding);
+    key_push(key, (uint32_t)attribute->format);
+    key_push(key, attribute->offset);
+  }
+  key_push(key, (uint32_t)desc->topology);
+  key_push(key, (uint32_t)desc->polygonMode);
+  key_push(key, desc->cullMode);
+  key_push(key, (uint32_t)desc->frontFace);
+  key_push(key, (uint32_t)desc->blendMode);
+  key_push_handle(key, &desc->renderPass, sizeof(desc->renderPass));
+  key_push(key, desc->subpass);
+  key_push_handle(key, &layout, sizeof(layout));
+}
+
+
+//
+// === HASH TABLE ===
+//
+
+/**
+ * @brief Finds the entry with the given key.  The mutex must be held.
+ */
+static RegistryEntry * find_entry(CJellyPipelineRegistry * registry, EntryKind kind, const EntryKey * key, uint64_t hash) {
+  for (RegistryEntry * entry = registry->buckets[hash & (registry->bucketCount - 1)]; entry; entry = entry->next) {
+    if (entry->hash == hash && entry->kind == kind && entry->key.count == key->count
+        && !memcmp(entry->key.words, key->words, key->count * sizeof(key->words[0]))) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * @brief Links an entry into the chain of its bucket.  The mutex must be held.
+ */
+static void link_entry(CJellyPipelineRegistry * registry, RegistryEntry * entry) {
+  RegistryEntry ** head = &registry->buckets[entry->hash & (registry->bucketCount - 1)];
+  entry->next = *head;
+  *head = entry;
+}
+
+
+/**
+ * @brief Unlinks an entry from the chain of its bucket.  The mutex must be
+ * held.
+ */
+static void unlink_entry(CJellyPipelineRegistry * registry, RegistryEntry * entry) {
+  RegistryEntry ** link = &registry->buckets[entry->hash & (registry->bucketCount - 1)];
+  while (*link != entry) {
+    link = &(*link)->next;
+  }
+  *link = entry->next;
+}
+
+
+/**
+ * @brief Adds an entry to the table, growing it if it has become too full.
+ * The mutex must be held.
+ *
+ * Growing is best effort: if it fails, the chains simply get longer.
+ */
+static void insert_entry(CJellyPipelineRegistry * registry, RegistryEntry * entry) {
+  if (registry->entryCount >= registry->bucketCount) {
+    size_t bucketCount = registry->bucketCount * 2;
+    RegistryEntry ** buckets = calloc(bucketCount, sizeof(RegistryEntry *));
+    if (buckets) {
+      for (size_t i = 0; i < registry->bucketCount; ++i) {
+        RegistryEntry * next;
+        for (RegistryEntry * moved = registry->buckets[i]; moved; moved = next) {
+          next = moved->next;
+          RegistryEntry ** head = &buckets[moved->hash & (bucketCount - 1)];
+          moved->next = *head;
+          *head = moved;
+        }
+      }
+      free(registry->buckets);
+      registry->buckets = buckets;
+      registry->bucketCount = bucketCount;
+    }
+  }
+
+  link_entry(registry, entry);
+  entry->older = registry->newest;
+  registry->newest = entry;
+  ++registry->entryCount;
+}
+
+
+//
+// === LAYOUTS ===
+//
+
+/**
+ * @brief Returns the shared descriptor set layout for a description.  The
+ * mutex must be held.
+ */
+static VkDescriptorSetLayout get_set_layout(CJellyPipelineRegistry * registry, const CJellyDescriptorSetLayoutDesc * desc) {
+  if (desc->bindingCount > CJELLY_PIPELINE_MAX_DESCRIPTOR_BINDINGS) {
+    return VK_NULL_HANDLE;
+  }
+
+  EntryKey key;
+  encode_set_layout(desc, &key);
+  uint64_t hash = key_hash(ENTRY_DESCRIPTOR_SET_LAYOUT, &key);
+  RegistryEntry * found = find_entry(registry, ENTRY_DESCRIPTOR_SET_LAYOUT, &key, hash);
+  if (found) {
+    return ((SetLayoutEntry *)found)->layout;
+  }
+
+  SetLayoutEntry * entry = malloc(sizeof(SetLayoutEntry));
+  if (!entry) {
+    return VK_NULL_HANDLE;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.flags = desc->flags;
+  layoutInfo.bindingCount = desc->bindingCount;
+  layoutInfo.pBindings = desc->bindings;
+
+  // Binding flags need VK_EXT_descriptor_indexing (or Vulkan 1.2), so they are
+  // left out unless they are used.
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = {0};
+  for (uint32_t i = 0; i < desc->bindingCount; ++i) {
+    if (desc->bindingFlags[i]) {
+      flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+      flagsInfo.bindingCount = desc->bindingCount;
+      flagsInfo.pBindingFlags = desc->bindingFlags;
+      layoutInfo.pNext = &flagsInfo;
+      break;
+    }
+  }
+  if (vkCreateDescriptorSetLayout(registry->device, &layoutInfo, NULL, &entry->layout) != VK_SUCCESS) {
+    free(entry);
+    return VK_NULL_HANDLE;
+  }
+
+  entry->entry.hash = hash;
+  entry->entry.kind = ENTRY_DESCRIPTOR_SET_LAYOUT;
+  entry->entry.key = key;
+  insert_entry(registry, &entry->entry);
+  return entry->layout;
+}
+
+
+/**
+ * @brief Returns the shared pipeline layout for a description.  The mutex must
+ * be held.
+ */
+static VkPipelineLayout get_layout(CJellyPipelineRegistry * registry, const CJellyPipelineLayoutDesc * desc) {
+  if (desc->setCount > CJELLY_PIPELINE_MAX_DESCRIPTOR_SETS
+      || desc->pushConstantRangeCount > CJELLY_PIPELINE_MAX_PUSH_CONSTANT_RANGES) {
+    return VK_NULL_HANDLE;
+  }
+
+  VkDescriptorSetLayout setLayouts[CJELLY_PIPELINE_MAX_DESCRIPTOR_SETS];
+  for (uint32_t i = 0; i < desc->setCount; ++i) {
+    setLayouts[i] = get_set_layout(registry, &desc->sets[i]);
+    if (setLayouts[i] == VK_NULL_HANDLE) {
+      return VK_NULL_HANDLE;
+    }
+  }
+
+  EntryKey key;
+  encode_layout(desc, setLayouts, &key);
+  uint64_t hash = key_hash(ENTRY_PIPELINE_LAYOUT, &key);
+  RegistryEntry * found = find_entry(registry, ENTRY_PIPELINE_LAYOUT, &key, hash);
+  if (found) {
+    return ((LayoutEntry *)found)->layout;
+  }
+
+  LayoutEntry * entry = malloc(sizeof(LayoutEntry));
+  if (!entry) {
+    return VK_NULL_HANDLE;
+  }
+
+  VkPipelineLayoutCreateInfo layoutInfo = {0};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layoutInfo.setLayoutCount = desc->setCount;
+  layoutInfo.pSetLayouts = desc->setCount ? setLayouts : NULL;
+  layoutInfo.pushConstantRangeCount = desc->pushConstantRangeCount;
+  layoutInfo.pPushConstantRanges = desc->pushConstantRangeCount ? desc->pushConstantRanges : NULL;
+  if (vkCreatePipelineLayout(registry->device, &layoutInfo, NULL, &entry->layout) != VK_SUCCESS) {
+    free(entry);
+    return VK_NULL_HANDLE;
+  }
+
+  entry->entry.hash = hash;
+  entry->entry.kind = ENTRY_PIPELINE_LAYOUT;
+  entry->entry.key = key;
+  insert_entry(registry, &entry->entry);
+  return entry->layout;
+}
+
+
+//
+// === PIPELINES ===
+//
+
+/**
+ * @brief Fills in the color blend state of a blend mode.
+ */
+static void set_blend_mode(CJellyBlendMode mode, VkPipelineColorBlendAttachmentState * attachment) {
+  attachment->colorWriteMask = VK_COLOR_COMPONENT_R_BIT
+    | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
+    | VK_COLOR_COMPONENT_A_BIT;
+  attachment->colorBlendOp = VK_BLEND_OP_ADD;
+  attachment->alphaBlendOp = VK_BLEND_OP_ADD;
+  attachment->srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  attachment->dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+
+  switch (mode) {
+    case CJELLY_BLEND_MODE_ALPHA:
+      attachment->blendEnable = VK_TRUE;
+      attachment->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+      attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+      break;
+    case CJELLY_BLEND_MODE_PREMULTIPLIED_ALPHA:
+      attachment->blendEnable = VK_TRUE;
+      attachment->srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+      attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+      break;
+    case CJELLY_BLEND_MODE_ADDITIVE:
+      attachment->blendEnable = VK_TRUE;
+      attachment->srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+      attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+      attachment->dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+      break;
+    case CJELLY_BLEND_MODE_OPAQUE:
+    default:
+      attachment->blendEnable = VK_FALSE;
+      attachment->srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+      attachment->dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+      break;
+  }
+}
+
+
+/**
+ * @brief Compiles a pipeline.  The mutex must not be held.
+ *
+ * @return The pipeline, or VK_NULL_HANDLE on failure.
+ */
+static VkPipeline compile_pipeline(CJellyPipelineRegistry * registry, const CJellyPipeline * pipeline) {
+  const CJellyPipelineDesc * desc = &pipeline->desc;
+
+  VkPipelineShaderStageCreateInfo shaderStages[2] = {0};
+  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0].module = desc->vertexShader;
+  shaderStages[0].pName = "main";
+  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1].module = desc->fragmentShader;
+  shaderStages[1].pName = "main";
+
+  VkVertexInputBindingDescription bindingDescription = {0};
+  bindingDescription.binding = 0;
+  bindingDescription.stride = desc->vertexStride;
+  bindingDescription.inputRate = desc->vertexInputRate;
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  if (desc->vertexStride) {
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount = desc->attributeCount;
+    vertexInputInfo.pVertexAttributeDescriptions = desc->attributes;
+  }
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {0};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = desc->topology;
+  inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+  // The viewport and scissor are dynamic, so only their counts are given.
+  VkPipelineViewportStateCreateInfo viewportState = {0};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  VkDynamicState dynamicStates[] = {
+    VK_DYNAMIC_STATE_VIEWPORT,
+    VK_DYNAMIC_STATE_SCISSOR,
+  };
+
+  VkPipelineDynamicStateCreateInfo dynamicState = {0};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {0};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = desc->polygonMode;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = desc->cullMode;
+  rasterizer.frontFace = desc->frontFace;
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {0};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.sampleShadingEnable = VK_FALSE;
+  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachment = {0};
+  set_blend_mode(desc->blendMode, &colorBlendAttachment);
+
+  VkPipelineColorBlendStateCreateInfo colorBlending = {0};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.logicOpEnable = VK_FALSE;
+  colorBlending.attachmentCount = 1;
+  colorBlending.pAttachments = &colorBlendAttachment;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo = {0};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = 2;
+  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.layout = pipeline->layout;
+  pipelineInfo.renderPass = desc->renderPass;
+  pipelineInfo.subpass = desc->subpass;
+
+  // The pipeline cache is internally synchronized, so compile threads may
+  // share it.
+  VkPipeline handle;
+  if (vkCreateGraphicsPipelines(registry->device, registry->cache, 1, &pipelineInfo, NULL, &handle) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  return handle;
+}
+
+
+/**
+ * @brief Records the result of a compile and wakes any waiting callers.
+ *
+ * A pipeline that replaces an older one retires the older one, together with
+ * its last use and its holds, which stay with that version.  If there is no
+ * memory to remember the retired pipeline, the new one is discarded instead,
+ * since it has not been used yet.
+ */
+static void finish_compile(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline, VkPipeline handle) {
+  pthread_mutex_lock(&registry->mutex);
+  pipeline->state = handle != VK_NULL_HANDLE ? PIPELINE_READY : PIPELINE_FAILED;
+  if (handle != VK_NULL_HANDLE && pipeline->pipeline != VK_NULL_HANDLE) {
+    if (registry->retiredCount == registry->retiredCapacity) {
+      size_t capacity = registry->retiredCapacity ? registry->retiredCapacity * 2 : 8;
+      RetiredPipeline * retired = realloc(registry->retired, capacity * sizeof(RetiredPipeline));
+      if (retired) {
+        registry->retired = retired;
+        registry->retiredCapacity = capacity;
+      }
+    }
+    if (registry->retiredCount < registry->retiredCapacity) {
+      RetiredPipeline * retired = &registry->retired[registry->retiredCount++];
+      retired->pipeline = pipeline->pipeline;
+      retired->lastUsedSerial = pipeline->lastUsedSerial;
+      retired->holds = pipeline->holds;
+      pipeline->lastUsedSerial = 0;
+      pipeline->holds = 0;
+    }
+    else {
+      vkDestroyPipeline(registry->device, handle, NULL);
+      handle = VK_NULL_HANDLE;
+    }
+  }
+  if (handle != VK_NULL_HANDLE) {
+    pipeline->pipeline = handle;
+  }
+  pthread_cond_broadcast(&registry->compiled);
+  pthread_mutex_unlock(&registry->mutex);
+}
+
+
+/**
+ * @brief Compiles a pipeline on a compile thread.
+ */
+static void compile_task(void * arg) {
+  CJellyPipeline * pipeline = (CJellyPipeline *)arg;
+  CJellyPipelineRegistry * registry = pipeline->registry;
+  finish_compile(registry, pipeline, compile_pipeline(registry, pipeline));
+}
+
+
+/**
+ * @brief Queues a pending pipeline on the compile threads.  The mutex must be
+ * held.
+ *
+ * If there are no compile threads, or the compile cannot be queued, the
+ * pipeline stays pending.
+ */
+static void start_compile(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline) {
+  if (pipeline->state != PIPELINE_PENDING || !registry->pool) {
+    return;
+  }
+  pipeline->state = PIPELINE_COMPILING;
+  if (!cjelly_thread_pool_submit(registry->pool, compile_task, pipeline)) {
+    pipeline->state = PIPELINE_PENDING;
+  }
+}
+
+
+/**
+ * @brief Compiles a pending pipeline on the calling thread.  The mutex must be
+ * held; it is released while compiling.
+ */
+static void compile_now(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline) {
+  pipeline->state = PIPELINE_COMPILING;
+  pthread_mutex_unlock(&registry->mutex);
+  finish_compile(registry, pipeline, compile_pipeline(registry, pipeline));
+  pthread_mutex_lock(&registry->mutex);
+}
+
+
+//
+// === PUBLIC FUNCTIONS ===
+//
+
+void cjelly_pipeline_desc_init(CJellyPipelineDesc * desc) {
+  memset(desc, 0, sizeof(*desc));
+  desc->vertexShader = VK_NULL_HANDLE;
+  desc->fragmentShader = VK_NULL_HANDLE;
+  desc->vertexInputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  desc->topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  desc->polygonMode = VK_POLYGON_MODE_FILL;
+  desc->cullMode = VK_CULL_MODE_BACK_BIT;
+  desc->frontFace = VK_FRONT_FACE_CLOCKWISE;
+  desc->blendMode = CJELLY_BLEND_MODE_OPAQUE;
+  desc->renderPass = VK_NULL_HANDLE;
+}
+
+
+CJellyPipelineRegistry * cjelly_pipeline_registry_create(VkDevice device, VkPipelineCache cache, int compileThreads) {
+  CJellyPipelineRegistry * registry = calloc(1, sizeof(CJellyPipelineRegistry));
+  if (!registry) {
+    goto ERROR_REGISTRY;
+  }
+  registry->device = device;
+  registry->cache = cache;
+
+  registry->bucketCount = INITIAL_BUCKET_COUNT;
+  registry->buckets = calloc(registry->bucketCount, sizeof(RegistryEntry *));
+  if (!registry->buckets) {
+    goto ERROR_BUCKETS;
+  }
+
+  if (pthread_mutex_init(&registry->mutex, NULL)) {
+    goto ERROR_MUTEX;
+  }
+  if (pthread_cond_init(&registry->compiled, NULL)) {
+    goto ERROR_COND;
+  }
+
+  if (compileThreads > 0) {
+    registry->pool = cjelly_thread_pool_create(compileThreads);
+    if (!registry->pool) {
+      goto ERROR_POOL;
+    }
+  }
+  return registry;
+
+ERROR_POOL:
+  pthread_cond_destroy(&registry->compiled);
+ERROR_COND:
+  pthread_mutex_destroy(&registry->mutex);
+ERROR_MUTEX:
+  free(registry->buckets);
+ERROR_BUCKETS:
+  free(registry);
+ERROR_REGISTRY:
+  return NULL;
+}
+
+
+void cjelly_pipeline_registry_destroy(CJellyPipelineRegistry * registry) {
+  if (!registry) {
+    return;
+  }
+
+  // Destroying the pool finishes the queued compiles first.
+  cjelly_thread_pool_destroy(registry->pool);
+
+  // Entries are destroyed newest first, so that every pipeline goes before
+  // its layout, and every pipeline layout before its set layouts.
+  RegistryEntry * older;
+  for (RegistryEntry * entry = registry->newest; entry; entry = older) {
+    older = entry->older;
+    switch (entry->kind) {
+      case ENTRY_DESCRIPTOR_SET_LAYOUT:
+        vkDestroyDescriptorSetLayout(registry->device, ((SetLayoutEntry *)entry)->layout, NULL);
+        break;
+      case ENTRY_PIPELINE_LAYOUT:
+        vkDestroyPipelineLayout(registry->device, ((LayoutEntry *)entry)->layout, NULL);
+        break;
+      case ENTRY_PIPELINE:
+        if (((CJellyPipeline *)entry)->pipeline != VK_NULL_HANDLE) {
+          vkDestroyPipeline(registry->device, ((CJellyPipeline *)entry)->pipeline, NULL);
+        }
+        break;
+    }
+    free(entry);
+  }
+
+  for (size_t i = 0; i < registry->retiredCount; ++i) {
+    vkDestroyPipeline(registry->device, registry->retired[i].pipeline, NULL);
+  }
+
+  pthread_cond_destroy(&registry->compiled);
+  pthread_mutex_destroy(&registry->mutex);
+  free(registry->retired);
+  free(registry->buckets);
+  free(registry);
+}
+
+
+VkDescriptorSetLayout cjelly_pipeline_registry_descriptor_set_layout(CJellyPipelineRegistry * registry, const CJellyDescriptorSetLayoutDesc * desc) {
+  pthread_mutex_lock(&registry->mutex);
+  VkDescriptorSetLayout layout = get_set_layout(registry, desc);
+  pthread_mutex_unlock(&registry->mutex);
+  return layout;
+}
+
+
+VkPipelineLayout cjelly_pipeline_registry_layout(CJellyPipelineRegistry * registry, const CJellyPipelineLayoutDesc * desc) {
+  pthread_mutex_lock(&registry->mutex);
+  VkPipelineLayout layout = get_layout(registry, desc);
+  pthread_mutex_unlock(&registry->mutex);
+  return layout;
+}
+
+
+CJellyPipeline * cjelly_pipeline_registry_request(CJellyPipelineRegistry * registry, const CJellyPipelineDesc * desc) {
+  if (desc->attributeCount > CJELLY_PIPELINE_MAX_VERTEX_ATTRIBUTES) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&registry->mutex);
+  CJellyPipeline * pipeline = NULL;
+  VkPipelineLayout layout = get_layout(registry, &desc->layout);
+  if (layout == VK_NULL_HANDLE) {
+    goto DONE;
+  }
+
+  EntryKey key;
+  encode_pipeline(desc, layout, &key);
+  uint64_t hash = key_hash(ENTRY_PIPELINE, &key);
+  RegistryEntry * found = find_entry(registry, ENTRY_PIPELINE, &key, hash);
+  if (found) {
+    pipeline = (CJellyPipeline *)found;
+    goto DONE;
+  }
+
+  pipeline = malloc(sizeof(CJellyPipeline));
+  if (!pipeline) {
+    goto DONE;
+  }
+  pipeline->entry.hash = hash;
+  pipeline->entry.kind = ENTRY_PIPELINE;
+  pipeline->entry.key = key;
+  pipeline->registry = registry;
+  pipeline->desc = *desc;
+  pipeline->layout = layout;
+  pipeline->state = PIPELINE_PENDING;
+  pipeline->pipeline = VK_NULL_HANDLE;
+  pipeline->lastUsedSerial = 0;
+  pipeline->holds = 0;
+  insert_entry(registry, &pipeline->entry);
+
+DONE:
+  pthread_mutex_unlock(&registry->mutex);
+  return pipeline;
+}
+
+
+void cjelly_pipeline_registry_prepare(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline) {
+  pthread_mutex_lock(&registry->mutex);
+  start_compile(registry, pipeline);
+  pthread_mutex_unlock(&registry->mutex);
+}
+
+
+VkPipeline cjelly_pipeline_registry_try_get(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline, uint64_t serial) {
+  pthread_mutex_lock(&registry->mutex);
+  start_compile(registry, pipeline);
+  if (pipeline->state == PIPELINE_PENDING) {
+    // There is nothing to compile it in the background.
+    compile_now(registry, pipeline);
+  }
+  VkPipeline handle = pipeline->pipeline;
+  if (handle != VK_NULL_HANDLE && serial > pipeline->lastUsedSerial) {
+    pipeline->lastUsedSerial = serial;
+  }
+  pthread_mutex_unlock(&registry->mutex);
+  return handle;
+}
+
+
+/**
+ * @brief Waits until a pipeline has been compiled, compiling it on the calling
+ * thread if it is pending.  The mutex must be held.
+ */
+static void wait_compile(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline) {
+  if (pipeline->state == PIPELINE_PENDING) {
+    // Compiling here is quicker than queueing the compile and waiting for it.
+    compile_now(registry, pipeline);
+  }
+  while (pipeline->state == PIPELINE_COMPILING) {
+    pthread_cond_wait(&registry->compiled, &registry->mutex);
+  }
+}
+
+
+VkPipeline cjelly_pipeline_registry_get(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline) {
+  pthread_mutex_lock(&registry->mutex);
+  wait_compile(registry, pipeline);
+  VkPipeline handle = pipeline->pipeline;
+  pthread_mutex_unlock(&registry->mutex);
+  return handle;
+}
+
+
+VkPipeline cjelly_pipeline_registry_hold(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline) {
+  pthread_mutex_lock(&registry->mutex);
+  wait_compile(registry, pipeline);
+  VkPipeline handle = pipeline->pipeline;
+  if (handle != VK_NULL_HANDLE) {
+    ++pipeline->holds;
+  }
+  pthread_mutex_unlock(&registry->mutex);
+  return handle;
+}
+
+
+void cjelly_pipeline_registry_release(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline, VkPipeline handle) {
+  if (handle == VK_NULL_HANDLE) {
+    return;
+  }
+  pthread_mutex_lock(&registry->mutex);
+  if (handle == pipeline->pipeline) {
+    if (pipeline->holds) {
+      --pipeline->holds;
+    }
+  }
+  else {
+    for (size_t i = 0; i < registry->retiredCount; ++i) {
+      if (registry->retired[i].pipeline == handle) {
+        if (registry->retired[i].holds) {
+          --registry->retired[i].holds;
+        }
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&registry->mutex);
+}
+
+
+bool cjelly_pipeline_registry_is_current(CJellyPipelineRegistry * registry, CJellyPipeline * pipeline, VkPipeline handle) {
+  pthread_mutex_lock(&registry->mutex);
+  bool current = handle == pipeline->pipeline;
+  pthread_mutex_unlock(&registry->mutex);
+  return current;
+}
+
+
+void cjelly_pipeline_registry_next_frame(CJellyPipelineRegistry * registry, uint64_t completedSerial) {
+  pthread_mutex_lock(&registry->mutex);
+  size_t kept = 0;
+  for (size_t i = 0; i < registry->retiredCount; ++i) {
+    RetiredPipeline * retired = &registry->retired[i];
+    if (!retired->holds && retired->lastUsedSerial <= completedSerial) {
+      vkDestroyPipeline(registry->device, retired->pipeline, NULL);
+    }
+    else {
+      registry->retired[kept++] = *retired;
+    }
+  }
+  registry->retiredCount = kept;
+  pthread_mutex_unlock(&registry->mutex);
+}
+
+
+size_t cjelly_pipeline_registry_replace_shader(CJellyPipelineRegistry * registry, VkShaderModule oldModule, VkShaderModule newModule) {
+  size_t count = 0;
+  pthread_mutex_lock(&registry->mutex);
+  for (RegistryEntry * entry = registry->newest; entry; entry = entry->older) {
+    if (entry->kind != ENTRY_PIPELINE) {
+      continue;
+    }
+    CJellyPipeline * pipeline = (CJellyPipeline *)entry;
+    if (pipeline->desc.vertexShader != oldModule && pipeline->desc.fragmentShader != oldModule) {
+      continue;
+    }
+
+    // A running compile reads the description without the mutex.  Entries
+    // added while waiting are newer than this one, so the walk is unaffected.
+    while (pipeline->state == PIPELINE_COMPILING) {
+      pthread_cond_wait(&registry->compiled, &registry->mutex);
+    }
+
+    unlink_entry(registry, entry);
+    if (pipeline->desc.vertexShader == oldModule) {
+      pipeline->desc.vertexShader = newModule;
+    }
+    if (pipeline->desc.fragmentShader == oldModule) {
+      pipeline->desc.fragmentShader = newModule;
+    }
+    encode_pipeline(&pipeline->desc, pipeline->layout, &entry->key);
+    entry->hash = key_hash(ENTRY_PIPELINE, &entry->key);
+    link_entry(registry, entry);
+
+    pipeline->state = PIPELINE_PENDING;
+    start_compile(registry, pipeline);
+    ++count;
+  }
+  pthread_mutex_unlock(&registry->mutex);
+  return count;
+}
+
+
+VkPipelineLayout cjelly_pipeline_layout(const CJellyPipeline * pipeline) {
+  return pipeline->layout;
+}
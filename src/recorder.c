@@ -0,0 +1,303 @@
+/**
+ * @file recorder.c
+ * @brief CJelly parallel command buffer recorder implementation.
+ *
+ * @details
+ * Each frame owns a primary command pool and a growable array of job slots,
+ * and each slot owns a command pool with a single secondary command buffer.
+ * A slot is only ever touched by the one job that records it, so recording
+ * needs no locking.  The calling thread records the first job itself while
+ * the thread pool records the others, and then waits on a counter of the
+ * jobs that are still outstanding.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/recorder.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+
+/**
+ * @brief A command pool and the secondary command buffer recorded from it.
+ */
+typedef struct {
+  VkCommandPool pool;            /**< Pool used by a single job at a time */
+  VkCommandBuffer commandBuffer; /**< The job's secondary command buffer */
+} RecordSlot;
+
+
+/**
+ * @brief The command buffers of one frame in flight.
+ */
+typedef struct {
+  VkCommandPool primaryPool;     /**< Pool of the primary command buffer */
+  VkCommandBuffer primary;       /**< Executes the secondary command buffers */
+  RecordSlot * slots;            /**< One slot per job */
+  uint32_t slotCount;            /**< Number of slots created so far */
+} RecordFrame;
+
+
+/**
+ * @brief The argument of a job submitted to the thread pool.
+ */
+typedef struct {
+  CJellyCommandRecorder * recorder; /**< The recorder */
+  RecordSlot * slot;                /**< The slot to record into */
+  CJellyRecordContext context;      /**< Passed to the job function */
+} RecordTask;
+
+
+struct CJellyCommandRecorder {
+  VkDevice device;                  /**< The logical device */
+  uint32_t queueFamilyIndex;        /**< Queue family of every command pool */
+  CJellyThreadPool * pool;          /**< Records the jobs, or NULL */
+  RecordFrame * frames;             /**< One entry per frame in flight */
+  uint32_t frameCount;              /**< Number of frames in flight */
+  RecordTask * tasks;               /**< Arguments of the jobs being recorded */
+  VkCommandBuffer * secondaries;    /**< Secondary command buffers to execute */
+  uint32_t taskCapacity;            /**< Allocated capacity of `tasks` and `secondaries` */
+
+  // State of the recording in progress, shared by its jobs.
+  VkCommandBufferInheritanceInfo inheritance; /**< The render pass being continued */
+  CJellyRecordJob job;              /**< The job function */
+  void * user;                      /**< User data for `job` */
+  pthread_mutex_t mutex;            /**< Protects `outstanding` and `result` */
+  pthread_cond_t jobsDone;          /**< Signaled when `outstanding` reaches zero */
+  uint32_t outstanding;             /**< Jobs that have not finished */
+  VkResult result;                  /**< First error reported by a job */
+};
+
+
+/**
+ * @brief Creates a command pool for the recorder's queue family.
+ */
+static VkResult create_pool(CJellyCommandRecorder * recorder, VkCommandPool * outPool) {
+  VkCommandPoolCreateInfo poolInfo = {0};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = recorder->queueFamilyIndex;
+  return vkCreateCommandPool(recorder->device, &poolInfo, NULL, outPool);
+}
+
+
+/**
+ * @brief Allocates a single command buffer from a pool.
+ */
+static VkResult allocate_command_buffer(CJellyCommandRecorder * recorder, VkCommandPool pool, VkCommandBufferLevel level, VkCommandBuffer * outCommandBuffer) {
+  VkCommandBufferAllocateInfo allocInfo = {0};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = pool;
+  allocInfo.level = level;
+  allocInfo.commandBufferCount = 1;
+  return vkAllocateCommandBuffers(recorder->device, &allocInfo, outCommandBuffer);
+}
+
+
+/**
+ * @brief Makes sure that a frame has at least `count` job slots, and that
+ * there is room for `count` jobs in the per-recording arrays.
+ */
+static VkResult reserve_slots(CJellyCommandRecorder * recorder, RecordFrame * frame, uint32_t count) {
+  if (count > recorder->taskCapacity) {
+    RecordTask * tasks = (RecordTask *)realloc(recorder->tasks, count * sizeof(RecordTask));
+    if (!tasks) { return VK_ERROR_OUT_OF_HOST_MEMORY; }
+    recorder->tasks = tasks;
+    VkCommandBuffer * secondaries = (VkCommandBuffer *)realloc(recorder->secondaries, count * sizeof(VkCommandBuffer));
+    if (!secondaries) { return VK_ERROR_OUT_OF_HOST_MEMORY; }
+    recorder->secondaries = secondaries;
+    recorder->taskCapacity = count;
+  }
+
+  if (count <= frame->slotCount) {
+    return VK_SUCCESS;
+  }
+  RecordSlot * slots = (RecordSlot *)realloc(frame->slots, count * sizeof(RecordSlot));
+  if (!slots) { return VK_ERROR_OUT_OF_HOST_MEMORY; }
+  frame->slots = slots;
+
+  // The slot count only grows once a slot is complete, so that a failure
+  // leaves the frame in a consistent state.
+  while (frame->slotCount < count) {
+    RecordSlot * slot = &frame->slots[frame->slotCount];
+    VkResult result = create_pool(recorder, &slot->pool);
+    if (result != VK_SUCCESS) { return result; }
+    result = allocate_command_buffer(recorder, slot->pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, &slot->commandBuffer);
+    if (result != VK_SUCCESS) {
+      vkDestroyCommandPool(recorder->device, slot->pool, NULL);
+      return result;
+    }
+    frame->slotCount++;
+  }
+  return VK_SUCCESS;
+}
+
+
+/**
+ * @brief Records one job into its secondary command buffer.
+ *
+ * This is the task executed by the thread pool.
+ */
+static void record_task(void * arg) {
+  RecordTask * task = (RecordTask *)arg;
+  CJellyCommandRecorder * recorder = task->recorder;
+
+  VkResult result = vkResetCommandPool(recorder->device, task->slot->pool, 0);
+  if (result == VK_SUCCESS) {
+    VkCommandBufferBeginInfo beginInfo = {0};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+        VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &recorder->inheritance;
+    result = vkBeginCommandBuffer(task->slot->commandBuffer, &beginInfo);
+  }
+  if (result == VK_SUCCESS) {
+    recorder->job(recorder->user, task->slot->commandBuffer, &task->context);
+    result = vkEndCommandBuffer(task->slot->commandBuffer);
+  }
+
+  pthread_mutex_lock(&recorder->mutex);
+  if (result != VK_SUCCESS && recorder->result == VK_SUCCESS) {
+    recorder->result = result;
+  }
+  if (!--recorder->outstanding) {
+    pthread_cond_signal(&recorder->jobsDone);
+  }
+  pthread_mutex_unlock(&recorder->mutex);
+}
+
+
+CJellyCommandRecorder * cjelly_command_recorder_create(VkDevice device, uint32_t queueFamilyIndex, uint32_t frameCount, CJellyThreadPool * pool) {
+  if (!frameCount) { return NULL; }
+
+  CJellyCommandRecorder * recorder = (CJellyCommandRecorder *)calloc(1, sizeof(CJellyCommandRecorder));
+  if (!recorder) { return NULL; }
+  recorder->device = device;
+  recorder->queueFamilyIndex = queueFamilyIndex;
+  recorder->pool = pool;
+
+  if (pthread_mutex_init(&recorder->mutex, NULL)) { goto ERROR_FREE; }
+  if (pthread_cond_init(&recorder->jobsDone, NULL)) { goto ERROR_MUTEX; }
+
+  recorder->frames = (RecordFrame *)calloc(frameCount, sizeof(RecordFrame));
+  if (!recorder->frames) { goto ERROR_COND; }
+
+  // The frame count grows as soon as a frame's pool exists, so that
+  // cjelly_command_recorder_destroy() can clean up after a failure.
+  for (uint32_t i = 0; i < frameCount; ++i) {
+    RecordFrame * frame = &recorder->frames[i];
+    if (create_pool(recorder, &frame->primaryPool) != VK_SUCCESS) { goto ERROR_DESTROY; }
+    recorder->frameCount++;
+    if (allocate_command_buffer(recorder, frame->primaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, &frame->primary) != VK_SUCCESS) { goto ERROR_DESTROY; }
+  }
+  return recorder;
+
+  // Error handling.
+ERROR_DESTROY:
+  cjelly_command_recorder_destroy(recorder);
+  return NULL;
+ERROR_COND:
+  pthread_cond_destroy(&recorder->jobsDone);
+ERROR_MUTEX:
+  pthread_mutex_destroy(&recorder->mutex);
+ERROR_FREE:
+  free(recorder);
+  return NULL;
+}
+
+
+void cjelly_command_recorder_destroy(CJellyCommandRecorder * recorder) {
+  if (!recorder) { return; }
+
+  for (uint32_t i = 0; i < recorder->frameCount; ++i) {
+    RecordFrame * frame = &recorder->frames[i];
+    for (uint32_t j = 0; j < frame->slotCount; ++j) {
+      // Destroying a pool frees the command buffers allocated from it.
+      vkDestroyCommandPool(recorder->device, frame->slots[j].pool, NULL);
+    }
+    free(frame->slots);
+    vkDestroyCommandPool(recorder->device, frame->primaryPool, NULL);
+  }
+
+  pthread_cond_destroy(&recorder->jobsDone);
+  pthread_mutex_destroy(&recorder->mutex);
+  free(recorder->frames);
+  free(recorder->tasks);
+  free(recorder->secondaries);
+  free(recorder);
+}
+
+
+VkResult cjelly_command_recorder_record(CJellyCommandRecorder * recorder, uint32_t frameIndex, uint64_t serial, const VkRenderPassBeginInfo * renderPassInfo, uint32_t jobCount, CJellyRecordJob job, void * user, VkCommandBuffer * outCommandBuffer) {
+  if (frameIndex >= recorder->frameCount || !jobCount || !job) {
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  RecordFrame * frame = &recorder->frames[frameIndex];
+
+  VkResult result = reserve_slots(recorder, frame, jobCount);
+  if (result != VK_SUCCESS) { return result; }
+
+  // Record the jobs.
+  recorder->inheritance = (VkCommandBufferInheritanceInfo){0};
+  recorder->inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  recorder->inheritance.renderPass = renderPassInfo->renderPass;
+  recorder->inheritance.subpass = 0;
+  recorder->inheritance.framebuffer = renderPassInfo->framebuffer;
+  recorder->job = job;
+  recorder->user = user;
+  recorder->outstanding = jobCount;
+  recorder->result = VK_SUCCESS;
+
+  for (uint32_t i = 0; i < jobCount; ++i) {
+    RecordTask * task = &recorder->tasks[i];
+    task->recorder = recorder;
+    task->slot = &frame->slots[i];
+    task->context.frameIndex = frameIndex;
+    task->context.serial = serial;
+    task->context.jobIndex = i;
+    task->context.jobCount = jobCount;
+    task->context.extent = renderPassInfo->renderArea.extent;
+    recorder->secondaries[i] = frame->slots[i].commandBuffer;
+  }
+
+  // Hand every job but the first to the thread pool, and record the first one
+  // on this thread rather than leaving it idle.  A job that cannot be queued
+  // is recorded here as well.
+  for (uint32_t i = 1; i < jobCount; ++i) {
+    if (!cjelly_thread_pool_submit(recorder->pool, record_task, &recorder->tasks[i])) {
+      record_task(&recorder->tasks[i]);
+    }
+  }
+  record_task(&recorder->tasks[0]);
+
+  pthread_mutex_lock(&recorder->mutex);
+  while (recorder->outstanding) {
+    pthread_cond_wait(&recorder->jobsDone, &recorder->mutex);
+  }
+  result = recorder->result;
+  pthread_mutex_unlock(&recorder->mutex);
+  if (result != VK_SUCCESS) { return result; }
+
+  // Record the primary command buffer that executes them.
+  result = vkResetCommandPool(recorder->device, frame->primaryPool, 0);
+  if (result != VK_SUCCESS) { return result; }
+
+  VkCommandBufferBeginInfo beginInfo = {0};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  result = vkBeginCommandBuffer(frame->primary, &beginInfo);
+  if (result != VK_SUCCESS) { return result; }
+
+  vkCmdBeginRenderPass(frame->primary, renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  vkCmdExecuteCommands(frame->primary, jobCount, recorder->secondaries);
+  vkCmdEndRenderPass(frame->primary);
+
+  result = vkEndCommandBuffer(frame->primary);
+  if (result != VK_SUCCESS) { return result; }
+
+  *outCommandBuffer = frame->primary;
+  return VK_SUCCESS;
+}
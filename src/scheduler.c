@@ -0,0 +1,243 @@
+/**
+ * @file scheduler.c
+ * @brief CJelly frame deadline scheduler implementation.
+ *
+ * @details
+ * Items live in an array indexed by id.  The heap is a separate array of ids
+ * ordered by deadline, and every item records its position in the heap, so
+ * that an item's deadline can be changed or removed without searching for
+ * it.  Removed ids are chained into a free list through their `heapIndex`.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/scheduler.h>
+
+#include <stdlib.h>
+
+/**
+ * @brief Initial capacity of the item and heap arrays.
+ */
+#define INITIAL_CAPACITY 16
+
+/**
+ * @brief The heap index of an item without a deadline.
+ */
+#define NOT_SCHEDULED UINT32_MAX
+
+
+/**
+ * @brief An item known to the scheduler.
+ */
+typedef struct {
+  void * item;        /**< The caller's item, or NULL if the id is free */
+  uint64_t deadline;  /**< The deadline, if the item is in the heap */
+  uint32_t heapIndex; /**< Position in the heap, NOT_SCHEDULED, or the next free id */
+} SchedulerEntry;
+
+
+struct CJellyFrameScheduler {
+  SchedulerEntry * entries; /**< Items, indexed by id */
+  uint32_t entryCount;      /**< Number of ids handed out so far */
+  uint32_t capacity;        /**< Allocated capacity of `entries` and `heap` */
+  uint32_t * heap;          /**< Ids of the scheduled items, as a min-heap */
+  uint32_t heapCount;       /**< Number of scheduled items */
+  uint32_t freeId;          /**< First id in the free list, or NOT_SCHEDULED */
+};
+
+
+//
+// === Heap ===
+//
+
+/**
+ * @brief Places an id at a heap position, updating its entry.
+ */
+static void heap_place(CJellyFrameScheduler * scheduler, uint32_t index, uint32_t id) {
+  scheduler->heap[index] = id;
+  scheduler->entries[id].heapIndex = index;
+}
+
+
+/**
+ * @brief Moves the id at a heap position towards the root until its parent is
+ * not later than it.
+ */
+static void sift_up(CJellyFrameScheduler * scheduler, uint32_t index) {
+  uint32_t id = scheduler->heap[index];
+  uint64_t deadline = scheduler->entries[id].deadline;
+  while (index > 0) {
+    uint32_t parent = (index - 1) / 2;
+    uint32_t parentId = scheduler->heap[parent];
+    if (scheduler->entries[parentId].deadline <= deadline) {
+      break;
+    }
+    heap_place(scheduler, index, parentId);
+    index = parent;
+  }
+  heap_place(scheduler, index, id);
+}
+
+
+/**
+ * @brief Moves the id at a heap position towards the leaves until neither
+ * child is earlier than it.
+ */
+static void sift_down(CJellyFrameScheduler * scheduler, uint32_t index) {
+  uint32_t id = scheduler->heap[index];
+  uint64_t deadline = scheduler->entries[id].deadline;
+  while (true) {
+    uint32_t child = index * 2 + 1;
+    if (child >= scheduler->heapCount) {
+      break;
+    }
+    if (child + 1 < scheduler->heapCount &&
+        scheduler->entries[scheduler->heap[child + 1]].deadline < scheduler->entries[scheduler->heap[child]].deadline) {
+      ++child;
+    }
+    uint32_t childId = scheduler->heap[child];
+    if (scheduler->entries[childId].deadline >= deadline) {
+      break;
+    }
+    heap_place(scheduler, index, childId);
+    index = child;
+  }
+  heap_place(scheduler, index, id);
+}
+
+
+/**
+ * @brief Removes the id at a heap position from the heap.
+ */
+static void heap_remove(CJellyFrameScheduler * scheduler, uint32_t index) {
+  uint32_t id = scheduler->heap[index];
+  scheduler->entries[id].heapIndex = NOT_SCHEDULED;
+
+  // Fill the hole with the last id, which may belong either above or below
+  // the hole.
+  uint32_t lastId = scheduler->heap[--scheduler->heapCount];
+  if (index == scheduler->heapCount) {
+    return;
+  }
+  heap_place(scheduler, index, lastId);
+  sift_down(scheduler, index);
+  sift_up(scheduler, scheduler->entries[lastId].heapIndex);
+}
+
+
+//
+// === Public API ===
+//
+
+CJellyFrameScheduler * cjelly_frame_scheduler_create(void) {
+  CJellyFrameScheduler * scheduler = (CJellyFrameScheduler *)calloc(1, sizeof(CJellyFrameScheduler));
+  if (!scheduler) { return NULL; }
+
+  scheduler->capacity = INITIAL_CAPACITY;
+  scheduler->entries = (SchedulerEntry *)malloc(scheduler->capacity * sizeof(SchedulerEntry));
+  scheduler->heap = (uint32_t *)malloc(scheduler->capacity * sizeof(uint32_t));
+  if (!scheduler->entries || !scheduler->heap) {
+    cjelly_frame_scheduler_destroy(scheduler);
+    return NULL;
+  }
+  scheduler->freeId = NOT_SCHEDULED;
+  return scheduler;
+}
+
+
+void cjelly_frame_scheduler_destroy(CJellyFrameScheduler * scheduler) {
+  if (!scheduler) { return; }
+  free(scheduler->entries);
+  free(scheduler->heap);
+  free(scheduler);
+}
+
+
+uint32_t cjelly_frame_scheduler_add(CJellyFrameScheduler * scheduler, void * item) {
+  if (!item) { return CJELLY_FRAME_SCHEDULER_INVALID_ID; }
+
+  uint32_t id = scheduler->freeId;
+  if (id != NOT_SCHEDULED) {
+    scheduler->freeId = scheduler->entries[id].heapIndex;
+  }
+  else {
+    if (scheduler->entryCount == scheduler->capacity) {
+      uint32_t capacity = scheduler->capacity * 2;
+      SchedulerEntry * entries = (SchedulerEntry *)realloc(scheduler->entries, capacity * sizeof(SchedulerEntry));
+      if (!entries) { return CJELLY_FRAME_SCHEDULER_INVALID_ID; }
+      scheduler->entries = entries;
+      uint32_t * heap = (uint32_t *)realloc(scheduler->heap, capacity * sizeof(uint32_t));
+      if (!heap) { return CJELLY_FRAME_SCHEDULER_INVALID_ID; }
+      scheduler->heap = heap;
+      scheduler->capacity = capacity;
+    }
+    id = scheduler->entryCount++;
+  }
+
+  scheduler->entries[id].item = item;
+  scheduler->entries[id].deadline = 0;
+  scheduler->entries[id].heapIndex = NOT_SCHEDULED;
+  return id;
+}
+
+
+void cjelly_frame_scheduler_remove(CJellyFrameScheduler * scheduler, uint32_t id) {
+  cjelly_frame_scheduler_clear_deadline(scheduler, id);
+  scheduler->entries[id].item = NULL;
+  scheduler->entries[id].heapIndex = scheduler->freeId;
+  scheduler->freeId = id;
+}
+
+
+void cjelly_frame_scheduler_set_deadline(CJellyFrameScheduler * scheduler, uint32_t id, uint64_t deadline) {
+  SchedulerEntry * entry = &scheduler->entries[id];
+  if (entry->heapIndex == NOT_SCHEDULED) {
+    entry->deadline = deadline;
+    heap_place(scheduler, scheduler->heapCount++, id);
+    sift_up(scheduler, entry->heapIndex);
+  }
+  else if (deadline < entry->deadline) {
+    entry->deadline = deadline;
+    sift_up(scheduler, entry->heapIndex);
+  }
+  else {
+    entry->deadline = deadline;
+    sift_down(scheduler, entry->heapIndex);
+  }
+}
+
+
+void cjelly_frame_scheduler_set_deadline_min(CJellyFrameScheduler * scheduler, uint32_t id, uint64_t deadline) {
+  SchedulerEntry * entry = &scheduler->entries[id];
+  if (entry->heapIndex == NOT_SCHEDULED || deadline < entry->deadline) {
+    cjelly_frame_scheduler_set_deadline(scheduler, id, deadline);
+  }
+}
+
+
+void cjelly_frame_scheduler_clear_deadline(CJellyFrameScheduler * scheduler, uint32_t id) {
+  if (scheduler->entries[id].heapIndex != NOT_SCHEDULED) {
+    heap_remove(scheduler, scheduler->entries[id].heapIndex);
+  }
+}
+
+
+bool cjelly_frame_scheduler_next_deadline(const CJellyFrameScheduler * scheduler, uint64_t * outDeadline) {
+  if (!scheduler->heapCount) { return false; }
+  *outDeadline = scheduler->entries[scheduler->heap[0]].deadline;
+  return true;
+}
+
+
+void * cjelly_frame_scheduler_pop(CJellyFrameScheduler * scheduler, uint64_t now, uint32_t * outId) {
+  if (!scheduler->heapCount) { return NULL; }
+
+  uint32_t id = scheduler->heap[0];
+  if (scheduler->entries[id].deadline > now) { return NULL; }
+
+  heap_remove(scheduler, 0);
+  if (outId) { *outId = id; }
+  return scheduler->entries[id].item;
+}
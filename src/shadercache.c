@@ -0,0 +1,491 @@
+/**
+ * @file shadercache.c
+ * @brief CJelly shader module cache implementation.
+ *
+ * @details
+ * Modules are kept in an array, with a copy of their code, and are looked up
+ * by an FNV-1a hash of the code followed by a full comparison.  A program has
+ * few enough shaders that a linear search is plenty.  Each entry counts its
+ * references (one per load, plus one for each watched file that currently
+ * contains it), and is destroyed, with its code, when the last one is
+ * released.
+ *
+ * On Linux, the directory of every watched file is watched with inotify for
+ * files that are closed after writing or moved into place, which covers both
+ * compilers that write the output directly and tools that write a temporary
+ * file and rename it.  Elsewhere, each poll compares the files' modification
+ * times instead.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+// read() and close() are POSIX.
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <cjelly/shadercache.h>
+#include <cjelly/cachefile.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+/**
+ * @brief The first word of every SPIR-V module.
+ */
+#define SPIRV_MAGIC 0x07230203u
+
+/**
+ * @brief Size of the SPIR-V header, in bytes.
+ */
+#define SPIRV_HEADER_SIZE 20
+
+
+/**
+ * @brief A module created by the cache.
+ */
+typedef struct {
+  uint64_t hash;         /**< Hash of the code */
+  size_t size;           /**< Size of the code in bytes */
+  uint32_t * code;       /**< Copy of the code */
+  VkShaderModule module; /**< The module */
+  uint32_t references;   /**< Number of loads and files that hold the module */
+} ShaderModuleEntry;
+
+
+/**
+ * @brief A watched shader file.
+ */
+typedef struct {
+  char * path;           /**< Path, as passed to cjelly_shader_cache_load_file() */
+  const char * name;     /**< The file name within `path` */
+  VkShaderModule module; /**< The module that the file currently contains */
+  bool changed;          /**< Set when the file has changed since it was loaded */
+#ifdef _WIN32
+  time_t mtime;          /**< Modification time when the file was loaded */
+#else
+  int watch;             /**< inotify watch descriptor of the file's directory, or -1 */
+#endif
+} ShaderFile;
+
+
+struct CJellyShaderCache {
+  VkDevice device;             /**< The logical device */
+  ShaderModuleEntry * modules; /**< Every module created so far */
+  size_t moduleCount;          /**< Number of entries in `modules` */
+  size_t moduleCapacity;       /**< Allocated capacity of `modules` */
+  ShaderFile * files;          /**< The watched files */
+  size_t fileCount;            /**< Number of entries in `files` */
+  size_t fileCapacity;         /**< Allocated capacity of `files` */
+#ifndef _WIN32
+  int inotify;                 /**< The inotify instance, or -1 if unavailable */
+#endif
+};
+
+
+/**
+ * @brief Grows an array, if necessary, so that it can hold one more element.
+ *
+ * @return false on allocation failure.
+ */
+static bool reserve(void * * array, size_t * capacity, size_t count, size_t elementSize) {
+  if (count < *capacity) {
+    return true;
+  }
+  size_t newCapacity = *capacity ? *capacity * 2 : 8;
+  void * grown = realloc(*array, newCapacity * elementSize);
+  if (!grown) {
+    return false;
+  }
+  *array = grown;
+  *capacity = newCapacity;
+  return true;
+}
+
+
+/**
+ * @brief Finds the entry of a module.
+ *
+ * @return The index of the entry, or moduleCount if the module is unknown.
+ */
+static size_t find_module(const CJellyShaderCache * cache, VkShaderModule module) {
+  size_t i = 0;
+  while (i < cache->moduleCount && cache->modules[i].module != module) {
+    ++i;
+  }
+  return i;
+}
+
+
+/**
+ * @brief Reads a whole file into memory.
+ *
+ * @param path Path of the file.
+ * @param outData Receives the contents, to be freed by the caller.
+ * @param outSize Receives the size of the contents.
+ * @return CJellyShaderCacheError Error code indicating success or the type of failure.
+ */
+static CJellyShaderCacheError read_file(const char * path, void * * outData, size_t * outSize) {
+  FILE * file = fopen(path, "rb");
+  if (!file) {
+    return CJELLY_SHADER_CACHE_ERR_FILE_NOT_FOUND;
+  }
+
+  CJellyShaderCacheError err = CJELLY_SHADER_CACHE_ERR_IO;
+  void * data = NULL;
+  if (fseek(file, 0, SEEK_END) != 0) {
+    goto ERROR_CLOSE;
+  }
+  long length = ftell(file);
+  if (length < 0 || fseek(file, 0, SEEK_SET) != 0) {
+    goto ERROR_CLOSE;
+  }
+
+  size_t size = (size_t)length;
+  data = malloc(size ? size : 1);
+  if (!data) {
+    err = CJELLY_SHADER_CACHE_ERR_OUT_OF_MEMORY;
+    goto ERROR_CLOSE;
+  }
+  if (fread(data, 1, size, file) != size) {
+    goto ERROR_FREE;
+  }
+
+  fclose(file);
+  *outData = data;
+  *outSize = size;
+  return CJELLY_SHADER_CACHE_SUCCESS;
+
+ERROR_FREE:
+  free(data);
+ERROR_CLOSE:
+  fclose(file);
+  return err;
+}
+
+
+#ifdef _WIN32
+/**
+ * @brief Returns the modification time of a file, or 0 if it cannot be read.
+ */
+static time_t modification_time(const char * path) {
+  struct stat info;
+  return stat(path, &info) == 0 ? info.st_mtime : 0;
+}
+#else
+/**
+ * @brief Watches the directory of a file.
+ *
+ * @return The watch descriptor, or -1 on failure.
+ */
+static int watch_directory(CJellyShaderCache * cache, const ShaderFile * file) {
+  if (cache->inotify < 0) {
+    return -1;
+  }
+  size_t length = (size_t)(file->name - file->path);
+  if (!length) {
+    return inotify_add_watch(cache->inotify, ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+  }
+  char * directory = malloc(length + 1);
+  if (!directory) {
+    return -1;
+  }
+  memcpy(directory, file->path, length);
+  directory[length] = '\0';
+  int watch = inotify_add_watch(cache->inotify, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+  free(directory);
+  return watch;
+}
+
+
+/**
+ * @brief Marks the watched files that inotify reports as written.
+ */
+static void read_events(CJellyShaderCache * cache) {
+  if (cache->inotify < 0) {
+    return;
+  }
+  // The buffer is aligned for struct inotify_event, as read() requires.
+  union {
+    struct inotify_event event;
+    char bytes[4096];
+  } buffer;
+  ssize_t length;
+  while ((length = read(cache->inotify, buffer.bytes, sizeof(buffer.bytes))) > 0) {
+    for (char * p = buffer.bytes; p < buffer.bytes + length;) {
+      const struct inotify_event * event = (const struct inotify_event *)(void *)p;
+      if (event->len) {
+        for (size_t i = 0; i < cache->fileCount; ++i) {
+          ShaderFile * file = &cache->files[i];
+          if (file->watch == event->wd && !strcmp(file->name, event->name)) {
+            file->changed = true;
+          }
+        }
+      }
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
+#endif
+
+
+/**
+ * @brief Reloads a watched file.
+ *
+ * @return true if the file now contains a different module.
+ */
+static bool reload_file(CJellyShaderCache * cache, ShaderFile * file, CJellyShaderReloadCallback callback, void * user) {
+  file->changed = false;
+#ifdef _WIN32
+  file->mtime = modification_time(file->path);
+#endif
+
+  void * data;
+  size_t size;
+  if (read_file(file->path, &data, &size) != CJELLY_SHADER_CACHE_SUCCESS) {
+    return false;
+  }
+  // The reference that this load adds becomes the file's reference.
+  VkShaderModule module;
+  CJellyShaderCacheError err = cjelly_shader_cache_load_memory(cache, data, size, &module);
+  free(data);
+  if (err != CJELLY_SHADER_CACHE_SUCCESS) {
+    return false;
+  }
+  if (module == file->module) {
+    cjelly_shader_cache_release(cache, module);
+    return false;
+  }
+
+  // The old module is released after the callback, so that the callback can
+  // still move its own references from it to the new one.
+  VkShaderModule oldModule = file->module;
+  file->module = module;
+  if (callback) {
+    callback(user, file->path, oldModule, module);
+  }
+  cjelly_shader_cache_release(cache, oldModule);
+  return true;
+}
+
+
+CJellyShaderCache * cjelly_shader_cache_create(VkDevice device) {
+  CJellyShaderCache * cache = calloc(1, sizeof(CJellyShaderCache));
+  if (!cache) {
+    return NULL;
+  }
+  cache->device = device;
+#ifndef _WIN32
+  // Without inotify, files are still loaded, but never reloaded.
+  cache->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+  return cache;
+}
+
+
+void cjelly_shader_cache_destroy(CJellyShaderCache * cache) {
+  if (!cache) {
+    return;
+  }
+#ifndef _WIN32
+  if (cache->inotify >= 0) {
+    close(cache->inotify);
+  }
+#endif
+  for (size_t i = 0; i < cache->fileCount; ++i) {
+    free(cache->files[i].path);
+  }
+  for (size_t i = 0; i < cache->moduleCount; ++i) {
+    vkDestroyShaderModule(cache->device, cache->modules[i].module, NULL);
+    free(cache->modules[i].code);
+  }
+  free(cache->files);
+  free(cache->modules);
+  free(cache);
+}
+
+
+CJellyShaderCacheError cjelly_shader_cache_load_memory(CJellyShaderCache * cache, const void * code, size_t size, VkShaderModule * outModule) {
+  if (size < SPIRV_HEADER_SIZE || size % sizeof(uint32_t)) {
+    return CJELLY_SHADER_CACHE_ERR_INVALID;
+  }
+
+  // Copy the code first: the arrays generated by `xxd -i` are only byte
+  // aligned, and Vulkan reads the code as 32-bit words.
+  uint32_t * copy = malloc(size);
+  if (!copy) {
+    return CJELLY_SHADER_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  memcpy(copy, code, size);
+  if (copy[0] != SPIRV_MAGIC) {
+    free(copy);
+    return CJELLY_SHADER_CACHE_ERR_INVALID;
+  }
+
+  uint64_t hash = cjelly_hash_bytes(copy, size, CJELLY_HASH_SEED);
+  for (size_t i = 0; i < cache->moduleCount; ++i) {
+    ShaderModuleEntry * entry = &cache->modules[i];
+    if (entry->hash == hash && entry->size == size && !memcmp(entry->code, copy, size)) {
+      free(copy);
+      ++entry->references;
+      *outModule = entry->module;
+      return CJELLY_SHADER_CACHE_SUCCESS;
+    }
+  }
+
+  if (!reserve((void * *)&cache->modules, &cache->moduleCapacity, cache->moduleCount, sizeof(ShaderModuleEntry))) {
+    free(copy);
+    return CJELLY_SHADER_CACHE_ERR_OUT_OF_MEMORY;
+  }
+
+  VkShaderModuleCreateInfo createInfo = {0};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = size;
+  createInfo.pCode = copy;
+  VkShaderModule module;
+  if (vkCreateShaderModule(cache->device, &createInfo, NULL, &module) != VK_SUCCESS) {
+    free(copy);
+    return CJELLY_SHADER_CACHE_ERR_VULKAN;
+  }
+
+  ShaderModuleEntry * entry = &cache->modules[cache->moduleCount++];
+  entry->hash = hash;
+  entry->size = size;
+  entry->code = copy;
+  entry->module = module;
+  entry->references = 1;
+  *outModule = module;
+  return CJELLY_SHADER_CACHE_SUCCESS;
+}
+
+
+CJellyShaderCacheError cjelly_shader_cache_load_file(CJellyShaderCache * cache, const char * path, VkShaderModule * outModule) {
+  // A file that is already watched keeps its current module.
+  for (size_t i = 0; i < cache->fileCount; ++i) {
+    if (!strcmp(cache->files[i].path, path)) {
+      cjelly_shader_cache_retain(cache, cache->files[i].module);
+      *outModule = cache->files[i].module;
+      return CJELLY_SHADER_CACHE_SUCCESS;
+    }
+  }
+
+  if (!reserve((void * *)&cache->files, &cache->fileCapacity, cache->fileCount, sizeof(ShaderFile))) {
+    return CJELLY_SHADER_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  size_t length = strlen(path);
+  char * pathCopy = malloc(length + 1);
+  if (!pathCopy) {
+    return CJELLY_SHADER_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  memcpy(pathCopy, path, length + 1);
+
+  ShaderFile file = {0};
+  file.path = pathCopy;
+  file.name = pathCopy;
+  for (const char * p = pathCopy; *p; ++p) {
+    if (*p == '/' || *p == '\\') {
+      file.name = p + 1;
+    }
+  }
+
+  // Start watching before reading, so that a write in between is not missed.
+#ifdef _WIN32
+  file.mtime = modification_time(path);
+#else
+  file.watch = watch_directory(cache, &file);
+#endif
+
+  void * data;
+  size_t size;
+  CJellyShaderCacheError err = read_file(path, &data, &size);
+  if (err != CJELLY_SHADER_CACHE_SUCCESS) {
+    free(pathCopy);
+    return err;
+  }
+  err = cjelly_shader_cache_load_memory(cache, data, size, &file.module);
+  free(data);
+  if (err != CJELLY_SHADER_CACHE_SUCCESS) {
+    free(pathCopy);
+    return err;
+  }
+
+  // The file holds the reference added by the load, and the caller holds
+  // another.
+  cjelly_shader_cache_retain(cache, file.module);
+  cache->files[cache->fileCount++] = file;
+  *outModule = file.module;
+  return CJELLY_SHADER_CACHE_SUCCESS;
+}
+
+
+void cjelly_shader_cache_retain(CJellyShaderCache * cache, VkShaderModule module) {
+  size_t i = find_module(cache, module);
+  if (i < cache->moduleCount) {
+    ++cache->modules[i].references;
+  }
+}
+
+
+void cjelly_shader_cache_release(CJellyShaderCache * cache, VkShaderModule module) {
+  size_t i = find_module(cache, module);
+  if (i == cache->moduleCount || --cache->modules[i].references) {
+    return;
+  }
+  vkDestroyShaderModule(cache->device, module, NULL);
+  free(cache->modules[i].code);
+  cache->modules[i] = cache->modules[--cache->moduleCount];
+}
+
+
+size_t cjelly_shader_cache_poll(CJellyShaderCache * cache, CJellyShaderReloadCallback callback, void * user) {
+#ifdef _WIN32
+  for (size_t i = 0; i < cache->fileCount; ++i) {
+    if (modification_time(cache->files[i].path) != cache->files[i].mtime) {
+      cache->files[i].changed = true;
+    }
+  }
+#else
+  read_events(cache);
+#endif
+
+  size_t reloaded = 0;
+  for (size_t i = 0; i < cache->fileCount; ++i) {
+    if (cache->files[i].changed && reload_file(cache, &cache->files[i], callback, user)) {
+      ++reloaded;
+    }
+  }
+  return reloaded;
+}
+
+
+const char * cjelly_shader_cache_strerror(CJellyShaderCacheError err) {
+  switch (err) {
+    case CJELLY_SHADER_CACHE_SUCCESS:
+      return "No error";
+    case CJELLY_SHADER_CACHE_ERR_OUT_OF_MEMORY:
+      return "Out of memory";
+    case CJELLY_SHADER_CACHE_ERR_FILE_NOT_FOUND:
+      return "File not found or cannot be opened";
+    case CJELLY_SHADER_CACHE_ERR_IO:
+      return "File could not be read";
+    case CJELLY_SHADER_CACHE_ERR_INVALID:
+      return "Not a SPIR-V module";
+    case CJELLY_SHADER_CACHE_ERR_VULKAN:
+      return "A Vulkan call failed";
+    default:
+      return "Unknown error";
+  }
+}
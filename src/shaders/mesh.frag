@@ -0,0 +1,24 @@
+#version 450
+
+// Receive the interpolated surface attributes from the vertex shader.
+layout(location = 0) in vec3 fragPosition;
+layout(location = 1) in vec3 fragNormal;
+
+// Output the final pixel color.
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Meshes without normals (such as scanned models) use the face normal,
+    // reconstructed from the screen-space derivatives of the position.  The
+    // framebuffer's y runs opposite to the position's, so dFdy comes first
+    // for the normal to face the viewer.
+    vec3 normal = dot(fragNormal, fragNormal) > 0.0
+        ? normalize(fragNormal)
+        : normalize(cross(dFdy(fragPosition), dFdx(fragPosition)));
+
+    // Back faces are culled, so the lighting is one-sided: Lambert with an
+    // ambient term, and no light on faces that point away from it.
+    vec3 lightDirection = normalize(vec3(0.4, 0.6, 0.7));
+    float diffuse = max(dot(normal, lightDirection), 0.0);
+    outColor = vec4(vec3(0.15 + 0.85 * diffuse), 1.0);
+}
@@ -0,0 +1,26 @@
+#version 450
+
+// Input from the interleaved mesh vertex buffer.
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
+
+// Fits the mesh into clip space: xyz is added to the position (centering the
+// bounding box on the origin), then the result is multiplied by w.
+layout(push_constant) uniform MeshPushConstants {
+    vec4 transform;
+} pc;
+
+// Pass the surface attributes to the fragment shader.
+layout(location = 0) out vec3 fragPosition;
+layout(location = 1) out vec3 fragNormal;
+
+void main() {
+    vec3 p = (inPosition + pc.transform.xyz) * pc.transform.w;
+
+    // OBJ is y-up and Vulkan clip space is y-down.  The render pass has no
+    // depth attachment, so z is not tested and every vertex is placed at 0.
+    gl_Position = vec4(p.x, -p.y, 0.0, 1.0);
+    fragPosition = p;
+    fragNormal = inNormal;
+}
@@ -0,0 +1,15 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// The bindless texture table.
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) flat in uint fragTextureIndex;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Sprites of one draw may use different textures, so the index must be
+    // marked as non-uniform.
+    outColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragTexCoord);
+}
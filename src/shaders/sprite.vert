@@ -0,0 +1,23 @@
+#version 450
+
+// Per-instance attributes of a CJellySprite.  The columns of a 2x3 affine
+// transform map the unit quad to clip space.
+layout(location = 0) in vec2 inAxisX;
+layout(location = 1) in vec2 inAxisY;
+layout(location = 2) in vec2 inTranslation;
+layout(location = 3) in vec4 inUvRect;
+layout(location = 4) in uint inTextureIndex;
+
+// Pass the texture coordinate and texture slot to the fragment shader.
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) flat out uint fragTextureIndex;
+
+void main() {
+    // The quad is a triangle strip generated from the vertex index, rather than
+    // read from a vertex buffer: (0, 0), (1, 0), (0, 1), (1, 1).
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+    vec2 p = inTranslation + inAxisX * corner.x + inAxisY * corner.y;
+    gl_Position = vec4(p, 0.0, 1.0);
+    fragTexCoord = mix(inUvRect.xy, inUvRect.zw, corner);
+    fragTextureIndex = inTextureIndex;
+}
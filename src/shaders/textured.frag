@@ -1,8 +1,16 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
 layout(location = 0) in vec2 fragTexCoord;
-layout(set = 0, binding = 0) uniform sampler2D texSampler;
+
+// The bindless texture table, and the slot of the texture to draw with.
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+layout(push_constant) uniform PushConstants {
+    uint textureIndex;
+} pc;
+
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
+    outColor = texture(textures[pc.textureIndex], fragTexCoord);
 }
@@ -0,0 +1,924 @@
+/**
+ * @file texturecache.c
+ * @brief CJelly texture cache implementation.
+ *
+ * @details
+ * Textures are kept in a chained hash table keyed by an FNV-1a hash of their
+ * size, format, and data (the encoded blocks, for a compressed texture), and
+ * every path that has been acquired is kept in a second table that points at
+ * its texture.  A texture links the entries of its own paths, so that they can
+ * be removed with it.
+ *
+ * Resident textures are also kept in a doubly linked list, most recently used
+ * first, so the eviction candidate is always at the tail.  Since the list is
+ * ordered by last use, eviction stops at the first texture that a frame still
+ * on the GPU may be reading.
+ *
+ * Files are never loaded with the mutex held.  Evicted textures that are used
+ * again are only flagged by cjelly_texture_cache_use(), which is called while
+ * commands are recorded, and are reloaded by
+ * cjelly_texture_cache_next_frame(), which holds a reference to each of them
+ * while it loads its file.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/texturecache.h>
+#include <cjelly/bctexturecache.h>
+#include <cjelly/cachefile.h>
+#include <cjelly/format/image.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Initial number of buckets of each hash table.
+ */
+#define INITIAL_BUCKET_COUNT 64
+
+/**
+ * @brief The format of every texture that is not block-compressed.
+ */
+#define TEXTURE_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+
+/**
+ * @brief Size of the buffer of a path in the cache directory.
+ */
+#define CACHE_PATH_SIZE 4096
+
+/**
+ * @brief Marks a heap index that is not known yet.
+ */
+#define UNKNOWN_HEAP UINT32_MAX
+
+
+/**
+ * @brief The contents of an image file, ready to be uploaded.
+ */
+typedef struct {
+  uint32_t width;                        /**< Width in pixels */
+  uint32_t height;                       /**< Height in pixels */
+  VkFormat format;                       /**< Format of the image */
+  uint32_t mipLevels;                    /**< Number of levels in `data`, or 0 if only the first level is, and the rest are blitted */
+  const VkDeviceSize * levelOffsets;     /**< Offset of each level, if mipLevels is not 0 */
+  const void * data;                     /**< The data to upload */
+  VkDeviceSize size;                     /**< Size of `data` in bytes */
+  unsigned char * pixels;                /**< The RGBA pixels, or NULL */
+  CJellyBcTextureCache * compressed;     /**< The BC texture cache file, or NULL */
+} TextureSource;
+
+
+/**
+ * @brief A path that has been acquired.
+ */
+typedef struct PathEntry {
+  struct PathEntry * next;    /**< Next entry in the same bucket */
+  struct PathEntry * sibling; /**< Next path of the same texture */
+  uint64_t hash;              /**< Hash of the path */
+  char * path;                /**< The path */
+  CJellyTexture * texture;    /**< The texture that the file contains */
+} PathEntry;
+
+
+struct CJellyTexture {
+  CJellyTexture * next;          /**< Next texture in the same bucket */
+  CJellyTexture * newer;         /**< More recently used resident texture */
+  CJellyTexture * older;         /**< Less recently used resident texture */
+  PathEntry * paths;             /**< The paths that refer to the texture */
+  uint64_t hash;                 /**< Hash of the size and pixels */
+  uint32_t width;                /**< Width in pixels */
+  uint32_t height;               /**< Height in pixels */
+  VkFormat format;               /**< Format of the image */
+  uint32_t refCount;             /**< Number of references held */
+  bool resident;                 /**< Whether the GPU objects below exist */
+  bool requested;                /**< Used while evicted, and due to be reloaded */
+  uint64_t lastUsedSerial;       /**< Latest serial of a frame that used it */
+  VkImage image;                 /**< The image */
+  CJellyGpuAllocation * memory;  /**< Memory of the image */
+  VkImageView view;              /**< View of every mip level */
+  uint32_t tableIndex;           /**< Slot in the bindless table */
+  CJellyUploadTicket ticket;     /**< The upload of the pixels */
+};
+
+
+struct CJellyTextureCache {
+  VkDevice device;                    /**< The logical device */
+  CJellyGpuAllocator * allocator;     /**< Allocator of the images' memory */
+  CJellyUploader * uploader;          /**< Queue of the uploads */
+  CJellyBindlessTable * table;        /**< Table of the textures' slots */
+  VkSampler sampler;                  /**< Sampler of every texture */
+  bool mipmaps;                       /**< Whether the format can be blitted */
+  VkFilter mipmapFilter;              /**< Filter of the mip chain blits */
+  bool compress;                      /**< Whether a BC format can be sampled */
+  VkFormat opaqueFormat;              /**< BC format of images without alpha */
+  VkFormat alphaFormat;               /**< BC format of images with alpha */
+  VkDeviceSize budget;                /**< Configured budget, or 0 */
+  uint64_t completedSerial;           /**< Serial up to which frames finished */
+  uint32_t heapIndex;                 /**< Heap of the images, or UNKNOWN_HEAP */
+
+  CJellyTexture * * textureBuckets;   /**< Textures by content */
+  size_t textureBucketCount;          /**< Number of buckets, a power of two */
+  size_t textureCount;                /**< Number of textures */
+  PathEntry * * pathBuckets;          /**< Paths */
+  size_t pathBucketCount;             /**< Number of buckets, a power of two */
+  size_t pathCount;                   /**< Number of paths */
+
+  CJellyTexture * newest;             /**< Most recently used resident texture */
+  CJellyTexture * oldest;             /**< Least recently used resident texture */
+  size_t residentCount;               /**< Number of resident textures */
+  VkDeviceSize residentBytes;         /**< Memory of the resident textures */
+  size_t requestCount;                /**< Number of requested textures */
+  uint64_t evictions;                 /**< Number of evictions */
+  uint64_t restreams;                 /**< Number of textures reloaded */
+
+  pthread_mutex_t mutex;              /**< Protects all of the fields above */
+};
+
+
+//
+// === HELPERS ===
+//
+
+/**
+ * @brief Hashes the size, format, and data of an image.
+ */
+static uint64_t hash_content(const TextureSource * source) {
+  uint64_t hash = cjelly_hash_bytes(&source->width, sizeof(source->width), CJELLY_HASH_SEED);
+  hash = cjelly_hash_bytes(&source->height, sizeof(source->height), hash);
+  hash = cjelly_hash_bytes(&source->format, sizeof(source->format), hash);
+  return cjelly_hash_bytes(source->data, (size_t)source->size, hash);
+}
+
+
+/**
+ * @brief The number of levels in a full mip chain, down to 1x1.
+ */
+static uint32_t mip_level_count(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  for (uint32_t size = width > height ? width : height; size > 1; size >>= 1) {
+    ++levels;
+  }
+  return levels;
+}
+
+
+/**
+ * @brief Loads an image file as tightly packed RGBA pixels.
+ */
+static CJellyTextureCacheError load_pixels(const char * path, unsigned char * * outPixels, uint32_t * outWidth, uint32_t * outHeight) {
+  CJellyFormatImage * image;
+  if (cjelly_format_image_load(path, &image) != CJELLY_FORMAT_IMAGE_SUCCESS) {
+    return CJELLY_TEXTURE_CACHE_ERR_LOAD;
+  }
+
+  CJellyFormatImageRaw * raw = image->raw;
+  int channels = raw->channels;
+  if (!raw->data || raw->width <= 0 || raw->height <= 0
+      || (channels != 3 && channels != 4) || raw->bitdepth != (size_t)channels * 8
+      || raw->data_size < (size_t)raw->width * raw->height * channels) {
+    cjelly_format_image_free(image);
+    return CJELLY_TEXTURE_CACHE_ERR_FORMAT;
+  }
+
+  size_t pixelCount = (size_t)raw->width * raw->height;
+  unsigned char * pixels = malloc(pixelCount * 4);
+  if (!pixels) {
+    cjelly_format_image_free(image);
+    return CJELLY_TEXTURE_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  for (size_t i = 0; i < pixelCount; ++i) {
+    pixels[i * 4 + 0] = raw->data[i * channels + 0];
+    pixels[i * 4 + 1] = raw->data[i * channels + 1];
+    pixels[i * 4 + 2] = raw->data[i * channels + 2];
+    pixels[i * 4 + 3] = channels == 4 ? raw->data[i * channels + 3] : 255;
+  }
+
+  *outWidth = (uint32_t)raw->width;
+  *outHeight = (uint32_t)raw->height;
+  *outPixels = pixels;
+  cjelly_format_image_free(image);
+  return CJELLY_TEXTURE_CACHE_SUCCESS;
+}
+
+
+/**
+ * @brief Loads an image file through the BC texture cache.
+ *
+ * @return true if the image was loaded compressed.
+ */
+static bool load_compressed(CJellyTextureCache * cache, const char * path, TextureSource * source) {
+  char name[64];
+  char cachePath[CACHE_PATH_SIZE];
+  if (!cjelly_bc_texture_cache_name(path, name, sizeof(name))
+      || cjelly_cache_file_path(name, cachePath, sizeof(cachePath)) != CJELLY_CACHE_FILE_SUCCESS
+      || cjelly_bc_texture_cache_load_image(path, cachePath, cache->opaqueFormat, cache->alphaFormat, &source->compressed) != CJELLY_BC_TEXTURE_CACHE_SUCCESS) {
+    source->compressed = NULL;
+    return false;
+  }
+
+  const CJellyBcTexture * texture = cjelly_bc_texture_cache_texture(source->compressed);
+  source->width = texture->width;
+  source->height = texture->height;
+  source->format = texture->format;
+  source->mipLevels = texture->mipLevels;
+  source->levelOffsets = texture->levelOffsets;
+  source->data = texture->data;
+  source->size = texture->size;
+  return true;
+}
+
+
+/**
+ * @brief Loads an image file, compressed if the device allows it, and as RGBA
+ * pixels otherwise.
+ */
+static CJellyTextureCacheError load_source(CJellyTextureCache * cache, const char * path, TextureSource * source) {
+  memset(source, 0, sizeof(TextureSource));
+  if (cache->compress && load_compressed(cache, path, source)) {
+    return CJELLY_TEXTURE_CACHE_SUCCESS;
+  }
+
+  CJellyTextureCacheError err = load_pixels(path, &source->pixels, &source->width, &source->height);
+  if (err != CJELLY_TEXTURE_CACHE_SUCCESS) {
+    return err;
+  }
+  source->format = TEXTURE_FORMAT;
+  source->data = source->pixels;
+  source->size = (VkDeviceSize)source->width * source->height * 4;
+  return CJELLY_TEXTURE_CACHE_SUCCESS;
+}
+
+
+/**
+ * @brief Frees what load_source() loaded.
+ */
+static void free_source(TextureSource * source) {
+  free(source->pixels);
+  cjelly_bc_texture_cache_close(source->compressed);
+}
+
+
+//
+// === HASH TABLES ===
+//
+
+/**
+ * @brief Finds the entry of a path.
+ */
+static PathEntry * find_path(CJellyTextureCache * cache, const char * path, uint64_t hash) {
+  for (PathEntry * entry = cache->pathBuckets[hash & (cache->pathBucketCount - 1)]; entry; entry = entry->next) {
+    if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * @brief Finds the texture with the given content.
+ */
+static CJellyTexture * find_texture(CJellyTextureCache * cache, uint64_t hash, const TextureSource * source) {
+  for (CJellyTexture * texture = cache->textureBuckets[hash & (cache->textureBucketCount - 1)]; texture; texture = texture->next) {
+    if (texture->hash == hash && texture->width == source->width && texture->height == source->height && texture->format == source->format) {
+      return texture;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * @brief Doubles the buckets of the path table.  On failure, the table keeps
+ * its buckets, which only makes it slower.
+ */
+static void grow_paths(CJellyTextureCache * cache) {
+  size_t bucketCount = cache->pathBucketCount * 2;
+  PathEntry * * buckets = calloc(bucketCount, sizeof(PathEntry *));
+  if (!buckets) {
+    return;
+  }
+  for (size_t i = 0; i < cache->pathBucketCount; ++i) {
+    PathEntry * entry = cache->pathBuckets[i];
+    while (entry) {
+      PathEntry * next = entry->next;
+      size_t bucket = entry->hash & (bucketCount - 1);
+      entry->next = buckets[bucket];
+      buckets[bucket] = entry;
+      entry = next;
+    }
+  }
+  free(cache->pathBuckets);
+  cache->pathBuckets = buckets;
+  cache->pathBucketCount = bucketCount;
+}
+
+
+/**
+ * @brief Doubles the buckets of the texture table.  On failure, the table
+ * keeps its buckets, which only makes it slower.
+ */
+static void grow_textures(CJellyTextureCache * cache) {
+  size_t bucketCount = cache->textureBucketCount * 2;
+  CJellyTexture * * buckets = calloc(bucketCount, sizeof(CJellyTexture *));
+  if (!buckets) {
+    return;
+  }
+  for (size_t i = 0; i < cache->textureBucketCount; ++i) {
+    CJellyTexture * texture = cache->textureBuckets[i];
+    while (texture) {
+      CJellyTexture * next = texture->next;
+      size_t bucket = texture->hash & (bucketCount - 1);
+      texture->next = buckets[bucket];
+      buckets[bucket] = texture;
+      texture = next;
+    }
+  }
+  free(cache->textureBuckets);
+  cache->textureBuckets = buckets;
+  cache->textureBucketCount = bucketCount;
+}
+
+
+/**
+ * @brief Adds a path to a texture.
+ */
+static CJellyTextureCacheError add_path(CJellyTextureCache * cache, CJellyTexture * texture, const char * path, uint64_t hash) {
+  PathEntry * entry = malloc(sizeof(PathEntry));
+  if (!entry) {
+    return CJELLY_TEXTURE_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  size_t length = strlen(path) + 1;
+  entry->path = malloc(length);
+  if (!entry->path) {
+    free(entry);
+    return CJELLY_TEXTURE_CACHE_ERR_OUT_OF_MEMORY;
+  }
+  memcpy(entry->path, path, length);
+  entry->hash = hash;
+  entry->texture = texture;
+  entry->sibling = texture->paths;
+  texture->paths = entry;
+
+  size_t bucket = hash & (cache->pathBucketCount - 1);
+  entry->next = cache->pathBuckets[bucket];
+  cache->pathBuckets[bucket] = entry;
+  if (++cache->pathCount > cache->pathBucketCount) {
+    grow_paths(cache);
+  }
+  return CJELLY_TEXTURE_CACHE_SUCCESS;
+}
+
+
+/**
+ * @brief Removes a texture that is not resident, and its paths, from the
+ * tables, and frees it.
+ */
+static void free_texture(CJellyTextureCache * cache, CJellyTexture * texture) {
+  while (texture->paths) {
+    PathEntry * entry = texture->paths;
+    texture->paths = entry->sibling;
+
+    PathEntry * * link = &cache->pathBuckets[entry->hash & (cache->pathBucketCount - 1)];
+    while (*link != entry) {
+      link = &(*link)->next;
+    }
+    *link = entry->next;
+    --cache->pathCount;
+
+    free(entry->path);
+    free(entry);
+  }
+
+  CJellyTexture * * link = &cache->textureBuckets[texture->hash & (cache->textureBucketCount - 1)];
+  while (*link != texture) {
+    link = &(*link)->next;
+  }
+  *link = texture->next;
+  --cache->textureCount;
+
+  free(texture);
+}
+
+
+//
+// === RESIDENCY ===
+//
+
+/**
+ * @brief Removes a resident texture from the recency list.
+ */
+static void unlink_resident(CJellyTextureCache * cache, CJellyTexture * texture) {
+  if (texture->newer) {
+    texture->newer->older = texture->older;
+  }
+  else {
+    cache->newest = texture->older;
+  }
+  if (texture->older) {
+    texture->older->newer = texture->newer;
+  }
+  else {
+    cache->oldest = texture->newer;
+  }
+  texture->newer = texture->older = NULL;
+}
+
+
+/**
+ * @brief Puts a resident texture at the front of the recency list.
+ */
+static void push_newest(CJellyTextureCache * cache, CJellyTexture * texture) {
+  texture->newer = NULL;
+  texture->older = cache->newest;
+  if (cache->newest) {
+    cache->newest->newer = texture;
+  }
+  else {
+    cache->oldest = texture;
+  }
+  cache->newest = texture;
+}
+
+
+/**
+ * @brief The most memory that resident textures may use right now.
+ */
+static VkDeviceSize current_budget(CJellyTextureCache * cache) {
+  VkDeviceSize budget = cache->budget ? cache->budget : UINT64_MAX;
+  if (cache->heapIndex != UNKNOWN_HEAP) {
+    CJellyGpuHeapStats stats;
+    cjelly_gpu_allocator_get_heap_stats(cache->allocator, cache->heapIndex, &stats);
+
+    // The memory that the rest of the application uses is not the cache's to
+    // take.
+    VkDeviceSize others = stats.usage > cache->residentBytes ? stats.usage - cache->residentBytes : 0;
+    VkDeviceSize available = stats.budget > others ? stats.budget - others : 0;
+    if (available < budget) {
+      budget = available;
+    }
+  }
+  return budget;
+}
+
+
+/**
+ * @brief Destroys the GPU objects of a resident texture.
+ */
+static void evict(CJellyTextureCache * cache, CJellyTexture * texture) {
+  unlink_resident(cache, texture);
+  cjelly_bindless_table_remove(cache->table, texture->tableIndex);
+  vkDestroyImageView(cache->device, texture->view, NULL);
+  vkDestroyImage(cache->device, texture->image, NULL);
+  cache->residentBytes -= texture->memory->size;
+  --cache->residentCount;
+  cjelly_gpu_allocator_free(cache->allocator, texture->memory);
+  texture->memory = NULL;
+  texture->resident = false;
+}
+
+
+/**
+ * @brief Evicts the least recently used textures until `incoming` more bytes
+ * fit in the budget, or until no more textures may be evicted.
+ */
+static void evict_to_fit(CJellyTextureCache * cache, VkDeviceSize incoming) {
+  VkDeviceSize budget = current_budget(cache);
+  while (cache->oldest && cache->residentBytes + incoming > budget) {
+    CJellyTexture * texture = cache->oldest;
+
+    // Every other texture was used more recently, so none of them may be
+    // evicted either.  (Frames of different windows are recorded
+    // concurrently, so a more recent use can have an older serial; stopping
+    // here then only evicts less than it could.)
+    if (texture->lastUsedSerial > cache->completedSerial
+        || !cjelly_uploader_is_ready(cache->uploader, texture->ticket)) {
+      break;
+    }
+
+    evict(cache, texture);
+    ++cache->evictions;
+    if (!texture->refCount) {
+      free_texture(cache, texture);
+    }
+  }
+}
+
+
+/**
+ * @brief Creates the GPU objects of a texture, and queues the upload of its
+ * data.
+ */
+static CJellyTextureCacheError make_resident(CJellyTextureCache * cache, CJellyTexture * texture, const TextureSource * source) {
+  // A mip chain loaded from the file is uploaded as it is, and is otherwise
+  // blitted from the first level, if the format allows it.
+  uint32_t mipLevels = source->mipLevels;
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  if (!mipLevels) {
+    mipLevels = cache->mipmaps ? mip_level_count(texture->width, texture->height) : 1;
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+
+  VkImageCreateInfo imageInfo = {0};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = texture->width;
+  imageInfo.extent.height = texture->height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = mipLevels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = source->format;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = usage;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (vkCreateImage(cache->device, &imageInfo, NULL, &texture->image) != VK_SUCCESS) {
+    return CJELLY_TEXTURE_CACHE_ERR_VULKAN;
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(cache->device, texture->image, &requirements);
+
+  // Make room first, so that the memory of the evicted textures can be
+  // reused.
+  evict_to_fit(cache, requirements.size);
+
+  CJellyTextureCacheError err = CJELLY_TEXTURE_CACHE_ERR_VULKAN;
+  uint32_t memoryType;
+  if (!cjelly_gpu_allocator_find_memory_type(cache->allocator, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memoryType)) {
+    goto ERROR_DESTROY_IMAGE;
+  }
+  if (cjelly_gpu_allocator_alloc(cache->allocator, &requirements, memoryType, CJELLY_GPU_RESOURCE_IMAGE, &texture->memory) != VK_SUCCESS) {
+    goto ERROR_DESTROY_IMAGE;
+  }
+  if (vkBindImageMemory(cache->device, texture->image, texture->memory->memory, texture->memory->offset) != VK_SUCCESS) {
+    goto ERROR_FREE_MEMORY;
+  }
+
+  VkImageViewCreateInfo viewInfo = {0};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = texture->image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = source->format;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = mipLevels;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+  if (vkCreateImageView(cache->device, &viewInfo, NULL, &texture->view) != VK_SUCCESS) {
+    goto ERROR_FREE_MEMORY;
+  }
+
+  if (cjelly_bindless_table_add(cache->table, texture->view, cache->sampler, &texture->tableIndex) != CJELLY_BINDLESS_SUCCESS) {
+    err = CJELLY_TEXTURE_CACHE_ERR_TABLE_FULL;
+    goto ERROR_DESTROY_VIEW;
+  }
+
+  VkResult result = source->mipLevels
+    ? cjelly_uploader_upload_image_levels(cache->uploader, texture->image, texture->width, texture->height, mipLevels, source->levelOffsets, source->data, source->size, &texture->ticket)
+    : cjelly_uploader_upload_image_mipmapped(cache->uploader, texture->image, texture->width, texture->height, mipLevels, cache->mipmapFilter, source->data, source->size, &texture->ticket);
+  if (result != VK_SUCCESS) {
+    goto ERROR_REMOVE_SLOT;
+  }
+
+  texture->resident = true;
+  push_newest(cache, texture);
+  ++cache->residentCount;
+  cache->residentBytes += texture->memory->size;
+  cache->heapIndex = cjelly_gpu_allocator_memory_type_heap(cache->allocator, memoryType);
+  return CJELLY_TEXTURE_CACHE_SUCCESS;
+
+  // Error handling.
+ERROR_REMOVE_SLOT:
+  cjelly_bindless_table_remove(cache->table, texture->tableIndex);
+
+ERROR_DESTROY_VIEW:
+  vkDestroyImageView(cache->device, texture->view, NULL);
+
+ERROR_FREE_MEMORY:
+  cjelly_gpu_allocator_free(cache->allocator, texture->memory);
+  texture->memory = NULL;
+
+ERROR_DESTROY_IMAGE:
+  vkDestroyImage(cache->device, texture->image, NULL);
+  return err;
+}
+
+
+/**
+ * @brief Drops a reference.  The mutex must be held.
+ */
+static void release_locked(CJellyTextureCache * cache, CJellyTexture * texture) {
+  // A resident texture stays cached until it is evicted.
+  if (--texture->refCount == 0 && !texture->resident && !texture->requested) {
+    free_texture(cache, texture);
+  }
+}
+
+
+//
+// === PUBLIC API ===
+//
+
+CJellyTextureCache * cjelly_texture_cache_create(VkPhysicalDevice physicalDevice, VkDevice device, CJellyGpuAllocator * allocator, CJellyUploader * uploader, CJellyBindlessTable * table, VkSampler sampler, VkDeviceSize budget) {
+  CJellyTextureCache * cache = malloc(sizeof(CJellyTextureCache));
+  if (!cache) {
+    goto ERROR_RETURN;
+  }
+  memset(cache, 0, sizeof(CJellyTextureCache));
+  cache->device = device;
+  cache->allocator = allocator;
+  cache->uploader = uploader;
+  cache->table = table;
+  cache->sampler = sampler;
+  cache->budget = budget;
+  cache->heapIndex = UNKNOWN_HEAP;
+
+  // Mip chains are blitted, which the format must support.
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, TEXTURE_FORMAT, &properties);
+  VkFormatFeatureFlags features = properties.optimalTilingFeatures;
+  cache->mipmaps = (features & VK_FORMAT_FEATURE_BLIT_SRC_BIT) && (features & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+  cache->mipmapFilter = (features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+    ? VK_FILTER_LINEAR
+    : VK_FILTER_NEAREST;
+  cache->compress = cjelly_bc_texture_choose_formats(physicalDevice, &cache->opaqueFormat, &cache->alphaFormat);
+
+  cache->textureBuckets = calloc(INITIAL_BUCKET_COUNT, sizeof(CJellyTexture *));
+  if (!cache->textureBuckets) {
+    goto ERROR_FREE_CACHE;
+  }
+  cache->textureBucketCount = INITIAL_BUCKET_COUNT;
+
+  cache->pathBuckets = calloc(INITIAL_BUCKET_COUNT, sizeof(PathEntry *));
+  if (!cache->pathBuckets) {
+    goto ERROR_FREE_TEXTURE_BUCKETS;
+  }
+  cache->pathBucketCount = INITIAL_BUCKET_COUNT;
+
+  if (pthread_mutex_init(&cache->mutex, NULL) != 0) {
+    goto ERROR_FREE_PATH_BUCKETS;
+  }
+
+  return cache;
+
+  // Error handling.
+ERROR_FREE_PATH_BUCKETS:
+  free(cache->pathBuckets);
+
+ERROR_FREE_TEXTURE_BUCKETS:
+  free(cache->textureBuckets);
+
+ERROR_FREE_CACHE:
+  free(cache);
+
+ERROR_RETURN:
+  return NULL;
+}
+
+
+void cjelly_texture_cache_destroy(CJellyTextureCache * cache) {
+  if (!cache) {
+    return;
+  }
+
+  for (size_t i = 0; i < cache->textureBucketCount; ++i) {
+    CJellyTexture * texture = cache->textureBuckets[i];
+    while (texture) {
+      CJellyTexture * next = texture->next;
+      if (texture->resident) {
+        evict(cache, texture);
+      }
+      while (texture->paths) {
+        PathEntry * entry = texture->paths;
+        texture->paths = entry->sibling;
+        free(entry->path);
+        free(entry);
+      }
+      free(texture);
+      texture = next;
+    }
+  }
+  free(cache->textureBuckets);
+  free(cache->pathBuckets);
+
+  pthread_mutex_destroy(&cache->mutex);
+  free(cache);
+}
+
+
+CJellyTextureCacheError cjelly_texture_cache_acquire(CJellyTextureCache * cache, const char * path, CJellyTexture * * outTexture) {
+  uint64_t pathHash = cjelly_hash_bytes(path, strlen(path), CJELLY_HASH_SEED);
+
+  pthread_mutex_lock(&cache->mutex);
+  PathEntry * entry = find_path(cache, path, pathHash);
+  if (entry) {
+    ++entry->texture->refCount;
+    *outTexture = entry->texture;
+    pthread_mutex_unlock(&cache->mutex);
+    return CJELLY_TEXTURE_CACHE_SUCCESS;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+
+  // Load the file without holding the lock.
+  TextureSource source;
+  CJellyTextureCacheError err = load_source(cache, path, &source);
+  if (err != CJELLY_TEXTURE_CACHE_SUCCESS) {
+    return err;
+  }
+  uint64_t contentHash = hash_content(&source);
+
+  pthread_mutex_lock(&cache->mutex);
+
+  // Another thread may have acquired the same path in the meantime, or
+  // another path with the same content may already be loaded.
+  CJellyTexture * texture = NULL;
+  entry = find_path(cache, path, pathHash);
+  if (entry) {
+    texture = entry->texture;
+  }
+  else if ((texture = find_texture(cache, contentHash, &source))) {
+    if ((err = add_path(cache, texture, path, pathHash)) != CJELLY_TEXTURE_CACHE_SUCCESS) {
+      goto CLEANUP;
+    }
+  }
+  else {
+    texture = calloc(1, sizeof(CJellyTexture));
+    if (!texture) {
+      err = CJELLY_TEXTURE_CACHE_ERR_OUT_OF_MEMORY;
+      goto CLEANUP;
+    }
+    texture->hash = contentHash;
+    texture->width = source.width;
+    texture->height = source.height;
+    texture->format = source.format;
+
+    if ((err = make_resident(cache, texture, &source)) != CJELLY_TEXTURE_CACHE_SUCCESS) {
+      free(texture);
+      texture = NULL;
+      goto CLEANUP;
+    }
+
+    size_t bucket = contentHash & (cache->textureBucketCount - 1);
+    texture->next = cache->textureBuckets[bucket];
+    cache->textureBuckets[bucket] = texture;
+    if (++cache->textureCount > cache->textureBucketCount) {
+      grow_textures(cache);
+    }
+
+    if ((err = add_path(cache, texture, path, pathHash)) != CJELLY_TEXTURE_CACHE_SUCCESS) {
+      // The texture stays cached, without a path, until it is evicted.
+      texture = NULL;
+      goto CLEANUP;
+    }
+  }
+
+  ++texture->refCount;
+  *outTexture = texture;
+
+CLEANUP:
+  pthread_mutex_unlock(&cache->mutex);
+  free_source(&source);
+  return err;
+}
+
+
+void cjelly_texture_cache_release(CJellyTextureCache * cache, CJellyTexture * texture) {
+  if (!texture) {
+    return;
+  }
+  pthread_mutex_lock(&cache->mutex);
+  release_locked(cache, texture);
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+
+bool cjelly_texture_cache_use(CJellyTextureCache * cache, CJellyTexture * texture, uint64_t serial, uint32_t * outIndex) {
+  pthread_mutex_lock(&cache->mutex);
+  if (serial > texture->lastUsedSerial) {
+    texture->lastUsedSerial = serial;
+  }
+
+  bool ready = false;
+  if (texture->resident) {
+    if (cache->newest != texture) {
+      unlink_resident(cache, texture);
+      push_newest(cache, texture);
+    }
+    ready = cjelly_uploader_is_ready(cache->uploader, texture->ticket);
+    if (ready) {
+      *outIndex = texture->tableIndex;
+    }
+  }
+  else if (!texture->requested) {
+    texture->requested = true;
+    ++cache->requestCount;
+  }
+
+  pthread_mutex_unlock(&cache->mutex);
+  return ready;
+}
+
+
+void cjelly_texture_cache_next_frame(CJellyTextureCache * cache, uint64_t completedSerial) {
+  pthread_mutex_lock(&cache->mutex);
+  cache->completedSerial = completedSerial;
+
+  // Take a reference to every requested texture, so that none of them is
+  // freed while their files are loaded without the lock.
+  CJellyTexture * * requests = NULL;
+  const char * * paths = NULL;
+  size_t requestCount = 0;
+  if (cache->requestCount) {
+    requests = malloc(sizeof(CJellyTexture *) * cache->requestCount);
+    paths = malloc(sizeof(const char *) * cache->requestCount);
+    for (size_t i = 0; i < cache->textureBucketCount; ++i) {
+      for (CJellyTexture * texture = cache->textureBuckets[i]; texture; texture = texture->next) {
+        if (!texture->requested) {
+          continue;
+        }
+        // If the lists could not be allocated, the textures are requested
+        // again when they are next used.
+        texture->requested = false;
+        if (requests && paths && texture->paths) {
+          ++texture->refCount;
+          requests[requestCount] = texture;
+          paths[requestCount++] = texture->paths->path;
+        }
+      }
+    }
+    cache->requestCount = 0;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+
+  for (size_t i = 0; i < requestCount; ++i) {
+    TextureSource source;
+    CJellyTextureCacheError err = load_source(cache, paths[i], &source);
+
+    pthread_mutex_lock(&cache->mutex);
+    CJellyTexture * texture = requests[i];
+    if (err == CJELLY_TEXTURE_CACHE_SUCCESS && !texture->resident
+        && source.width == texture->width && source.height == texture->height
+        && source.format == texture->format
+        && make_resident(cache, texture, &source) == CJELLY_TEXTURE_CACHE_SUCCESS) {
+      ++cache->restreams;
+    }
+    release_locked(cache, texture);
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (err == CJELLY_TEXTURE_CACHE_SUCCESS) {
+      free_source(&source);
+    }
+  }
+  free(requests);
+  free(paths);
+
+  pthread_mutex_lock(&cache->mutex);
+  evict_to_fit(cache, 0);
+  pthread_mutex_unlock(&cache->mutex);
+
+  cjelly_uploader_flush(cache->uploader, NULL);
+}
+
+
+void cjelly_texture_cache_set_budget(CJellyTextureCache * cache, VkDeviceSize budget) {
+  pthread_mutex_lock(&cache->mutex);
+  cache->budget = budget;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+
+void cjelly_texture_cache_get_stats(CJellyTextureCache * cache, CJellyTextureCacheStats * outStats) {
+  pthread_mutex_lock(&cache->mutex);
+  outStats->textureCount = cache->textureCount;
+  outStats->residentCount = cache->residentCount;
+  outStats->residentBytes = cache->residentBytes;
+  outStats->budget = current_budget(cache);
+  outStats->evictions = cache->evictions;
+  outStats->restreams = cache->restreams;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+
+const char * cjelly_texture_cache_strerror(CJellyTextureCacheError err) {
+  switch (err) {
+    case CJELLY_TEXTURE_CACHE_SUCCESS:
+      return "No error";
+    case CJELLY_TEXTURE_CACHE_ERR_OUT_OF_MEMORY:
+      return "Out of memory";
+    case CJELLY_TEXTURE_CACHE_ERR_LOAD:
+      return "The image file could not be loaded";
+    case CJELLY_TEXTURE_CACHE_ERR_FORMAT:
+      return "The image is not 8-bit RGB or RGBA";
+    case CJELLY_TEXTURE_CACHE_ERR_VULKAN:
+      return "The image could not be created or uploaded";
+    case CJELLY_TEXTURE_CACHE_ERR_TABLE_FULL:
+      return "The bindless table is full";
+    default:
+      return "Unknown error";
+  }
+}
@@ -0,0 +1,209 @@
+/**
+ * @file threadpool.c
+ * @brief CJelly worker thread pool implementation.
+ *
+ * @details
+ * The pool is built on POSIX threads (provided by winpthreads on MSYS2).  The
+ * task queue is a growable ring buffer protected by a single mutex, which is
+ * more than adequate for the coarse-grained jobs that the library submits.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/threadpool.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Initial capacity of the task queue.
+ */
+#define INITIAL_QUEUE_CAPACITY 64
+
+
+/**
+ * @brief A queued task.
+ */
+typedef struct {
+  CJellyThreadPoolTask task; /**< The function to run */
+  void * arg;                /**< The argument passed to the function */
+} ThreadPoolJob;
+
+
+struct CJellyThreadPool {
+  pthread_t * threads;         /**< The worker threads */
+  int thread_count;            /**< Number of worker threads */
+  ThreadPoolJob * queue;       /**< Ring buffer of queued tasks */
+  int queue_capacity;          /**< Allocated capacity of the ring buffer */
+  int queue_head;              /**< Index of the next task to run */
+  int queue_count;             /**< Number of queued tasks */
+  int active_count;            /**< Number of tasks currently running */
+  bool shutdown;               /**< Set when the workers should exit */
+  pthread_mutex_t mutex;       /**< Protects all of the fields above */
+  pthread_cond_t work_ready;   /**< Signaled when a task is queued */
+  pthread_cond_t work_done;    /**< Signaled when the pool becomes idle */
+};
+
+
+int cjelly_thread_pool_hardware_concurrency(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+#endif
+}
+
+
+/**
+ * @brief The main loop of each worker thread.
+ */
+static void * worker_main(void * arg) {
+  CJellyThreadPool * pool = (CJellyThreadPool *)arg;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (!pool->queue_count && !pool->shutdown) {
+      pthread_cond_wait(&pool->work_ready, &pool->mutex);
+    }
+    if (!pool->queue_count) {
+      // The pool is shutting down and there is nothing left to do.
+      break;
+    }
+
+    ThreadPoolJob job = pool->queue[pool->queue_head];
+    pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
+    pool->queue_count--;
+    pool->active_count++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    job.task(job.arg);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->active_count--;
+    if (!pool->queue_count && !pool->active_count) {
+      pthread_cond_broadcast(&pool->work_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+
+CJellyThreadPool * cjelly_thread_pool_create(int thread_count) {
+  if (thread_count <= 0) {
+    thread_count = cjelly_thread_pool_hardware_concurrency();
+  }
+
+  CJellyThreadPool * pool = (CJellyThreadPool *)calloc(1, sizeof(CJellyThreadPool));
+  if (!pool) { return NULL; }
+
+  pool->queue_capacity = INITIAL_QUEUE_CAPACITY;
+  pool->queue = (ThreadPoolJob *)malloc(pool->queue_capacity * sizeof(ThreadPoolJob));
+  pool->threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+  if (!pool->queue || !pool->threads) { goto ERROR_FREE; }
+
+  if (pthread_mutex_init(&pool->mutex, NULL)) { goto ERROR_FREE; }
+  if (pthread_cond_init(&pool->work_ready, NULL)) { goto ERROR_MUTEX; }
+  if (pthread_cond_init(&pool->work_done, NULL)) { goto ERROR_WORK_READY; }
+
+  for (int i = 0; i < thread_count; ++i) {
+    if (pthread_create(&pool->threads[i], NULL, worker_main, pool)) {
+      // Keep the threads that were started, so that they can be joined.
+      if (!i) { goto ERROR_WORK_DONE; }
+      break;
+    }
+    pool->thread_count++;
+  }
+  return pool;
+
+  // Error handling.
+ERROR_WORK_DONE:
+  pthread_cond_destroy(&pool->work_done);
+ERROR_WORK_READY:
+  pthread_cond_destroy(&pool->work_ready);
+ERROR_MUTEX:
+  pthread_mutex_destroy(&pool->mutex);
+ERROR_FREE:
+  free(pool->threads);
+  free(pool->queue);
+  free(pool);
+  return NULL;
+}
+
+
+void cjelly_thread_pool_destroy(CJellyThreadPool * pool) {
+  if (!pool) { return; }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int i = 0; i < pool->thread_count; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->work_done);
+  pthread_cond_destroy(&pool->work_ready);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->threads);
+  free(pool->queue);
+  free(pool);
+}
+
+
+int cjelly_thread_pool_size(const CJellyThreadPool * pool) {
+  return pool ? pool->thread_count : 0;
+}
+
+
+bool cjelly_thread_pool_submit(CJellyThreadPool * pool, CJellyThreadPoolTask task, void * arg) {
+  if (!pool || !task) { return false; }
+
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->queue_count >= pool->queue_capacity) {
+    // Grow the ring buffer, unwrapping the queued tasks into the new array.
+    int capacity = pool->queue_capacity * 2;
+    ThreadPoolJob * queue = (ThreadPoolJob *)malloc(capacity * sizeof(ThreadPoolJob));
+    if (!queue) {
+      pthread_mutex_unlock(&pool->mutex);
+      return false;
+    }
+    for (int i = 0; i < pool->queue_count; ++i) {
+      queue[i] = pool->queue[(pool->queue_head + i) % pool->queue_capacity];
+    }
+    free(pool->queue);
+    pool->queue = queue;
+    pool->queue_capacity = capacity;
+    pool->queue_head = 0;
+  }
+  int tail = (pool->queue_head + pool->queue_count) % pool->queue_capacity;
+  pool->queue[tail].task = task;
+  pool->queue[tail].arg = arg;
+  pool->queue_count++;
+  pthread_cond_signal(&pool->work_ready);
+  pthread_mutex_unlock(&pool->mutex);
+  return true;
+}
+
+
+void cjelly_thread_pool_wait(CJellyThreadPool * pool) {
+  if (!pool) { return; }
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->queue_count || pool->active_count) {
+    pthread_cond_wait(&pool->work_done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,1226 @@
+/**
+ * @file upload.c
+ * @brief CJelly asynchronous GPU upload queue implementation.
+ *
+ * @details
+ * The staging ring is addressed with monotonically increasing virtual
+ * offsets: the physical offset is the virtual offset modulo the ring size.
+ * Every submitted batch remembers the ring head at the time it was
+ * submitted, and when its fence signals, the ring tail advances to that
+ * point.  Batches are opened, submitted, and retired strictly in order, so
+ * both the batches and the staging space they use form rings.
+ *
+ * Ownership acquire barriers are kept, tagged with the ticket of their batch,
+ * until the batch has finished.  They are then recorded into a single
+ * command buffer and submitted to the graphics queue by
+ * cjelly_uploader_poll().  Because the release has already completed on the
+ * host's timeline, the acquire submission does not need to wait on a
+ * semaphore, and never holds up rendering.
+ *
+ * Mip chains are generated with vkCmdBlitImage(), which needs a graphics
+ * queue, so they are recorded by whichever submission runs on the graphics
+ * queue family: the batch itself when the two queue families are the same,
+ * and otherwise the acquire submission, right after the acquire barriers.
+ * The chains of every image in the submission are built together, one level
+ * at a time, so that each level needs a single pipeline barrier.  Mip
+ * chains that are built on the host, such as those of block-compressed
+ * images, are copied instead, with one region per level.
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <cjelly/upload.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Number of batches that may be in flight at once.
+ */
+#define BATCH_COUNT 4
+
+/**
+ * @brief Number of acquire submissions that may be in flight at once.
+ */
+#define ACQUIRE_COUNT 4
+
+/**
+ * @brief Alignment of each upload within the staging ring.
+ *
+ * This satisfies the offset requirements of vkCmdCopyBufferToImage() for
+ * every uncompressed and block-compressed format.
+ */
+#define STAGING_ALIGNMENT 16
+
+/**
+ * @brief Initial capacity of the growable arrays.
+ */
+#define INITIAL_ARRAY_CAPACITY 16
+
+/**
+ * @brief Largest number of mip levels of a 2D image with 32-bit extents.
+ */
+#define MAX_MIP_LEVELS 32
+
+/**
+ * @brief Number of runs of failed batches that are remembered.
+ */
+#define FAILED_RUN_COUNT 16
+
+
+/**
+ * @brief The state of a batch.
+ */
+typedef enum {
+  BATCH_IDLE = 0,  /**< Available to be opened */
+  BATCH_RECORDING, /**< Commands are being recorded */
+  BATCH_PENDING,   /**< Submitted, and not yet retired */
+} UploadBatchState;
+
+
+/**
+ * @brief A temporary staging buffer, for uploads larger than the ring.
+ */
+typedef struct {
+  VkBuffer buffer;                /**< The buffer */
+  CJellyGpuAllocation * memory;   /**< Its memory */
+} StagingBuffer;
+
+
+/**
+ * @brief A command buffer of copies, submitted to the transfer queue at once.
+ */
+typedef struct {
+  UploadBatchState state;         /**< The state of the batch */
+  VkCommandBuffer commandBuffer;  /**< The recorded copies */
+  VkFence fence;                  /**< Signaled when the batch has executed */
+  CJellyUploadTicket ticket;      /**< The ticket of every upload in the batch */
+  uint64_t stagingStart;          /**< Ring head when the batch was opened */
+  uint64_t stagingEnd;            /**< Ring head when the batch was submitted */
+  VkDeviceSize recordedBytes;     /**< Bytes of data copied by the batch */
+  int waiters;                    /**< Threads waiting on `fence` */
+  StagingBuffer * oversized;      /**< Temporary staging buffers, freed on retirement */
+  size_t oversizedCount;          /**< Number of temporary staging buffers */
+  size_t oversizedCapacity;       /**< Allocated capacity of `oversized` */
+} UploadBatch;
+
+
+/**
+ * @brief An image whose mip chain is still to be generated from level 0.
+ */
+typedef struct {
+  VkImage image;             /**< The image */
+  uint32_t width;            /**< Width of level 0 in pixels */
+  uint32_t height;           /**< Height of level 0 in pixels */
+  uint32_t mipLevels;        /**< Number of levels in the chain */
+  VkFilter filter;           /**< Filter of the blits */
+  CJellyUploadTicket ticket; /**< The batch that uploaded level 0 */
+} MipmapJob;
+
+
+/**
+ * @brief Consecutive batches whose submission failed, and so will never
+ * complete.
+ */
+typedef struct {
+  CJellyUploadTicket first; /**< The ticket of the first batch */
+  CJellyUploadTicket last;  /**< The ticket of the last batch */
+  VkResult result;          /**< The error that the first submission returned */
+} FailedRun;
+
+
+/**
+ * @brief A command buffer of ownership acquire barriers.
+ */
+typedef struct {
+  VkCommandBuffer commandBuffer; /**< The recorded barriers */
+  VkFence fence;                 /**< Signaled when the command buffer may be reused */
+} AcquireSubmission;
+
+
+struct CJellyUploader {
+  VkDevice device;                           /**< The logical device */
+  CJellyGpuAllocator * allocator;            /**< Source of the staging memory */
+  uint32_t graphicsFamily;                   /**< Queue family of `graphicsQueue` */
+  VkQueue graphicsQueue;                     /**< The queue that uses the resources */
+  pthread_mutex_t * graphicsQueueMutex;      /**< Guards `graphicsQueue`, or NULL */
+  uint32_t transferFamily;                   /**< Queue family of `transferQueue` */
+  VkQueue transferQueue;                     /**< The queue that executes the copies */
+  pthread_mutex_t * transferQueueMutex;      /**< Guards `transferQueue`, or NULL */
+  bool ownershipTransfer;                    /**< Whether the two queue families differ */
+  VkCommandPool transferPool;                /**< Pool of the batch command buffers */
+  VkCommandPool graphicsPool;                /**< Pool of the acquire command buffers */
+
+  VkBuffer staging;                          /**< The staging ring */
+  CJellyGpuAllocation * stagingMemory;       /**< Memory of the staging ring */
+  VkDeviceSize stagingSize;                  /**< Size of the staging ring */
+  uint64_t stagingHead;                      /**< Virtual offset of the next free byte */
+  uint64_t stagingTail;                      /**< Virtual offset of the oldest byte in use */
+
+  UploadBatch batches[BATCH_COUNT];          /**< Ring of batches */
+  uint32_t oldestBatch;                      /**< Index of the oldest pending batch */
+  uint32_t pendingBatches;                   /**< Number of pending batches */
+  UploadBatch * recording;                   /**< The batch being recorded, or NULL */
+  CJellyUploadTicket nextTicket;             /**< Ticket of the next batch to open */
+  CJellyUploadTicket completedTicket;        /**< Ticket of the newest retired batch */
+  CJellyUploadTicket readyTicket;            /**< Ticket of the newest usable batch */
+
+  VkImageMemoryBarrier * imageAcquires;      /**< Outstanding image acquire barriers */
+  CJellyUploadTicket * imageAcquireTickets;  /**< The batch of each image barrier */
+  size_t imageAcquireCount;                  /**< Number of image barriers */
+  size_t imageAcquireCapacity;               /**< Allocated capacity of the image arrays */
+  VkBufferMemoryBarrier * bufferAcquires;    /**< Outstanding buffer acquire barriers */
+  CJellyUploadTicket * bufferAcquireTickets; /**< The batch of each buffer barrier */
+  size_t bufferAcquireCount;                 /**< Number of buffer barriers */
+  size_t bufferAcquireCapacity;              /**< Allocated capacity of the buffer arrays */
+  AcquireSubmission acquires[ACQUIRE_COUNT]; /**< Ring of acquire submissions */
+  uint32_t nextAcquire;                      /**< Index of the next acquire submission */
+
+  MipmapJob * mipmaps;                       /**< Mip chains still to be generated */
+  VkImageMemoryBarrier * mipmapBarriers;     /**< Scratch space, two per chain */
+  size_t mipmapCount;                        /**< Number of chains */
+  size_t mipmapCapacity;                     /**< Allocated capacity of `mipmaps` */
+
+  FailedRun failedRuns[FAILED_RUN_COUNT];    /**< Ring of the newest failed batches */
+  uint32_t failedRunCount;                   /**< Number of remembered runs */
+  uint32_t newestFailedRun;                  /**< Index of the newest run */
+
+  pthread_mutex_t mutex;                     /**< Protects all of the fields above */
+};
+
+
+//
+// === Helpers ===
+//
+
+/**
+ * @brief Submits to a queue that other threads may use as well.
+ */
+static VkResult queue_submit(VkQueue queue, pthread_mutex_t * mutex, const VkSubmitInfo * submitInfo, VkFence fence) {
+  if (mutex) {
+    pthread_mutex_lock(mutex);
+  }
+  VkResult result = vkQueueSubmit(queue, 1, submitInfo, fence);
+  if (mutex) {
+    pthread_mutex_unlock(mutex);
+  }
+  return result;
+}
+
+
+/**
+ * @brief Makes room for one more image or buffer acquire barrier.
+ */
+static bool reserve_acquires(CJellyUploader * uploader, bool image) {
+  size_t * count = image ? &uploader->imageAcquireCount : &uploader->bufferAcquireCount;
+  size_t * capacity = image ? &uploader->imageAcquireCapacity : &uploader->bufferAcquireCapacity;
+  if (*count < *capacity) {
+    return true;
+  }
+  size_t newCapacity = *capacity ? *capacity * 2 : INITIAL_ARRAY_CAPACITY;
+
+  // Both arrays are grown before the capacity is updated, so that a failure
+  // leaves them consistent.
+  void * tickets = realloc(image ? (void *)uploader->imageAcquireTickets : (void *)uploader->bufferAcquireTickets,
+      newCapacity * sizeof(CJellyUploadTicket));
+  if (!tickets) {
+    return false;
+  }
+  if (image) {
+    uploader->imageAcquireTickets = tickets;
+    void * barriers = realloc(uploader->imageAcquires, newCapacity * sizeof(VkImageMemoryBarrier));
+    if (!barriers) {
+      return false;
+    }
+    uploader->imageAcquires = barriers;
+  }
+  else {
+    uploader->bufferAcquireTickets = tickets;
+    void * barriers = realloc(uploader->bufferAcquires, newCapacity * sizeof(VkBufferMemoryBarrier));
+    if (!barriers) {
+      return false;
+    }
+    uploader->bufferAcquires = barriers;
+  }
+  *capacity = newCapacity;
+  return true;
+}
+
+
+/**
+ * @brief Makes room for one more mip chain.
+ */
+static bool reserve_mipmaps(CJellyUploader * uploader) {
+  if (uploader->mipmapCount < uploader->mipmapCapacity) {
+    return true;
+  }
+  size_t newCapacity = uploader->mipmapCapacity ? uploader->mipmapCapacity * 2 : INITIAL_ARRAY_CAPACITY;
+
+  void * barriers = realloc(uploader->mipmapBarriers, newCapacity * 2 * sizeof(VkImageMemoryBarrier));
+  if (!barriers) {
+    return false;
+  }
+  uploader->mipmapBarriers = barriers;
+  void * jobs = realloc(uploader->mipmaps, newCapacity * sizeof(MipmapJob));
+  if (!jobs) {
+    return false;
+  }
+  uploader->mipmaps = jobs;
+  uploader->mipmapCapacity = newCapacity;
+  return true;
+}
+
+
+/**
+ * @brief Remembers that the submission of a batch failed.
+ *
+ * A batch that fails right after another one (as every batch does once the
+ * device is lost) extends the newest run, and a new run replaces the oldest
+ * one once the ring is full, so the record stays bounded.
+ */
+static void record_failed_batch(CJellyUploader * uploader, CJellyUploadTicket ticket, VkResult result) {
+  if (uploader->failedRunCount) {
+    FailedRun * newest = &uploader->failedRuns[uploader->newestFailedRun];
+    if (newest->last + 1 == ticket) {
+      newest->last = ticket;
+      return;
+    }
+    uploader->newestFailedRun = (uploader->newestFailedRun + 1) % FAILED_RUN_COUNT;
+  }
+  if (uploader->failedRunCount < FAILED_RUN_COUNT) {
+    ++uploader->failedRunCount;
+  }
+  uploader->failedRuns[uploader->newestFailedRun] = (FailedRun){ticket, ticket, result};
+}
+
+
+/**
+ * @brief Returns the error that lost a batch, or VK_SUCCESS if its submission
+ * did not fail (or failed too long ago to be remembered).
+ */
+static VkResult failed_batch_result(const CJellyUploader * uploader, CJellyUploadTicket ticket) {
+  for (uint32_t i = 0; i < uploader->failedRunCount; ++i) {
+    const FailedRun * run = &uploader->failedRuns[i];
+    if (run->first <= ticket && ticket <= run->last) {
+      return run->result;
+    }
+  }
+  return VK_SUCCESS;
+}
+
+
+/**
+ * @brief Describes a layout transition of a range of mip levels.
+ */
+static VkImageMemoryBarrier mip_barrier(VkImage image, uint32_t baseLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstAccessMask = dstAccess;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = baseLevel;
+  barrier.subresourceRange.levelCount = levelCount;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  return barrier;
+}
+
+
+/**
+ * @brief Records the generation of the first `count` mip chains, and leaves
+ * their images in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+ *
+ * Every level of the images must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+ * with level 0 written by a transfer that is visible to the command buffer.
+ */
+static void record_mipmaps(CJellyUploader * uploader, VkCommandBuffer commandBuffer, size_t count) {
+  MipmapJob * jobs = uploader->mipmaps;
+  VkImageMemoryBarrier * barriers = uploader->mipmapBarriers;
+
+  uint32_t maxLevels = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (jobs[i].mipLevels > maxLevels) {
+      maxLevels = jobs[i].mipLevels;
+    }
+  }
+
+  for (uint32_t level = 1; level < maxLevels; ++level) {
+    // The previous level of every chain that continues becomes a blit source.
+    uint32_t barrierCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (level < jobs[i].mipLevels) {
+        barriers[barrierCount++] = mip_barrier(jobs[i].image, level - 1, 1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+      }
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, barrierCount, barriers);
+
+    for (size_t i = 0; i < count; ++i) {
+      if (level >= jobs[i].mipLevels) {
+        continue;
+      }
+      uint32_t srcWidth = jobs[i].width >> (level - 1);
+      uint32_t srcHeight = jobs[i].height >> (level - 1);
+      uint32_t dstWidth = jobs[i].width >> level;
+      uint32_t dstHeight = jobs[i].height >> level;
+
+      VkImageBlit blit = {0};
+      blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      blit.srcSubresource.mipLevel = level - 1;
+      blit.srcSubresource.baseArrayLayer = 0;
+      blit.srcSubresource.layerCount = 1;
+      blit.srcOffsets[1] = (VkOffset3D){(int32_t)(srcWidth ? srcWidth : 1), (int32_t)(srcHeight ? srcHeight : 1), 1};
+      blit.dstSubresource = blit.srcSubresource;
+      blit.dstSubresource.mipLevel = level;
+      blit.dstOffsets[1] = (VkOffset3D){(int32_t)(dstWidth ? dstWidth : 1), (int32_t)(dstHeight ? dstHeight : 1), 1};
+      vkCmdBlitImage(commandBuffer, jobs[i].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          jobs[i].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, jobs[i].filter);
+    }
+  }
+
+  // Every level but the last has been a blit source.
+  uint32_t barrierCount = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t last = jobs[i].mipLevels - 1;
+    if (last) {
+      barriers[barrierCount++] = mip_barrier(jobs[i].image, 0, last,
+          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+          VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+    barriers[barrierCount++] = mip_barrier(jobs[i].image, last, 1,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+  }
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, barrierCount, barriers);
+
+  // Drop the recorded chains from the front of the array.
+  uploader->mipmapCount -= count;
+  memmove(uploader->mipmaps, uploader->mipmaps + count, uploader->mipmapCount * sizeof(MipmapJob));
+}
+
+
+static void destroy_staging_buffer(CJellyUploader * uploader, StagingBuffer * staging) {
+  vkDestroyBuffer(uploader->device, staging->buffer, NULL);
+  cjelly_gpu_allocator_free(uploader->allocator, staging->memory);
+}
+
+
+static VkResult create_staging_buffer(CJellyUploader * uploader, VkDeviceSize size, StagingBuffer * outStaging) {
+  VkBufferCreateInfo bufferInfo = {0};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VkResult result = vkCreateBuffer(uploader->device, &bufferInfo, NULL, &outStaging->buffer);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(uploader->device, outStaging->buffer, &requirements);
+
+  uint32_t memoryType;
+  if (!cjelly_gpu_allocator_find_memory_type(uploader->allocator, requirements.memoryTypeBits,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &memoryType)) {
+    result = VK_ERROR_FEATURE_NOT_PRESENT;
+    goto ERROR_CLEANUP;
+  }
+
+  result = cjelly_gpu_allocator_alloc(uploader->allocator, &requirements, memoryType, CJELLY_GPU_RESOURCE_BUFFER, &outStaging->memory);
+  if (result != VK_SUCCESS) {
+    goto ERROR_CLEANUP;
+  }
+
+  result = vkBindBufferMemory(uploader->device, outStaging->buffer, outStaging->memory->memory, outStaging->memory->offset);
+  if (result != VK_SUCCESS) {
+    cjelly_gpu_allocator_free(uploader->allocator, outStaging->memory);
+    goto ERROR_CLEANUP;
+  }
+  return VK_SUCCESS;
+
+ERROR_CLEANUP:
+  vkDestroyBuffer(uploader->device, outStaging->buffer, NULL);
+  return result;
+}
+
+
+//
+// === Batches ===
+//
+
+/**
+ * @brief Retires, in order, every batch whose fence has signaled.
+ */
+static void retire_batches(CJellyUploader * uploader) {
+  while (uploader->pendingBatches) {
+    UploadBatch * batch = &uploader->batches[uploader->oldestBatch];
+    if (vkGetFenceStatus(uploader->device, batch->fence) != VK_SUCCESS) {
+      break;
+    }
+
+    if (batch->stagingEnd > uploader->stagingTail) {
+      uploader->stagingTail = batch->stagingEnd;
+    }
+    for (size_t i = 0; i < batch->oversizedCount; ++i) {
+      destroy_staging_buffer(uploader, &batch->oversized[i]);
+    }
+    batch->oversizedCount = 0;
+
+    // Without an ownership transfer, the fence is all that the graphics queue
+    // needs to wait for.
+    uploader->completedTicket = batch->ticket;
+    if (!uploader->ownershipTransfer && uploader->readyTicket < batch->ticket) {
+      uploader->readyTicket = batch->ticket;
+    }
+
+    batch->state = BATCH_IDLE;
+    uploader->oldestBatch = (uploader->oldestBatch + 1) % BATCH_COUNT;
+    --uploader->pendingBatches;
+  }
+}
+
+
+/**
+ * @brief Waits for a batch to finish, without holding the lock, and then
+ * retires it.
+ */
+static VkResult wait_for_batch(CJellyUploader * uploader, UploadBatch * batch) {
+  VkFence fence = batch->fence;
+  ++batch->waiters;
+  pthread_mutex_unlock(&uploader->mutex);
+  VkResult result = vkWaitForFences(uploader->device, 1, &fence, VK_TRUE, UINT64_MAX);
+  pthread_mutex_lock(&uploader->mutex);
+  --batch->waiters;
+  retire_batches(uploader);
+  return result;
+}
+
+
+/**
+ * @brief Ensures that a batch is being recorded.
+ *
+ * The lock may be released while waiting for a batch to become available.
+ */
+static VkResult open_batch(CJellyUploader * uploader) {
+  while (!uploader->recording) {
+    retire_batches(uploader);
+    if (uploader->pendingBatches == BATCH_COUNT) {
+      VkResult result = wait_for_batch(uploader, &uploader->batches[uploader->oldestBatch]);
+      if (result != VK_SUCCESS) {
+        return result;
+      }
+      continue;
+    }
+
+    UploadBatch * batch = &uploader->batches[(uploader->oldestBatch + uploader->pendingBatches) % BATCH_COUNT];
+    if (batch->waiters) {
+      // Another thread is still returning from waiting on this batch's fence,
+      // which must not be reset under it.
+      pthread_mutex_unlock(&uploader->mutex);
+      sched_yield();
+      pthread_mutex_lock(&uploader->mutex);
+      continue;
+    }
+
+    VkResult result = vkResetFences(uploader->device, 1, &batch->fence);
+    if (result == VK_SUCCESS) {
+      result = vkResetCommandBuffer(batch->commandBuffer, 0);
+    }
+    if (result == VK_SUCCESS) {
+      VkCommandBufferBeginInfo beginInfo = {0};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      result = vkBeginCommandBuffer(batch->commandBuffer, &beginInfo);
+    }
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+
+    batch->state = BATCH_RECORDING;
+    batch->ticket = uploader->nextTicket++;
+    batch->stagingStart = uploader->stagingHead;
+    batch->recordedBytes = 0;
+    uploader->recording = batch;
+  }
+  return VK_SUCCESS;
+}
+
+
+/**
+ * @brief Submits the batch that is being recorded to the transfer queue.
+ */
+static VkResult submit_batch(CJellyUploader * uploader) {
+  UploadBatch * batch = uploader->recording;
+  uploader->recording = NULL;
+
+  if (!uploader->ownershipTransfer) {
+    // The batch runs on the graphics queue family, so it can blit the mip
+    // chains of its images itself.
+    if (uploader->mipmapCount) {
+      record_mipmaps(uploader, batch->commandBuffer, uploader->mipmapCount);
+    }
+
+    // Make the copies visible to everything that is submitted after the batch.
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+  }
+
+  VkResult result = vkEndCommandBuffer(batch->commandBuffer);
+  if (result == VK_SUCCESS) {
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch->commandBuffer;
+    result = queue_submit(uploader->transferQueue, uploader->transferQueueMutex, &submitInfo, batch->fence);
+  }
+  if (result != VK_SUCCESS) {
+    // The uploads are lost.  The batch was the last to take staging space,
+    // so the space is handed straight back: waiting for a later batch to
+    // retire would never end if nothing else is in flight.  If the ring was
+    // empty and restarted at its beginning during the batch, the tail marks
+    // where the batch's space starts.
+    uploader->stagingHead = batch->stagingStart > uploader->stagingTail ? batch->stagingStart : uploader->stagingTail;
+    for (size_t i = 0; i < batch->oversizedCount; ++i) {
+      destroy_staging_buffer(uploader, &batch->oversized[i]);
+    }
+    batch->oversizedCount = 0;
+    batch->state = BATCH_IDLE;
+
+    // The batch has the newest ticket, so whatever still refers to it is at
+    // the end of the arrays.  Acquiring or blitting images that were never
+    // written would only hand garbage to the graphics queue.
+    while (uploader->imageAcquireCount && uploader->imageAcquireTickets[uploader->imageAcquireCount - 1] == batch->ticket) {
+      --uploader->imageAcquireCount;
+    }
+    while (uploader->bufferAcquireCount && uploader->bufferAcquireTickets[uploader->bufferAcquireCount - 1] == batch->ticket) {
+      --uploader->bufferAcquireCount;
+    }
+    while (uploader->mipmapCount && uploader->mipmaps[uploader->mipmapCount - 1].ticket == batch->ticket) {
+      --uploader->mipmapCount;
+    }
+
+    // Later batches advance `readyTicket` past this one, so it is remembered
+    // for cjelly_uploader_is_ready() and cjelly_uploader_wait().
+    record_failed_batch(uploader, batch->ticket, result);
+    return result;
+  }
+
+  batch->stagingEnd = uploader->stagingHead;
+  batch->state = BATCH_PENDING;
+  ++uploader->pendingBatches;
+
+  // On a shared queue, submission order alone guarantees that later work
+  // sees the copies.
+  if (uploader->transferQueue == uploader->graphicsQueue) {
+    uploader->readyTicket = batch->ticket;
+  }
+  return VK_SUCCESS;
+}
+
+
+/**
+ * @brief Takes space for `size` bytes from the staging ring, if there is room.
+ */
+static bool staging_reserve(CJellyUploader * uploader, VkDeviceSize size, VkDeviceSize * outOffset) {
+  uint64_t ringSize = uploader->stagingSize;
+
+  // When the ring is empty, start over at its beginning.
+  if (uploader->stagingHead == uploader->stagingTail && uploader->stagingHead % ringSize) {
+    uploader->stagingHead += ringSize - uploader->stagingHead % ringSize;
+    uploader->stagingTail = uploader->stagingHead;
+  }
+
+  uint64_t start = (uploader->stagingHead + STAGING_ALIGNMENT - 1) & ~(uint64_t)(STAGING_ALIGNMENT - 1);
+  if (start % ringSize + size > ringSize) {
+    // An upload never wraps around the end of the ring.
+    start += ringSize - start % ringSize;
+  }
+  if (start + size - uploader->stagingTail > ringSize) {
+    return false;
+  }
+
+  uploader->stagingHead = start + size;
+  *outOffset = start % ringSize;
+  return true;
+}
+
+
+/**
+ * @brief Opens a batch and copies upload data into staging memory for it.
+ *
+ * On success, the lock has been held continuously since the staging space was
+ * taken, so the space belongs to the batch that is being recorded.
+ */
+static VkResult stage_data(CJellyUploader * uploader, const void * data, VkDeviceSize size, VkBuffer * outBuffer, VkDeviceSize * outOffset) {
+  if (size > uploader->stagingSize) {
+    StagingBuffer staging;
+    VkResult result = create_staging_buffer(uploader, size, &staging);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    if ((result = open_batch(uploader)) != VK_SUCCESS) {
+      destroy_staging_buffer(uploader, &staging);
+      return result;
+    }
+
+    UploadBatch * batch = uploader->recording;
+    if (batch->oversizedCount == batch->oversizedCapacity) {
+      size_t newCapacity = batch->oversizedCapacity ? batch->oversizedCapacity * 2 : INITIAL_ARRAY_CAPACITY;
+      void * grown = realloc(batch->oversized, newCapacity * sizeof(StagingBuffer));
+      if (!grown) {
+        destroy_staging_buffer(uploader, &staging);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+      }
+      batch->oversized = grown;
+      batch->oversizedCapacity = newCapacity;
+    }
+    batch->oversized[batch->oversizedCount++] = staging;
+
+    memcpy(staging.memory->mapped, data, (size_t)size);
+    *outBuffer = staging.buffer;
+    *outOffset = 0;
+    return VK_SUCCESS;
+  }
+
+  for (;;) {
+    VkResult result = open_batch(uploader);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+    if (staging_reserve(uploader, size, outOffset)) {
+      break;
+    }
+
+    // The ring is full.  Submit what has been recorded so far, so that it can
+    // drain, and wait for the oldest batch if that is not enough.
+    retire_batches(uploader);
+    if (staging_reserve(uploader, size, outOffset)) {
+      break;
+    }
+    if (uploader->recording->recordedBytes) {
+      if ((result = submit_batch(uploader)) != VK_SUCCESS) {
+        return result;
+      }
+    }
+    else if (uploader->pendingBatches) {
+      if ((result = wait_for_batch(uploader, &uploader->batches[uploader->oldestBatch])) != VK_SUCCESS) {
+        return result;
+      }
+    }
+  }
+
+  memcpy((char *)uploader->stagingMemory->mapped + *outOffset, data, (size_t)size);
+  *outBuffer = uploader->staging;
+  return VK_SUCCESS;
+}
+
+
+/**
+ * @brief Accounts for an upload that has been recorded, and submits the batch
+ * once it has grown large.
+ */
+static VkResult finish_upload(CJellyUploader * uploader, VkDeviceSize size, CJellyUploadTicket * outTicket) {
+  UploadBatch * batch = uploader->recording;
+  batch->recordedBytes += size;
+  if (outTicket) {
+    *outTicket = batch->ticket;
+  }
+  if (batch->recordedBytes >= uploader->stagingSize / 4) {
+    return submit_batch(uploader);
+  }
+  return VK_SUCCESS;
+}
+
+
+//
+// === Ownership acquisition ===
+//
+
+/**
+ * @brief Submits the acquire barriers of every retired batch to the graphics
+ * queue.
+ *
+ * @param block Whether to wait for an acquire command buffer to become
+ *   available, rather than trying again on the next call.
+ */
+static VkResult submit_acquires(CJellyUploader * uploader, bool block) {
+  if (!uploader->ownershipTransfer) {
+    return VK_SUCCESS;
+  }
+
+  size_t imageCount = 0;
+  while (imageCount < uploader->imageAcquireCount && uploader->imageAcquireTickets[imageCount] <= uploader->completedTicket) {
+    ++imageCount;
+  }
+  size_t bufferCount = 0;
+  while (bufferCount < uploader->bufferAcquireCount && uploader->bufferAcquireTickets[bufferCount] <= uploader->completedTicket) {
+    ++bufferCount;
+  }
+  size_t mipmapCount = 0;
+  while (mipmapCount < uploader->mipmapCount && uploader->mipmaps[mipmapCount].ticket <= uploader->completedTicket) {
+    ++mipmapCount;
+  }
+  if (!imageCount && !bufferCount) {
+    uploader->readyTicket = uploader->completedTicket;
+    return VK_SUCCESS;
+  }
+
+  AcquireSubmission * acquire = &uploader->acquires[uploader->nextAcquire];
+  VkResult result = block
+    ? vkWaitForFences(uploader->device, 1, &acquire->fence, VK_TRUE, UINT64_MAX)
+    : vkGetFenceStatus(uploader->device, acquire->fence);
+  if (result != VK_SUCCESS) {
+    return result == VK_NOT_READY ? VK_SUCCESS : result;
+  }
+
+  if ((result = vkResetCommandBuffer(acquire->commandBuffer, 0)) != VK_SUCCESS) {
+    return result;
+  }
+  VkCommandBufferBeginInfo beginInfo = {0};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if ((result = vkBeginCommandBuffer(acquire->commandBuffer, &beginInfo)) != VK_SUCCESS) {
+    return result;
+  }
+  vkCmdPipelineBarrier(acquire->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, (uint32_t)bufferCount,
+      uploader->bufferAcquires, (uint32_t)imageCount, uploader->imageAcquires);
+  if (mipmapCount) {
+    record_mipmaps(uploader, acquire->commandBuffer, mipmapCount);
+  }
+  if ((result = vkEndCommandBuffer(acquire->commandBuffer)) != VK_SUCCESS) {
+    return result;
+  }
+
+  if ((result = vkResetFences(uploader->device, 1, &acquire->fence)) != VK_SUCCESS) {
+    return result;
+  }
+  VkSubmitInfo submitInfo = {0};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &acquire->commandBuffer;
+  if ((result = queue_submit(uploader->graphicsQueue, uploader->graphicsQueueMutex, &submitInfo, acquire->fence)) != VK_SUCCESS) {
+    return result;
+  }
+  uploader->nextAcquire = (uploader->nextAcquire + 1) % ACQUIRE_COUNT;
+
+  // Drop the submitted barriers from the front of the arrays.
+  uploader->imageAcquireCount -= imageCount;
+  memmove(uploader->imageAcquires, uploader->imageAcquires + imageCount, uploader->imageAcquireCount * sizeof(VkImageMemoryBarrier));
+  memmove(uploader->imageAcquireTickets, uploader->imageAcquireTickets + imageCount, uploader->imageAcquireCount * sizeof(CJellyUploadTicket));
+  uploader->bufferAcquireCount -= bufferCount;
+  memmove(uploader->bufferAcquires, uploader->bufferAcquires + bufferCount, uploader->bufferAcquireCount * sizeof(VkBufferMemoryBarrier));
+  memmove(uploader->bufferAcquireTickets, uploader->bufferAcquireTickets + bufferCount, uploader->bufferAcquireCount * sizeof(CJellyUploadTicket));
+
+  uploader->readyTicket = uploader->completedTicket;
+  return VK_SUCCESS;
+}
+
+
+//
+// === Uploader ===
+//
+
+CJellyUploader * cjelly_uploader_create(VkDevice device, CJellyGpuAllocator * allocator, uint32_t graphicsQueueFamily, VkQueue graphicsQueue, pthread_mutex_t * graphicsQueueMutex, uint32_t transferQueueFamily, VkQueue transferQueue, pthread_mutex_t * transferQueueMutex, VkDeviceSize stagingSize) {
+  CJellyUploader * uploader = calloc(1, sizeof(CJellyUploader));
+  if (!uploader) {
+    return NULL;
+  }
+  if (pthread_mutex_init(&uploader->mutex, NULL)) {
+    free(uploader);
+    return NULL;
+  }
+
+  uploader->device = device;
+  uploader->allocator = allocator;
+  uploader->graphicsFamily = graphicsQueueFamily;
+  uploader->graphicsQueue = graphicsQueue;
+  uploader->graphicsQueueMutex = graphicsQueueMutex;
+  uploader->transferFamily = transferQueueFamily;
+  uploader->transferQueue = transferQueue;
+  uploader->transferQueueMutex = transferQueueMutex;
+  uploader->ownershipTransfer = graphicsQueueFamily != transferQueueFamily;
+  uploader->nextTicket = 1;
+
+  // Create the staging ring.
+  if (!stagingSize) {
+    stagingSize = CJELLY_UPLOADER_DEFAULT_STAGING_SIZE;
+  }
+  uploader->stagingSize = (stagingSize + STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)(STAGING_ALIGNMENT - 1);
+  StagingBuffer ring;
+  if (create_staging_buffer(uploader, uploader->stagingSize, &ring) != VK_SUCCESS) {
+    goto ERROR_CLEANUP;
+  }
+  uploader->staging = ring.buffer;
+  uploader->stagingMemory = ring.memory;
+
+  // Create the batches.
+  VkCommandPoolCreateInfo poolInfo = {0};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = transferQueueFamily;
+  if (vkCreateCommandPool(device, &poolInfo, NULL, &uploader->transferPool) != VK_SUCCESS) {
+    goto ERROR_CLEANUP;
+  }
+
+  VkCommandBufferAllocateInfo allocInfo = {0};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = uploader->transferPool;
+  allocInfo.commandBufferCount = 1;
+
+  VkFenceCreateInfo fenceInfo = {0};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+  for (int i = 0; i < BATCH_COUNT; ++i) {
+    if (vkAllocateCommandBuffers(device, &allocInfo, &uploader->batches[i].commandBuffer) != VK_SUCCESS
+        || vkCreateFence(device, &fenceInfo, NULL, &uploader->batches[i].fence) != VK_SUCCESS) {
+      goto ERROR_CLEANUP;
+    }
+  }
+
+  // Create the acquire submissions, whose fences start out signaled because
+  // their command buffers are free.
+  if (uploader->ownershipTransfer) {
+    poolInfo.queueFamilyIndex = graphicsQueueFamily;
+    if (vkCreateCommandPool(device, &poolInfo, NULL, &uploader->graphicsPool) != VK_SUCCESS) {
+      goto ERROR_CLEANUP;
+    }
+    allocInfo.commandPool = uploader->graphicsPool;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    for (int i = 0; i < ACQUIRE_COUNT; ++i) {
+      if (vkAllocateCommandBuffers(device, &allocInfo, &uploader->acquires[i].commandBuffer) != VK_SUCCESS
+          || vkCreateFence(device, &fenceInfo, NULL, &uploader->acquires[i].fence) != VK_SUCCESS) {
+        goto ERROR_CLEANUP;
+      }
+    }
+  }
+
+  return uploader;
+
+ERROR_CLEANUP:
+  cjelly_uploader_destroy(uploader);
+  return NULL;
+}
+
+
+void cjelly_uploader_destroy(CJellyUploader * uploader) {
+  if (!uploader) {
+    return;
+  }
+
+  for (int i = 0; i < BATCH_COUNT; ++i) {
+    UploadBatch * batch = &uploader->batches[i];
+    if (batch->state == BATCH_PENDING) {
+      vkWaitForFences(uploader->device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+    }
+    for (size_t j = 0; j < batch->oversizedCount; ++j) {
+      destroy_staging_buffer(uploader, &batch->oversized[j]);
+    }
+    free(batch->oversized);
+    vkDestroyFence(uploader->device, batch->fence, NULL);
+  }
+  for (int i = 0; i < ACQUIRE_COUNT; ++i) {
+    if (uploader->acquires[i].fence != VK_NULL_HANDLE) {
+      vkWaitForFences(uploader->device, 1, &uploader->acquires[i].fence, VK_TRUE, UINT64_MAX);
+    }
+    vkDestroyFence(uploader->device, uploader->acquires[i].fence, NULL);
+  }
+
+  vkDestroyCommandPool(uploader->device, uploader->transferPool, NULL);
+  vkDestroyCommandPool(uploader->device, uploader->graphicsPool, NULL);
+  if (uploader->stagingMemory) {
+    StagingBuffer ring = {uploader->staging, uploader->stagingMemory};
+    destroy_staging_buffer(uploader, &ring);
+  }
+
+  free(uploader->imageAcquires);
+  free(uploader->imageAcquireTickets);
+  free(uploader->bufferAcquires);
+  free(uploader->bufferAcquireTickets);
+  free(uploader->mipmaps);
+  free(uploader->mipmapBarriers);
+  pthread_mutex_destroy(&uploader->mutex);
+  free(uploader);
+}
+
+
+VkResult cjelly_uploader_upload_buffer(CJellyUploader * uploader, VkBuffer buffer, VkDeviceSize offset, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket) {
+  pthread_mutex_lock(&uploader->mutex);
+
+  VkBuffer source;
+  VkDeviceSize sourceOffset;
+  VkResult result = stage_data(uploader, data, size, &source, &sourceOffset);
+  if (result != VK_SUCCESS) {
+    goto CLEANUP;
+  }
+  UploadBatch * batch = uploader->recording;
+
+  // Staging may release the lock, so the barrier is only reserved once the
+  // lock is held until it has been added.  On failure, nothing has been
+  // recorded, and the staging space is reclaimed with the batch.
+  if (uploader->ownershipTransfer && !reserve_acquires(uploader, false)) {
+    result = VK_ERROR_OUT_OF_HOST_MEMORY;
+    goto CLEANUP;
+  }
+
+  VkBufferCopy copyRegion = {0};
+  copyRegion.srcOffset = sourceOffset;
+  copyRegion.dstOffset = offset;
+  copyRegion.size = size;
+  vkCmdCopyBuffer(batch->commandBuffer, source, buffer, 1, &copyRegion);
+
+  if (uploader->ownershipTransfer) {
+    // Release the range to the graphics queue family.
+    VkBufferMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = uploader->transferFamily;
+    barrier.dstQueueFamilyIndex = uploader->graphicsFamily;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    uploader->bufferAcquires[uploader->bufferAcquireCount] = barrier;
+    uploader->bufferAcquireTickets[uploader->bufferAcquireCount++] = batch->ticket;
+  }
+
+  result = finish_upload(uploader, size, outTicket);
+
+CLEANUP:
+  pthread_mutex_unlock(&uploader->mutex);
+  return result;
+}
+
+
+/**
+ * @brief Queues an image upload.
+ *
+ * @param uploader The uploader.
+ * @param image The destination image.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param mipLevels The number of mip levels of the image.
+ * @param levelOffsets The offset of each level within `data`, or NULL if
+ *   `data` only holds the first level and the rest are to be generated.
+ * @param filter The filter used to generate the levels.
+ * @param data The tightly packed pixel data.
+ * @param size The size of `data` in bytes.
+ * @param outTicket Output pointer that receives the ticket of the upload.
+ * @return VK_SUCCESS, or the error that prevented the upload.
+ */
+static VkResult upload_image(CJellyUploader * uploader, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const VkDeviceSize * levelOffsets, VkFilter filter, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket) {
+  if (!mipLevels || mipLevels > MAX_MIP_LEVELS) {
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  bool mipmapped = !levelOffsets && mipLevels > 1;
+  pthread_mutex_lock(&uploader->mutex);
+
+  VkBuffer source;
+  VkDeviceSize sourceOffset;
+  VkResult result = stage_data(uploader, data, size, &source, &sourceOffset);
+  if (result != VK_SUCCESS) {
+    goto CLEANUP;
+  }
+  UploadBatch * batch = uploader->recording;
+
+  // Staging may release the lock, so the barrier and the mip chain are only
+  // reserved once the lock is held until they have been added.  On failure,
+  // nothing has been recorded, and the staging space is reclaimed with the
+  // batch.
+  if ((uploader->ownershipTransfer && !reserve_acquires(uploader, true))
+      || (mipmapped && !reserve_mipmaps(uploader))) {
+    result = VK_ERROR_OUT_OF_HOST_MEMORY;
+    goto CLEANUP;
+  }
+
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mipLevels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+  // Levels that are supplied are copied with one region each.  For a
+  // block-compressed format, the extent of a small level may be less than a
+  // block, which vkCmdCopyBufferToImage() allows for the last block.
+  VkBufferImageCopy regions[MAX_MIP_LEVELS];
+  uint32_t regionCount = levelOffsets ? mipLevels : 1;
+  for (uint32_t level = 0; level < regionCount; ++level) {
+    VkBufferImageCopy * region = &regions[level];
+    memset(region, 0, sizeof(*region));
+    region->bufferOffset = sourceOffset + (levelOffsets ? levelOffsets[level] : 0);
+    region->bufferRowLength = 0; // Tightly packed.
+    region->bufferImageHeight = 0;
+    region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region->imageSubresource.mipLevel = level;
+    region->imageSubresource.baseArrayLayer = 0;
+    region->imageSubresource.layerCount = 1;
+    region->imageOffset = (VkOffset3D){0, 0, 0};
+    region->imageExtent = (VkExtent3D){
+      width >> level ? width >> level : 1,
+      height >> level ? height >> level : 1,
+      1};
+  }
+  vkCmdCopyBufferToImage(batch->commandBuffer, source, image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regionCount, regions);
+
+  // A mip chain is generated from level 0 on the graphics queue family, which
+  // needs every level to stay in the transfer layout until then.
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = mipmapped ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  if (uploader->ownershipTransfer) {
+    // Release the image to the graphics queue family, which performs the
+    // same layout transition when it acquires it.
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = uploader->transferFamily;
+    barrier.dstQueueFamilyIndex = uploader->graphicsFamily;
+    vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = mipmapped
+      ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+      : VK_ACCESS_SHADER_READ_BIT;
+    uploader->imageAcquires[uploader->imageAcquireCount] = barrier;
+    uploader->imageAcquireTickets[uploader->imageAcquireCount++] = batch->ticket;
+  }
+  else if (!mipmapped) {
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+  }
+
+  if (mipmapped) {
+    MipmapJob * job = &uploader->mipmaps[uploader->mipmapCount++];
+    job->image = image;
+    job->width = width;
+    job->height = height;
+    job->mipLevels = mipLevels;
+    job->filter = filter;
+    job->ticket = batch->ticket;
+  }
+
+  result = finish_upload(uploader, size, outTicket);
+
+CLEANUP:
+  pthread_mutex_unlock(&uploader->mutex);
+  return result;
+}
+
+
+VkResult cjelly_uploader_upload_image(CJellyUploader * uploader, VkImage image, uint32_t width, uint32_t height, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket) {
+  return upload_image(uploader, image, width, height, 1, NULL, VK_FILTER_LINEAR, data, size, outTicket);
+}
+
+
+VkResult cjelly_uploader_upload_image_mipmapped(CJellyUploader * uploader, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkFilter filter, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket) {
+  return upload_image(uploader, image, width, height, mipLevels, NULL, filter, data, size, outTicket);
+}
+
+
+VkResult cjelly_uploader_upload_image_levels(CJellyUploader * uploader, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const VkDeviceSize * levelOffsets, const void * data, VkDeviceSize size, CJellyUploadTicket * outTicket) {
+  if (!levelOffsets) {
+    return VK_ERROR_INITIALIZATION_FAILED;
+  }
+  return upload_image(uploader, image, width, height, mipLevels, levelOffsets, VK_FILTER_NEAREST, data, size, outTicket);
+}
+
+
+VkResult cjelly_uploader_flush(CJellyUploader * uploader, CJellyUploadTicket * outTicket) {
+  pthread_mutex_lock(&uploader->mutex);
+  VkResult result = uploader->recording
+    ? submit_batch(uploader)
+    : VK_SUCCESS;
+  if (outTicket) {
+    *outTicket = uploader->nextTicket - 1;
+  }
+  pthread_mutex_unlock(&uploader->mutex);
+  return result;
+}
+
+
+void cjelly_uploader_poll(CJellyUploader * uploader) {
+  pthread_mutex_lock(&uploader->mutex);
+  retire_batches(uploader);
+  submit_acquires(uploader, false);
+  pthread_mutex_unlock(&uploader->mutex);
+}
+
+
+bool cjelly_uploader_is_busy(CJellyUploader * uploader) {
+  pthread_mutex_lock(&uploader->mutex);
+  bool busy = uploader->pendingBatches || uploader->imageAcquireCount || uploader->bufferAcquireCount;
+  pthread_mutex_unlock(&uploader->mutex);
+  return busy;
+}
+
+
+bool cjelly_uploader_is_ready(CJellyUploader * uploader, CJellyUploadTicket ticket) {
+  pthread_mutex_lock(&uploader->mutex);
+  bool ready = ticket <= uploader->readyTicket && failed_batch_result(uploader, ticket) == VK_SUCCESS;
+  pthread_mutex_unlock(&uploader->mutex);
+  return ready;
+}
+
+
+VkResult cjelly_uploader_wait(CJellyUploader * uploader, CJellyUploadTicket ticket) {
+  pthread_mutex_lock(&uploader->mutex);
+
+  VkResult result = VK_SUCCESS;
+  if (uploader->recording && ticket >= uploader->recording->ticket) {
+    result = submit_batch(uploader);
+  }
+  if (result == VK_SUCCESS) {
+    result = failed_batch_result(uploader, ticket);
+  }
+
+  while (result == VK_SUCCESS && ticket > uploader->readyTicket) {
+    retire_batches(uploader);
+    if ((result = submit_acquires(uploader, true)) != VK_SUCCESS || ticket <= uploader->readyTicket) {
+      break;
+    }
+    if (!uploader->pendingBatches) {
+      // The batch was never submitted successfully.
+      result = VK_ERROR_DEVICE_LOST;
+      break;
+    }
+    result = wait_for_batch(uploader, &uploader->batches[uploader->oldestBatch]);
+  }
+
+  pthread_mutex_unlock(&uploader->mutex);
+  return result;
+}
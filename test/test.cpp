@@ -0,0 +1,1027 @@
+/**
+ * @file test.cpp
+ * @brief Unit tests of the parts of CJelly that do not need a GPU.
+ *
+ * @details
+ * The tests are run from the build's apps directory, next to the copy of the
+ * test data, so the models and images are found under "test/".
+ *
+ * Author: Ghoti.io
+ * Date: 2025
+ * Copyright (C) 2025 Ghoti.io
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cjelly/bctexture.h>
+#include <cjelly/bctexturecache.h>
+#include <cjelly/cachefile.h>
+#include <cjelly/format/3d/obj.h>
+#include <cjelly/format/image.h>
+#include <cjelly/gpuallocator.h>
+#include <cjelly/scheduler.h>
+#include <cjelly/threadpool.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+//
+// === Helpers ===
+//
+
+// A directory of its own for each test, removed when the test ends.
+class TempDir : public ::testing::Test {
+  protected:
+    fs::path dir;
+
+    void SetUp() override {
+      const ::testing::TestInfo * info = ::testing::UnitTest::GetInstance()->current_test_info();
+      dir = fs::temp_directory_path() / (string("cjelly-") + info->test_suite_name() + "-" + info->name());
+      fs::remove_all(dir);
+      fs::create_directories(dir);
+    }
+
+    void TearDown() override {
+      fs::remove_all(dir);
+    }
+
+    string path(const char * name) const {
+      return (dir / name).string();
+    }
+};
+
+
+static void writeFile(const string & path, const string & contents) {
+  ofstream file(path, ios::binary | ios::trunc);
+  file << contents;
+}
+
+
+static string readFile(const string & path) {
+  ifstream file(path, ios::binary);
+  return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+
+//
+// === OBJ loading ===
+//
+
+// The canonical dump of a model, which covers every one of its arrays.
+static string dumpModel(const CJellyFormat3dObjModel * model) {
+  FILE * file = tmpfile();
+  if (!file) {
+    return "";
+  }
+  cjelly_format_3d_obj_dump(model, file);
+  string dump;
+  rewind(file);
+  char buffer[4096];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    dump.append(buffer, count);
+  }
+  fclose(file);
+  return dump;
+}
+
+
+// Loads a file both serially and in parallel, and expects the same model, or
+// the same error, from both.
+static void expectSameModel(const string & path, int threads, bool valid) {
+  CJellyThreadPool * pool = cjelly_thread_pool_create(threads);
+  ASSERT_NE(pool, nullptr);
+
+  CJellyFormat3dObjModel * serial = nullptr;
+  CJellyFormat3dObjModel * parallel = nullptr;
+  CJellyFormat3dObjError serialErr = cjelly_format_3d_obj_load(path.c_str(), &serial);
+  CJellyFormat3dObjError parallelErr = cjelly_format_3d_obj_load_parallel(path.c_str(), pool, &parallel);
+  EXPECT_EQ(serialErr, parallelErr) << threads << " threads";
+  EXPECT_EQ(serialErr == CJELLY_FORMAT_3D_OBJ_SUCCESS, valid);
+  if (serialErr == CJELLY_FORMAT_3D_OBJ_SUCCESS && parallelErr == CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    EXPECT_TRUE(dumpModel(serial) == dumpModel(parallel)) << threads << " threads";
+  }
+  if (serialErr == CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    cjelly_format_3d_obj_free(serial);
+  }
+  if (parallelErr == CJELLY_FORMAT_3D_OBJ_SUCCESS) {
+    cjelly_format_3d_obj_free(parallel);
+  }
+  cjelly_thread_pool_destroy(pool);
+}
+
+
+// Writes an OBJ file large enough to be split into several chunks, with every
+// feature whose state crosses a chunk boundary: groups, materials, relative
+// indices, n-gons, CRLF line endings, and an unterminated last line.
+static string syntheticObj(size_t faces) {
+  string obj = "# synthetic\nmtllib synthetic.mtl\n";
+  char line[512];
+  mt19937 random(1234);
+  for (size_t i = 0; i < faces; ++i) {
+    if (i % 997 == 0) {
+      snprintf(line, sizeof(line), "g group%zu\n", i / 997);
+      obj += line;
+    }
+    if (i % 1511 == 0) {
+      snprintf(line, sizeof(line), "usemtl material%zu\n", (i / 1511) % 5);
+      obj += line;
+    }
+    for (int v = 0; v < 4; ++v) {
+      snprintf(line, sizeof(line), "v %.4f %.4f %.4f%s\n", (double)(random() % 2000) / 1000.0, (double)(random() % 2000) / 1000.0, (double)(random() % 2000) / 1000.0, v == 1 ? "\r" : "");
+      obj += line;
+    }
+    obj += "vt 0.25 0.75\nvn 0 0 1\n";
+    switch (i % 4) {
+      case 0:
+        obj += "f -4 -3 -2\n";
+        break;
+      case 1:
+        snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+            4 * i + 1, i + 1, i + 1, 4 * i + 2, i + 1, i + 1, 4 * i + 3, i + 1, i + 1, 4 * i + 4, i + 1, i + 1);
+        obj += line;
+        break;
+      case 2:
+        obj += "f -4//-1 -3//-1 -2//-1 -1//-1\r\n";
+        break;
+      default:
+        snprintf(line, sizeof(line), "f %zu/-1 %zu/-1 %zu/-1 %zu/-1 -4/-1\n", 4 * i + 1, 4 * i + 2, 4 * i + 3, 4 * i + 4);
+        obj += line;
+        break;
+    }
+  }
+  obj += "f -1 -2 -3";
+  return obj;
+}
+
+
+TEST(ObjLoad, ParallelMatchesSerialOnTheBunny) {
+  for (int threads : {2, 3, 4, 8}) {
+    expectSameModel("test/models/stanford-bunny/stanford-bunny.obj", threads, true);
+  }
+}
+
+
+class ObjLoadFile : public TempDir {};
+
+
+TEST_F(ObjLoadFile, ParallelMatchesSerialAcrossChunkBoundaries) {
+  string file = path("synthetic.obj");
+  writeFile(file, syntheticObj(20000));
+  ASSERT_GT(fs::file_size(file), (uintmax_t)8 * 256 * 1024);
+  for (int threads : {1, 2, 3, 5, 8}) {
+    expectSameModel(file, threads, true);
+  }
+}
+
+
+TEST_F(ObjLoadFile, ParallelReportsTheSerialError) {
+  string obj = syntheticObj(20000);
+  obj.insert(obj.size() / 2, "\nf 1/\n");
+  string file = path("bad.obj");
+  writeFile(file, obj);
+  for (int threads : {2, 4}) {
+    expectSameModel(file, threads, false);
+  }
+}
+
+
+//
+// === Frame scheduler ===
+//
+
+TEST(FrameScheduler, PopsInDeadlineOrder) {
+  CJellyFrameScheduler * scheduler = cjelly_frame_scheduler_create();
+  ASSERT_NE(scheduler, nullptr);
+
+  int items[5];
+  uint64_t deadlines[5] = {50, 10, 40, 20, 30};
+  uint32_t ids[5];
+  for (int i = 0; i < 5; ++i) {
+    ids[i] = cjelly_frame_scheduler_add(scheduler, &items[i]);
+    ASSERT_NE(ids[i], CJELLY_FRAME_SCHEDULER_INVALID_ID);
+    cjelly_frame_scheduler_set_deadline(scheduler, ids[i], deadlines[i]);
+  }
+
+  uint64_t next;
+  ASSERT_TRUE(cjelly_frame_scheduler_next_deadline(scheduler, &next));
+  EXPECT_EQ(next, 10u);
+
+  // Nothing is due before the earliest deadline.
+  EXPECT_EQ(cjelly_frame_scheduler_pop(scheduler, 9, nullptr), nullptr);
+
+  int order[5] = {1, 3, 4, 2, 0};
+  for (int i = 0; i < 5; ++i) {
+    uint32_t id;
+    EXPECT_EQ(cjelly_frame_scheduler_pop(scheduler, 100, &id), &items[order[i]]);
+    EXPECT_EQ(id, ids[order[i]]);
+  }
+  EXPECT_EQ(cjelly_frame_scheduler_pop(scheduler, 100, nullptr), nullptr);
+  EXPECT_FALSE(cjelly_frame_scheduler_next_deadline(scheduler, &next));
+
+  cjelly_frame_scheduler_destroy(scheduler);
+}
+
+
+TEST(FrameScheduler, ChangesAndRemovesDeadlines) {
+  CJellyFrameScheduler * scheduler = cjelly_frame_scheduler_create();
+  ASSERT_NE(scheduler, nullptr);
+
+  int a, b, c;
+  uint32_t idA = cjelly_frame_scheduler_add(scheduler, &a);
+  uint32_t idB = cjelly_frame_scheduler_add(scheduler, &b);
+  uint32_t idC = cjelly_frame_scheduler_add(scheduler, &c);
+  cjelly_frame_scheduler_set_deadline(scheduler, idA, 10);
+  cjelly_frame_scheduler_set_deadline(scheduler, idB, 20);
+  cjelly_frame_scheduler_set_deadline(scheduler, idC, 30);
+
+  // A later deadline replaces an earlier one, but not through _min.
+  cjelly_frame_scheduler_set_deadline(scheduler, idA, 40);
+  cjelly_frame_scheduler_set_deadline_min(scheduler, idB, 50);
+  cjelly_frame_scheduler_set_deadline_min(scheduler, idC, 5);
+  uint64_t next;
+  ASSERT_TRUE(cjelly_frame_scheduler_next_deadline(scheduler, &next));
+  EXPECT_EQ(next, 5u);
+  EXPECT_EQ(cjelly_frame_scheduler_pop(scheduler, 100, nullptr), &c);
+  EXPECT_EQ(cjelly_frame_scheduler_pop(scheduler, 100, nullptr), &b);
+
+  // A cleared item keeps its id, and can be scheduled again.
+  cjelly_frame_scheduler_clear_deadline(scheduler, idA);
+  EXPECT_FALSE(cjelly_frame_scheduler_next_deadline(scheduler, &next));
+  cjelly_frame_scheduler_set_deadline_min(scheduler, idA, 7);
+  ASSERT_TRUE(cjelly_frame_scheduler_next_deadline(scheduler, &next));
+  EXPECT_EQ(next, 7u);
+
+  // A removed item is never returned, and its id can be handed out again.
+  cjelly_frame_scheduler_remove(scheduler, idA);
+  EXPECT_EQ(cjelly_frame_scheduler_pop(scheduler, 100, nullptr), nullptr);
+  int d;
+  uint32_t idD = cjelly_frame_scheduler_add(scheduler, &d);
+  ASSERT_NE(idD, CJELLY_FRAME_SCHEDULER_INVALID_ID);
+  cjelly_frame_scheduler_set_deadline(scheduler, idD, 1);
+  uint32_t id;
+  EXPECT_EQ(cjelly_frame_scheduler_pop(scheduler, 1, &id), &d);
+  EXPECT_EQ(id, idD);
+
+  cjelly_frame_scheduler_destroy(scheduler);
+}
+
+
+TEST(FrameScheduler, MatchesAReferenceUnderRandomOperations) {
+  CJellyFrameScheduler * scheduler = cjelly_frame_scheduler_create();
+  ASSERT_NE(scheduler, nullptr);
+
+  // The reference keeps each scheduled id's deadline.  Deadlines are unique,
+  // so that the order in which items are popped is fully determined.
+  constexpr int ITEMS = 100;
+  int items[ITEMS];
+  uint32_t ids[ITEMS];
+  for (int i = 0; i < ITEMS; ++i) {
+    ids[i] = cjelly_frame_scheduler_add(scheduler, &items[i]);
+    ASSERT_NE(ids[i], CJELLY_FRAME_SCHEDULER_INVALID_ID);
+  }
+  map<int, uint64_t> scheduled;
+  mt19937 random(42);
+  uint64_t serial = 0;
+  auto nextDeadline = [&]() { return (uint64_t)(random() % 1000000) * 1024 + (serial++ % 1024); };
+
+  for (int step = 0; step < 20000; ++step) {
+    int i = (int)(random() % ITEMS);
+    switch (random() % 4) {
+      case 0: {
+        uint64_t deadline = nextDeadline();
+        cjelly_frame_scheduler_set_deadline(scheduler, ids[i], deadline);
+        scheduled[i] = deadline;
+        break;
+      }
+      case 1: {
+        uint64_t deadline = nextDeadline();
+        cjelly_frame_scheduler_set_deadline_min(scheduler, ids[i], deadline);
+        auto found = scheduled.find(i);
+        if (found == scheduled.end() || deadline < found->second) {
+          scheduled[i] = deadline;
+        }
+        break;
+      }
+      case 2:
+        cjelly_frame_scheduler_clear_deadline(scheduler, ids[i]);
+        scheduled.erase(i);
+        break;
+      default: {
+        auto earliest = min_element(scheduled.begin(), scheduled.end(),
+            [](const auto & x, const auto & y) { return x.second < y.second; });
+        uint64_t now = (uint64_t)(random() % 1000000) * 1024;
+        void * popped = cjelly_frame_scheduler_pop(scheduler, now, nullptr);
+        if (earliest == scheduled.end() || earliest->second > now) {
+          ASSERT_EQ(popped, nullptr) << "step " << step;
+        }
+        else {
+          ASSERT_EQ(popped, &items[earliest->first]) << "step " << step;
+          scheduled.erase(earliest);
+        }
+        break;
+      }
+    }
+  }
+
+  cjelly_frame_scheduler_destroy(scheduler);
+}
+
+
+//
+// === GPU memory allocator ===
+//
+
+// The allocator is exercised against a fake device, whose "device memory" is
+// host memory.  The test's definitions of the few Vulkan functions that the
+// allocator calls take the place of the loader's, which relies on ELF symbol
+// interposition, so these tests are left out on Windows.
+#ifndef _WIN32
+
+// The fake device has one device-local and one host-visible memory type.
+#define FAKE_HEAP_SIZE ((VkDeviceSize)256 << 20)
+#define DEVICE_LOCAL_TYPE 0u
+#define HOST_VISIBLE_TYPE 1u
+
+static int fakeMemoryObjects;
+
+extern "C" {
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties * properties) {
+  memset(properties, 0, sizeof(*properties));
+  properties->memoryTypeCount = 2;
+  properties->memoryTypes[DEVICE_LOCAL_TYPE].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  properties->memoryTypes[DEVICE_LOCAL_TYPE].heapIndex = 0;
+  properties->memoryTypes[HOST_VISIBLE_TYPE].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  properties->memoryTypes[HOST_VISIBLE_TYPE].heapIndex = 1;
+  properties->memoryHeapCount = 2;
+  properties->memoryHeaps[0].size = FAKE_HEAP_SIZE;
+  properties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+  properties->memoryHeaps[1].size = FAKE_HEAP_SIZE;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties * properties) {
+  memset(properties, 0, sizeof(*properties));
+  properties->limits.maxMemoryAllocationCount = 4096;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo * info, const VkAllocationCallbacks *, VkDeviceMemory * memory) {
+  void * data = malloc((size_t)info->allocationSize);
+  if (!data) {
+    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
+  ++fakeMemoryObjects;
+  *memory = (VkDeviceMemory)(uintptr_t)data;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags, void * * data) {
+  *data = (char *)(uintptr_t)memory + offset;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks *) {
+  if (memory) {
+    --fakeMemoryObjects;
+    free((void *)(uintptr_t)memory);
+  }
+}
+
+} // extern "C"
+
+
+// Every test uses 1 MiB blocks, so that requests over 512 KiB are dedicated.
+#define TEST_BLOCK_SIZE ((VkDeviceSize)1 << 20)
+
+
+class GpuAllocator : public ::testing::Test {
+  protected:
+    CJellyGpuAllocator * allocator = nullptr;
+
+    void SetUp() override {
+      fakeMemoryObjects = 0;
+      allocator = cjelly_gpu_allocator_create(VK_NULL_HANDLE, VK_NULL_HANDLE, TEST_BLOCK_SIZE);
+      ASSERT_NE(allocator, nullptr);
+    }
+
+    void TearDown() override {
+      cjelly_gpu_allocator_destroy(allocator);
+      EXPECT_EQ(fakeMemoryObjects, 0);
+    }
+
+    CJellyGpuAllocation * alloc(VkDeviceSize size, VkDeviceSize alignment = 256, uint32_t type = DEVICE_LOCAL_TYPE) {
+      VkMemoryRequirements requirements = {size, alignment, 0x3};
+      CJellyGpuAllocation * allocation = nullptr;
+      EXPECT_EQ(cjelly_gpu_allocator_alloc(allocator, &requirements, type, CJELLY_GPU_RESOURCE_BUFFER, &allocation), VK_SUCCESS);
+      return allocation;
+    }
+
+    CJellyGpuHeapStats stats(uint32_t heap = 0) {
+      CJellyGpuHeapStats result;
+      cjelly_gpu_allocator_get_heap_stats(allocator, heap, &result);
+      return result;
+    }
+};
+
+
+TEST_F(GpuAllocator, PacksAllocationsIntoOneBlock) {
+  CJellyGpuAllocation * a = alloc(64 << 10);
+  CJellyGpuAllocation * b = alloc(64 << 10);
+  CJellyGpuAllocation * c = alloc(64 << 10);
+  ASSERT_TRUE(a && b && c);
+  EXPECT_EQ(a->memory, b->memory);
+  EXPECT_EQ(b->memory, c->memory);
+  EXPECT_EQ(a->offset, 0u);
+  EXPECT_EQ(b->offset, (VkDeviceSize)64 << 10);
+  EXPECT_EQ(c->offset, (VkDeviceSize)128 << 10);
+
+  CJellyGpuHeapStats heap = stats();
+  EXPECT_EQ(heap.blockCount, 1u);
+  EXPECT_EQ(heap.blockBytes, TEST_BLOCK_SIZE);
+  EXPECT_EQ(heap.usedBytes, (VkDeviceSize)192 << 10);
+  EXPECT_EQ(heap.allocationCount, 3u);
+
+  cjelly_gpu_allocator_free(allocator, a);
+  cjelly_gpu_allocator_free(allocator, b);
+  cjelly_gpu_allocator_free(allocator, c);
+  heap = stats();
+  EXPECT_EQ(heap.usedBytes, 0u);
+  EXPECT_EQ(heap.allocationCount, 0u);
+  // The last empty block is kept for reuse.
+  EXPECT_EQ(heap.blockCount, 1u);
+}
+
+
+// A search for an aligned range asks for `alignment - 1` bytes more than the
+// size, so only a byte-aligned request can reuse a free range of its own size.
+TEST_F(GpuAllocator, CoalescesFreedNeighbors) {
+  CJellyGpuAllocation * a = alloc(64 << 10, 1);
+  CJellyGpuAllocation * b = alloc(64 << 10, 1);
+  CJellyGpuAllocation * c = alloc(64 << 10, 1);
+  CJellyGpuAllocation * d = alloc(64 << 10, 1);
+  ASSERT_TRUE(a && b && c && d);
+
+  // Freeing the middle one last merges it with both of its neighbors, so the
+  // first three ranges are free as one.
+  cjelly_gpu_allocator_free(allocator, a);
+  cjelly_gpu_allocator_free(allocator, c);
+  cjelly_gpu_allocator_free(allocator, b);
+  CJellyGpuAllocation * merged = alloc(192 << 10, 1);
+  ASSERT_TRUE(merged);
+  EXPECT_EQ(merged->memory, d->memory);
+  EXPECT_EQ(merged->offset, 0u);
+
+  // Once everything is free, the whole block is one range again.
+  cjelly_gpu_allocator_free(allocator, merged);
+  cjelly_gpu_allocator_free(allocator, d);
+  CJellyGpuAllocation * whole = alloc(TEST_BLOCK_SIZE / 2, 1);
+  CJellyGpuAllocation * rest = alloc(TEST_BLOCK_SIZE / 2, 1);
+  ASSERT_TRUE(whole && rest);
+  EXPECT_EQ(whole->memory, rest->memory);
+  EXPECT_EQ(stats().blockCount, 1u);
+  cjelly_gpu_allocator_free(allocator, whole);
+  cjelly_gpu_allocator_free(allocator, rest);
+}
+
+
+TEST_F(GpuAllocator, AlignsAndReusesThePadding) {
+  CJellyGpuAllocation * small = alloc(100, 1);
+  CJellyGpuAllocation * aligned = alloc(100, 4096);
+  ASSERT_TRUE(small && aligned);
+  EXPECT_EQ(aligned->offset % 4096, 0u);
+  EXPECT_EQ(aligned->memory, small->memory);
+
+  // The padding in front of the aligned range is free for small requests.
+  CJellyGpuAllocation * padding = alloc(100, 1);
+  ASSERT_TRUE(padding);
+  EXPECT_EQ(padding->memory, small->memory);
+  EXPECT_LT(padding->offset, aligned->offset);
+
+  cjelly_gpu_allocator_free(allocator, small);
+  cjelly_gpu_allocator_free(allocator, aligned);
+  cjelly_gpu_allocator_free(allocator, padding);
+}
+
+
+TEST_F(GpuAllocator, GivesLargeRequestsTheirOwnMemory) {
+  CJellyGpuAllocation * pooled = alloc(64 << 10);
+  CJellyGpuAllocation * large = alloc(TEST_BLOCK_SIZE / 2 + 1);
+  ASSERT_TRUE(pooled && large);
+  EXPECT_NE(large->memory, pooled->memory);
+  EXPECT_EQ(large->offset, 0u);
+  EXPECT_EQ(fakeMemoryObjects, 2);
+
+  cjelly_gpu_allocator_free(allocator, large);
+  EXPECT_EQ(fakeMemoryObjects, 1);
+  cjelly_gpu_allocator_free(allocator, pooled);
+}
+
+
+TEST_F(GpuAllocator, MapsHostVisibleMemory) {
+  CJellyGpuAllocation * first = alloc(1024, 256, HOST_VISIBLE_TYPE);
+  CJellyGpuAllocation * second = alloc(1024, 256, HOST_VISIBLE_TYPE);
+  CJellyGpuAllocation * local = alloc(1024);
+  ASSERT_TRUE(first && second && local);
+  ASSERT_NE(first->mapped, nullptr);
+  EXPECT_EQ((char *)second->mapped - (char *)first->mapped, (ptrdiff_t)(second->offset - first->offset));
+  EXPECT_EQ(local->mapped, nullptr);
+  memset(first->mapped, 0xAB, 1024);
+  memset(second->mapped, 0xCD, 1024);
+  EXPECT_EQ(((unsigned char *)first->mapped)[1023], 0xAB);
+  EXPECT_EQ(stats(1).usedBytes, 2048u);
+
+  cjelly_gpu_allocator_free(allocator, first);
+  cjelly_gpu_allocator_free(allocator, second);
+  cjelly_gpu_allocator_free(allocator, local);
+}
+
+
+TEST_F(GpuAllocator, NeverOverlapsUnderRandomOperations) {
+  mt19937 random(7);
+  vector<CJellyGpuAllocation *> live;
+  VkDeviceSize used = 0;
+  for (int step = 0; step < 5000; ++step) {
+    if (live.empty() || random() % 3) {
+      VkDeviceSize size = 1 + random() % (96 << 10);
+      VkDeviceSize alignment = (VkDeviceSize)1 << (random() % 13);
+      CJellyGpuAllocation * allocation = alloc(size, alignment);
+      ASSERT_TRUE(allocation);
+      ASSERT_EQ(allocation->offset % alignment, 0u);
+      ASSERT_EQ(allocation->size, size);
+      for (CJellyGpuAllocation * other : live) {
+        if (other->memory == allocation->memory) {
+          ASSERT_TRUE(allocation->offset + allocation->size <= other->offset || other->offset + other->size <= allocation->offset) << "step " << step;
+        }
+      }
+      live.push_back(allocation);
+      used += size;
+    }
+    else {
+      size_t index = random() % live.size();
+      used -= live[index]->size;
+      cjelly_gpu_allocator_free(allocator, live[index]);
+      live[index] = live.back();
+      live.pop_back();
+    }
+    ASSERT_EQ(stats().usedBytes, used);
+  }
+
+  for (CJellyGpuAllocation * allocation : live) {
+    cjelly_gpu_allocator_free(allocator, allocation);
+  }
+  CJellyGpuHeapStats heap = stats();
+  EXPECT_EQ(heap.usedBytes, 0u);
+  EXPECT_EQ(heap.blockCount, 1u);
+}
+
+#endif // _WIN32
+
+
+//
+// === Cache files ===
+//
+
+class CacheFile : public TempDir {};
+
+
+TEST_F(CacheFile, WritesAndMapsAFile) {
+  string file = path("data.bin");
+  string contents(100000, '\0');
+  for (size_t i = 0; i < contents.size(); ++i) {
+    contents[i] = (char)(i * 31);
+  }
+
+  CJellyCacheFileWriter writer;
+  ASSERT_EQ(cjelly_cache_file_begin(file.c_str(), &writer), CJELLY_CACHE_FILE_SUCCESS);
+  bool written = fwrite(contents.data(), 1, 1000, writer.file) == 1000
+    && cjelly_cache_file_pad(&writer, 24)
+    && fwrite(contents.data() + 1024, 1, contents.size() - 1024, writer.file) == contents.size() - 1024;
+  ASSERT_EQ(cjelly_cache_file_commit(&writer, written), CJELLY_CACHE_FILE_SUCCESS);
+  EXPECT_FALSE(fs::exists(file + ".tmp"));
+
+  CJellyCacheFileView view;
+  ASSERT_EQ(cjelly_cache_file_map(file.c_str(), &view), CJELLY_CACHE_FILE_SUCCESS);
+  ASSERT_EQ(view.size, contents.size());
+  EXPECT_EQ(memcmp(view.data, contents.data(), 1000), 0);
+  for (size_t i = 1000; i < 1024; ++i) {
+    EXPECT_EQ(view.data[i], 0);
+  }
+  EXPECT_EQ(memcmp(view.data + 1024, contents.data() + 1024, contents.size() - 1024), 0);
+  cjelly_cache_file_unmap(&view);
+}
+
+
+TEST_F(CacheFile, KeepsTheOldFileWhenAWriteFails) {
+  string file = path("data.bin");
+  writeFile(file, "old");
+
+  CJellyCacheFileWriter writer;
+  ASSERT_EQ(cjelly_cache_file_begin(file.c_str(), &writer), CJELLY_CACHE_FILE_SUCCESS);
+  fputs("partial", writer.file);
+  EXPECT_EQ(cjelly_cache_file_commit(&writer, false), CJELLY_CACHE_FILE_ERR_IO);
+  EXPECT_EQ(readFile(file), "old");
+  EXPECT_FALSE(fs::exists(file + ".tmp"));
+
+  CJellyCacheFileView view;
+  EXPECT_EQ(cjelly_cache_file_map(path("missing.bin").c_str(), &view), CJELLY_CACHE_FILE_ERR_FILE_NOT_FOUND);
+}
+
+
+TEST_F(CacheFile, StampsNoticeChangedContentOnly) {
+  string file = path("source.txt");
+  writeFile(file, "first version");
+  CJellyCacheFileStamp stamp;
+  ASSERT_EQ(cjelly_cache_file_stamp(file.c_str(), &stamp), CJELLY_CACHE_FILE_SUCCESS);
+  EXPECT_FALSE(cjelly_cache_file_stamp_changed(&stamp, file.c_str()));
+
+  // A touched file with the same contents is unchanged.
+  fs::last_write_time(file, fs::last_write_time(file) + chrono::hours(1));
+  EXPECT_FALSE(cjelly_cache_file_stamp_changed(&stamp, file.c_str()));
+
+  // Different contents of the same size are a change.
+  writeFile(file, "other version");
+  fs::last_write_time(file, fs::last_write_time(file) + chrono::hours(2));
+  EXPECT_TRUE(cjelly_cache_file_stamp_changed(&stamp, file.c_str()));
+
+  // A missing source is not, so that a cache can ship without it.
+  fs::remove(file);
+  EXPECT_FALSE(cjelly_cache_file_stamp_changed(&stamp, file.c_str()));
+}
+
+
+//
+// === BC texture compression ===
+//
+
+// Decodes one BC1 color block, as the GPU does.
+static void decodeColorBlock(const uint8_t * in, uint8_t out[16][4]) {
+  uint16_t color0 = (uint16_t)(in[0] | in[1] << 8);
+  uint16_t color1 = (uint16_t)(in[2] | in[3] << 8);
+  int palette[4][4];
+  for (int e = 0; e < 2; ++e) {
+    uint16_t packed = e ? color1 : color0;
+    int r = packed >> 11;
+    int g = (packed >> 5) & 0x3F;
+    int b = packed & 0x1F;
+    palette[e][0] = r << 3 | r >> 2;
+    palette[e][1] = g << 2 | g >> 4;
+    palette[e][2] = b << 3 | b >> 2;
+    palette[e][3] = 255;
+  }
+  for (int c = 0; c < 3; ++c) {
+    if (color0 > color1) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  palette[2][3] = 255;
+  palette[3][3] = color0 > color1 ? 255 : 0;
+
+  uint32_t indices = (uint32_t)in[4] | (uint32_t)in[5] << 8 | (uint32_t)in[6] << 16 | (uint32_t)in[7] << 24;
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 4; ++c) {
+      out[i][c] = (uint8_t)palette[(indices >> (2 * i)) & 3][c];
+    }
+  }
+}
+
+
+// Decodes one BC3 alpha block into the alpha of `out`.
+static void decodeAlphaBlock(const uint8_t * in, uint8_t out[16][4]) {
+  int palette[8] = {in[0], in[1]};
+  for (int i = 2; i < 8; ++i) {
+    palette[i] = in[0] > in[1]
+      ? ((8 - i) * in[0] + (i - 1) * in[1]) / 7
+      : i < 6 ? ((6 - i) * in[0] + (i - 1) * in[1]) / 5 : i == 6 ? 0 : 255;
+  }
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; ++i) {
+    indices |= (uint64_t)in[2 + i] << (8 * i);
+  }
+  for (int i = 0; i < 16; ++i) {
+    out[i][3] = (uint8_t)palette[(indices >> (3 * i)) & 7];
+  }
+}
+
+
+// Decodes one BC7 block.  The encoder only writes mode 6, so any other mode
+// fails the test.
+static bool decodeBc7Block(const uint8_t * in, uint8_t out[16][4]) {
+  uint32_t position = 0;
+  auto bits = [&](uint32_t count) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; ++i, ++position) {
+      value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+    }
+    return value;
+  };
+  if (bits(7) != 1u << 6) {
+    return false;
+  }
+  int endpoints[2][4];
+  for (int c = 0; c < 4; ++c) {
+    endpoints[0][c] = (int)bits(7) << 1;
+    endpoints[1][c] = (int)bits(7) << 1;
+  }
+  uint32_t p0 = bits(1);
+  uint32_t p1 = bits(1);
+  for (int c = 0; c < 4; ++c) {
+    endpoints[0][c] |= (int)p0;
+    endpoints[1][c] |= (int)p1;
+  }
+  static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+  for (int i = 0; i < 16; ++i) {
+    uint32_t index = bits(i == 0 ? 3 : 4);
+    for (int c = 0; c < 4; ++c) {
+      out[i][c] = (uint8_t)(((64 - weights[index]) * endpoints[0][c] + weights[index] * endpoints[1][c] + 32) >> 6);
+    }
+  }
+  return true;
+}
+
+
+// The error of the first level of a texture, decoded, against the image.
+struct CodecError {
+  double rmse = 0;   // Root mean square error over the checked channels
+  int maxError = 0;  // Largest error of any channel of any texel
+};
+
+
+static CodecError decodeError(const CJellyBcTexture * texture, const vector<uint8_t> & rgba, bool alpha) {
+  CodecError error;
+  uint32_t blockSize = cjelly_bc_texture_block_size(texture->format);
+  uint32_t blocksWide = (texture->width + 3) / 4;
+  double squares = 0;
+  size_t samples = 0;
+  for (uint32_t y = 0; y < texture->height; y += 4) {
+    for (uint32_t x = 0; x < texture->width; x += 4) {
+      const uint8_t * block = texture->data + texture->levelOffsets[0] + ((y / 4) * blocksWide + x / 4) * blockSize;
+      uint8_t texels[16][4];
+      switch (texture->format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+          decodeColorBlock(block, texels);
+          break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+          decodeColorBlock(block + 8, texels);
+          decodeAlphaBlock(block, texels);
+          break;
+        default:
+          if (!decodeBc7Block(block, texels)) {
+            ADD_FAILURE() << "BC7 block in a mode other than 6";
+            return error;
+          }
+          break;
+      }
+      for (uint32_t ty = 0; ty < 4 && y + ty < texture->height; ++ty) {
+        for (uint32_t tx = 0; tx < 4 && x + tx < texture->width; ++tx) {
+          const uint8_t * source = &rgba[((size_t)(y + ty) * texture->width + x + tx) * 4];
+          for (int c = 0; c < (alpha ? 4 : 3); ++c) {
+            int difference = abs((int)texels[ty * 4 + tx][c] - (int)source[c]);
+            error.maxError = max(error.maxError, difference);
+            squares += (double)difference * difference;
+            ++samples;
+          }
+        }
+      }
+    }
+  }
+  error.rmse = sqrt(squares / (double)samples);
+  return error;
+}
+
+
+// A smooth RGBA gradient, with a size that is not a multiple of the block.
+static vector<uint8_t> gradient(uint32_t width, uint32_t height) {
+  vector<uint8_t> rgba((size_t)width * height * 4);
+  for (uint32_t y = 0; y < height; ++y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      uint8_t * texel = &rgba[((size_t)y * width + x) * 4];
+      texel[0] = (uint8_t)(x * 255 / (width - 1));
+      texel[1] = (uint8_t)(y * 255 / (height - 1));
+      texel[2] = (uint8_t)((x + y) * 255 / (width + height - 2));
+      texel[3] = (uint8_t)(255 - y * 255 / (height - 1));
+    }
+  }
+  return rgba;
+}
+
+
+static CJellyBcTexture * encode(vector<uint8_t> & rgba, uint32_t width, uint32_t height, int channels, VkFormat format) {
+  vector<uint8_t> pixels;
+  for (size_t i = 0; i < rgba.size(); i += 4) {
+    pixels.insert(pixels.end(), &rgba[i], &rgba[i] + channels);
+  }
+  CJellyFormatImageRaw raw = {};
+  raw.width = (int)width;
+  raw.height = (int)height;
+  raw.channels = channels;
+  raw.bitdepth = (size_t)channels * 8;
+  raw.data_size = pixels.size();
+  raw.data = pixels.data();
+  CJellyBcTexture * texture = nullptr;
+  EXPECT_EQ(cjelly_bc_texture_encode(&raw, format, &texture), CJELLY_BC_TEXTURE_SUCCESS);
+  return texture;
+}
+
+
+TEST(BcTexture, LaysOutAFullMipChain) {
+  vector<uint8_t> rgba = gradient(70, 30);
+  CJellyBcTexture * texture = encode(rgba, 70, 30, 4, VK_FORMAT_BC7_UNORM_BLOCK);
+  ASSERT_TRUE(texture);
+  ASSERT_EQ(texture->mipLevels, 7u);
+  VkDeviceSize offset = 0;
+  uint32_t width = 70;
+  uint32_t height = 30;
+  for (uint32_t level = 0; level < texture->mipLevels; ++level) {
+    EXPECT_EQ(texture->levelOffsets[level], offset);
+    EXPECT_EQ(texture->levelSizes[level], (VkDeviceSize)((width + 3) / 4) * ((height + 3) / 4) * 16);
+    offset += texture->levelSizes[level];
+    width = max(width / 2, 1u);
+    height = max(height / 2, 1u);
+  }
+  EXPECT_EQ(texture->size, offset);
+  cjelly_bc_texture_free(texture);
+}
+
+
+// The encoder as it is measures an RMSE of 3.5, 3.1, and 2.6 on the gradient
+// for BC1, BC3, and BC7, and 4.0, 4.0, and 2.1 on the photo.  The bounds leave
+// some margin above that, so that only a real loss of quality fails.
+TEST(BcTexture, Bc1StaysCloseToAGradient) {
+  vector<uint8_t> rgba = gradient(70, 30);
+  CJellyBcTexture * texture = encode(rgba, 70, 30, 3, VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+  ASSERT_TRUE(texture);
+  CodecError error = decodeError(texture, rgba, false);
+  EXPECT_LT(error.rmse, 5.0);
+  EXPECT_LE(error.maxError, 16);
+  cjelly_bc_texture_free(texture);
+}
+
+
+TEST(BcTexture, Bc3StaysCloseToAGradientWithAlpha) {
+  vector<uint8_t> rgba = gradient(70, 30);
+  CJellyBcTexture * texture = encode(rgba, 70, 30, 4, VK_FORMAT_BC3_UNORM_BLOCK);
+  ASSERT_TRUE(texture);
+  CodecError error = decodeError(texture, rgba, true);
+  EXPECT_LT(error.rmse, 4.5);
+  EXPECT_LE(error.maxError, 16);
+  cjelly_bc_texture_free(texture);
+}
+
+
+TEST(BcTexture, Bc7StaysCloseToAGradientWithAlpha) {
+  vector<uint8_t> rgba = gradient(70, 30);
+  CJellyBcTexture * texture = encode(rgba, 70, 30, 4, VK_FORMAT_BC7_UNORM_BLOCK);
+  ASSERT_TRUE(texture);
+  CodecError error = decodeError(texture, rgba, true);
+  EXPECT_LT(error.rmse, 3.5);
+  EXPECT_LE(error.maxError, 12);
+  cjelly_bc_texture_free(texture);
+}
+
+
+TEST(BcTexture, EveryFormatStaysCloseToAPhoto) {
+  CJellyFormatImage * image;
+  ASSERT_EQ(cjelly_format_image_load("test/images/bmp/tang.bmp", &image), CJELLY_FORMAT_IMAGE_SUCCESS);
+  CJellyFormatImageRaw * raw = image->raw;
+  ASSERT_TRUE(raw->channels == 3 || raw->channels == 4);
+  vector<uint8_t> rgba;
+  for (size_t i = 0; i < (size_t)raw->width * raw->height; ++i) {
+    for (int c = 0; c < 4; ++c) {
+      rgba.push_back(c < raw->channels ? raw->data[i * raw->channels + c] : 255);
+    }
+  }
+
+  struct {
+    VkFormat format;
+    double rmse;
+  } formats[] = {
+    {VK_FORMAT_BC1_RGB_UNORM_BLOCK, 5.5},
+    {VK_FORMAT_BC3_UNORM_BLOCK, 5.5},
+    {VK_FORMAT_BC7_UNORM_BLOCK, 3.0},
+  };
+  for (const auto & expected : formats) {
+    CJellyBcTexture * texture = nullptr;
+    ASSERT_EQ(cjelly_bc_texture_encode(raw, expected.format, &texture), CJELLY_BC_TEXTURE_SUCCESS);
+    CodecError error = decodeError(texture, rgba, false);
+    EXPECT_LT(error.rmse, expected.rmse) << "format " << expected.format;
+    cjelly_bc_texture_free(texture);
+  }
+  cjelly_format_image_free(image);
+}
+
+
+//
+// === BC texture cache files ===
+//
+
+class BcTextureCache : public TempDir {
+  protected:
+    CJellyBcTexture * texture = nullptr;
+    vector<uint8_t> rgba;
+
+    void SetUp() override {
+      TempDir::SetUp();
+      rgba = gradient(40, 24);
+      texture = encode(rgba, 40, 24, 4, VK_FORMAT_BC3_UNORM_BLOCK);
+      ASSERT_TRUE(texture);
+    }
+
+    void TearDown() override {
+      cjelly_bc_texture_free(texture);
+      TempDir::TearDown();
+    }
+};
+
+
+TEST_F(BcTextureCache, ReadsBackWhatItWrote) {
+  string source = path("source.bmp");
+  string cache = path("texture.bc");
+  writeFile(source, "stands in for the source image");
+  ASSERT_EQ(cjelly_bc_texture_cache_write(texture, source.c_str(), cache.c_str()), CJELLY_BC_TEXTURE_CACHE_SUCCESS);
+
+  CJellyBcTextureCache * opened;
+  ASSERT_EQ(cjelly_bc_texture_cache_open(cache.c_str(), source.c_str(), &opened), CJELLY_BC_TEXTURE_CACHE_SUCCESS);
+  const CJellyBcTexture * read = cjelly_bc_texture_cache_texture(opened);
+  EXPECT_EQ(read->format, texture->format);
+  EXPECT_EQ(read->width, texture->width);
+  EXPECT_EQ(read->height, texture->height);
+  EXPECT_EQ(read->mipLevels, texture->mipLevels);
+  ASSERT_EQ(read->size, texture->size);
+  for (uint32_t level = 0; level < texture->mipLevels; ++level) {
+    EXPECT_EQ(read->levelOffsets[level], texture->levelOffsets[level]);
+  }
+  EXPECT_EQ(memcmp(read->data, texture->data, (size_t)texture->size), 0);
+  cjelly_bc_texture_cache_close(opened);
+}
+
+
+TEST_F(BcTextureCache, RejectsCorruptFiles) {
+  string cache = path("texture.bc");
+  ASSERT_EQ(cjelly_bc_texture_cache_write(texture, nullptr, cache.c_str()), CJELLY_BC_TEXTURE_CACHE_SUCCESS);
+  string intact = readFile(cache);
+  CJellyBcTextureCache * opened;
+
+  // A flipped bit in the blocks fails the checksum.
+  string corrupt = intact;
+  corrupt[corrupt.size() - 1] ^= 0x10;
+  writeFile(cache, corrupt);
+  EXPECT_EQ(cjelly_bc_texture_cache_open(cache.c_str(), nullptr, &opened), CJELLY_BC_TEXTURE_CACHE_ERR_INVALID);
+
+  // So does a damaged header.
+  corrupt = intact;
+  corrupt[0] ^= 0x01;
+  writeFile(cache, corrupt);
+  EXPECT_EQ(cjelly_bc_texture_cache_open(cache.c_str(), nullptr, &opened), CJELLY_BC_TEXTURE_CACHE_ERR_INVALID);
+
+  // And a file cut short, anywhere.
+  for (size_t size : {(size_t)0, (size_t)10, intact.size() / 2, intact.size() - 1}) {
+    writeFile(cache, intact.substr(0, size));
+    EXPECT_EQ(cjelly_bc_texture_cache_open(cache.c_str(), nullptr, &opened), CJELLY_BC_TEXTURE_CACHE_ERR_INVALID) << size << " bytes";
+  }
+
+  writeFile(cache, intact);
+  ASSERT_EQ(cjelly_bc_texture_cache_open(cache.c_str(), nullptr, &opened), CJELLY_BC_TEXTURE_CACHE_SUCCESS);
+  cjelly_bc_texture_cache_close(opened);
+}
+
+
+TEST_F(BcTextureCache, NoticesAChangedSource) {
+  string source = path("source.bmp");
+  string cache = path("texture.bc");
+  writeFile(source, "first version");
+  ASSERT_EQ(cjelly_bc_texture_cache_write(texture, source.c_str(), cache.c_str()), CJELLY_BC_TEXTURE_CACHE_SUCCESS);
+
+  writeFile(source, "second, longer version");
+  CJellyBcTextureCache * opened;
+  EXPECT_EQ(cjelly_bc_texture_cache_open(cache.c_str(), source.c_str(), &opened), CJELLY_BC_TEXTURE_CACHE_ERR_STALE);
+
+  // Without a source to check, the cache is still usable.
+  ASSERT_EQ(cjelly_bc_texture_cache_open(cache.c_str(), nullptr, &opened), CJELLY_BC_TEXTURE_CACHE_SUCCESS);
+  cjelly_bc_texture_cache_close(opened);
+}
+
+
+int main(int argc, char * * argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}